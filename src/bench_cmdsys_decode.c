@@ -0,0 +1,89 @@
+#include "cmdsys_decode.h"
+#include <snlsys/snlsys.h>
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NB_VALUES 100000
+#define NB_RUNS 20
+#define VALUE_LEN 32
+
+static double
+elapsed_ms(const clock_t start)
+{
+  return (double)(clock() - start) * 1000.0 / (double)CLOCKS_PER_SEC;
+}
+
+int
+main(int argc, char** argv)
+{
+  char (*flt_list)[VALUE_LEN] = NULL;
+  char (*int_list)[VALUE_LEN] = NULL;
+  clock_t start;
+  double sum = 0.0;
+  double ms_ref = 0.0;
+  double ms = 0.0;
+  long isum = 0;
+  int run = 0;
+  int i = 0;
+  (void)argc, (void)argv;
+
+  flt_list = malloc(NB_VALUES * sizeof(*flt_list));
+  int_list = malloc(NB_VALUES * sizeof(*int_list));
+  if(!flt_list || !int_list) {
+    fprintf(stderr, "Not enough memory.\n");
+    return 1;
+  }
+  /* Values similar to the transform parameters sent by the tools. */
+  for(i = 0; i < NB_VALUES; ++i) {
+    const float f = (float)(rand() - RAND_MAX / 2) / (float)(rand() % 1000 + 1);
+    snprintf(flt_list[i], VALUE_LEN, i % 2 ? "%.9g" : "%g", f);
+    snprintf(int_list[i], VALUE_LEN, "%d", rand() - RAND_MAX / 2);
+  }
+
+  start = clock();
+  for(run = 0; run < NB_RUNS; ++run) {
+    for(i = 0; i < NB_VALUES; ++i)
+      sum += (float)strtod(flt_list[i], NULL);
+  }
+  ms_ref = elapsed_ms(start);
+  start = clock();
+  for(run = 0; run < NB_RUNS; ++run) {
+    for(i = 0; i < NB_VALUES; ++i) {
+      float f = 0.f;
+      decode_float(flt_list[i], -FLT_MAX, FLT_MAX, &f);
+      sum += f;
+    }
+  }
+  ms = elapsed_ms(start);
+  printf("float: strtod %.2f ms; decode_float %.2f ms; speedup %.2fx\n",
+    ms_ref, ms, ms_ref / ms);
+
+  start = clock();
+  for(run = 0; run < NB_RUNS; ++run) {
+    for(i = 0; i < NB_VALUES; ++i)
+      isum += strtol(int_list[i], NULL, 0);
+  }
+  ms_ref = elapsed_ms(start);
+  start = clock();
+  for(run = 0; run < NB_RUNS; ++run) {
+    for(i = 0; i < NB_VALUES; ++i) {
+      int val = 0;
+      decode_int(int_list[i], INT_MIN, INT_MAX, &val);
+      isum += val;
+    }
+  }
+  ms = elapsed_ms(start);
+  printf("int: strtol %.2f ms; decode_int %.2f ms; speedup %.2fx\n",
+    ms_ref, ms, ms_ref / ms);
+
+  /* Prevent the compiler from discarding the decoding. */
+  printf("checksum: %g %ld\n", sum, isum);
+  free(flt_list);
+  free(int_list);
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "cmdsys.h"
+#include <snlsys/snlsys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NB_COMMANDS 20000
+#define NB_RUNS 10
+#define IMAGE_FILENAME "bench_cmdsys_image.img"
+
+static const char* modes[] = { "fast", "safe", NULL };
+
+static const struct cmdarg_desc argv_desc[] = {
+  CMDARG_APPEND_INT("i", NULL, NULL, "level", 0, 1, 0, 9),
+  CMDARG_APPEND_FLOAT("f", NULL, NULL, "factor", 0, 1, 0.f, 1.f),
+  CMDARG_APPEND_STRING("m", NULL, "<mode>", NULL, 0, 1, modes),
+  CMDARG_END_INITIALIZER
+};
+
+static void
+nop(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+}
+
+static enum cmdsys_error
+resolve
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  (void)name, (void)syntax_id, (void)data;
+  binding->func = nop;
+  return CMDSYS_NO_ERROR;
+}
+
+static double
+elapsed_ms(const clock_t start)
+{
+  return (double)(clock() - start) * 1000.0 / (double)CLOCKS_PER_SEC;
+}
+
+static int
+add_commands(struct cmdsys* sys)
+{
+  char name[32];
+  int i = 0;
+
+  for(i = 0; i < NB_COMMANDS; ++i) {
+    snprintf(name, sizeof(name), "bench.cmd%d", i);
+    if(cmdsys_add_command
+      (sys, name, nop, NULL, NULL, argv_desc, "bench command")
+       != CMDSYS_NO_ERROR)
+      return 1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+  struct cmdsys* sys = NULL;
+  clock_t start;
+  double ms_add = 0.0;
+  double ms_load = 0.0;
+  int run = 0;
+  (void)argc, (void)argv;
+
+  for(run = 0; run < NB_RUNS; ++run) {
+    if(cmdsys_create(NULL, &sys) != CMDSYS_NO_ERROR) {
+      fprintf(stderr, "Cannot create the command system.\n");
+      return 1;
+    }
+    start = clock();
+    if(add_commands(sys)) {
+      fprintf(stderr, "Cannot add the commands.\n");
+      return 1;
+    }
+    ms_add += elapsed_ms(start);
+    if(run == 0 && cmdsys_save_image(sys, IMAGE_FILENAME) != CMDSYS_NO_ERROR) {
+      fprintf(stderr, "Cannot save the image.\n");
+      return 1;
+    }
+    cmdsys_ref_put(sys);
+  }
+
+  for(run = 0; run < NB_RUNS; ++run) {
+    if(cmdsys_create(NULL, &sys) != CMDSYS_NO_ERROR) {
+      fprintf(stderr, "Cannot create the command system.\n");
+      return 1;
+    }
+    start = clock();
+    if(cmdsys_load_image(sys, IMAGE_FILENAME, resolve, NULL)
+       != CMDSYS_NO_ERROR) {
+      fprintf(stderr, "Cannot load the image.\n");
+      return 1;
+    }
+    ms_load += elapsed_ms(start);
+    cmdsys_ref_put(sys);
+  }
+  remove(IMAGE_FILENAME);
+
+  printf("%d commands: add_command %.2f ms; load_image %.2f ms; "
+    "speedup %.2fx\n", NB_COMMANDS, ms_add / NB_RUNS, ms_load / NB_RUNS,
+    ms_add / ms_load);
+  return 0;
+}
@@ -1,8 +1,12 @@
+#define _POSIX_C_SOURCE 200809L /* pthread, mmap */
+
 #include "cmdsys.h"
+#include "cmdsys_decode.h"
+#include "cmdsys_memory.h"
+#include "cmdsys_schema.h"
 
 #include <sl/sl_flat_set.h>
 #include <sl/sl_hash_table.h>
-#include <sl/sl_string.h>
 
 #include <snlsys/list.h>
 #include <snlsys/math.h>
@@ -11,90 +15,505 @@
 #include <snlsys/snlsys.h>
 
 #include <argtable2.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define IS_END_REACHED(desc) \
-  (memcmp(&desc, &CMDARG_END, sizeof(struct cmdarg_desc)) == 0)
+/* Compare the fields rather than the raw bytes since the padding of a
+ * descriptor built at runtime is undefined. */
+#define IS_END_REACHED(desc)                                                   \
+  (  (desc).type == CMDARG_END.type                                            \
+  && (desc).short_options == CMDARG_END.short_options                          \
+  && (desc).long_options == CMDARG_END.long_options                            \
+  && (desc).data_type == CMDARG_END.data_type                                  \
+  && (desc).glossary == CMDARG_END.glossary                                    \
+  && (desc).min_count == CMDARG_END.min_count                                  \
+  && (desc).max_count == CMDARG_END.max_count)
 
-#define ERRBUF_LEN 1024
 #define SCRATCH_LEN 1024
+#define ERRLOG_MAX_RECORDS 64
+#define ERRLOG_MAX_TOKENS 128
+#define ERRLOG_ARENA_LEN 4096
+#define VALIDATE_MAX_WORKERS 64
+#define MAX_PLACEHOLDERS 16
+#define VALIDATE_MIN_CHUNK_LEN (64 * 1024)
+
+/* Failure of a command. Its tokens are copied into the arena of the error log
+ * and its message is only formatted on demand. */
+struct error_record {
+  struct cmdsys_error_info info;
+  size_t version; /* Registry version at the time of the failure. */
+  size_t first_token; /* Arena offset of the tokens. */
+  size_t text_offset; /* Offset of the message into the error text. */
+  int ntokens;
+};
+
+struct errlog {
+  struct error_record records[ERRLOG_MAX_RECORDS];
+  size_t nrecords;
+  size_t nlost; /* Failures not recorded since the log was full. */
+  char arena[ERRLOG_ARENA_LEN];
+  size_t arena_len;
+  /* Messages of the first `nformatted' records. */
+  char* text;
+  size_t text_len;
+  size_t text_capacity;
+  size_t nformatted;
+};
+
+#define IMAGE_MAGIC "CMDSYSIM"
+#define IMAGE_VERSION 2
+#define IMAGE_BYTE_ORDER 0x01020304u
+#define IMAGE_NIL UINT64_MAX
+#define IMAGE_ARG_STREAMED 0x1u
+
+/* On disk layout of a registry image. Every reference is an offset relative
+ * to the beginning of the image, i.e. the image can be mapped at any address
+ * and only the value lists are patched in place at load time. */
+struct image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t nnames;
+  uint32_t nsyntaxes;
+  uint32_t nargs;
+  uint32_t padding;
+  /* Hash of IMAGE_MAGIC when the image was saved. The hashes of the names
+   * are computed again if the hash function changed since then. */
+  uint64_t hash_probe;
+  uint64_t names; /* Offset toward the image_name array. */
+  uint64_t syntaxes; /* Offset toward the image_syntax array. */
+  uint64_t args; /* Offset toward the image_arg array. */
+  uint64_t lists; /* Offset toward the NIL terminated string value lists. */
+  uint64_t strings; /* Offset toward the string pool. */
+  uint64_t size; /* Overall size in bytes of the image. */
+};
+
+/* Entry of the name index, sorted by command name. */
+struct image_name {
+  uint64_t name;
+  /* Hash of the name used as registry key. A wrong hash of a corrupted image
+   * only makes the command unreachable by its name. */
+  uint64_t hash;
+  uint32_t first_syntax;
+  uint32_t nsyntaxes; /* Syntaxes of the command, in their add order. */
+};
+
+struct image_syntax {
+  uint64_t description; /* IMAGE_NIL if no description. */
+  uint32_t first_arg;
+  uint32_t argc; /* Does not count the command name. */
+};
+
+struct image_arg {
+  uint32_t type;
+  uint32_t min_count;
+  uint32_t max_count;
+  uint32_t flags; /* Combination of IMAGE_ARG_* flags. */
+  uint64_t short_options;
+  uint64_t long_options;
+  uint64_t data_type;
+  uint64_t glossary;
+  union {
+    struct { int32_t min, max; } integer;
+    struct { float min, max; } real;
+    uint64_t value_list;
+  } domain;
+};
+
+/* Loaded registry image. Its syntaxes are lazy and reference the mapped file
+ * which is thus unmapped once they are all deleted. */
+struct image {
+  struct cmdsys* sys;
+  char* buffer; /* Private mapping of the image file. */
+  size_t size;
+  struct cmdarg_desc* argv_desc; /* Descriptors of the image arguments. */
+  struct ref ref;
+};
+
+/* Data of the stub registered for a syntax of a plugin until its module is
+ * loaded. */
+struct plugin_stub {
+  struct plugin* plugin;
+  const char* name; /* Command name in the manifest. */
+  size_t syntax_id;
+};
+
+struct plugin {
+  struct list_node node;
+  const struct cmdsys_schema* manifest;
+  char* path;
+  void* handle; /* NULL until the module is loaded. */
+  enum cmdsys_error (*resolve)
+    (const char*, size_t, struct cmdsys_binding*, void*);
+  void* data;
+  size_t nstubs;
+  struct plugin_stub stubs[]; /* One per manifest syntax, then the path. */
+};
+
+struct cmdsys_completion_session {
+  struct cmdsys* sys;
+  size_t version; /* Registry version of the cached completion. */
+  bool is_cached;
+  /* Command name and hint arguments of the cached completion, stored as a
+   * sequence of NULL terminated strings. */
+  char* key;
+  size_t key_len;
+  size_t key_capacity;
+  /* Completion function of the cached syntax. NULL if no syntax is
+   * selected. */
+  void (*completion)
+    (struct cmdsys*, const char*, size_t, size_t*, const char**[]);
+  /* Argument string and its candidate list of the cached completion. */
+  char* input;
+  size_t input_len;
+  size_t input_capacity;
+  const char** candidate_list;
+  size_t candidate_count;
+  size_t candidate_capacity;
+  struct ref ref;
+};
+
+/* Value bound to the `$N' placeholder of a prepared command. */
+struct placeholder {
+  struct cmdarg_value* value; /* Value of the prepared arguments. */
+  enum cmdarg_type type;
+  union cmdarg_domain domain;
+  bool is_bound;
+  /* Bound value before its clamping, applied again on a new preparation. */
+  union { int integer; float real; } bound;
+  char* string; /* Copy of the bound STRING or FILE value. */
+  size_t string_capacity;
+};
+
+/* Command resolved by cmdsys_prepare. Its argument set lies in one memory
+ * block: the argv array, the arguments and their string values. */
+struct cmdsys_prepared {
+  struct cmdsys* sys;
+  size_t version; /* Registry version of the resolved syntax. */
+  char* command; /* Prepared again once the registry is updated. */
+  void (*func)(struct cmdsys*, size_t, const struct cmdarg**, void*);
+  void* data;
+  size_t argc;
+  struct cmdarg** argv;
+  size_t syntax_id;
+  struct placeholder* placeholders; /* Indexed by N - 1. */
+  size_t nplaceholders;
+  struct ref ref;
+};
+
+/* Node of the namespace tree. Its path component is the NULL terminated
+ * string that follows the node in memory. */
+struct ns_node {
+  struct sl_flat_set* children; /* Sorted child names. NULL if no child. */
+  size_t ncommands; /* Number of commands registered in the subtree. */
+};
+
+#define NS_NODE_NAME(node) ((char*)((node) + 1))
+#define NS_NODE_FROM_NAME(name) (((struct ns_node*)(void*)(name)) - 1)
+
+/* Operator that connects a command to the previous one. */
+enum chain_op {
+  CHAIN_ALWAYS, /* `;' */
+  CHAIN_ON_SUCCESS, /* `&&' */
+  CHAIN_ON_FAILURE /* `||' */
+};
+
+struct cmd_segment {
+  enum chain_op op;
+  int first_arg; /* Index of its first token. */
+  int argc;
+  struct cmd_list* command_list; /* Resolved syntaxes. May be NULL. */
+};
+
+/* Pre-tokenized command line. Its tokens are expanded and its command names
+ * resolved once; only the tokens that reference variables are expanded at
+ * each execution. */
+struct macro {
+  char* tokens; /* Sequence of NULL terminated tokens. */
+  char** argv;
+  bool* has_variable; /* Per token flag. */
+  int argc;
+  struct cmd_segment* segments;
+  int nsegments;
+  size_t version; /* Registry version of the resolved command lists. */
+  struct mem_allocator* allocator;
+  struct ref ref;
+};
+
+/* Key of the variable table. The name of a stored variable is owned by the
+ * table while the key of a lookup may reference a not NULL terminated
+ * string. */
+struct var_key {
+  const char* name;
+  size_t len;
+};
+
+struct var {
+  char* value;
+  size_t len;
+};
+
+/* Output written by the command functions. */
+struct output {
+  char* buffer; /* NULL terminated. */
+  size_t len;
+  size_t capacity;
+  struct cmdsys_output_config config;
+  bool is_truncated;
+};
+
+/* Values of a streamed argument, decoded on demand either from the tokens
+ * parsed by argtable or from caller built values. */
+struct cmdarg_cursor {
+  enum cmdarg_type type;
+  union cmdarg_domain domain;
+  const char* const* tokens; /* NULL if the values are caller built. */
+  const struct cmdarg_value* values;
+  size_t count; /* Number of tokens or caller built values. */
+  size_t next; /* Index of the next token or value to read. */
+};
+
+/* Chunk of the value arena. */
+struct value_chunk {
+  struct value_chunk* next;
+  size_t capacity;
+  struct cmdarg_value values[];
+};
+
+/* Stack of the argument values of the commands being parsed or invoked. The
+ * chunks are kept once allocated and reused by the next commands. */
+struct value_arena {
+  struct value_chunk* first;
+  struct value_chunk* chunk; /* Current chunk. NULL if the arena is empty. */
+  size_t len; /* Number of values used in the current chunk. */
+};
+
+/* Header of an interned string, stored right before its characters. */
+struct pooled_string {
+  struct string_chunk* chunk;
+  size_t hash;
+  uint32_t len;
+  uint32_t nrefs;
+};
+
+/* Chunk of a string pool. */
+struct string_chunk {
+  size_t capacity; /* In bytes. */
+  size_t len; /* Number of used bytes. */
+  size_t nstrings; /* Number of live strings. */
+  char data[];
+};
+
+/* Pool of interned strings. Each distinct string is stored once, contiguously
+ * in a chunk, after its precomputed hash; two interned strings are thus equal
+ * if and only if their pointers are. The strings are reference counted. The
+ * room of a released string is not reused but a chunk is freed once all its
+ * strings are released, i.e. the pool is bounded by the chunks that hold at
+ * least one live string. */
+struct string_pool {
+  /* Chunks sorted by address, i.e. the chunk of a string is retrieved without
+   * hashing it. */
+  struct string_chunk** chunks;
+  size_t nchunks;
+  size_t chunks_capacity;
+  struct string_chunk* chunk; /* Chunk the strings are appended to. */
+  const char** slots; /* Open addressing table of the interned strings. */
+  size_t nslots; /* Power of 2. 0 until the first string is interned. */
+  size_t count; /* Number of interned strings. */
+  enum cmdsys_memory_category category; /* Memory category of the chunks. */
+};
 
-struct errbuf {
-  char buffer[ERRBUF_LEN];
-  size_t buffer_id;
+/* Key of the registry hash table. The hash of an interned name is read from
+ * its pool header rather than computed again. */
+struct name_key {
+  const char* str;
+  size_t hash;
 };
 
 struct cmdsys {
-  char scratch[SCRATCH_LEN];
   FILE* stream;
-  struct mem_allocator* allocator;
-  struct sl_hash_table* htbl; /* hash table [cmd name, struct cmd*] */
+  struct mem_allocator* allocator; /* Allocator of the OTHERS category. */
+  struct mem_account mem;
+  struct sl_hash_table* htbl; /* hash table [struct name_key, cmd_list] */
   struct sl_flat_set* name_set;  /* set of const char*. Used by completion.*/
-  struct errbuf errbuf;
+  struct ns_node* ns_root; /* Tree of the dot separated name components. */
+  struct sl_hash_table* var_tbl; /* hash table [struct var_key, struct var] */
+  struct sl_hash_table* macro_tbl; /* hash table [char*, struct macro*] */
+  int macro_depth; /* Nesting level of the macro being executed. */
+  struct list_node plugin_list; /* List of added plugins. */
+  size_t version; /* Incremented each time a command is added or deleted. */
+  size_t nlazy; /* Number of lazy syntaxes not built yet. */
+  size_t prewarm_id; /* Name set index from which the pre-warm resumes. */
+  struct errlog errlog;
+  /* Tokens of the last validated command, referenced by its arguments. */
+  char validation_tokens[SCRATCH_LEN];
+  struct output output;
+  struct value_arena values;
+  struct string_pool names; /* Command names. */
+  /* Descriptions and option, data type and glossary texts of the syntaxes. */
+  struct string_pool texts;
+  int call_depth; /* Number of command functions being invoked. */
+  /* Lock of the getopt state used by arg_parse while a script is validated
+   * by several threads. NULL otherwise. */
+  pthread_mutex_t* parse_lock;
+  /* Hash table [struct cmd_list*, struct cmd_list] of the syntaxes cloned by a
+   * validation worker. NULL if the command system is not a worker context. */
+  struct sl_hash_table* clones;
   struct ref ref;
 };
 
+/* Fields of a command syntax used to parse and invoke a command line. The
+ * arg table, the argv list and the arg domains lie in one memory block that
+ * begins with the arg table; the arguments lie in another one that begins with
+ * argv[0] and ends with the value of the command name. Both blocks are NULL
+ * until a lazy syntax is built. The values of the other arguments are drawn
+ * from the value arena of the command system when the syntax is selected. */
 struct cmd {
-  struct list_node node;
+  void** arg_table;
+  struct cmdarg** argv;
+  union cmdarg_domain* arg_domain;
   size_t argc;
   void(*func)(struct cmdsys*, size_t, const struct cmdarg**, void* data);
   void* data;
+};
+
+/* Fields of a command syntax that are not used by its execution. */
+struct cmd_info {
+  /* Interned description or, for a lazy syntax, the referenced one. */
+  const char* description;
+  /* Schema syntax of an adopted command. Its manual is printed rather than
+   * rendered from the arg table. */
+  const struct cmdsys_schema_syntax* schema;
+  const struct cmdarg_desc* argv_desc; /* Descriptors of a lazy syntax. */
   void (*completion)
     (struct cmdsys*, const char*, size_t, size_t*, const char**[]);
-  struct sl_string* description;
-  union cmdarg_domain* arg_domain;
-  struct cmdarg** argv;
-  void** arg_table;
+  size_t arg_table_size; /* Bytes allocated by argtable2. */
+  struct image* image; /* Image that the syntax references. May be NULL. */
+  /* Define whether the description and the texts of the arg table are
+   * references on the text pool to release with the syntax. */
+  bool is_interned;
 };
 
+/* Syntaxes of a command name stored in their dispatch order, i.e. from the
+ * last added to the first one. The syntaxes are walked through the densely
+ * packed `cmds' array while their cold fields are stored apart in `infos'. */
+struct cmd_list {
+  struct cmd* cmds;
+  struct cmd_info* infos;
+  size_t count;
+  size_t capacity;
+  size_t nlazy; /* Number of syntaxes not built yet. */
+};
+
+/* Minimum number of values of a chunk of the value arena. */
+#define VALUE_CHUNK_MIN_CAPACITY 256
+
+/* Minimum size in bytes of a chunk of a string pool. */
+#define STRING_CHUNK_MIN_CAPACITY 4096
+
+#define ALLOCATOR(sys, category)                                               \
+  mem_account_allocator(&(sys)->mem, CONCAT(CMDSYS_MEMORY_, category))
+
 /*******************************************************************************
  *
  * Error management.
  *
  ******************************************************************************/
+/* Record the failure of the command `argv'. `text' is the offending text; the
+ * offending token is the one it points into, if any. */
 static void
-errbuf_print(struct errbuf* buf, const char* fmt, ...) FORMAT_PRINTF(2, 3);
-
-void
-errbuf_print(struct errbuf* buf, const char* fmt, ...)
+errlog_record
+  (struct errlog* log,
+   const size_t version,
+   const enum cmdsys_error_code code,
+   const int argc,
+   const char* const argv[],
+   const char* text, /* May be NULL. */
+   const enum cmdarg_type expected_type,
+   const size_t syntax_id)
 {
-  ASSERT(buf);
-
-  va_list vargs_list;
-  const size_t buf_size = sizeof(buf->buffer);
-  const size_t buf_size_remaining = buf_size - buf->buffer_id - 1;
+  struct error_record* rec = NULL;
+  size_t len = 0;
   int i = 0;
+  ASSERT(log && argc >= 0 && (!argc || argv));
 
-  if(buf->buffer_id >= buf_size - 1)
+  for(i = 0; i < argc; ++i)
+    len += strlen(argv[i]) + 1;
+  if(log->nrecords >= ERRLOG_MAX_RECORDS
+  || argc > ERRLOG_MAX_TOKENS
+  || len > sizeof(log->arena) - log->arena_len) {
+    ++log->nlost;
     return;
-
-  va_start(vargs_list, fmt);
-
-  i = vsnprintf
-    (buf->buffer + buf->buffer_id, buf_size_remaining, fmt, vargs_list);
-  ASSERT(i > 0);
-
-  if((size_t)i >= buf_size) {
-    buf->buffer_id = buf_size;
-    buf->buffer[buf_size - 1] = '\0';
-  } else {
-    buf->buffer_id += (size_t)i;
   }
+  rec = log->records + log->nrecords++;
+  rec->version = version;
+  rec->first_token = log->arena_len;
+  rec->ntokens = argc;
+  rec->info.code = code;
+  rec->info.command = argc ? log->arena + log->arena_len : NULL;
+  rec->info.token = -1;
+  rec->info.offset = 0;
+  rec->info.length = 0;
+  rec->info.expected_type = expected_type;
+  rec->info.syntax_id = syntax_id;
+  rec->info.line = 0;
 
-  va_end(vargs_list);
+  for(i = 0; i < argc; ++i) {
+    const size_t tok_len = strlen(argv[i]);
+    if(text && text >= argv[i] && text <= argv[i] + tok_len) {
+      rec->info.token = i;
+      rec->info.offset = (size_t)(text - argv[i]);
+      rec->info.length = strlen(text);
+    }
+    memcpy(log->arena + log->arena_len, argv[i], tok_len + 1);
+    log->arena_len += tok_len + 1;
+  }
 }
 
-static FINLINE void
-errbuf_flush(struct errbuf* buf)
+#define RECORD_ERROR(sys, code, argc, argv, text, type, syntax_id)             \
+  errlog_record                                                                \
+    (&(sys)->errlog, (sys)->version, CONCAT(CMDSYS_ERROR_, code), (argc),      \
+     (const char* const*)(argv), (text), (type), (syntax_id))
+
+/* Append the records of `src' to `dst'. The records that `dst' cannot store
+ * are counted as lost, as if they were recorded into `dst' directly. */
+static void
+errlog_merge(struct errlog* dst, const struct errlog* src)
 {
-  ASSERT(buf);
-  buf->buffer_id = 0;
-  buf->buffer[0] = '\0';
+  size_t i = 0;
+  ASSERT(dst && src && dst != src);
+
+  for(i = 0; i < src->nrecords; ++i) {
+    const struct error_record* rec = src->records + i;
+    struct error_record* copy = NULL;
+    const size_t len = (i + 1 < src->nrecords
+      ? rec[1].first_token : src->arena_len) - rec->first_token;
+
+    if(dst->nrecords >= ERRLOG_MAX_RECORDS
+    || len > sizeof(dst->arena) - dst->arena_len) {
+      ++dst->nlost;
+      continue;
+    }
+    copy = dst->records + dst->nrecords++;
+    *copy = *rec;
+    copy->first_token = dst->arena_len;
+    copy->info.command = rec->ntokens ? dst->arena + dst->arena_len : NULL;
+    memcpy(dst->arena + dst->arena_len, src->arena + rec->first_token, len);
+    dst->arena_len += len;
+  }
+  dst->nlost += src->nlost;
 }
 
 static enum cmdsys_error
@@ -138,6 +557,50 @@ eqstr(const void* key0, const void* key1)
   return strcmp(str0, str1) == 0;
 }
 
+static size_t
+hash_name(const void* key)
+{
+  return ((const struct name_key*)key)->hash;
+}
+
+static bool
+eqname(const void* key0, const void* key1)
+{
+  const struct name_key* name_key0 = key0;
+  const struct name_key* name_key1 = key1;
+  return name_key0->hash == name_key1->hash
+      && (name_key0->str == name_key1->str /* Interned names. */
+       || strcmp(name_key0->str, name_key1->str) == 0);
+}
+
+static size_t
+hash_ptr(const void* key)
+{
+  return sl_hash(key, sizeof(void*));
+}
+
+static bool
+eqptr(const void* key0, const void* key1)
+{
+  return *(void* const*)key0 == *(void* const*)key1;
+}
+
+static size_t
+hash_var(const void* key)
+{
+  const struct var_key* var_key = key;
+  return sl_hash(var_key->name, var_key->len);
+}
+
+static bool
+eqvar(const void* key0, const void* key1)
+{
+  const struct var_key* var_key0 = key0;
+  const struct var_key* var_key1 = key1;
+  return var_key0->len == var_key1->len
+      && memcmp(var_key0->name, var_key1->name, var_key0->len) == 0;
+}
+
 static int
 cmpstr(const void* a, const void* b)
 {
@@ -146,17 +609,255 @@ cmpstr(const void* a, const void* b)
   return strcmp(str0, str1);
 }
 
+/* Compare `name' against the `len' first chars of `prefix' followed by the
+ * `sep' char. A negative `sep' compares the prefix only. */
+static FINLINE int
+cmp_prefix
+  (const char* name,
+   const char* prefix,
+   const size_t len,
+   const int sep)
+{
+  const int i = strncmp(name, prefix, len);
+  return i != 0 || sep < 0 ? i : (int)(unsigned char)name[len] - sep;
+}
+
+/* Range [begin, end) of the sorted `list' entries matching the prefix. */
+static void
+prefix_range
+  (const char** list,
+   const size_t count,
+   const char* prefix,
+   const size_t len,
+   const int sep,
+   size_t* begin,
+   size_t* end)
+{
+  size_t lo = 0;
+  size_t hi = 0;
+  ASSERT((list || !count) && (prefix || !len) && begin && end);
+
+  for(lo = 0, hi = count; lo < hi; ) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if(cmp_prefix(list[mid], prefix, len, sep) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *begin = lo;
+  for(hi = count; lo < hi; ) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if(cmp_prefix(list[mid], prefix, len, sep) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *end = lo;
+}
+
+/*******************************************************************************
+ *
+ * Namespace functions.
+ *
+ ******************************************************************************/
+static struct ns_node*
+create_ns_node(struct mem_allocator* allocator, const char* name, size_t len)
+{
+  struct ns_node* node = NULL;
+  ASSERT(allocator && (name || !len));
+
+  node = MEM_CALLOC(allocator, 1, sizeof(struct ns_node) + len + 1);
+  if(node) {
+    if(len)
+      memcpy(NS_NODE_NAME(node), name, len);
+    NS_NODE_NAME(node)[len] = '\0';
+  }
+  return node;
+}
+
+static void
+free_ns_node(struct mem_allocator* allocator, struct ns_node* node)
+{
+  ASSERT(allocator && node);
+
+  if(node->children) {
+    const char** name_list = NULL;
+    size_t len = 0;
+    size_t i = 0;
+
+    SL(flat_set_buffer(node->children, &len, NULL, NULL, (void**)&name_list));
+    for(i = 0; i < len; ++i)
+      free_ns_node(allocator, NS_NODE_FROM_NAME(name_list[i]));
+    SL(free_flat_set(node->children));
+  }
+  MEM_FREE(allocator, node);
+}
+
+/* Return the child of `node' whose name is the `len' first chars of `name'. */
+static struct ns_node*
+find_ns_child(struct ns_node* node, const char* name, const size_t len)
+{
+  const char** name_list = NULL;
+  size_t count = 0;
+  size_t begin = 0;
+  size_t end = 0;
+  ASSERT(node);
+
+  if(!node->children)
+    return NULL;
+  SL(flat_set_buffer(node->children, &count, NULL, NULL, (void**)&name_list));
+  prefix_range(name_list, count, name, len, '\0', &begin, &end);
+  return begin == end ? NULL : NS_NODE_FROM_NAME(name_list[begin]);
+}
+
+/* Length of the path component that begins `name'. */
+static FINLINE size_t
+ns_component_len(const char* name, const size_t len)
+{
+  const char* sep = memchr(name, '.', len);
+  return sep ? (size_t)(sep - name) : len;
+}
+
+/* Return the node of the namespace stored in the `len' first chars of `ns' or
+ * NULL if it does not exist. */
+static struct ns_node*
+find_ns_node(struct cmdsys* sys, const char* ns, const size_t len)
+{
+  struct ns_node* node = NULL;
+  size_t i = 0;
+  ASSERT(sys && (ns || !len));
+
+  node = sys->ns_root;
+  for(i = 0; node && i < len; ) {
+    const size_t comp_len = ns_component_len(ns + i, len - i);
+    node = find_ns_child(node, ns + i, comp_len);
+    i += comp_len + 1; /* +1 <=> separator. */
+  }
+  return node;
+}
+
+/* Unregister the command `name' from the nodes of its `depth' first path
+ * components and release the nodes that no more have commands. */
+static void
+ns_erase(struct cmdsys* sys, const char* name, const size_t depth)
+{
+  struct ns_node* node = NULL;
+  const size_t len = strlen(name);
+  size_t i = 0;
+  size_t d = 0;
+  ASSERT(sys && name);
+
+  node = sys->ns_root;
+  --node->ncommands;
+  for(i = 0, d = 0; i < len && d < depth; ++d) {
+    const size_t comp_len = ns_component_len(name + i, len - i);
+    struct ns_node* child = find_ns_child(node, name + i, comp_len);
+    ASSERT(child && child->ncommands);
+
+    if(--child->ncommands == 0) {
+      const char* child_name = NS_NODE_NAME(child);
+      SL(flat_set_erase(node->children, &child_name, NULL));
+      free_ns_node(ALLOCATOR(sys, INDICES), child);
+      break;
+    }
+    node = child;
+    i += comp_len + 1; /* +1 <=> separator. */
+  }
+}
+
+static enum cmdsys_error
+ns_insert(struct cmdsys* sys, const char* name)
+{
+  struct ns_node* node = NULL;
+  const size_t len = strlen(name);
+  size_t i = 0;
+  size_t depth = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  enum sl_error sl_err = SL_NO_ERROR;
+  ASSERT(sys && name);
+
+  node = sys->ns_root;
+  ++node->ncommands;
+  for(i = 0, depth = 0; i < len; ++depth) {
+    const size_t comp_len = ns_component_len(name + i, len - i);
+    struct ns_node* child = find_ns_child(node, name + i, comp_len);
+
+    if(!child) {
+      const char* child_name = NULL;
+
+      if(!node->children) {
+        sl_err = sl_create_flat_set
+          (sizeof(const char*),
+           ALIGNOF(const char*),
+           cmpstr,
+           ALLOCATOR(sys, INDICES),
+           &node->children);
+        if(sl_err != SL_NO_ERROR) {
+          err = sl_to_cmdsys_error(sl_err);
+          goto error;
+        }
+      }
+      child = create_ns_node(ALLOCATOR(sys, INDICES), name + i, comp_len);
+      if(!child) {
+        err = CMDSYS_MEMORY_ERROR;
+        goto error;
+      }
+      child_name = NS_NODE_NAME(child);
+      sl_err = sl_flat_set_insert(node->children, &child_name, NULL);
+      if(sl_err != SL_NO_ERROR) {
+        MEM_FREE(ALLOCATOR(sys, INDICES), child);
+        err = sl_to_cmdsys_error(sl_err);
+        goto error;
+      }
+    }
+    ++child->ncommands;
+    node = child;
+    i += comp_len + 1; /* +1 <=> separator. */
+  }
+
+exit:
+  return err;
+error:
+  /* Unregister the command from the nodes already traversed. */
+  ns_erase(sys, name, depth);
+  goto exit;
+}
+
 /*******************************************************************************
  *
  * Helper function.
  *
  ******************************************************************************/
+#define ARG_END_MAX_ERRORS 16
+
+/* Size of the argtable2 object of an argument, i.e. its structure followed by
+ * its value arrays. */
+static size_t
+arg_size(const struct cmdarg_desc* desc)
+{
+  size_t max_count = 0;
+  ASSERT(desc);
+
+  max_count = (size_t)desc->max_count;
+  switch(desc->type) {
+    case CMDARG_FILE:
+      return sizeof(struct arg_file) + max_count * 3 * sizeof(char*);
+    case CMDARG_LITERAL:
+      return sizeof(struct arg_lit);
+    default: /* Numeric values are stored as strings. */
+      return sizeof(struct arg_str) + max_count * sizeof(char*);
+  }
+}
+
 static enum cmdsys_error
-init_domain_and_table(struct cmd* cmd, const struct cmdarg_desc argv_desc[])
+init_domain_and_table
+  (struct cmd* cmd,
+   struct cmd_info* info,
+   const struct cmdarg_desc argv_desc[])
 {
   size_t i = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
-  ASSERT(cmd);
+  ASSERT(cmd && info);
 
   if(argv_desc) {
     void* arg = NULL;
@@ -175,31 +876,42 @@ init_domain_and_table(struct cmd* cmd, const struct cmdarg_desc argv_desc[])
       CONCAT(CONCAT(arg_, suffix), n)                                          \
         ((a).short_options, (a).long_options, (int)(a).min_count,              \
          (int)(a).max_count, (a).glossary)
+    /* Numeric values are stored as strings and decoded by cmdsys rather than
+     * by the locale dependent strtol/strtod of argtable2. */
+    #define NUM(suffix, a, type)                                               \
+      CONCAT(arg_, suffix)                                                     \
+        ((a).short_options, (a).long_options,                                  \
+         (a).data_type ? (a).data_type : (type), (a).glossary)
+    #define NUMN(a, type)                                                      \
+      arg_strn                                                                 \
+        ((a).short_options, (a).long_options,                                  \
+         (a).data_type ? (a).data_type : (type),                               \
+         (int)(a).min_count, (int)(a).max_count, (a).glossary)
 
     for(i = 0; !IS_END_REACHED(argv_desc[i]); ++i) {
      if(argv_desc[i].min_count == 0 && argv_desc[i].max_count == 1) {
         switch(argv_desc[i].type) {
-          case CMDARG_INT: arg = ARG(int0, argv_desc[i]); break;
+          case CMDARG_INT: arg = NUM(str0, argv_desc[i], "<int>"); break;
           case CMDARG_FILE: arg = ARG(file0, argv_desc[i]); break;
-          case CMDARG_FLOAT: arg = ARG(dbl0, argv_desc[i]); break;
+          case CMDARG_FLOAT: arg = NUM(str0, argv_desc[i], "<double>"); break;
           case CMDARG_STRING: arg = ARG(str0, argv_desc[i]); break;
           case CMDARG_LITERAL: arg = LIT(lit0, argv_desc[i]); break;
           default: ASSERT(0); break;
         }
       } else if(argv_desc[i].max_count == 1) {
         switch(argv_desc[i].type) {
-          case CMDARG_INT: arg = ARG(int1, argv_desc[i]); break;
+          case CMDARG_INT: arg = NUM(str1, argv_desc[i], "<int>"); break;
           case CMDARG_FILE: arg = ARG(file1, argv_desc[i]); break;
-          case CMDARG_FLOAT: arg = ARG(dbl1, argv_desc[i]); break;
+          case CMDARG_FLOAT: arg = NUM(str1, argv_desc[i], "<double>"); break;
           case CMDARG_STRING: arg = ARG(str1, argv_desc[i]); break;
           case CMDARG_LITERAL: arg = LIT(lit1, argv_desc[i]); break;
           default: ASSERT(0); break;
         }
       } else {
         switch(argv_desc[i].type) {
-          case CMDARG_INT: arg = ARGN(int, argv_desc[i]); break;
+          case CMDARG_INT: arg = NUMN(argv_desc[i], "<int>"); break;
           case CMDARG_FILE: arg = ARGN(file, argv_desc[i]); break;
-          case CMDARG_FLOAT: arg = ARGN(dbl, argv_desc[i]); break;
+          case CMDARG_FLOAT: arg = NUMN(argv_desc[i], "<double>"); break;
           case CMDARG_STRING: arg = ARGN(str, argv_desc[i]); break;
           case CMDARG_LITERAL: arg = LITN(lit, argv_desc[i]); break;
           default: ASSERT(0); break;
@@ -207,10 +919,13 @@ init_domain_and_table(struct cmd* cmd, const struct cmdarg_desc argv_desc[])
       }
       cmd->arg_table[i] = arg;
       cmd->arg_domain[i + 1] = argv_desc[i].domain; /* +1 <=> command name. */
+      info->arg_table_size += arg_size(&argv_desc[i]);
     }
   }
 
-  cmd->arg_table[i] = arg_end(16);
+  cmd->arg_table[i] = arg_end(ARG_END_MAX_ERRORS);
+  info->arg_table_size += sizeof(struct arg_end)
+    + ARG_END_MAX_ERRORS * (sizeof(int) + sizeof(void*) + sizeof(char*));
   if(arg_nullcheck(cmd->arg_table)) {
     err = CMDSYS_MEMORY_ERROR;
     goto error;
@@ -220,6 +935,8 @@ init_domain_and_table(struct cmd* cmd, const struct cmdarg_desc argv_desc[])
   #undef LIT
   #undef ARGN
   #undef LITN
+  #undef NUM
+  #undef NUMN
 
 exit:
   return err;
@@ -244,15 +961,11 @@ set_optvalue_flag(struct cmd* cmd, const bool val)
 
   for(argv_id = 1, tbl_id = 0; argv_id < cmd->argc; ++argv_id, ++tbl_id) {
     switch(cmd->argv[argv_id]->type) {
-      case CMDARG_INT:
-        SET_OPTVAL((struct arg_int*)cmd->arg_table[tbl_id], val);
-        break;
       case CMDARG_FILE:
         SET_OPTVAL((struct arg_file*)cmd->arg_table[tbl_id], val);
         break;
+      case CMDARG_INT:
       case CMDARG_FLOAT:
-        SET_OPTVAL((struct arg_dbl*)cmd->arg_table[tbl_id], val);
-        break;
       case CMDARG_STRING:
         SET_OPTVAL((struct arg_str*)cmd->arg_table[tbl_id], val);
         break;
@@ -265,116 +978,186 @@ set_optvalue_flag(struct cmd* cmd, const bool val)
   #undef SET_OPTVAL
 }
 
+/* Number of values of the argument `argv_id' parsed by argtable. */
+static FINLINE int
+parsed_count(const struct cmd* cmd, const size_t argv_id)
+{
+  const void* tbl = NULL;
+  ASSERT(cmd && argv_id > 0 && argv_id < cmd->argc);
+
+  tbl = cmd->arg_table[argv_id - 1]; /* -1 <=> arg name. */
+  switch(cmd->argv[argv_id]->type) {
+    case CMDARG_FILE: return ((const struct arg_file*)tbl)->count;
+    case CMDARG_INT:
+    case CMDARG_FLOAT:
+    case CMDARG_STRING: return ((const struct arg_str*)tbl)->count;
+    case CMDARG_LITERAL: return ((const struct arg_lit*)tbl)->count;
+    default: ASSERT(0); return 0;
+  }
+}
+
 static int
 defined_args_count(struct cmd* cmd)
 {
   int count = 0;
   size_t argv_id = 0;
-  size_t tbl_id = 0;
   ASSERT(cmd);
 
-  for(argv_id = 1, tbl_id = 0; argv_id < cmd->argc; ++argv_id, ++tbl_id) {
-    switch(cmd->argv[argv_id]->type) {
-      case CMDARG_INT:
-        count += ((struct arg_int*)cmd->arg_table[tbl_id])->count;
-        break;
-      case CMDARG_FILE:
-        count += ((struct arg_file*)cmd->arg_table[tbl_id])->count;
-        break;
-      case CMDARG_FLOAT:
-        count += ((struct arg_dbl*)cmd->arg_table[tbl_id])->count;
-        break;
-      case CMDARG_STRING:
-        count += ((struct arg_str*)cmd->arg_table[tbl_id])->count;
-        break;
-      case CMDARG_LITERAL:
-        count += ((struct arg_lit*)cmd->arg_table[tbl_id])->count;
-        break;
-      default: ASSERT(0); break;
+  for(argv_id = 1; argv_id < cmd->argc; ++argv_id)
+    count += parsed_count(cmd, argv_id);
+  return count;
+}
+
+/* Decode the INT and FLOAT values parsed by argtable, into the value list of
+ * the command arguments if `store' is true. Return the number of invalid
+ * values, reported into `stream' if it is not NULL. The first invalid value
+ * and its argument are returned in `invalid_value' and `invalid_arg' if they
+ * are not NULL. */
+static int
+decode_numeric_args
+  (struct cmd* cmd,
+   const bool store,
+   FILE* stream,
+   const char* name,
+   size_t* invalid_arg,
+   const char** invalid_value)
+{
+  size_t arg_id = 0;
+  int nerror = 0;
+  ASSERT(cmd);
+
+  for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+    const struct arg_str* arg = NULL;
+    union cmdarg_domain* domain = cmd->arg_domain + arg_id;
+    struct cmdarg_value* value_list = cmd->argv[arg_id]->value_list;
+    int val_id = 0;
+
+    /* The streamed values are decoded as they are read. */
+    if((cmd->argv[arg_id]->type != CMDARG_INT
+     && cmd->argv[arg_id]->type != CMDARG_FLOAT)
+    || cmd->argv[arg_id]->cursor)
+      continue;
+
+    arg = (const struct arg_str*)cmd->arg_table[arg_id - 1]; /* -1 <=> name. */
+    ASSERT(!store || (size_t)arg->count == cmd->argv[arg_id]->count);
+    for(val_id = 0; val_id < arg->count; ++val_id) {
+      bool is_valid = false;
+      if(cmd->argv[arg_id]->type == CMDARG_INT) {
+        int integer = 0;
+        is_valid = decode_int
+          (arg->sval[val_id], domain->integer.min, domain->integer.max,
+           &integer);
+        if(store)
+          value_list[val_id].data.integer = integer;
+      } else {
+        float real = 0.f;
+        is_valid = decode_float
+          (arg->sval[val_id], domain->real.min, domain->real.max, &real);
+        if(store)
+          value_list[val_id].data.real = real;
+      }
+      if(!is_valid) {
+        if(!nerror && invalid_arg)
+          *invalid_arg = arg_id;
+        if(!nerror && invalid_value)
+          *invalid_value = arg->sval[val_id];
+        ++nerror;
+        if(stream) {
+          fprintf(stream, "%s: invalid argument \"%s\" to option ",
+            name, arg->sval[val_id]);
+          arg_print_option
+            (stream, arg->hdr.shortopts, arg->hdr.longopts,
+             arg->hdr.datatype, "\n");
+        }
+      }
     }
   }
-  return count;
+  return nerror;
+}
+
+static FINLINE bool
+is_unchecked
+  (const char* str,
+   const char* const* unchecked,
+   const size_t nunchecked)
+{
+  size_t i = 0;
+  for(i = 0; i < nunchecked && unchecked[i] != str; ++i);
+  return i < nunchecked;
 }
 
+/* Setup the argument values of the command, allocated by alloc_arg_values.
+ * On a value out of its string domain, the value is returned in
+ * `invalid_value'. The `unchecked' tokens are not checked against the string
+ * domains. */
 static enum cmdsys_error
-setup_cmd_arg(struct cmdsys* sys, struct cmd* cmd, const char* name)
+setup_cmd_arg
+  (struct cmd* cmd,
+   const char* name,
+   const char* const* unchecked,
+   const size_t nunchecked,
+   const char** invalid_value)
 {
   size_t arg_id = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
 
-  ASSERT(cmd && cmd->argc && cmd->argv[0]->type == CMDARG_STRING);
+  ASSERT(cmd && invalid_value && cmd->argc);
+  ASSERT(cmd->argv[0]->type == CMDARG_STRING);
   cmd->argv[0]->value_list[0].is_defined = true;
   cmd->argv[0]->value_list[0].data.string = name;
+  cmd->argv[0]->value_list[0].length = strlen(name);
 
   for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
-    const char** value_list = NULL;
-    const char* str = NULL;
-    const size_t arg_tbl_id = arg_id - 1; /* -1 <=> arg name. */
-    int val_id = 0;
-    bool isdef = true;
+    struct cmdarg* arg = cmd->argv[arg_id];
+    const void* tbl = cmd->arg_table[arg_id - 1]; /* -1 <=> arg name. */
+    const char** value_list = cmd->arg_domain[arg_id].string.value_list;
+    size_t val_id = 0;
+
+    if(arg->cursor) {
+      arg->value_list = NULL;
+      arg->cursor->tokens = arg->type == CMDARG_FILE
+        ? ((const struct arg_file*)tbl)->filename
+        : ((const struct arg_str*)tbl)->sval;
+      arg->cursor->values = NULL;
+      arg->cursor->count = arg->count;
+      arg->cursor->next = 0;
+      continue;
+    }
+    for(val_id = 0; val_id < arg->count; ++val_id) {
+      const char* str = NULL;
+      size_t i = 0;
 
-    for(val_id=0; isdef && (size_t)val_id<cmd->argv[arg_id]->count; ++val_id) {
-      switch(cmd->argv[arg_id]->type) {
+      arg->value_list[val_id].is_defined = true;
+      switch(arg->type) {
         case CMDARG_STRING:
-          isdef = val_id < ((struct arg_str*)cmd->arg_table[arg_tbl_id])->count;
-          if(isdef) {
-            str = ((struct arg_str*)(cmd->arg_table[arg_tbl_id]))->sval[val_id];
-            /* Check the string domain. */
-            value_list = cmd->arg_domain[arg_id].string.value_list;
-            if(value_list == NULL) {
-              cmd->argv[arg_id]->value_list[val_id].data.string = str;
-            } else {
-              size_t i = 0;
-              for(i = 0; value_list[i] != NULL; ++i) {
-                if(strcmp(str, value_list[i]) == 0)
-                  break;
-              }
-              if(value_list[i] != NULL) {
-                cmd->argv[arg_id]->value_list[val_id].data.string = str;
-              } else {
-                errbuf_print
-                  (&sys->errbuf,
-                   "%s: unexpected option value `%s'\n",
-                   name, str);
-                err = CMDSYS_COMMAND_ERROR;
-                goto error;
-              }
+          str = ((const struct arg_str*)tbl)->sval[val_id];
+          /* Check the string domain. */
+          if(value_list && !is_unchecked(str, unchecked, nunchecked)) {
+            for(i = 0; value_list[i] != NULL; ++i) {
+              if(strcmp(str, value_list[i]) == 0)
+                break;
+            }
+            if(value_list[i] == NULL) {
+              *invalid_value = str;
+              err = CMDSYS_COMMAND_ERROR;
+              goto error;
             }
           }
+          arg->value_list[val_id].data.string = str;
+          arg->value_list[val_id].length = strlen(str);
           break;
         case CMDARG_FILE:
-          isdef = val_id< ((struct arg_file*)cmd->arg_table[arg_tbl_id])->count;
-          if(isdef) {
-            cmd->argv[arg_id]->value_list[val_id].data.string =
-             ((struct arg_file*)(cmd->arg_table[arg_tbl_id]))->filename[val_id];
-          }
+          str = ((const struct arg_file*)tbl)->filename[val_id];
+          arg->value_list[val_id].data.string = str;
+          arg->value_list[val_id].length = strlen(str);
           break;
         case CMDARG_INT:
-          isdef = val_id < ((struct arg_int*)cmd->arg_table[arg_tbl_id])->count;
-          if(isdef) {
-            cmd->argv[arg_id]->value_list[val_id].data.integer = MAX(MIN(
-              ((struct arg_int*)(cmd->arg_table[arg_tbl_id]))->ival[val_id],
-              cmd->arg_domain[arg_id].integer.max),
-              cmd->arg_domain[arg_id].integer.min);
-          }
-          break;
         case CMDARG_FLOAT:
-          isdef = val_id < ((struct arg_dbl*)cmd->arg_table[arg_tbl_id])->count;
-          if(isdef) {
-            cmd->argv[arg_id]->value_list[val_id].data.real = MAX(MIN((float)
-              ((struct arg_dbl*)(cmd->arg_table[arg_tbl_id]))->dval[val_id],
-              cmd->arg_domain[arg_id].real.max),
-              cmd->arg_domain[arg_id].real.min);
-          }
-          break;
-        case CMDARG_LITERAL:
-          isdef = val_id < ((struct arg_lit*)cmd->arg_table[arg_tbl_id])->count;
-          break;
-        default:
-          ASSERT(0);
+          /* The values were already decoded by decode_numeric_args. */
           break;
+        case CMDARG_LITERAL: break;
+        default: ASSERT(0); /* Unreachable code */ break;
       }
-      cmd->argv[arg_id]->value_list[val_id].is_defined = isdef;
     }
   }
 exit:
@@ -383,42 +1166,551 @@ error:
   goto exit;
 }
 
+/* Return the completion function of the syntax that matches the hint
+ * arguments or NULL if no syntax is selected. */
+static void
+(*select_completion_syntax
+  (struct cmd_list* cmd_list,
+   const size_t hint_argc,
+   char* hint_argv[]))
+  (struct cmdsys*, const char*, size_t, size_t*, const char**[])
+{
+  size_t cmd_id = 0;
+  ASSERT(cmd_list && cmd_list->count);
+
+  /* No multi syntax. */
+  if(cmd_list->count == 1) {
+    cmd_id = 0;
+  /* Multi syntax. */
+  } else {
+    size_t valid_cmd = 0;
+    int nb_valid_cmd = 0;
+    int min_nerror = INT_MAX;
+    int max_ndefargs = INT_MIN;
+
+    for(cmd_id = 0; cmd_id < cmd_list->count; ++cmd_id) {
+      struct cmd* cmd = cmd_list->cmds + cmd_id;
+      int nerror = 0;
+      int ndefargs = 0;
+
+      set_optvalue_flag(cmd, true);
+      nerror = arg_parse((int)hint_argc, hint_argv, cmd->arg_table);
+      ndefargs = defined_args_count(cmd);
+
+      /* Define as the completion function the one defined by the command
+       * syntax which match the best the hint arguments. If the minimal
+       * number of parsing error is obtained by several syntaxes, we select
+       * the syntax which have the maximum of its argument defined by the
+       * hint command. */
+      if(nerror < min_nerror
+      || (nerror == min_nerror && ndefargs > max_ndefargs)) {
+        valid_cmd = cmd_id;
+        nb_valid_cmd = 0;
+      }
+      min_nerror = MIN(nerror, min_nerror);
+      max_ndefargs = MAX(ndefargs, max_ndefargs);
+      nb_valid_cmd += ((ndefargs == max_ndefargs) & (nerror == min_nerror));
+      set_optvalue_flag(cmd, false);
+    }
+    /* Select the syntax only if it is the unique one to match the previous
+     * completion heuristic. */
+    if(nb_valid_cmd != 1)
+      return NULL;
+    cmd_id = valid_cmd;
+  }
+  return cmd_list->infos[cmd_id].completion;
+}
+
+static enum cmdsys_error
+reserve_buffer
+  (struct mem_allocator* allocator,
+   void** buffer,
+   size_t* capacity,
+   const size_t size)
+{
+  void* mem = NULL;
+  ASSERT(allocator && buffer && capacity);
+
+  if(size <= *capacity)
+    return CMDSYS_NO_ERROR;
+  mem = MEM_REALLOC(allocator, *buffer, size);
+  if(!mem)
+    return CMDSYS_MEMORY_ERROR;
+  *buffer = mem;
+  *capacity = size;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Ensure that the output can store `size' more bytes and its NULL char. The
+ * capacity is doubled to amortize the allocations. */
+static enum cmdsys_error
+reserve_output(struct cmdsys* sys, const size_t size)
+{
+  struct output* output = &sys->output;
+  size_t capacity = 0;
+  ASSERT(sys);
+
+  if(output->len + size + 1 <= output->capacity)
+    return CMDSYS_NO_ERROR;
+  capacity = MAX(output->len + size + 1, 2 * output->capacity);
+  capacity = MAX(capacity, 256);
+  if(reserve_buffer(sys->allocator, (void**)&output->buffer, &output->capacity,
+     capacity) != CMDSYS_NO_ERROR)
+    return CMDSYS_MEMORY_ERROR;
+  if(!output->len)
+    output->buffer[0] = '\0';
+  return CMDSYS_NO_ERROR;
+}
+
+/* Position of the value arena to which it can be restored. */
+struct value_mark {
+  struct value_chunk* chunk;
+  size_t len;
+};
+
+static FINLINE struct value_mark
+value_arena_mark(const struct value_arena* arena)
+{
+  struct value_mark mark;
+  ASSERT(arena);
+  mark.chunk = arena->chunk;
+  mark.len = arena->len;
+  return mark;
+}
+
+/* Release all the values. The chunks are kept. */
+static FINLINE void
+value_arena_clear(struct value_arena* arena)
+{
+  ASSERT(arena);
+  arena->chunk = NULL;
+  arena->len = 0;
+}
+
+/* Release the values allocated since `mark'. Their chunks are kept. */
+static FINLINE void
+value_arena_restore(struct value_arena* arena, const struct value_mark mark)
+{
+  ASSERT(arena);
+  arena->chunk = mark.chunk;
+  arena->len = mark.len;
+}
+
+/* Allocate `count' values from the value arena. A chunk too small for them is
+ * skipped and a new chunk, at least twice as large as the last one, is
+ * appended once the kept chunks are exhausted. */
+static enum cmdsys_error
+value_arena_alloc
+  (struct cmdsys* sys,
+   const size_t count,
+   struct cmdarg_value** values)
+{
+  struct value_arena* arena = &sys->values;
+  struct value_chunk* chunk = NULL;
+  size_t len = 0;
+  ASSERT(sys && values);
+
+  chunk = arena->chunk;
+  len = arena->len;
+  while(!chunk || chunk->capacity - len < count) {
+    struct value_chunk* next = chunk ? chunk->next : arena->first;
+    if(!next) {
+      size_t capacity = MAX(count, VALUE_CHUNK_MIN_CAPACITY);
+      if(chunk) /* Last chunk. */
+        capacity = MAX(capacity, 2 * chunk->capacity);
+      next = MEM_ALLOC(ALLOCATOR(sys, VALUES),
+        sizeof(struct value_chunk) + capacity * sizeof(struct cmdarg_value));
+      if(!next)
+        return CMDSYS_MEMORY_ERROR;
+      next->next = NULL;
+      next->capacity = capacity;
+      if(chunk)
+        chunk->next = next;
+      else
+        arena->first = next;
+    }
+    chunk = next;
+    len = 0;
+  }
+  *values = chunk->values + len;
+  arena->chunk = chunk;
+  arena->len = len + count;
+  return CMDSYS_NO_ERROR;
+}
+
+static void
+free_value_arena(struct cmdsys* sys)
+{
+  struct value_chunk* chunk = NULL;
+  ASSERT(sys);
+
+  chunk = sys->values.first;
+  while(chunk) {
+    struct value_chunk* next = chunk->next;
+    MEM_FREE(ALLOCATOR(sys, VALUES), chunk);
+    chunk = next;
+  }
+}
+
+static FINLINE struct pooled_string*
+pooled_string_header(const char* str)
+{
+  ASSERT(str);
+  return (struct pooled_string*)str - 1;
+}
+
+static void
+string_pool_init
+  (struct string_pool* pool,
+   const enum cmdsys_memory_category category)
+{
+  ASSERT(pool);
+  memset(pool, 0, sizeof(struct string_pool));
+  pool->category = category;
+}
+
+/* Index of the first chunk of `pool' whose address is greater than `ptr'. */
+static size_t
+string_pool_upper_chunk(const struct string_pool* pool, const void* ptr)
+{
+  size_t begin = 0;
+  size_t end = 0;
+  ASSERT(pool);
+
+  end = pool->nchunks;
+  while(begin < end) {
+    const size_t mid = begin + (end - begin) / 2;
+    if((uintptr_t)pool->chunks[mid] <= (uintptr_t)ptr) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return begin;
+}
+
+/* Return the chunk of `pool' that stores `str', or NULL if `str' is not a
+ * string of the pool. */
+static struct string_chunk*
+string_pool_find_chunk(const struct string_pool* pool, const char* str)
+{
+  struct string_chunk* chunk = NULL;
+  size_t id = 0;
+  ASSERT(pool && str);
+
+  id = string_pool_upper_chunk(pool, str);
+  if(id == 0)
+    return NULL;
+  chunk = pool->chunks[id - 1];
+  if((uintptr_t)str < (uintptr_t)chunk->data
+  || (uintptr_t)str >= (uintptr_t)(chunk->data + chunk->len))
+    return NULL;
+  return chunk;
+}
+
+/* Double the slot count of `pool' and reinsert its strings from their
+ * precomputed hash. */
+static enum cmdsys_error
+string_pool_grow(struct cmdsys* sys, struct string_pool* pool)
+{
+  const size_t nslots = pool->nslots ? pool->nslots * 2 : 64;
+  const char** slots = NULL;
+  size_t i = 0;
+  ASSERT(sys && pool && !(nslots & (nslots - 1)));
+
+  slots = MEM_CALLOC(ALLOCATOR(sys, INDICES), nslots, sizeof(const char*));
+  if(!slots)
+    return CMDSYS_MEMORY_ERROR;
+  for(i = 0; i < pool->nslots; ++i) {
+    size_t slot = 0;
+    if(!pool->slots[i])
+      continue;
+    slot = pooled_string_header(pool->slots[i])->hash & (nslots - 1);
+    while(slots[slot])
+      slot = (slot + 1) & (nslots - 1);
+    slots[slot] = pool->slots[i];
+  }
+  if(pool->slots)
+    MEM_FREE(ALLOCATOR(sys, INDICES), pool->slots);
+  pool->slots = slots;
+  pool->nslots = nslots;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Return a new reference on the interned copy of `str' whose hash is already
+ * computed, or NULL if it cannot be allocated. */
+static const char*
+string_pool_intern_hashed
+  (struct cmdsys* sys,
+   struct string_pool* pool,
+   const char* str,
+   const size_t hash)
+{
+  struct pooled_string* header = NULL;
+  struct string_chunk* chunk = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  size_t slot = 0;
+  ASSERT(sys && pool && str);
+
+  len = strlen(str);
+  if(len > UINT32_MAX)
+    return NULL;
+  if((pool->count + 1) * 4 > pool->nslots * 3
+  && string_pool_grow(sys, pool) != CMDSYS_NO_ERROR)
+    return NULL;
+
+  slot = hash & (pool->nslots - 1);
+  while(pool->slots[slot]) {
+    const char* interned = pool->slots[slot];
+    header = pooled_string_header(interned);
+    if(header->hash == hash && header->len == len
+    && !memcmp(interned, str, len)) {
+      ++header->nrefs;
+      return interned;
+    }
+    slot = (slot + 1) & (pool->nslots - 1);
+  }
+
+  /* Append the string to the current chunk. The room left in a chunk too
+   * small for it is lost. */
+  size = ALIGN_SIZE
+    (sizeof(struct pooled_string) + len + 1, ALIGNOF(struct pooled_string));
+  chunk = pool->chunk;
+  if(!chunk || chunk->capacity - chunk->len < size) {
+    const size_t capacity = MAX(size, STRING_CHUNK_MIN_CAPACITY);
+    size_t id = 0;
+
+    if(pool->nchunks == pool->chunks_capacity) {
+      const size_t chunks_capacity =
+        pool->chunks_capacity ? pool->chunks_capacity * 2 : 8;
+      struct string_chunk** chunks = MEM_REALLOC
+        (ALLOCATOR(sys, INDICES), pool->chunks,
+         chunks_capacity * sizeof(struct string_chunk*));
+      if(!chunks)
+        return NULL;
+      pool->chunks = chunks;
+      pool->chunks_capacity = chunks_capacity;
+    }
+    chunk = MEM_ALLOC(mem_account_allocator(&sys->mem, pool->category),
+      sizeof(struct string_chunk) + capacity);
+    if(!chunk)
+      return NULL;
+    id = string_pool_upper_chunk(pool, chunk);
+    memmove(pool->chunks + id + 1, pool->chunks + id,
+      (pool->nchunks - id) * sizeof(struct string_chunk*));
+    pool->chunks[id] = chunk;
+    ++pool->nchunks;
+    chunk->capacity = capacity;
+    chunk->len = 0;
+    chunk->nstrings = 0;
+    pool->chunk = chunk;
+  }
+  header = (struct pooled_string*)(chunk->data + chunk->len);
+  header->chunk = chunk;
+  header->hash = hash;
+  header->len = (uint32_t)len;
+  header->nrefs = 1;
+  memcpy(header + 1, str, len + 1);
+  chunk->len += size;
+  ++chunk->nstrings;
+
+  pool->slots[slot] = (const char*)(header + 1);
+  ++pool->count;
+  return pool->slots[slot];
+}
+
+static FINLINE const char*
+string_pool_intern
+  (struct cmdsys* sys,
+   struct string_pool* pool,
+   const char* str)
+{
+  ASSERT(str);
+  return string_pool_intern_hashed(sys, pool, str, sl_hash(str, strlen(str)));
+}
+
+/* Release a reference on `str' if it is a string of the pool; other strings,
+ * e.g. the default texts of argtable2, are ignored. */
+static void
+string_pool_release
+  (struct cmdsys* sys,
+   struct string_pool* pool,
+   const char* str)
+{
+  struct pooled_string* header = NULL;
+  struct string_chunk* chunk = NULL;
+  size_t mask = 0;
+  size_t slot = 0;
+  size_t next = 0;
+  size_t id = 0;
+  ASSERT(sys && pool);
+
+  if(!str || !(chunk = string_pool_find_chunk(pool, str)))
+    return;
+  header = pooled_string_header(str);
+  ASSERT(header->chunk == chunk && header->nrefs);
+  if(--header->nrefs)
+    return;
+
+  /* Look for the slot of the string from its stored hash. */
+  mask = pool->nslots - 1;
+  slot = header->hash & mask;
+  while(pool->slots[slot] != str) {
+    ASSERT(pool->slots[slot]);
+    slot = (slot + 1) & mask;
+  }
+
+  /* Remove the string from the table by shifting back the strings of its
+   * probe sequence that would no longer be reachable. */
+  pool->slots[slot] = NULL;
+  --pool->count;
+  for(next = (slot + 1) & mask; pool->slots[next]; next = (next + 1) & mask) {
+    const size_t home = pooled_string_header(pool->slots[next])->hash & mask;
+    if(((next - home) & mask) >= ((next - slot) & mask)) {
+      pool->slots[slot] = pool->slots[next];
+      pool->slots[next] = NULL;
+      slot = next;
+    }
+  }
+
+  ASSERT(chunk->nstrings);
+  if(--chunk->nstrings)
+    return;
+  id = string_pool_upper_chunk(pool, chunk) - 1;
+  ASSERT(pool->chunks[id] == chunk);
+  memmove(pool->chunks + id, pool->chunks + id + 1,
+    (pool->nchunks - id - 1) * sizeof(struct string_chunk*));
+  --pool->nchunks;
+  if(pool->chunk == chunk)
+    pool->chunk = NULL;
+  MEM_FREE(mem_account_allocator(&sys->mem, pool->category), chunk);
+}
+
+static void
+free_string_pool(struct cmdsys* sys, struct string_pool* pool)
+{
+  size_t i = 0;
+  ASSERT(sys && pool);
+
+  for(i = 0; i < pool->nchunks; ++i) {
+    MEM_FREE(mem_account_allocator(&sys->mem, pool->category),
+      pool->chunks[i]);
+  }
+  if(pool->chunks)
+    MEM_FREE(ALLOCATOR(sys, INDICES), pool->chunks);
+  if(pool->slots)
+    MEM_FREE(ALLOCATOR(sys, INDICES), pool->slots);
+}
+
+static FINLINE struct name_key
+name_key(const char* name)
+{
+  struct name_key key;
+  ASSERT(name);
+  key.str = name;
+  key.hash = sl_hash(name, strlen(name));
+  return key;
+}
+
+/* Key of a name of the name pool, whose hash is not computed again. */
+static FINLINE struct name_key
+interned_name_key(const char* name)
+{
+  struct name_key key;
+  key.str = name;
+  key.hash = pooled_string_header(name)->hash;
+  return key;
+}
+
+static FINLINE struct cmd_list*
+find_cmd_list(struct cmdsys* sys, const struct name_key key)
+{
+  struct cmd_list* list = NULL;
+  ASSERT(sys);
+  SL(hash_table_find(sys->htbl, &key, (void**)&list));
+  return list;
+}
+
+/* Allocate from the value arena the values of the arguments parsed by
+ * argtable into the arg table of `cmd', each followed by an undefined
+ * value. The values of the streamed arguments are not allocated. */
+static enum cmdsys_error
+alloc_arg_values(struct cmdsys* sys, struct cmd* cmd)
+{
+  size_t arg_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && cmd);
+
+  for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+    struct cmdarg* arg = cmd->argv[arg_id];
+    arg->count = (size_t)parsed_count(cmd, arg_id);
+    if(arg->cursor)
+      continue;
+    err = value_arena_alloc(sys, arg->count + 1, &arg->value_list);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+    arg->value_list[arg->count].is_defined = false;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+static void
+release_completion_session(struct ref* ref)
+{
+  struct cmdsys_completion_session* session = NULL;
+  struct cmdsys* sys = NULL;
+  ASSERT(ref != NULL);
+
+  session = CONTAINER_OF(ref, struct cmdsys_completion_session, ref);
+  sys = session->sys;
+  if(session->key)
+    MEM_FREE(sys->allocator, session->key);
+  if(session->input)
+    MEM_FREE(sys->allocator, session->input);
+  if(session->candidate_list)
+    MEM_FREE(sys->allocator, (void*)session->candidate_list);
+  MEM_FREE(sys->allocator, session);
+  CMDSYS(ref_put(sys));
+}
+
 static enum cmdsys_error
 register_command
   (struct cmdsys* sys,
-   struct cmd* cmd,
-   const char* name)
+   const struct cmd* cmd,
+   const struct cmd_info* info,
+   struct name_key key) /* The name may not be interned yet. */
 {
-  struct list_node* list = NULL;
-  char* cmd_name = NULL;
+  struct cmd_list* list = NULL;
+  const char* cmd_name = NULL;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
   enum sl_error sl_err = SL_NO_ERROR;
   bool is_inserted_in_htbl = false;
   bool is_inserted_in_fset = false;
-  ASSERT(sys && cmd && name);
+  bool is_inserted_in_ns = false;
+  ASSERT(sys && cmd && info && key.str);
 
-  SL(hash_table_find(sys->htbl, &name, (void**)&list));
+  list = find_cmd_list(sys, key);
 
   /* Register the command against the command system if it does not exist. */
   if(list == NULL) {
-    cmd_name = MEM_CALLOC(sys->allocator, strlen(name) + 1, sizeof(char));
+    cmd_name = string_pool_intern_hashed(sys, &sys->names, key.str, key.hash);
     if(NULL == cmd_name) {
       err = CMDSYS_MEMORY_ERROR;
       goto error;
     }
-    strcpy(cmd_name, name);
+    key.str = cmd_name;
 
     sl_err = sl_hash_table_insert
-      (sys->htbl, &cmd_name, (struct list_node[]){{NULL, NULL}});
+      (sys->htbl, &key, (struct cmd_list[]){{NULL, NULL, 0, 0, 0}});
     if(SL_NO_ERROR != sl_err) {
       err = sl_to_cmdsys_error(sl_err);
       goto error;
     }
     is_inserted_in_htbl = true;
 
-    SL(hash_table_find(sys->htbl, &cmd_name, (void**)&list));
+    list = find_cmd_list(sys, key);
     ASSERT(list != NULL);
-    list_init(list);
 
     sl_err = sl_flat_set_insert(sys->name_set, &cmd_name, NULL);
     if(SL_NO_ERROR != sl_err) {
@@ -426,9 +1718,43 @@ register_command
       goto error;
     }
     is_inserted_in_fset = true;
+
+    err = ns_insert(sys, cmd_name);
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    is_inserted_in_ns = true;
   }
 
-  list_add(list, &cmd->node);
+  if(list->count == list->capacity) {
+    const size_t capacity = list->capacity ? list->capacity * 2 : 1;
+    struct cmd* cmds = NULL;
+    struct cmd_info* infos = NULL;
+
+    cmds = MEM_REALLOC
+      (ALLOCATOR(sys, DESCRIPTORS), list->cmds, capacity*sizeof(struct cmd));
+    if(cmds)
+      list->cmds = cmds;
+    infos = MEM_REALLOC
+      (ALLOCATOR(sys, DESCRIPTORS), list->infos,
+       capacity * sizeof(struct cmd_info));
+    if(infos)
+      list->infos = infos;
+    if(!cmds || !infos) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+    list->capacity = capacity;
+  }
+  /* The last added syntax is the first one to be dispatched. */
+  memmove(list->cmds + 1, list->cmds, list->count * sizeof(struct cmd));
+  memmove(list->infos + 1, list->infos, list->count*sizeof(struct cmd_info));
+  list->cmds[0] = *cmd;
+  list->infos[0] = *info;
+  ++list->count;
+  if(!cmd->arg_table) {
+    ++list->nlazy;
+    ++sys->nlazy;
+  }
 
 exit:
   return err;
@@ -436,18 +1762,81 @@ error:
   if(cmd_name) {
     size_t i = 0;
 
-    if(is_inserted_in_htbl) {
-      SL(hash_table_erase(sys->htbl, &cmd_name, &i));
-      ASSERT(1 == i);
-    }
+    if(is_inserted_in_ns)
+      ns_erase(sys, cmd_name, SIZE_MAX);
     if(is_inserted_in_fset) {
       SL(flat_set_erase(sys->name_set, &cmd_name, NULL));
     }
-    MEM_FREE(sys->allocator, cmd_name);
+    if(is_inserted_in_htbl) {
+      if(list->cmds)
+        MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), list->cmds);
+      if(list->infos)
+        MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), list->infos);
+      SL(hash_table_erase(sys->htbl, &key, &i));
+      ASSERT(1 == i);
+    }
+    string_pool_release(sys, &sys->names, cmd_name);
   }
   goto exit;
 }
 
+static void
+release_image(struct ref* ref)
+{
+  struct image* img = NULL;
+  ASSERT(ref);
+
+  img = CONTAINER_OF(ref, struct image, ref);
+  if(img->buffer)
+    munmap(img->buffer, img->size);
+  if(img->argv_desc)
+    MEM_FREE(img->sys->allocator, img->argv_desc);
+  MEM_FREE(img->sys->allocator, img);
+}
+
+/* Release the memory of a syntax that may be partially initialised. */
+static void
+free_cmd(struct cmdsys* sys, struct cmd* cmd, struct cmd_info* info)
+{
+  size_t arg_id = 0;
+  ASSERT(sys && cmd && info);
+
+  if(info->is_interned) {
+    string_pool_release(sys, &sys->texts, info->description);
+    for(arg_id = 1; cmd->arg_table && arg_id < cmd->argc; ++arg_id) {
+      const struct arg_hdr* hdr =
+        (const struct arg_hdr*)cmd->arg_table[arg_id - 1]; /* -1 <=> name. */
+      string_pool_release(sys, &sys->texts, hdr->shortopts);
+      string_pool_release(sys, &sys->texts, hdr->longopts);
+      string_pool_release(sys, &sys->texts, hdr->datatype);
+      string_pool_release(sys, &sys->texts, hdr->glossary);
+    }
+  }
+  if(cmd->arg_table) {
+    mem_account_untrack
+      (&sys->mem, CMDSYS_MEMORY_ARGTABLE, info->arg_table_size, cmd->argc);
+    MEM_FREE(ALLOCATOR(sys, VALUES), cmd->argv[0]);
+    arg_freetable(cmd->arg_table, cmd->argc + 1); /* +1 <=> arg_end. */
+    MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), cmd->arg_table);
+  }
+  if(info->image)
+    ref_put(&info->image->ref, release_image);
+}
+
+static void
+free_cmd_list(struct cmdsys* sys, struct cmd_list* list)
+{
+  size_t i = 0;
+  ASSERT(sys && list);
+
+  for(i = 0; i < list->count; ++i)
+    free_cmd(sys, list->cmds + i, list->infos + i);
+  ASSERT(sys->nlazy >= list->nlazy);
+  sys->nlazy -= list->nlazy;
+  MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), list->cmds);
+  MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), list->infos);
+}
+
 static void
 del_all_commands(struct cmdsys* sys)
 {
@@ -457,39 +1846,56 @@ del_all_commands(struct cmdsys* sys)
 
   SL(hash_table_begin(sys->htbl, &it, &b));
   while(!b) {
-    struct list_node* list = (struct list_node*)it.pair.data;
-    struct list_node* pos = NULL;
-    struct list_node* tmp = NULL;
-    size_t i = 0;
+    struct cmd_list* list = (struct cmd_list*)it.pair.data;
+    ASSERT(list->count);
+
+    free_cmd_list(sys, list);
+    string_pool_release
+      (sys, &sys->names, ((const struct name_key*)it.pair.key)->str);
+    SL(hash_table_it_next(&it, &b));
+  }
+  SL(hash_table_clear(sys->htbl));
+}
+
+static void
+del_all_variables(struct cmdsys* sys)
+{
+  struct sl_hash_table_it it;
+  bool b = false;
+  ASSERT(sys && sys->var_tbl);
 
-    ASSERT(is_list_empty(list) == false);
+  SL(hash_table_begin(sys->var_tbl, &it, &b));
+  while(!b) {
+    MEM_FREE(sys->allocator, (char*)((struct var_key*)it.pair.key)->name);
+    MEM_FREE(sys->allocator, ((struct var*)it.pair.data)->value);
+    SL(hash_table_it_next(&it, &b));
+  }
+}
 
-    LIST_FOR_EACH_SAFE(pos, tmp, list) {
-      struct cmd* cmd = CONTAINER_OF(pos, struct cmd, node);
-      list_del(pos);
+static void release_macro(struct ref* ref);
+static enum cmdsys_error format_errors(struct cmdsys* sys);
 
-      if(cmd->description)
-        SL(free_string(cmd->description));
-      for(i = 0; i < cmd->argc; ++i) {
-        MEM_FREE(sys->allocator, cmd->argv[i]);
-      }
-      MEM_FREE(sys->allocator, cmd->argv);
-      MEM_FREE(sys->allocator, cmd->arg_domain);
-      arg_freetable(cmd->arg_table, cmd->argc + 1); /* +1 <=> arg_end. */
-      MEM_FREE(sys->allocator, cmd->arg_table);
-      MEM_FREE(sys->allocator, cmd);
-    }
+static void
+del_all_macros(struct cmdsys* sys)
+{
+  struct sl_hash_table_it it;
+  bool b = false;
+  ASSERT(sys && sys->macro_tbl);
 
-    MEM_FREE(sys->allocator, (*(char**)it.pair.key));
+  SL(hash_table_begin(sys->macro_tbl, &it, &b));
+  while(!b) {
+    MEM_FREE(sys->allocator, *(char**)it.pair.key);
+    ref_put(&(*(struct macro**)it.pair.data)->ref, release_macro);
     SL(hash_table_it_next(&it, &b));
   }
-  SL(hash_table_clear(sys->htbl));
 }
 
 static void
 release_cmdsys(struct ref* ref)
 {
   struct cmdsys* sys = NULL;
+  struct list_node* pos = NULL;
+  struct list_node* tmp = NULL;
   ASSERT(ref != NULL);
 
   sys = CONTAINER_OF(ref, struct cmdsys, ref);
@@ -498,100 +1904,292 @@ release_cmdsys(struct ref* ref)
     del_all_commands(sys);
     SL(free_hash_table(sys->htbl));
   }
+  /* The modules are unloaded once no command references their functions. */
+  LIST_FOR_EACH_SAFE(pos, tmp, &sys->plugin_list) {
+    struct plugin* plugin = CONTAINER_OF(pos, struct plugin, node);
+    list_del(pos);
+    if(plugin->handle)
+      dlclose(plugin->handle);
+    MEM_FREE(sys->allocator, plugin);
+  }
   if(sys->name_set)
     SL(free_flat_set(sys->name_set));
+  if(sys->ns_root)
+    free_ns_node(ALLOCATOR(sys, INDICES), sys->ns_root);
+  if(sys->var_tbl) {
+    del_all_variables(sys);
+    SL(free_hash_table(sys->var_tbl));
+  }
+  if(sys->macro_tbl) {
+    del_all_macros(sys);
+    SL(free_hash_table(sys->macro_tbl));
+  }
   if(sys->stream)
     fclose(sys->stream);
+  if(sys->errlog.text)
+    MEM_FREE(sys->allocator, sys->errlog.text);
+  if(sys->output.buffer)
+    MEM_FREE(sys->allocator, sys->output.buffer);
+  free_value_arena(sys);
+  free_string_pool(sys, &sys->names);
+  free_string_pool(sys, &sys->texts);
 
-  MEM_FREE(sys->allocator, sys);
+  MEM_FREE(sys->mem.parent, sys);
 }
 
-/*******************************************************************************
- *
- * Command functions
- *
- ******************************************************************************/
-enum cmdsys_error
-cmdsys_create(struct mem_allocator* allocator, struct cmdsys** out_sys)
+/* Build the arg table, the arg domains and the argument values of a syntax
+ * whose arg count is set. The syntax is left untouched on error. */
+static enum cmdsys_error
+build_cmd
+  (struct cmdsys* sys,
+   struct cmd* cmd,
+   struct cmd_info* info,
+   const struct cmdarg_desc argv_desc[])
 {
-  struct mem_allocator* alloc = allocator ? allocator : &mem_default_allocator;
-  struct cmdsys* sys = NULL;
+  struct cmdarg* args = NULL;
+  struct cmdarg_cursor* cursors = NULL;
+  size_t ncursors = 0;
+  size_t arg_id = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
-  enum sl_error sl_err = SL_NO_ERROR;
+  ASSERT(sys && cmd && info && cmd->argc && !cmd->arg_table);
+  ASSERT(argv_desc || cmd->argc == 1);
 
-  if(!out_sys) {
-    err = CMDSYS_INVALID_ARGUMENT;
-    goto error;
-  }
+  for(arg_id = 1; arg_id < cmd->argc; ++arg_id)
+    ncursors += argv_desc[arg_id - 1].is_streamed;
 
-  sys = MEM_CALLOC(alloc, 1, sizeof(struct cmdsys));
-  if(!sys) {
+  /* Create the block of the command arg table, argv container and arg
+   * domain. */
+  cmd->arg_table = MEM_CALLOC
+    (ALLOCATOR(sys, DESCRIPTORS), 1,
+       (cmd->argc + 1) * sizeof(void*) /* +1 <=> arg_end */
+     + cmd->argc * sizeof(struct cmdarg*)
+     + cmd->argc * sizeof(union cmdarg_domain));
+  if(NULL == cmd->arg_table) {
     err = CMDSYS_MEMORY_ERROR;
     goto error;
   }
-  sys->allocator = alloc;
-  ref_init(&sys->ref);
+  cmd->argv = (struct cmdarg**)(cmd->arg_table + cmd->argc + 1);
+  cmd->arg_domain = (union cmdarg_domain*)(cmd->argv + cmd->argc);
 
-  sl_err = sl_create_hash_table
-    (sizeof(const char*),
-     ALIGNOF(const char*),
-     sizeof(struct list_node),
-     ALIGNOF(struct list_node),
-     hash_str,
-     eqstr,
-     sys->allocator,
-     &sys->htbl);
-  if(SL_NO_ERROR != sl_err) {
-    err = sl_to_cmdsys_error(sl_err);
+  /* Setup the arg domain and table. */
+  info->arg_table_size = 0;
+  err = init_domain_and_table(cmd, info, argv_desc);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  /* Setup the arguments, followed by the value of the command name, its
+   * undefined terminating value and the cursors of the streamed arguments. */
+  args = MEM_CALLOC(ALLOCATOR(sys, VALUES), 1,
+      cmd->argc * sizeof(struct cmdarg)
+    + 2 * sizeof(struct cmdarg_value)
+    + ncursors * sizeof(struct cmdarg_cursor));
+  if(NULL == args) {
+    err = CMDSYS_MEMORY_ERROR;
     goto error;
   }
-  sl_err = sl_create_flat_set
-    (sizeof(const char*),
-     ALIGNOF(const char*),
-     cmpstr,
-     sys->allocator,
-     &sys->name_set);
-  if(SL_NO_ERROR != sl_err) {
-    err = sl_to_cmdsys_error(sl_err);
-    goto error;
-  }
-  sys->stream = tmpfile();
-  if(!sys->stream) {
-    err = CMDSYS_IO_ERROR;
-    goto error;
+  for(arg_id = 0; arg_id < cmd->argc; ++arg_id)
+    cmd->argv[arg_id] = args + arg_id;
+  cmd->argv[0]->type = CMDARG_STRING;
+  cmd->argv[0]->count = 1;
+  cmd->argv[0]->value_list = (struct cmdarg_value*)(args + cmd->argc);
+  cursors = (struct cmdarg_cursor*)(cmd->argv[0]->value_list + 2);
+  for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+    cmd->argv[arg_id]->type = argv_desc[arg_id - 1].type;
+    if(argv_desc[arg_id - 1].is_streamed) {
+      cmd->argv[arg_id]->cursor = cursors++;
+      cmd->argv[arg_id]->cursor->type = argv_desc[arg_id - 1].type;
+      cmd->argv[arg_id]->cursor->domain = argv_desc[arg_id - 1].domain;
+    }
   }
+  /* One argtable2 object per argument and the arg_end. */
+  mem_account_track
+    (&sys->mem, CMDSYS_MEMORY_ARGTABLE, info->arg_table_size, cmd->argc);
+
 exit:
-  if(out_sys)
-    *out_sys = sys;
   return err;
 error:
-  if(sys) {
-    CMDSYS(ref_put(sys));
-    sys = NULL;
+  if(cmd->arg_table) {
+    arg_freetable(cmd->arg_table, cmd->argc + 1); /* +1 <=> arg_end. */
+    MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), cmd->arg_table);
   }
+  cmd->arg_table = NULL;
+  cmd->argv = NULL;
+  cmd->arg_domain = NULL;
+  info->arg_table_size = 0;
   goto exit;
 }
 
-enum cmdsys_error
-cmdsys_ref_get(struct cmdsys* sys)
+/* Build at most `max_count' lazy syntaxes of `list'. */
+static enum cmdsys_error
+build_cmd_list
+  (struct cmdsys* sys,
+   struct cmd_list* list,
+   const size_t max_count,
+   size_t* out_count) /* May be NULL. */
 {
-  if(!sys)
-    return CMDSYS_INVALID_ARGUMENT;
-  ref_get(&sys->ref);
+  size_t cmd_id = 0;
+  size_t count = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && list);
+
+  for(cmd_id = 0; list->nlazy && count < max_count; ++cmd_id) {
+    ASSERT(cmd_id < list->count);
+    if(list->cmds[cmd_id].arg_table)
+      continue;
+    err = build_cmd
+      (sys, list->cmds + cmd_id, list->infos + cmd_id,
+       list->infos[cmd_id].argv_desc);
+    if(err != CMDSYS_NO_ERROR)
+      break;
+    --list->nlazy;
+    --sys->nlazy;
+    ++count;
+  }
+  if(out_count)
+    *out_count = count;
+  return err;
+}
+
+/* Function of a plugin syntax whose module is not loaded yet. The stub is
+ * replaced before the syntax is invoked; see bind_stub. A stub that is still
+ * bound is not called but reported as a failure; see call_command. */
+static void
+plugin_stub
+  (struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+  ASSERT(false);
+}
+
+static enum cmdsys_error
+load_plugin(struct plugin* plugin)
+{
+  void* sym = NULL;
+  ASSERT(plugin && !plugin->handle);
+
+  plugin->handle = dlopen(plugin->path, RTLD_NOW | RTLD_LOCAL);
+  if(!plugin->handle)
+    return CMDSYS_IO_ERROR;
+  sym = dlsym(plugin->handle, CMDSYS_PLUGIN_RESOLVE);
+  if(!sym) {
+    dlclose(plugin->handle);
+    plugin->handle = NULL;
+    return CMDSYS_IO_ERROR;
+  }
+  /* ISO C does not define the conversion of a data pointer into a function
+   * pointer while POSIX requires it for the dlsym result. */
+  memcpy(&plugin->resolve, &sym, sizeof(sym));
   return CMDSYS_NO_ERROR;
 }
 
-enum cmdsys_error
-cmdsys_ref_put(struct cmdsys* sys)
+/* Bind in place a plugin syntax to the functions of its module, loaded on
+ * first use. Nothing is done if the syntax is not a stub. */
+static enum cmdsys_error
+bind_stub(struct cmd* cmd, struct cmd_info* info)
 {
-  if(!sys)
+  struct cmdsys_binding binding = { NULL, NULL, NULL };
+  const struct plugin_stub* stub = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(cmd && info);
+
+  if(cmd->func != plugin_stub)
+    return CMDSYS_NO_ERROR;
+  stub = cmd->data;
+  if(!stub->plugin->handle) {
+    err = load_plugin(stub->plugin);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+  }
+  err = stub->plugin->resolve
+    (stub->name, stub->syntax_id, &binding, stub->plugin->data);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  if(!binding.func)
     return CMDSYS_INVALID_ARGUMENT;
-  ref_put(&sys->ref, release_cmdsys);
+  cmd->func = binding.func;
+  cmd->data = binding.data;
+  info->completion = binding.arg_completion;
   return CMDSYS_NO_ERROR;
 }
 
-enum cmdsys_error
-cmdsys_add_command
+/* Build the lazy syntaxes of `list' and bind its plugin syntaxes. Used by the
+ * manual and the completion, which need every syntax. */
+static enum cmdsys_error
+load_cmd_list(struct cmdsys* sys, struct cmd_list* list)
+{
+  size_t cmd_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && list);
+
+  err = build_cmd_list(sys, list, SIZE_MAX, NULL);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  for(cmd_id = 0; cmd_id < list->count; ++cmd_id) {
+    err = bind_stub(list->cmds + cmd_id, list->infos + cmd_id);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+/* Release the texts of `argc' descriptors interned by intern_argv_desc. */
+static void
+release_argv_desc
+  (struct cmdsys* sys,
+   const struct cmdarg_desc interned[],
+   const size_t argc)
+{
+  size_t i = 0;
+  ASSERT(sys && interned);
+
+  for(i = 0; i < argc; ++i) {
+    string_pool_release(sys, &sys->texts, interned[i].short_options);
+    string_pool_release(sys, &sys->texts, interned[i].long_options);
+    string_pool_release(sys, &sys->texts, interned[i].data_type);
+    string_pool_release(sys, &sys->texts, interned[i].glossary);
+  }
+}
+
+/* Copy in `interned' the `argc' first descriptors of `argv_desc' with their
+ * texts interned, since argtable2 references rather than copies them. On
+ * failure the texts interned so far are released. */
+static enum cmdsys_error
+intern_argv_desc
+  (struct cmdsys* sys,
+   const struct cmdarg_desc argv_desc[],
+   const size_t argc,
+   struct cmdarg_desc interned[])
+{
+  size_t i = 0;
+  ASSERT(sys && argv_desc && interned);
+
+  #define INTERN(field)                                                        \
+    if(argv_desc[i].field) {                                                   \
+      interned[i].field = string_pool_intern(sys, &sys->texts,                 \
+        argv_desc[i].field);                                                   \
+      if(!interned[i].field) {                                                 \
+        release_argv_desc(sys, interned, i + 1);                               \
+        return CMDSYS_MEMORY_ERROR;                                            \
+      }                                                                        \
+    } (void)0
+  for(i = 0; i < argc; ++i) {
+    interned[i] = argv_desc[i];
+    interned[i].short_options = NULL;
+    interned[i].long_options = NULL;
+    interned[i].data_type = NULL;
+    interned[i].glossary = NULL;
+    INTERN(short_options);
+    INTERN(long_options);
+    INTERN(data_type);
+    INTERN(glossary);
+  }
+  #undef INTERN
+  interned[argc] = CMDARG_END;
+  return CMDSYS_NO_ERROR;
+}
+
+static enum cmdsys_error
+add_syntax
   (struct cmdsys* sys,
    const char* name,
    void (*func)(struct cmdsys*, size_t, const struct cmdarg**, void*),
@@ -599,534 +2197,3873 @@ cmdsys_add_command
    void (*completion)
     (struct cmdsys*, const char*, size_t, size_t*, const char**[]),
    const struct cmdarg_desc argv_desc[],
-   const char* description)
+   const char* description,
+   const struct cmdsys_schema_syntax* schema,
+   const bool is_lazy)
 {
-  struct cmd* cmd = NULL;
+  struct cmd cmd;
+  struct cmd_info info;
+  struct cmdarg_desc* interned = NULL;
   size_t argc = 0;
-  size_t buffer_len = 0;
-  size_t arg_id = 0;
-  size_t desc_id = 0;
-  size_t i = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
-  enum sl_error sl_err = SL_NO_ERROR;
+
+  memset(&cmd, 0, sizeof(cmd));
+  memset(&info, 0, sizeof(info));
 
   if(!sys || !name || !func) {
     err = CMDSYS_INVALID_ARGUMENT;
     goto error;
   }
-
-  cmd = MEM_CALLOC(sys->allocator, 1, sizeof(struct cmd));
-  if(NULL == cmd) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
-  }
-  list_init(&cmd->node);
-  cmd->func = func;
-  cmd->data = data;
+  cmd.func = func;
+  cmd.data = data;
 
   /* Check arg desc list */
   if(argv_desc != NULL) {
     for(argc = 0; !IS_END_REACHED(argv_desc[argc]); ++argc) {
       if(argv_desc[argc].min_count > argv_desc[argc].max_count
       || argv_desc[argc].max_count == 0
-      || argv_desc[argc].type == CMDARG_TYPES_COUNT) {
+      || argv_desc[argc].type == CMDARG_TYPES_COUNT
+      || (argv_desc[argc].is_streamed
+        && argv_desc[argc].type == CMDARG_LITERAL)) {
         err = CMDSYS_INVALID_ARGUMENT;
         goto error;
       }
-      buffer_len += (size_t)argv_desc[argc].max_count;
     }
   }
   ++argc; /* +1 <=> command name. */
+  cmd.argc = argc;
 
-  /* Create the command arg table, arg domain,  and argv container. */
-  cmd->arg_table = MEM_CALLOC
-    (sys->allocator, argc + 1 /* +1 <=> arg_end */, sizeof(void*));
-  if(NULL == cmd->arg_table) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
-  }
-  cmd->arg_domain = MEM_CALLOC
-    (sys->allocator, argc, sizeof(union cmdarg_domain));
-  if(NULL == cmd->arg_domain) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
-  }
-  cmd->argv = MEM_CALLOC(sys->allocator, argc, sizeof(struct cmdarg*));
-  if(NULL == cmd->argv) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
-  }
-
-  /* Setup the arg domain and table. */
-  err = init_domain_and_table(cmd, argv_desc);
-  if(err != CMDSYS_NO_ERROR)
-    goto error;
-
-  /* Setup the command name arg. */
-  cmd->argv[0] = MEM_CALLOC
-    (sys->allocator, 1, sizeof(struct cmdarg) + sizeof(struct cmdarg_value));
-  if(NULL == cmd->argv[0]) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
-  }
-  cmd->argv[0]->type = CMDARG_STRING;
-  cmd->argv[0]->count = 1;
-
-  /* Setup the remaining args. */
-  for(arg_id = 1, desc_id = 0; arg_id < argc; ++arg_id, ++desc_id) {
-    cmd->argv[arg_id] = MEM_CALLOC
-      (sys->allocator, 1,
-       sizeof(struct cmdarg)
-       + (size_t)argv_desc[desc_id].max_count * sizeof(struct cmdarg_value));
-    if(NULL == cmd->argv[arg_id]) {
-      err = CMDSYS_MEMORY_ERROR;
+  /* The tables of a lazy syntax are built on its first use. */
+  if(is_lazy) {
+    info.argv_desc = argc > 1 ? argv_desc : NULL;
+  } else {
+    if(argc > 1) {
+      interned = MEM_ALLOC(sys->allocator, argc * sizeof(struct cmdarg_desc));
+      if(NULL == interned) {
+        err = CMDSYS_MEMORY_ERROR;
+        goto error;
+      }
+      err = intern_argv_desc(sys, argv_desc, argc - 1, interned);
+      if(err != CMDSYS_NO_ERROR) {
+        MEM_FREE(sys->allocator, interned);
+        interned = NULL;
+        goto error;
+      }
+    }
+    err = build_cmd(sys, &cmd, &info, interned);
+    if(err != CMDSYS_NO_ERROR) {
+      if(interned)
+        release_argv_desc(sys, interned, argc - 1);
       goto error;
     }
-    cmd->argv[arg_id]->type = argv_desc[desc_id].type;
-    cmd->argv[arg_id]->count = (size_t)argv_desc[desc_id].max_count;
+    /* From now on the arg table owns the interned texts. */
+    info.is_interned = true;
   }
-  cmd->argc = argc;
 
   /* Setup the command description. */
-  if(NULL == description) {
-    cmd->description = NULL;
+  info.schema = schema;
+  if(is_lazy || NULL == description) {
+    info.description = description;
   } else {
-    sl_err = sl_create_string(description, sys->allocator, &cmd->description);
-    if(sl_err != SL_NO_ERROR) {
-      err = sl_to_cmdsys_error(sl_err);
+    info.description = string_pool_intern(sys, &sys->texts, description);
+    if(NULL == info.description) {
+      err = CMDSYS_MEMORY_ERROR;
       goto error;
     }
   }
-  cmd->completion = completion;
+  info.completion = completion;
+
+  /* The pending errors are formatted against the current syntaxes. On failure
+   * their message is reduced to a generic one. */
+  (void)format_errors(sys);
 
   /* Register the command against the command system. */
-  err = register_command(sys, cmd, name);
+  err = register_command(sys, &cmd, &info, name_key(name));
   if(err != CMDSYS_NO_ERROR)
     goto error;
+  ++sys->version;
 
 exit:
+  if(interned)
+    MEM_FREE(sys->allocator, interned);
   return err;
 error:
   /* The command registration is the last action, i.e. the command is
    * registered only if no error occurs. It is thus useless to handle command
    * registration in the error management. */
-  if(cmd) {
-    if(cmd->description)
-      SL(free_string(cmd->description));
-    if(cmd->arg_table) {
-      for(i = 0; i < argc + 1 /* +1 <=> arg_end */ ; ++i) {
-        if(cmd->arg_table[i])
-          free(cmd->arg_table[i]);
-      }
-      MEM_FREE(sys->allocator, cmd->arg_table);
-    }
-    if(cmd->argv) {
-      for(i = 0; i < argc; ++i) {
-        if(cmd->argv[i])
-          free(cmd->argv[i]);
-      }
-      MEM_FREE(sys->allocator, cmd->argv);
-    }
-    MEM_FREE(sys->allocator, cmd);
-    cmd = NULL;
-  }
+  if(sys)
+    free_cmd(sys, &cmd, &info);
   goto exit;
 }
 
-enum cmdsys_error
-cmdsys_del_command(struct cmdsys* sys, const char* name)
+/*******************************************************************************
+ *
+ * Image functions.
+ *
+ ******************************************************************************/
+struct image_writer {
+  char* buffer;
+  uint64_t string_id; /* Offset toward the next free byte of the string pool. */
+  uint64_t list_id; /* Offset toward the next free value list entry. */
+};
+
+static FINLINE size_t
+image_string_size(const char* str)
 {
-  struct sl_pair pair;
-  struct list_node* list = NULL;
-  struct list_node* pos = NULL;
-  struct list_node* tmp = NULL;
-  char* cmd_name = NULL;
-  size_t i = 0;
-  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  return str ? strlen(str) + 1 : 0;
+}
 
-  if(!sys || !name) {
-    err = CMDSYS_INVALID_ARGUMENT;
-    goto error;
-  }
+static uint64_t
+image_push_string(struct image_writer* writer, const char* str)
+{
+  uint64_t offset = IMAGE_NIL;
+  ASSERT(writer);
 
-  /* Unregister the command. */
-  SL(hash_table_find_pair(sys->htbl, &name, &pair));
-  if(!SL_IS_PAIR_VALID(&pair)) {
-    err = CMDSYS_INVALID_ARGUMENT;
-    goto error;
+  if(str) {
+    const size_t len = strlen(str) + 1;
+    offset = writer->string_id;
+    memcpy(writer->buffer + offset, str, len);
+    writer->string_id += len;
   }
+  return offset;
+}
 
-  /* Free the command syntaxes. */
-  list = (struct list_node*)pair.data;
-  LIST_FOR_EACH_SAFE(pos, tmp, list) {
-    struct cmd* cmd = CONTAINER_OF(pos, struct cmd, node);
-    list_del(pos);
+static void
+image_push_list_entry(struct image_writer* writer, const uint64_t entry)
+{
+  ASSERT(writer);
+  memcpy(writer->buffer + writer->list_id, &entry, sizeof(uint64_t));
+  writer->list_id += sizeof(uint64_t);
+}
 
-    if(cmd->description)
-      SL(free_string(cmd->description));
-    for(i = 0; i < cmd->argc; ++i) {
-      MEM_FREE(sys->allocator, cmd->argv[i]);
-    }
-    MEM_FREE(sys->allocator, cmd->argv);
-    MEM_FREE(sys->allocator, cmd->arg_domain);
-    arg_freetable(cmd->arg_table, cmd->argc + 1); /* +1 <=> arg_end. */
-    MEM_FREE(sys->allocator, cmd->arg_table);
-    MEM_FREE(sys->allocator, cmd);
-  }
+/* Rebuild the descriptor of the arg_id^th argument of a command syntax. */
+static void
+get_arg_desc(struct cmd* cmd, const size_t arg_id, struct cmdarg_desc* desc)
+{
+  const struct arg_hdr* hdr = NULL;
+  ASSERT(cmd && arg_id > 0 && arg_id < cmd->argc && desc);
 
-  /* Free the command name. */
-  cmd_name = *(char**)pair.key;
-  SL(flat_set_erase(sys->name_set, &cmd_name, NULL));
-  SL(hash_table_erase(sys->htbl, &cmd_name, &i));
-  ASSERT(1 == i);
-  MEM_FREE(sys->allocator, cmd_name);
+  hdr = (const struct arg_hdr*)cmd->arg_table[arg_id - 1]; /* -1 <=> name. */
+  desc->type = cmd->argv[arg_id]->type;
+  desc->short_options = hdr->shortopts;
+  desc->long_options = hdr->longopts;
+  desc->data_type = hdr->datatype;
+  desc->glossary = hdr->glossary;
+  desc->min_count = (unsigned int)hdr->mincount;
+  desc->max_count = (unsigned int)hdr->maxcount;
+  desc->domain = cmd->arg_domain[arg_id];
+  desc->is_streamed = cmd->argv[arg_id]->cursor != NULL;
+}
 
-exit:
-  return err;
-error:
-  goto exit;
+static FINLINE bool
+is_image_string_valid(const struct image_header* header, const uint64_t str)
+{
+  ASSERT(header);
+  return str >= header->strings && str < header->size;
 }
 
-enum cmdsys_error
-cmdsys_has_command(struct cmdsys* sys, const char* name, bool* has_command)
+static bool
+is_image_list_valid(const char* buffer, const uint64_t list)
 {
-  void* ptr = NULL;
-  if(!sys || !name || !has_command)
-    return CMDSYS_INVALID_ARGUMENT;
-  SL(hash_table_find(sys->htbl, &name, &ptr));
-  *has_command = (ptr != NULL);
-  return CMDSYS_NO_ERROR;
+  const struct image_header* header = (const struct image_header*)buffer;
+  uint64_t entry = 0;
+  uint64_t offset = 0;
+  ASSERT(buffer);
+
+  if(list < header->lists || (list % sizeof(uint64_t)) != 0)
+    return false;
+  for(offset = list; offset < header->strings; offset += sizeof(uint64_t)) {
+    memcpy(&entry, buffer + offset, sizeof(uint64_t));
+    if(entry == IMAGE_NIL)
+      return true;
+    if(!is_image_string_valid(header, entry))
+      return false;
+  }
+  return false; /* Missing list terminator. */
 }
 
-enum cmdsys_error
-cmdsys_execute_command
-  (struct cmdsys* sys,
-   const char* command,
-   const char* inverse)
+/* Hash of the probe string saved into the images. */
+static FINLINE uint64_t
+image_hash_probe(void)
 {
-  (void)inverse;
+  return (uint64_t)sl_hash(IMAGE_MAGIC, sizeof(IMAGE_MAGIC) - 1);
+}
 
-  #define MAX_ARG_COUNT 128
-  char* argv[MAX_ARG_COUNT];
-  struct list_node* command_list = NULL;
-  struct list_node* node = NULL;
-  struct cmd* valid_cmd = NULL;
-  char* name = NULL;
-  char* ptr = NULL;
-  int argc = 0;
-  enum cmdsys_error err = CMDSYS_NO_ERROR;
-  int min_nerror = 0;
+static bool
+is_image_valid(const char* buffer, const size_t size)
+{
+  const struct image_header* header = (const struct image_header*)buffer;
+  const struct image_name* names = NULL;
+  const struct image_syntax* syntaxes = NULL;
+  const struct image_arg* args = NULL;
+  uint64_t nsyntaxes = 0;
+  size_t i = 0;
+  ASSERT(buffer);
 
-  if(!sys || !command) {
-    err = CMDSYS_INVALID_ARGUMENT;
-    goto error;
-  }
-  if(strlen(command) + 1 > sizeof(sys->scratch) / sizeof(char)) {
-    err = CMDSYS_MEMORY_ERROR;
-    goto error;
+  if(size < sizeof(struct image_header)
+  || memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0
+  || header->version != IMAGE_VERSION
+  || header->byte_order != IMAGE_BYTE_ORDER
+  || header->size != size
+  || header->names != sizeof(struct image_header)
+  || header->syntaxes != header->names
+      + (uint64_t)header->nnames * sizeof(struct image_name)
+  || header->args != header->syntaxes
+      + (uint64_t)header->nsyntaxes * sizeof(struct image_syntax)
+  || header->lists != header->args
+      + (uint64_t)header->nargs * sizeof(struct image_arg)
+  || header->strings < header->lists
+  || header->strings > header->size
+  || ((header->strings - header->lists) % sizeof(uint64_t)) != 0
+  || (header->strings < header->size && buffer[size - 1] != '\0'))
+    return false;
+
+  /* The names are sorted and their syntaxes are contiguous. */
+  names = (const struct image_name*)(buffer + header->names);
+  for(i = 0; i < header->nnames; ++i) {
+    if(!is_image_string_valid(header, names[i].name)
+    || names[i].nsyntaxes == 0
+    || names[i].first_syntax != nsyntaxes)
+      return false;
+    if(i > 0 && strcmp(buffer + names[i-1].name, buffer + names[i].name) >= 0)
+      return false;
+    nsyntaxes += names[i].nsyntaxes;
   }
-  /* Copy the command into the mutable scratch buffer of the command system. */
-  strcpy(sys->scratch, command);
+  if(nsyntaxes != header->nsyntaxes)
+    return false;
 
-  /* Retrieve the first token <=> command name. */
-  name = strtok(sys->scratch, " \t");
-  SL(hash_table_find(sys->htbl, &name, (void**)&command_list));
-  if(!command_list) {
-    errbuf_print(&sys->errbuf, "%s: command not found\n", name);
-    err = CMDSYS_COMMAND_ERROR;
-    goto error;
+  syntaxes = (const struct image_syntax*)(buffer + header->syntaxes);
+  args = (const struct image_arg*)(buffer + header->args);
+  for(i = 0; i < header->nsyntaxes; ++i) {
+    if((syntaxes[i].description != IMAGE_NIL
+      && !is_image_string_valid(header, syntaxes[i].description))
+    || (uint64_t)syntaxes[i].first_arg + syntaxes[i].argc > header->nargs)
+      return false;
   }
-  argv[0] = name;
-  for(argc = 1; NULL != (ptr = strtok(NULL, " \t")); ++argc) {
-    if(argc >= MAX_ARG_COUNT) {
-      err = CMDSYS_MEMORY_ERROR;
-      goto error;
-    }
-    argv[argc] = ptr;
+  for(i = 0; i < header->nargs; ++i) {
+    if(args[i].type >= CMDARG_TYPES_COUNT
+    || (args[i].flags & ~IMAGE_ARG_STREAMED)
+    || ((args[i].flags & IMAGE_ARG_STREAMED)
+      && args[i].type == CMDARG_LITERAL)
+    || args[i].max_count == 0
+    || args[i].min_count > args[i].max_count
+    || (args[i].short_options != IMAGE_NIL
+      && !is_image_string_valid(header, args[i].short_options))
+    || (args[i].long_options != IMAGE_NIL
+      && !is_image_string_valid(header, args[i].long_options))
+    || (args[i].data_type != IMAGE_NIL
+      && !is_image_string_valid(header, args[i].data_type))
+    || (args[i].glossary != IMAGE_NIL
+      && !is_image_string_valid(header, args[i].glossary)))
+      return false;
+    if(args[i].type == CMDARG_STRING
+    && args[i].domain.value_list != IMAGE_NIL
+    && !is_image_list_valid(buffer, args[i].domain.value_list))
+      return false;
   }
+  return true;
+}
 
-  min_nerror = INT_MAX;
-  LIST_FOR_EACH(node, command_list) {
-    struct cmd* cmd = CONTAINER_OF(node, struct cmd, node);
-    int nerror = 0;
+/* Transform in place the value list offsets in pointers. Since a pointer is
+ * never larger than an offset, each entry is read before being overwritten. */
+static void
+relocate_image_lists(char* buffer)
+{
+  const struct image_header* header = (const struct image_header*)buffer;
+  const size_t nentries =
+    (size_t)(header->strings - header->lists) / sizeof(uint64_t);
+  size_t i = 0;
+  ASSERT(buffer);
 
-    ASSERT(cmd->argc > 0);
-    nerror = arg_parse(argc, argv, cmd->arg_table);
+  for(i = 0; i < nentries; ++i) {
+    const char* str = NULL;
+    uint64_t entry = 0;
 
-    if(nerror <= min_nerror) {
-      if(nerror < min_nerror) {
-        min_nerror = nerror;
-        rewind(sys->stream);
-      }
-      fprintf(sys->stream, "\n%s", name);
-      arg_print_syntaxv(sys->stream, cmd->arg_table, "\n");
-      arg_print_errors
-        (sys->stream, (struct arg_end*)cmd->arg_table[cmd->argc - 1], name);
-    }
-    if(nerror == 0) {
-      valid_cmd = cmd;
-      break;
-    }
+    memcpy
+      (&entry, buffer + header->lists + i * sizeof(uint64_t), sizeof(entry));
+    str = entry == IMAGE_NIL ? NULL : buffer + entry;
+    memcpy(buffer + header->lists + i * sizeof(const char*), &str, sizeof(str));
   }
+}
 
-  if(min_nerror != 0) {
-    long fpos = 0;
-    size_t size =0;
-    size_t nb = 0;
-    (void)nb;
+static const char*
+image_string(const char* buffer, const uint64_t str)
+{
+  ASSERT(buffer);
+  return str == IMAGE_NIL ? NULL : buffer + str;
+}
 
-    fpos = ftell(sys->stream);
-    size = MIN((size_t)fpos, sizeof(sys->scratch)/sizeof(char) - 1);
-    rewind(sys->stream);
-    nb = fread(sys->scratch, size, 1, sys->stream);
-    ASSERT(nb == 1);
-    sys->scratch[size] = '\0';
-    errbuf_print(&sys->errbuf, "%s", sys->scratch);
-    err = CMDSYS_COMMAND_ERROR;
-    goto error;
-  }
+static void
+image_arg_desc
+  (const char* buffer,
+   const struct image_arg* arg,
+   struct cmdarg_desc* desc)
+{
+  const struct image_header* header = (const struct image_header*)buffer;
+  ASSERT(buffer && arg && desc);
 
-  /* Setup the args and invoke the commands. */
-  err = setup_cmd_arg(sys, valid_cmd, name);
-  if(err != CMDSYS_NO_ERROR)
-    goto error;
+  desc->type = (enum cmdarg_type)arg->type;
+  desc->short_options = image_string(buffer, arg->short_options);
+  desc->long_options = image_string(buffer, arg->long_options);
+  desc->data_type = image_string(buffer, arg->data_type);
+  desc->glossary = image_string(buffer, arg->glossary);
+  desc->min_count = arg->min_count;
+  desc->max_count = arg->max_count;
+  desc->is_streamed = (arg->flags & IMAGE_ARG_STREAMED) != 0;
+  switch(desc->type) {
+    case CMDARG_INT:
+      desc->domain.integer.min = arg->domain.integer.min;
+      desc->domain.integer.max = arg->domain.integer.max;
+      break;
+    case CMDARG_FLOAT:
+      desc->domain.real.min = arg->domain.real.min;
+      desc->domain.real.max = arg->domain.real.max;
+      break;
+    default:
+      if(desc->type != CMDARG_STRING || arg->domain.value_list == IMAGE_NIL) {
+        desc->domain.string.value_list = NULL;
+      } else {
+        const size_t id =
+          (size_t)(arg->domain.value_list - header->lists) / sizeof(uint64_t);
+        desc->domain.string.value_list =
+          (const char**)(void*)(buffer + header->lists) + id;
+      }
+      break;
+  }
+}
 
-  valid_cmd->func
-    (sys,
-     valid_cmd->argc,
-     (const struct cmdarg**)valid_cmd->argv,
-     valid_cmd->data);
+/*******************************************************************************
+ *
+ * Command functions
+ *
+ ******************************************************************************/
+enum cmdsys_error
+cmdsys_create(struct mem_allocator* allocator, struct cmdsys** out_sys)
+{
+  struct mem_allocator* alloc = allocator ? allocator : &mem_default_allocator;
+  struct cmdsys* sys = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  enum sl_error sl_err = SL_NO_ERROR;
+
+  if(!out_sys) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  sys = MEM_CALLOC(alloc, 1, sizeof(struct cmdsys));
+  if(!sys) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  mem_account_init(&sys->mem, alloc);
+  mem_account_track(&sys->mem, CMDSYS_MEMORY_OTHERS, sizeof(struct cmdsys), 1);
+  sys->allocator = ALLOCATOR(sys, OTHERS);
+  sys->output.config.max_size = SIZE_MAX;
+  list_init(&sys->plugin_list);
+  string_pool_init(&sys->names, CMDSYS_MEMORY_NAMES);
+  string_pool_init(&sys->texts, CMDSYS_MEMORY_DESCRIPTIONS);
+  ref_init(&sys->ref);
+
+  sl_err = sl_create_hash_table
+    (sizeof(struct name_key),
+     ALIGNOF(struct name_key),
+     sizeof(struct cmd_list),
+     ALIGNOF(struct cmd_list),
+     hash_name,
+     eqname,
+     ALLOCATOR(sys, INDICES),
+     &sys->htbl);
+  if(SL_NO_ERROR != sl_err) {
+    err = sl_to_cmdsys_error(sl_err);
+    goto error;
+  }
+  sl_err = sl_create_flat_set
+    (sizeof(const char*),
+     ALIGNOF(const char*),
+     cmpstr,
+     ALLOCATOR(sys, INDICES),
+     &sys->name_set);
+  if(SL_NO_ERROR != sl_err) {
+    err = sl_to_cmdsys_error(sl_err);
+    goto error;
+  }
+  sl_err = sl_create_hash_table
+    (sizeof(struct var_key),
+     ALIGNOF(struct var_key),
+     sizeof(struct var),
+     ALIGNOF(struct var),
+     hash_var,
+     eqvar,
+     sys->allocator,
+     &sys->var_tbl);
+  if(SL_NO_ERROR != sl_err) {
+    err = sl_to_cmdsys_error(sl_err);
+    goto error;
+  }
+  sl_err = sl_create_hash_table
+    (sizeof(char*),
+     ALIGNOF(char*),
+     sizeof(struct macro*),
+     ALIGNOF(struct macro*),
+     hash_str,
+     eqstr,
+     sys->allocator,
+     &sys->macro_tbl);
+  if(SL_NO_ERROR != sl_err) {
+    err = sl_to_cmdsys_error(sl_err);
+    goto error;
+  }
+  sys->ns_root = create_ns_node(ALLOCATOR(sys, INDICES), NULL, 0);
+  if(!sys->ns_root) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  sys->stream = tmpfile();
+  if(!sys->stream) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+exit:
+  if(out_sys)
+    *out_sys = sys;
+  return err;
+error:
+  if(sys) {
+    CMDSYS(ref_put(sys));
+    sys = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_ref_get(struct cmdsys* sys)
+{
+  if(!sys)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&sys->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_ref_put(struct cmdsys* sys)
+{
+  if(!sys)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&sys->ref, release_cmdsys);
+  return CMDSYS_NO_ERROR;
+}
+
+
+enum cmdsys_error
+cmdsys_add_command
+  (struct cmdsys* sys,
+   const char* name,
+   void (*func)(struct cmdsys*, size_t, const struct cmdarg**, void*),
+   void* data,
+   void (*completion)
+    (struct cmdsys*, const char*, size_t, size_t*, const char**[]),
+   const struct cmdarg_desc argv_desc[],
+   const char* description)
+{
+  return add_syntax
+    (sys, name, func, data, completion, argv_desc, description, NULL, false);
+}
+
+enum cmdsys_error
+cmdsys_add_lazy_command
+  (struct cmdsys* sys,
+   const char* name,
+   void (*func)(struct cmdsys*, size_t, const struct cmdarg**, void*),
+   void* data,
+   void (*completion)
+    (struct cmdsys*, const char*, size_t, size_t*, const char**[]),
+   const struct cmdarg_desc argv_desc[],
+   const char* description)
+{
+  return add_syntax
+    (sys, name, func, data, completion, argv_desc, description, NULL, true);
+}
+
+enum cmdsys_error
+cmdsys_prewarm(struct cmdsys* sys, const size_t max_count, size_t* out_count)
+{
+  const char** name_list = NULL;
+  size_t nnames = 0;
+  size_t count = 0;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  /* Walk the names from the one where the previous pre-warm stopped. */
+  SL(flat_set_buffer(sys->name_set, &nnames, NULL, NULL, (void**)&name_list));
+  for(i = 0; i < nnames && sys->nlazy && count < max_count; ++i) {
+    const size_t name_id = (sys->prewarm_id + i) % nnames;
+    struct cmd_list* list = NULL;
+    size_t n = 0;
+
+    list = find_cmd_list(sys, interned_name_key(name_list[name_id]));
+    ASSERT(list != NULL);
+    err = build_cmd_list(sys, list, max_count - count, &n);
+    count += n;
+    sys->prewarm_id = name_id;
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+  }
+
+exit:
+  if(out_count)
+    *out_count = count;
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_del_command(struct cmdsys* sys, const char* name)
+{
+  struct sl_pair pair;
+  struct name_key key;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !name) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* Unregister the command. */
+  key = name_key(name);
+  SL(hash_table_find_pair(sys->htbl, &key, &pair));
+  if(!SL_IS_PAIR_VALID(&pair)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* Free the command syntaxes. */
+  (void)format_errors(sys); /* See add_syntax. */
+  free_cmd_list(sys, (struct cmd_list*)pair.data);
+
+  /* Unregister and release the command name. */
+  key = *(const struct name_key*)pair.key;
+  ns_erase(sys, key.str, SIZE_MAX);
+  SL(flat_set_erase(sys->name_set, &key.str, NULL));
+  SL(hash_table_erase(sys->htbl, &key, &i));
+  ASSERT(1 == i);
+  string_pool_release(sys, &sys->names, key.str);
+  ++sys->version;
+
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_has_command(struct cmdsys* sys, const char* name, bool* has_command)
+{
+  if(!sys || !name || !has_command)
+    return CMDSYS_INVALID_ARGUMENT;
+  *has_command = find_cmd_list(sys, name_key(name)) != NULL;
+  return CMDSYS_NO_ERROR;
+}
+
+#define MAX_ARG_COUNT 128
+#define MAX_MACRO_DEPTH 16
+
+static FINLINE bool
+is_blank(const char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+static FINLINE bool
+is_var_char(const char c, const bool is_first)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+      || (!is_first && c >= '0' && c <= '9');
+}
+
+/* Length of the chaining operator that begins `buf', 0 if none. */
+static FINLINE size_t
+chain_op_len(const char* buf, const size_t len)
+{
+  if(buf[0] == ';')
+    return 1;
+  if(len > 1 && (buf[0] == '&' || buf[0] == '|') && buf[1] == buf[0])
+    return 2;
+  return 0;
+}
+
+/* Parse the $NAME or ${NAME} variable reference that begins `buf'. Return
+ * the number of referencing chars, 0 if `buf' does not begin with a valid
+ * reference. */
+static size_t
+parse_var_ref(const char* buf, const size_t len, struct var_key* key)
+{
+  const size_t first = len > 1 && buf[1] == '{' ? 2 : 1;
+  const bool is_braced = first == 2;
+  size_t i = 0;
+  ASSERT(buf && len && buf[0] == '$' && key);
+
+  key->name = buf + first;
+  for(i = first; i < len && is_var_char(buf[i], i == first); ++i);
+  key->len = i - first;
+  if(!key->len)
+    return 0;
+  if(is_braced) {
+    if(i >= len || buf[i] != '}')
+      return 0;
+    ++i;
+  }
+  return i;
+}
+
+/* Copy the `len' chars of the token `src' into `dst', substituting the
+ * variables that are not between single quotes if `expand' is true. */
+static enum cmdsys_error
+copy_token
+  (struct cmdsys* sys,
+   const char* src,
+   const size_t len,
+   const bool expand,
+   char* dst,
+   const size_t capacity,
+   size_t* out_len)
+{
+  size_t i = 0;
+  size_t n = 0;
+  char quote = '\0';
+  ASSERT(sys && src && dst && out_len);
+
+  for(i = 0; i < len; ) {
+    const char c = src[i];
+    if(expand && c == '$' && quote != '\'') {
+      struct var_key key;
+      const size_t ref_len = parse_var_ref(src + i, len - i, &key);
+      if(ref_len) {
+        struct var* var = NULL;
+        SL(hash_table_find(sys->var_tbl, &key, (void**)&var));
+        if(var) { /* Undefined variables are empty. */
+          if(n + var->len > capacity)
+            return CMDSYS_MEMORY_ERROR;
+          memcpy(dst + n, var->value, var->len);
+          n += var->len;
+        }
+        i += ref_len;
+        continue;
+      }
+    }
+    if(quote) {
+      quote = c == quote ? '\0' : quote;
+    } else if(c == '"' || c == '\'') {
+      quote = c;
+    }
+    if(n + 1 > capacity)
+      return CMDSYS_MEMORY_ERROR;
+    dst[n++] = c;
+    ++i;
+  }
+  *out_len = n;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Split `buf' in blank separated tokens and in segments delimited by the
+ * chaining operators. The tokens are copied as NULL terminated strings into
+ * `scratch'; this is the only copy of the command since argtable requires
+ * NULL terminated arguments. Blanks and operators between quotes do not
+ * split; the quotes are kept in the tokens. If `expand' is true, the
+ * variables are substituted while copying and the tokens that become empty
+ * are removed. */
+static enum cmdsys_error
+tokenize_command
+  (struct cmdsys* sys,
+   const char* buf,
+   const size_t len,
+   const bool expand,
+   char* scratch,
+   const size_t scratch_len,
+   const int max_argc,
+   int* out_argc,
+   char** argv,
+   int* out_nsegments,
+   struct cmd_segment* segments)
+{
+  size_t i = 0;
+  size_t scratch_id = 0;
+  int argc = 0;
+  int nsegments = 1;
+  int seg = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && buf && scratch && max_argc > 0 && out_argc && argv);
+  ASSERT(out_nsegments && segments);
+
+  memset(segments, 0, sizeof(struct cmd_segment));
+  segments[0].op = CHAIN_ALWAYS;
+  for(i = 0; i < len; ) {
+    char quote = '\0';
+    size_t op_len = 0;
+    size_t tok_len = 0;
+    size_t first = 0;
+
+    if(is_blank(buf[i])) {
+      ++i;
+      continue;
+    }
+    op_len = chain_op_len(buf + i, len - i);
+    if(op_len) {
+      if(nsegments > max_argc)
+        return CMDSYS_MEMORY_ERROR;
+      seg = nsegments++;
+      memset(segments + seg, 0, sizeof(struct cmd_segment));
+      segments[seg].op = buf[i] == ';' ? CHAIN_ALWAYS
+        : buf[i] == '&' ? CHAIN_ON_SUCCESS : CHAIN_ON_FAILURE;
+      segments[seg].first_arg = argc;
+      i += op_len;
+      continue;
+    }
+
+    for(first = i; i < len; ++i) {
+      const char c = buf[i];
+      if(quote) {
+        quote = c == quote ? '\0' : quote;
+      } else if(c == '"' || c == '\'') {
+        quote = c;
+      } else if(is_blank(c) || chain_op_len(buf + i, len - i)) {
+        break;
+      }
+    }
+    if(scratch_id >= scratch_len)
+      return CMDSYS_MEMORY_ERROR;
+    err = copy_token
+      (sys, buf + first, i - first, expand, scratch + scratch_id,
+       scratch_len - scratch_id - 1 /* NULL char */, &tok_len);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+    if(!tok_len)
+      continue;
+    if(argc >= max_argc)
+      return CMDSYS_MEMORY_ERROR;
+    argv[argc++] = scratch + scratch_id;
+    ++segments[seg].argc;
+    scratch_id += tok_len;
+    scratch[scratch_id++] = '\0';
+  }
+
+  /* The `&&' and `||' operators require a command on both sides. */
+  for(seg = 0; seg < nsegments; ++seg) {
+    enum chain_op op = segments[seg].op;
+    if(segments[seg].argc)
+      continue;
+    if(op == CHAIN_ALWAYS && seg + 1 < nsegments)
+      op = segments[seg + 1].op;
+    if(op != CHAIN_ALWAYS) {
+      const char* op_str = op == CHAIN_ON_SUCCESS ? "&&" : "||";
+      RECORD_ERROR(sys, CHAIN_SYNTAX, 1, &op_str, op_str, CMDARG_TYPES_COUNT,
+        SIZE_MAX);
+      return CMDSYS_COMMAND_ERROR;
+    }
+  }
+  *out_argc = argc;
+  *out_nsegments = nsegments;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Record the failure of `argv' to match the syntaxes of `command_list'.
+ * `best' is the syntax with the fewest parse errors. */
+static void
+record_syntax_error
+  (struct cmdsys* sys,
+   struct cmd_list* command_list,
+   const size_t best,
+   const int argc,
+   char** argv)
+{
+  struct cmd* cmd = command_list->cmds + best;
+  const struct arg_end* end = cmd->arg_table[cmd->argc - 1];
+  const char* text = NULL;
+  size_t arg_id = cmd->argc;
+  enum cmdarg_type type = CMDARG_TYPES_COUNT;
+  ASSERT(sys && best < command_list->count);
+
+  if(end->count) {
+    text = end->argval[0];
+    for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+      if(cmd->arg_table[arg_id - 1] == end->parent[0]) /* -1 <=> name. */
+        break;
+    }
+  } else {
+    decode_numeric_args(cmd, false, NULL, NULL, &arg_id, &text);
+  }
+  if(arg_id < cmd->argc)
+    type = cmd->argv[arg_id]->type;
+  /* The syntaxes are listed from the last added one. */
+  RECORD_ERROR(sys, INVALID_SYNTAX, argc, argv, text, type,
+    command_list->count - 1 - best);
+}
+
+static FINLINE enum cmdsys_error
+call_command
+  (struct cmdsys* sys,
+   void (*func)(struct cmdsys*, size_t, const struct cmdarg**, void*),
+   const size_t argc,
+   const struct cmdarg** argv,
+   void* data)
+{
+  ASSERT(sys && func && argc && argv);
+  if(func == plugin_stub) { /* The plugin syntax was not bound. */
+    const char* name = argv[0]->value_list[0].data.string;
+    RECORD_ERROR(sys, PLUGIN_NOT_BOUND, 1, &name, NULL, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    return CMDSYS_COMMAND_ERROR;
+  }
+  ++sys->call_depth;
+  func(sys, argc, argv, data);
+  --sys->call_depth;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Reset the output before a command that is not invoked by a command
+ * function, if the output is reset per command. */
+static FINLINE void
+begin_command(struct cmdsys* sys)
+{
+  ASSERT(sys);
+  if(!sys->call_depth && sys->output.config.reset_per_command)
+    CMDSYS(reset_output(sys));
+}
+
+/* Parse `argv' against the syntaxes of `command_list' and setup the arguments
+ * of the first one that matches. See setup_cmd_arg for `unchecked'. The values
+ * are allocated on top of the value arena. */
+static enum cmdsys_error
+select_syntax
+  (struct cmdsys* sys,
+   struct cmd_list* command_list,
+   const int argc,
+   char** argv,
+   const char* const* unchecked,
+   const size_t nunchecked,
+   struct cmd** out_cmd)
+{
+  struct cmd* valid_cmd = NULL;
+  char* name = NULL;
+  const char* invalid_value = NULL;
+  struct value_mark mark;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  size_t cmd_id = 0;
+  size_t best = 0;
+  int min_nerror = 0;
+  ASSERT(sys && command_list && argc > 0 && argv && out_cmd);
+
+  /* The plugin syntaxes are parsed against their manifest descriptors; their
+   * module is only loaded once they are invoked. */
+  err = build_cmd_list(sys, command_list, SIZE_MAX, NULL);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  mark = value_arena_mark(&sys->values);
+
+  name = argv[0];
+  min_nerror = INT_MAX;
+  for(cmd_id = 0; cmd_id < command_list->count; ++cmd_id) {
+    struct cmd* cmd = command_list->cmds + cmd_id;
+    int nerror = 0;
+
+    ASSERT(cmd->argc > 0);
+    if(sys->parse_lock)
+      pthread_mutex_lock(sys->parse_lock);
+    nerror = arg_parse(argc, argv, cmd->arg_table);
+    if(sys->parse_lock)
+      pthread_mutex_unlock(sys->parse_lock);
+    /* Invalid numeric values are parse errors of the syntax. */
+    if(nerror == 0) {
+      value_arena_restore(&sys->values, mark);
+      err = alloc_arg_values(sys, cmd);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      nerror = decode_numeric_args(cmd, true, NULL, NULL, NULL, NULL);
+    }
+
+    if(nerror < min_nerror) {
+      min_nerror = nerror;
+      best = cmd_id;
+    }
+    if(nerror == 0) {
+      valid_cmd = cmd;
+      break;
+    }
+  }
+
+  if(min_nerror != 0) {
+    record_syntax_error(sys, command_list, best, argc, argv);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+
+  err = setup_cmd_arg(valid_cmd, name, unchecked, nunchecked, &invalid_value);
+  if(err != CMDSYS_NO_ERROR) {
+    RECORD_ERROR(sys, INVALID_VALUE, argc, argv, invalid_value, CMDARG_STRING,
+      command_list->count - 1 - (size_t)(valid_cmd - command_list->cmds));
+    goto error;
+  }
+  *out_cmd = valid_cmd;
+
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+/* Parse `argv' against the syntaxes of `command_list' and invoke the first
+ * one that matches. */
+static enum cmdsys_error
+execute_syntaxes
+  (struct cmdsys* sys,
+   struct cmd_list* command_list,
+   const int argc,
+   char** argv)
+{
+  struct cmd* valid_cmd = NULL;
+  struct value_mark mark;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && command_list && argc > 0 && argv);
+
+  /* The values of the commands that invoke a command function are stacked. */
+  if(!sys->call_depth)
+    value_arena_clear(&sys->values);
+  mark = value_arena_mark(&sys->values);
+  err = select_syntax(sys, command_list, argc, argv, NULL, 0, &valid_cmd);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  err = bind_stub
+    (valid_cmd, command_list->infos + (valid_cmd - command_list->cmds));
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  err = call_command
+    (sys,
+     valid_cmd->func,
+     valid_cmd->argc,
+     (const struct cmdarg**)valid_cmd->argv,
+     valid_cmd->data);
+
+exit:
+  value_arena_restore(&sys->values, mark);
+  return err;
+error:
+  goto exit;
+}
+
+static enum cmdsys_error execute_macro(struct cmdsys*, struct macro*);
+
+/* Execute the command or the macro named `argv[0]'. */
+static enum cmdsys_error
+execute_command(struct cmdsys* sys, const int argc, char** argv)
+{
+  struct cmd_list* command_list = NULL;
+  struct macro** macro = NULL;
+  ASSERT(sys && argc > 0 && argv);
+
+  command_list = find_cmd_list(sys, name_key(argv[0]));
+  if(command_list)
+    return execute_syntaxes(sys, command_list, argc, argv);
+
+  SL(hash_table_find(sys->macro_tbl, &argv[0], (void**)&macro));
+  if(macro) {
+    if(argc > 1) {
+      RECORD_ERROR(sys, UNEXPECTED_ARGUMENT, argc, argv, argv[1],
+        CMDARG_TYPES_COUNT, SIZE_MAX);
+      return CMDSYS_COMMAND_ERROR;
+    }
+    return execute_macro(sys, *macro);
+  }
+  RECORD_ERROR(sys, COMMAND_NOT_FOUND, argc, argv, argv[0],
+    CMDARG_TYPES_COUNT, SIZE_MAX);
+  return CMDSYS_COMMAND_ERROR;
+}
+
+/* Execute the segments with the short-circuit semantic of the shell: a
+ * skipped segment keeps the status of the previous one. */
+#define SKIP_SEGMENT(seg, err)                                                 \
+  (  ((seg).op == CHAIN_ON_SUCCESS && (err) != CMDSYS_NO_ERROR)                \
+  || ((seg).op == CHAIN_ON_FAILURE && (err) == CMDSYS_NO_ERROR))
+
+static void
+resolve_macro(struct cmdsys* sys, struct macro* macro)
+{
+  int seg = 0;
+  ASSERT(sys && macro);
+
+  for(seg = 0; seg < macro->nsegments; ++seg) {
+    struct cmd_segment* segment = macro->segments + seg;
+    segment->command_list = NULL;
+    if(segment->argc && !macro->has_variable[segment->first_arg]) {
+      segment->command_list =
+        find_cmd_list(sys, name_key(macro->argv[segment->first_arg]));
+    }
+  }
+  macro->version = sys->version;
+}
+
+static void
+release_macro(struct ref* ref)
+{
+  struct macro* macro = NULL;
+  ASSERT(ref);
+
+  macro = CONTAINER_OF(ref, struct macro, ref);
+  if(macro->tokens)
+    MEM_FREE(macro->allocator, macro->tokens);
+  if(macro->argv)
+    MEM_FREE(macro->allocator, macro->argv);
+  if(macro->has_variable)
+    MEM_FREE(macro->allocator, macro->has_variable);
+  if(macro->segments)
+    MEM_FREE(macro->allocator, macro->segments);
+  MEM_FREE(macro->allocator, macro);
+}
+
+static enum cmdsys_error
+execute_macro(struct cmdsys* sys, struct macro* macro)
+{
+  char scratch[SCRATCH_LEN];
+  char* argv[MAX_ARG_COUNT];
+  int seg = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && macro);
+
+  if(sys->macro_depth >= MAX_MACRO_DEPTH) {
+    RECORD_ERROR(sys, MACRO_DEPTH, 0, NULL, NULL, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    return CMDSYS_COMMAND_ERROR;
+  }
+  ++sys->macro_depth;
+  ref_get(&macro->ref); /* The macro may be undefined by its commands. */
+
+  for(seg = 0; seg < macro->nsegments; ++seg) {
+    const struct cmd_segment* segment = macro->segments + seg;
+    size_t scratch_id = 0;
+    int argc = 0;
+    int i = 0;
+
+    if(SKIP_SEGMENT(*segment, err))
+      continue;
+    /* Expand the tokens that reference variables. */
+    for(i = segment->first_arg; i < segment->first_arg + segment->argc; ++i) {
+      size_t tok_len = 0;
+      if(!macro->has_variable[i]) {
+        argv[argc++] = macro->argv[i];
+        continue;
+      }
+      err = copy_token
+        (sys, macro->argv[i], strlen(macro->argv[i]), true,
+         scratch + scratch_id, sizeof(scratch) - scratch_id - 1, &tok_len);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      if(tok_len) {
+        argv[argc++] = scratch + scratch_id;
+        scratch_id += tok_len;
+        scratch[scratch_id++] = '\0';
+      }
+    }
+    if(!argc)
+      continue;
+
+    /* The commands of the previous segments may have updated the registry. */
+    if(macro->version != sys->version)
+      resolve_macro(sys, macro);
+    if(segment->command_list && argv[0] == macro->argv[segment->first_arg]) {
+      err = execute_syntaxes(sys, segment->command_list, argc, argv);
+    } else {
+      err = execute_command(sys, argc, argv);
+    }
+  }
+
+exit:
+  ref_put(&macro->ref, release_macro);
+  --sys->macro_depth;
+  return err;
+error:
+  goto exit;
+}
+
+/* Clone the syntaxes of `list' into `clone'. The arg tables of the clones are
+ * built from the descriptors of the registered syntaxes, or from the
+ * descriptors of the lazy ones, that are thus left unbuilt; the cold fields of
+ * the syntaxes are shared. */
+static enum cmdsys_error
+clone_cmd_list
+  (struct cmdsys* sys,
+   const struct cmd_list* list,
+   struct cmd_list* clone)
+{
+  struct cmdarg_desc* argv_desc = NULL;
+  size_t cmd_id = 0;
+  size_t arg_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && list && clone);
+
+  memset(clone, 0, sizeof(struct cmd_list));
+  clone->cmds = MEM_CALLOC
+    (ALLOCATOR(sys, DESCRIPTORS), list->count, sizeof(struct cmd));
+  clone->infos = MEM_CALLOC
+    (ALLOCATOR(sys, DESCRIPTORS), list->count, sizeof(struct cmd_info));
+  if(!clone->cmds || !clone->infos) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  clone->capacity = list->count;
+
+  for(cmd_id = 0; cmd_id < list->count; ++cmd_id) {
+    struct cmd* cmd = list->cmds + cmd_id;
+    struct cmd* copy = clone->cmds + cmd_id;
+    const struct cmdarg_desc* desc = NULL;
+
+    copy->argc = cmd->argc;
+    copy->func = cmd->func;
+    copy->data = cmd->data;
+    if(!cmd->arg_table) { /* Lazy syntax. */
+      desc = list->infos[cmd_id].argv_desc;
+    } else if(cmd->argc > 1) {
+      argv_desc = MEM_ALLOC
+        (sys->allocator, cmd->argc * sizeof(struct cmdarg_desc));
+      if(!argv_desc) {
+        err = CMDSYS_MEMORY_ERROR;
+        goto error;
+      }
+      for(arg_id = 1; arg_id < cmd->argc; ++arg_id)
+        get_arg_desc(cmd, arg_id, argv_desc + arg_id - 1);
+      argv_desc[cmd->argc - 1] = CMDARG_END;
+      desc = argv_desc;
+    }
+    err = build_cmd(sys, copy, clone->infos + cmd_id, desc);
+    if(argv_desc) {
+      MEM_FREE(sys->allocator, argv_desc);
+      argv_desc = NULL;
+    }
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    ++clone->count;
+  }
+
+exit:
+  return err;
+error:
+  if(clone->cmds) {
+    free_cmd_list(sys, clone);
+  } else if(clone->infos) {
+    MEM_FREE(ALLOCATOR(sys, DESCRIPTORS), clone->infos);
+  }
+  memset(clone, 0, sizeof(struct cmd_list));
+  goto exit;
+}
+
+/* Worker validating a chunk of a script. Its context only shares with the
+ * command system the tables that the validation reads, i.e. the registered
+ * syntaxes, the variables and the macros; the error log, the value arena, the
+ * token scratch and the arg tables of the syntaxes are private. */
+struct validation_worker {
+  struct cmdsys ctx;
+  const char* chunk;
+  size_t len;
+  size_t first_line;
+  size_t ninvalid;
+  pthread_t thread;
+  bool is_running;
+  enum cmdsys_error err;
+};
+
+static enum cmdsys_error
+init_validation_worker
+  (struct cmdsys* sys,
+   pthread_mutex_t* parse_lock,
+   struct validation_worker* worker)
+{
+  struct cmdsys* ctx = NULL;
+  ASSERT(sys && parse_lock && worker);
+
+  ctx = &worker->ctx;
+  memset(ctx, 0, sizeof(struct cmdsys));
+  mem_account_init(&ctx->mem, sys->mem.parent);
+  ctx->allocator = ALLOCATOR(ctx, OTHERS);
+  ctx->htbl = sys->htbl;
+  ctx->var_tbl = sys->var_tbl;
+  ctx->macro_tbl = sys->macro_tbl;
+  ctx->version = sys->version;
+  ctx->parse_lock = parse_lock;
+  return sl_to_cmdsys_error(sl_create_hash_table
+    (sizeof(struct cmd_list*), ALIGNOF(struct cmd_list*),
+     sizeof(struct cmd_list), ALIGNOF(struct cmd_list),
+     hash_ptr, eqptr, ctx->allocator, &ctx->clones));
+}
+
+static void
+release_validation_worker(struct validation_worker* worker)
+{
+  struct sl_hash_table_it it;
+  bool b = false;
+  ASSERT(worker);
+
+  if(worker->ctx.clones) {
+    SL(hash_table_begin(worker->ctx.clones, &it, &b));
+    while(!b) {
+      free_cmd_list(&worker->ctx, it.pair.data);
+      SL(hash_table_it_next(&it, &b));
+    }
+    SL(free_hash_table(worker->ctx.clones));
+    worker->ctx.clones = NULL;
+  }
+  free_value_arena(&worker->ctx);
+}
+
+/* Retrieve the clone of `list' private to the validation worker context
+ * `sys'. */
+static enum cmdsys_error
+find_clone
+  (struct cmdsys* sys,
+   struct cmd_list* list,
+   struct cmd_list** out_clone)
+{
+  struct cmd_list clone;
+  struct cmd_list* found = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && sys->clones && list && out_clone);
+
+  SL(hash_table_find(sys->clones, &list, (void**)&found));
+  if(!found) {
+    err = clone_cmd_list(sys, list, &clone);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+    err = sl_to_cmdsys_error(sl_hash_table_insert(sys->clones, &list, &clone));
+    if(err != CMDSYS_NO_ERROR) {
+      free_cmd_list(sys, &clone);
+      return err;
+    }
+    SL(hash_table_find(sys->clones, &list, (void**)&found));
+  }
+  *out_clone = found;
+  return CMDSYS_NO_ERROR;
+}
+
+static enum cmdsys_error
+validate_commandn
+  (struct cmdsys* sys,
+   const char* buf,
+   size_t len,
+   struct cmdsys_validation* result)
+{
+  char* argv[MAX_ARG_COUNT];
+  struct cmd_segment segments[MAX_ARG_COUNT + 1];
+  struct cmdsys_validation validation = { SIZE_MAX, 0, NULL };
+  int argc = 0;
+  int nsegments = 0;
+  int seg = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && (buf || !len));
+
+  err = tokenize_command
+    (sys, buf ? buf : "", len, true, sys->validation_tokens,
+     sizeof(sys->validation_tokens), MAX_ARG_COUNT, &argc, argv, &nsegments,
+     segments);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  if(!argc) { /* Empty command. */
+    RECORD_ERROR(sys, COMMAND_NOT_FOUND, 0, NULL, NULL, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+
+  for(seg = 0; seg < nsegments; ++seg) {
+    char** seg_argv = argv + segments[seg].first_arg;
+    const int seg_argc = segments[seg].argc;
+    struct cmd_list* command_list = NULL;
+    struct macro** macro = NULL;
+    struct cmd* cmd = NULL;
+
+    if(!seg_argc)
+      continue;
+    command_list = find_cmd_list(sys, name_key(seg_argv[0]));
+    if(command_list && sys->clones) {
+      err = find_clone(sys, command_list, &command_list);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+    }
+    if(command_list) {
+      if(!sys->call_depth)
+        value_arena_clear(&sys->values);
+      err = select_syntax
+        (sys, command_list, seg_argc, seg_argv, NULL, 0, &cmd);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      validation.syntax_id =
+        command_list->count - 1 - (size_t)(cmd - command_list->cmds);
+      validation.argc = cmd->argc;
+      validation.argv = (const struct cmdarg**)cmd->argv;
+      continue;
+    }
+    SL(hash_table_find(sys->macro_tbl, &seg_argv[0], (void**)&macro));
+    if(!macro) {
+      RECORD_ERROR(sys, COMMAND_NOT_FOUND, seg_argc, seg_argv, seg_argv[0],
+        CMDARG_TYPES_COUNT, SIZE_MAX);
+      err = CMDSYS_COMMAND_ERROR;
+      goto error;
+    }
+    if(seg_argc > 1) {
+      RECORD_ERROR(sys, UNEXPECTED_ARGUMENT, seg_argc, seg_argv, seg_argv[1],
+        CMDARG_TYPES_COUNT, SIZE_MAX);
+      err = CMDSYS_COMMAND_ERROR;
+      goto error;
+    }
+    validation.syntax_id = SIZE_MAX;
+    validation.argc = 0;
+    validation.argv = NULL;
+  }
+  if(result)
+    *result = validation;
+
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+/* Validate the non blank lines of `buf'. The failures are recorded with their
+ * line number. */
+static void
+validate_lines
+  (struct cmdsys* sys,
+   const char* buf,
+   const size_t len,
+   size_t line,
+   size_t* ninvalid)
+{
+  size_t i = 0;
+  ASSERT(sys && (buf || !len) && ninvalid);
+
+  for(i = 0; i < len; ++line) {
+    const char* end = memchr(buf + i, '\n', len - i);
+    const size_t line_len = end ? (size_t)(end - buf) - i : len - i;
+    const size_t nrecords = sys->errlog.nrecords;
+    size_t j = 0;
+
+    for(j = i; j < i + line_len && is_blank(buf[j]); ++j);
+    if(j < i + line_len
+    && validate_commandn(sys, buf + i, line_len, NULL) != CMDSYS_NO_ERROR) {
+      ++(*ninvalid);
+      if(sys->errlog.nrecords > nrecords)
+        sys->errlog.records[nrecords].info.line = line;
+    }
+    i += line_len + 1;
+  }
+}
+
+static void*
+run_validation_worker(void* arg)
+{
+  struct validation_worker* worker = arg;
+  ASSERT(worker);
+  validate_lines(&worker->ctx, worker->chunk, worker->len, worker->first_line,
+    &worker->ninvalid);
+  return NULL;
+}
+
+enum cmdsys_error
+cmdsys_validate_command
+  (struct cmdsys* sys,
+   const char* command,
+   struct cmdsys_validation* result)
+{
+  if(!sys || !command)
+    return CMDSYS_INVALID_ARGUMENT;
+  return validate_commandn(sys, command, strlen(command), result);
+}
+
+enum cmdsys_error
+cmdsys_validate_file
+  (struct cmdsys* sys,
+   const char* path,
+   const size_t nworkers)
+{
+  struct validation_worker* workers = NULL;
+  pthread_mutex_t parse_lock;
+  FILE* file = NULL;
+  char* buf = NULL;
+  long size = 0;
+  size_t len = 0;
+  size_t nchunks = 0;
+  size_t ninvalid = 0;
+  size_t line = 1;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !path || !nworkers) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  file = fopen(path, "rb");
+  if(!file
+  || fseek(file, 0, SEEK_END) != 0
+  || (size = ftell(file)) < 0
+  || fseek(file, 0, SEEK_SET) != 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  len = (size_t)size;
+  buf = MEM_ALLOC(sys->allocator, len + 1);
+  if(!buf) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  if(len && fread(buf, len, 1, file) != 1) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  buf[len] = '\0';
+
+  nchunks = MIN(nworkers, VALIDATE_MAX_WORKERS);
+  nchunks = MAX(MIN(nchunks, len / VALIDATE_MIN_CHUNK_LEN), 1);
+  if(nchunks == 1) {
+    validate_lines(sys, buf, len, line, &ninvalid);
+    goto exit;
+  }
+
+  workers = MEM_CALLOC
+    (sys->allocator, nchunks, sizeof(struct validation_worker));
+  if(!workers) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  pthread_mutex_init(&parse_lock, NULL);
+
+  /* Split the script in chunks of whole lines. */
+  for(i = 0; i < nchunks; ++i) {
+    const size_t begin = i ? (size_t)(workers[i-1].chunk - buf)
+      + workers[i-1].len : 0;
+    size_t end = i == nchunks - 1 ? len : MAX(begin, (len * (i + 1)) / nchunks);
+    const char* c = NULL;
+
+    if(end < len) {
+      const char* eol = memchr(buf + end, '\n', len - end);
+      end = eol ? (size_t)(eol - buf) + 1 : len;
+    }
+    workers[i].chunk = buf + begin;
+    workers[i].len = end - begin;
+    workers[i].first_line = line;
+    for(c = buf + begin; (c = memchr(c, '\n', (size_t)(buf + end - c))); ++c)
+      ++line;
+  }
+
+  /* The registry is only read while the chunks are validated: each worker,
+   * including the one of the first chunk run by the calling thread, builds
+   * the syntaxes that its chunk references in its own clones. */
+  for(i = 0; i < nchunks; ++i) {
+    workers[i].err = init_validation_worker(sys, &parse_lock, workers + i);
+    if(i && workers[i].err == CMDSYS_NO_ERROR) {
+      workers[i].is_running = pthread_create
+        (&workers[i].thread, NULL, run_validation_worker, workers + i) == 0;
+    }
+  }
+
+  /* Merge the failures in the line order. */
+  for(i = 0; i < nchunks; ++i) {
+    if(workers[i].is_running) {
+      pthread_join(workers[i].thread, NULL);
+    } else if(workers[i].err == CMDSYS_NO_ERROR) {
+      run_validation_worker(workers + i);
+    }
+    if(err == CMDSYS_NO_ERROR)
+      err = workers[i].err;
+    errlog_merge(&sys->errlog, &workers[i].ctx.errlog);
+    ninvalid += workers[i].ninvalid;
+  }
+  for(i = 0; i < nchunks; ++i)
+    release_validation_worker(workers + i);
+  pthread_mutex_destroy(&parse_lock);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+exit:
+  if(err == CMDSYS_NO_ERROR && ninvalid)
+    err = CMDSYS_COMMAND_ERROR;
+  if(file)
+    fclose(file);
+  if(buf)
+    MEM_FREE(sys->allocator, buf);
+  if(workers)
+    MEM_FREE(sys->allocator, workers);
+  return err;
+error:
+  goto exit;
+}
+
+static void
+release_prepared(struct ref* ref)
+{
+  struct cmdsys_prepared* prepared = NULL;
+  struct cmdsys* sys = NULL;
+  size_t i = 0;
+  ASSERT(ref);
+
+  prepared = CONTAINER_OF(ref, struct cmdsys_prepared, ref);
+  sys = prepared->sys;
+  if(prepared->placeholders) {
+    for(i = 0; i < prepared->nplaceholders; ++i) {
+      if(prepared->placeholders[i].string)
+        MEM_FREE(sys->allocator, prepared->placeholders[i].string);
+    }
+    MEM_FREE(sys->allocator, prepared->placeholders);
+  }
+  if(prepared->argv)
+    MEM_FREE(sys->allocator, prepared->argv);
+  if(prepared->command)
+    MEM_FREE(sys->allocator, prepared->command);
+  MEM_FREE(sys->allocator, prepared);
+  CMDSYS(ref_put(sys));
+}
+
+/* Return N if `tok' is the placeholder `$N', SIZE_MAX if N is out of range
+ * and 0 if the token is not a placeholder. */
+static size_t
+placeholder_id(const char* tok)
+{
+  size_t id = 0;
+  const char* c = NULL;
+  ASSERT(tok);
+
+  if(tok[0] != '$' || tok[1] < '1' || tok[1] > '9')
+    return 0;
+  for(c = tok + 1; *c; ++c) {
+    if(*c < '0' || *c > '9')
+      return 0;
+    id = MIN(id * 10 + (size_t)(*c - '0'), (size_t)MAX_PLACEHOLDERS + 1);
+  }
+  return id > MAX_PLACEHOLDERS ? SIZE_MAX : id;
+}
+
+/* Write the bound value of a placeholder into its prepared argument. The
+ * value is clamped or checked against the domain of the argument. */
+static enum cmdsys_error
+apply_binding(struct cmdsys_prepared* prepared, struct placeholder* holder)
+{
+  const char** value_list = NULL;
+  size_t i = 0;
+  ASSERT(prepared && holder && holder->is_bound);
+
+  switch(holder->type) {
+    case CMDARG_INT:
+      holder->value->data.integer = MAX(MIN
+        (holder->bound.integer, holder->domain.integer.max),
+         holder->domain.integer.min);
+      break;
+    case CMDARG_FLOAT:
+      holder->value->data.real = MAX(MIN
+        (holder->bound.real, holder->domain.real.max),
+         holder->domain.real.min);
+      break;
+    case CMDARG_STRING:
+      value_list = holder->domain.string.value_list;
+      for(i = 0; value_list && value_list[i]; ++i) {
+        if(strcmp(holder->string, value_list[i]) == 0)
+          break;
+      }
+      if(value_list && !value_list[i]) {
+        const char* tokens[2];
+        tokens[0] = prepared->argv[0]->value_list[0].data.string;
+        tokens[1] = holder->string;
+        RECORD_ERROR(prepared->sys, INVALID_VALUE, 2, tokens, tokens[1],
+          CMDARG_STRING, prepared->syntax_id);
+        return CMDSYS_COMMAND_ERROR;
+      }
+      /* Fall through */
+    case CMDARG_FILE:
+      holder->value->data.string = holder->string;
+      holder->value->length = strlen(holder->string);
+      break;
+    default: ASSERT(0); /* Unreachable code */ break;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+/* Resolve the syntax of the prepared command and copy its decoded arguments.
+ * The `$N' placeholders are parsed as "0", which is a valid value of any
+ * argument type, and the bound values are then applied again. The command is
+ * tokenized in a private buffer and parsed against a private copy of its
+ * syntaxes, i.e. the arguments of a validated command are left untouched. The
+ * prepared command is left untouched if its syntax is not resolved. */
+static enum cmdsys_error
+prepare_command(struct cmdsys_prepared* prepared)
+{
+  char tokens[SCRATCH_LEN];
+  char* argv[MAX_ARG_COUNT];
+  struct cmd_segment segments[MAX_ARG_COUNT + 1];
+  const char* holder_tokens[MAX_PLACEHOLDERS];
+  struct cmdarg_value* holder_values[MAX_PLACEHOLDERS];
+  size_t holder_args[MAX_PLACEHOLDERS];
+  struct cmdsys* sys = NULL;
+  struct cmd_list* command_list = NULL;
+  struct cmd_list clone;
+  struct cmd* cmd = NULL;
+  struct cmdarg** args = NULL;
+  struct value_mark mark;
+  char* mem = NULL;
+  size_t size = 0;
+  size_t arg_id = 0;
+  size_t val_id = 0;
+  size_t nholders = 0;
+  size_t i = 0;
+  int argc = 0;
+  int nsegments = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(prepared);
+
+  memset(&clone, 0, sizeof(clone));
+  sys = prepared->sys;
+  mark = value_arena_mark(&sys->values);
+  err = tokenize_command
+    (sys, prepared->command, strlen(prepared->command), true, tokens,
+     sizeof(tokens), MAX_ARG_COUNT, &argc, argv, &nsegments, segments);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  if(!argc || nsegments != 1) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* Setup the placeholders. They are numbered from 1 without gap. */
+  memset(holder_tokens, 0, sizeof(holder_tokens));
+  for(i = 1; i < (size_t)argc; ++i) {
+    const size_t id = placeholder_id(argv[i]);
+    if(!id)
+      continue;
+    if(id == SIZE_MAX || holder_tokens[id - 1]) {
+      err = CMDSYS_INVALID_ARGUMENT;
+      goto error;
+    }
+    holder_tokens[id - 1] = argv[i];
+    nholders = MAX(nholders, id);
+    strcpy(argv[i], "0");
+  }
+  for(i = 0; i < nholders && holder_tokens[i]; ++i);
+  if(i < nholders || (prepared->argv && nholders != prepared->nplaceholders)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  command_list = find_cmd_list(sys, name_key(argv[0]));
+  if(!command_list) {
+    struct macro** macro = NULL;
+    SL(hash_table_find(sys->macro_tbl, &argv[0], (void**)&macro));
+    if(macro) {
+      err = CMDSYS_INVALID_ARGUMENT;
+    } else {
+      RECORD_ERROR(sys, COMMAND_NOT_FOUND, argc, argv, argv[0],
+        CMDARG_TYPES_COUNT, SIZE_MAX);
+      err = CMDSYS_COMMAND_ERROR;
+    }
+    goto error;
+  }
+  err = build_cmd_list(sys, command_list, SIZE_MAX, NULL);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  err = clone_cmd_list(sys, command_list, &clone);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  err = select_syntax
+    (sys, &clone, argc, argv, holder_tokens, nholders, &cmd);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  /* The streamed values reference the command tokens. */
+  for(arg_id = 1; arg_id < cmd->argc && !cmd->argv[arg_id]->cursor; ++arg_id);
+  if(arg_id < cmd->argc) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* Find the argument parsed from each placeholder. */
+  memset(holder_args, 0, sizeof(holder_args));
+  for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+    const void* tbl = cmd->arg_table[arg_id - 1]; /* -1 <=> name. */
+    const char** sval = NULL;
+    size_t nvals = 0;
+
+    if(cmd->argv[arg_id]->type == CMDARG_FILE) {
+      sval = ((const struct arg_file*)tbl)->filename;
+      nvals = (size_t)((const struct arg_file*)tbl)->count;
+    } else if(cmd->argv[arg_id]->type != CMDARG_LITERAL) {
+      sval = ((const struct arg_str*)tbl)->sval;
+      nvals = (size_t)((const struct arg_str*)tbl)->count;
+    }
+    for(val_id = 0; val_id < nvals; ++val_id) {
+      for(i = 0; i < nholders; ++i) {
+        if(sval[val_id] == holder_tokens[i]) {
+          holder_args[i] = arg_id;
+          holder_values[i] = cmd->argv[arg_id]->value_list + val_id;
+        }
+      }
+    }
+  }
+  for(i = 0; i < nholders && holder_args[i]; ++i);
+  if(i < nholders) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  if(nholders && !prepared->placeholders) {
+    prepared->placeholders = MEM_CALLOC
+      (sys->allocator, nholders, sizeof(struct placeholder));
+    if(!prepared->placeholders) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+  }
+
+  /* Copy the decoded arguments since they reference the command tokens and
+   * the value arena. The block stores the argument pointers, the arguments,
+   * their values followed by their undefined value and the strings. */
+  size = cmd->argc * (sizeof(struct cmdarg*) + sizeof(struct cmdarg));
+  size = ALIGN_SIZE(size, ALIGNOF(struct cmdarg_value));
+  for(arg_id = 0; arg_id < cmd->argc; ++arg_id) {
+    const struct cmdarg* arg = cmd->argv[arg_id];
+    size += (arg->count + 1) * sizeof(struct cmdarg_value);
+    if(arg->type != CMDARG_STRING && arg->type != CMDARG_FILE)
+      continue;
+    for(val_id = 0; val_id < arg->count; ++val_id)
+      size += arg->value_list[val_id].length + 1;
+  }
+  args = MEM_ALLOC(sys->allocator, size);
+  if(!args) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  mem = (char*)(args + cmd->argc);
+  for(arg_id = 0; arg_id < cmd->argc; ++arg_id) {
+    args[arg_id] = (struct cmdarg*)mem;
+    *args[arg_id] = *cmd->argv[arg_id];
+    mem += sizeof(struct cmdarg);
+  }
+  mem = (char*)args + ALIGN_SIZE
+    (cmd->argc * (sizeof(struct cmdarg*) + sizeof(struct cmdarg)),
+     ALIGNOF(struct cmdarg_value));
+  for(arg_id = 0; arg_id < cmd->argc; ++arg_id) {
+    const size_t nvals = args[arg_id]->count + 1;
+    memcpy(mem, args[arg_id]->value_list, nvals * sizeof(struct cmdarg_value));
+    args[arg_id]->value_list = (struct cmdarg_value*)mem;
+    mem += nvals * sizeof(struct cmdarg_value);
+  }
+  for(arg_id = 0; arg_id < cmd->argc; ++arg_id) {
+    struct cmdarg* arg = args[arg_id];
+    if(arg->type != CMDARG_STRING && arg->type != CMDARG_FILE)
+      continue;
+    for(val_id = 0; val_id < arg->count; ++val_id) {
+      struct cmdarg_value* val = arg->value_list + val_id;
+      memcpy(mem, val->data.string, val->length + 1);
+      val->data.string = mem;
+      mem += val->length + 1;
+    }
+  }
+
+  if(prepared->argv)
+    MEM_FREE(sys->allocator, prepared->argv);
+  prepared->version = sys->version;
+  prepared->func = cmd->func;
+  prepared->data = cmd->data;
+  prepared->argc = cmd->argc;
+  prepared->argv = args;
+  prepared->syntax_id = clone.count - 1 - (size_t)(cmd - clone.cmds);
+  prepared->nplaceholders = nholders;
+
+  /* Apply the bindings to the copied arguments. */
+  for(i = 0; i < nholders; ++i) {
+    struct placeholder* holder = prepared->placeholders + i;
+    enum cmdsys_error res = CMDSYS_NO_ERROR;
+
+    holder->value = args[holder_args[i]]->value_list
+      + (holder_values[i] - cmd->argv[holder_args[i]]->value_list);
+    holder->type = cmd->argv[holder_args[i]]->type;
+    holder->domain = cmd->arg_domain[holder_args[i]];
+    if(!holder->is_bound)
+      continue;
+    res = apply_binding(prepared, holder);
+    if(res != CMDSYS_NO_ERROR) {
+      holder->is_bound = false;
+      err = res;
+    }
+  }
+
+exit:
+  if(clone.cmds)
+    free_cmd_list(sys, &clone);
+  value_arena_restore(&sys->values, mark);
+  return err;
+error:
+  goto exit;
+}
+
+/* Prepare again the command if the registry was updated since its last
+ * preparation. */
+static FINLINE enum cmdsys_error
+update_prepared(struct cmdsys_prepared* prepared)
+{
+  ASSERT(prepared);
+  if(prepared->version == prepared->sys->version)
+    return CMDSYS_NO_ERROR;
+  return prepare_command(prepared);
+}
+
+/* Return the placeholder `id' if values of `type' can be bound to it. */
+static enum cmdsys_error
+get_placeholder
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   const enum cmdarg_type type,
+   struct placeholder** holder)
+{
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(holder);
+
+  if(!prepared || !id)
+    return CMDSYS_INVALID_ARGUMENT;
+  err = update_prepared(prepared);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  if(id > prepared->nplaceholders)
+    return CMDSYS_INVALID_ARGUMENT;
+  *holder = prepared->placeholders + id - 1;
+  if((*holder)->type != type
+  && (type != CMDARG_STRING || (*holder)->type != CMDARG_FILE))
+    return CMDSYS_INVALID_ARGUMENT;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_prepare
+  (struct cmdsys* sys,
+   const char* command,
+   struct cmdsys_prepared** out_prepared)
+{
+  struct cmdsys_prepared* prepared = NULL;
+  const size_t len = command ? strlen(command) : 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !command || !out_prepared) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  prepared = MEM_CALLOC(sys->allocator, 1, sizeof(struct cmdsys_prepared));
+  if(!prepared) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  CMDSYS(ref_get(sys));
+  prepared->sys = sys;
+  ref_init(&prepared->ref);
+  prepared->command = MEM_ALLOC(sys->allocator, len + 1);
+  if(!prepared->command) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  memcpy(prepared->command, command, len + 1);
+  err = prepare_command(prepared);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+exit:
+  if(out_prepared)
+    *out_prepared = prepared;
+  return err;
+error:
+  if(prepared) {
+    CMDSYS(prepared_ref_put(prepared));
+    prepared = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_prepared_ref_get(struct cmdsys_prepared* prepared)
+{
+  if(!prepared)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&prepared->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_prepared_ref_put(struct cmdsys_prepared* prepared)
+{
+  if(!prepared)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&prepared->ref, release_prepared);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_bind_int
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   int value)
+{
+  struct placeholder* holder = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  err = get_placeholder(prepared, id, CMDARG_INT, &holder);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  holder->bound.integer = value;
+  holder->is_bound = true;
+  return apply_binding(prepared, holder);
+}
+
+enum cmdsys_error
+cmdsys_bind_float
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   float value)
+{
+  struct placeholder* holder = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  err = get_placeholder(prepared, id, CMDARG_FLOAT, &holder);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  holder->bound.real = value;
+  holder->is_bound = true;
+  return apply_binding(prepared, holder);
+}
+
+enum cmdsys_error
+cmdsys_bind_string
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   const char* value)
+{
+  struct placeholder* holder = NULL;
+  size_t len = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!value)
+    return CMDSYS_INVALID_ARGUMENT;
+  err = get_placeholder(prepared, id, CMDARG_STRING, &holder);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  len = strlen(value);
+  holder->is_bound = false;
+  err = reserve_buffer
+    (prepared->sys->allocator, (void**)&holder->string,
+     &holder->string_capacity, len + 1);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  memcpy(holder->string, value, len + 1);
+  holder->is_bound = true;
+  err = apply_binding(prepared, holder);
+  if(err != CMDSYS_NO_ERROR)
+    holder->is_bound = false;
+  return err;
+}
+
+/* Bind the registered plugin syntax of a command prepared against its stub and
+ * adopt its functions. */
+static enum cmdsys_error
+bind_prepared(struct cmdsys_prepared* prepared)
+{
+  const struct plugin_stub* stub = NULL;
+  struct cmd_list* list = NULL;
+  size_t cmd_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(prepared && prepared->func == plugin_stub);
+
+  stub = prepared->data;
+  list = find_cmd_list(prepared->sys, name_key(stub->name));
+  ASSERT(list && prepared->syntax_id < list->count);
+  cmd_id = list->count - 1 - prepared->syntax_id;
+  err = bind_stub(list->cmds + cmd_id, list->infos + cmd_id);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  prepared->func = list->cmds[cmd_id].func;
+  prepared->data = list->cmds[cmd_id].data;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_execute_prepared(struct cmdsys_prepared* prepared)
+{
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!prepared)
+    return CMDSYS_INVALID_ARGUMENT;
+  err = update_prepared(prepared);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  for(i = 0; i < prepared->nplaceholders; ++i) {
+    if(!prepared->placeholders[i].is_bound)
+      return CMDSYS_INVALID_ARGUMENT;
+  }
+  if(prepared->func == plugin_stub) {
+    err = bind_prepared(prepared);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+  }
+  ref_get(&prepared->ref); /* The function may release the command. */
+  begin_command(prepared->sys);
+  err = call_command
+    (prepared->sys, prepared->func, prepared->argc,
+     (const struct cmdarg**)prepared->argv, prepared->data);
+  ref_put(&prepared->ref, release_prepared);
+  return err;
+}
+
+/* Check the caller built arguments against the syntax. Return the index of
+ * the first invalid argument or `argc' if they are valid; `code' is then set
+ * to the kind of the failure. */
+static size_t
+check_invoke_args
+  (const struct cmd* cmd,
+   const struct cmdarg* args[],
+   const size_t argc,
+   enum cmdsys_error_code* code)
+{
+  size_t i = 0;
+  ASSERT(cmd && (args || !argc) && code);
+
+  *code = CMDSYS_ERROR_INVALID_SYNTAX;
+  if(argc != cmd->argc - 1) /* -1 <=> name. */
+    return 0;
+
+  for(i = 0; i < argc; ++i) {
+    const struct cmdarg* expected = cmd->argv[i + 1];
+    const union cmdarg_domain* domain = cmd->arg_domain + i + 1;
+    const struct arg_hdr* hdr = cmd->arg_table[i];
+    const struct cmdarg* arg = args[i];
+    int ndefined = 0;
+    size_t val_id = 0;
+
+    *code = CMDSYS_ERROR_INVALID_SYNTAX;
+    if(!arg || arg->type != expected->type || arg->cursor
+    || arg->count > (size_t)hdr->maxcount)
+      return i;
+    for(val_id = 0; val_id < arg->count; ++val_id)
+      ndefined += arg->value_list[val_id].is_defined;
+    if(ndefined < hdr->mincount || ndefined > hdr->maxcount)
+      return i;
+
+    *code = CMDSYS_ERROR_INVALID_VALUE;
+    for(val_id = 0; val_id < arg->count; ++val_id) {
+      const struct cmdarg_value* val = arg->value_list + val_id;
+      const char** value_list = NULL;
+      size_t j = 0;
+
+      if(!val->is_defined)
+        continue;
+      switch(arg->type) {
+        case CMDARG_INT:
+          if(val->data.integer < domain->integer.min
+          || val->data.integer > domain->integer.max)
+            return i;
+          break;
+        case CMDARG_FLOAT:
+          if(!(val->data.real >= domain->real.min
+            && val->data.real <= domain->real.max)) /* Reject NaN. */
+            return i;
+          break;
+        case CMDARG_STRING:
+          if(!val->data.string)
+            return i;
+          value_list = domain->string.value_list;
+          for(j = 0; value_list && value_list[j]; ++j) {
+            if(strcmp(val->data.string, value_list[j]) == 0)
+              break;
+          }
+          if(value_list && !value_list[j])
+            return i;
+          break;
+        case CMDARG_FILE:
+          if(!val->data.string)
+            return i;
+          break;
+        case CMDARG_LITERAL: break;
+        default: ASSERT(0); /* Unreachable code */ break;
+      }
+    }
+  }
+  return argc;
+}
+
+enum cmdsys_error
+cmdsys_invoke
+  (struct cmdsys* sys,
+   const char* name,
+   const size_t syntax_hint,
+   const struct cmdarg* args[],
+   const size_t argc)
+{
+  const struct cmdarg* argv[MAX_ARG_COUNT];
+  struct cmd_list* command_list = NULL;
+  struct cmd* cmd = NULL;
+  enum cmdsys_error_code code = CMDSYS_ERROR_INVALID_SYNTAX;
+  enum cmdarg_type expected_type = CMDARG_TYPES_COUNT;
+  size_t best_syntax = SIZE_MAX;
+  size_t best_arg = 0;
+  size_t cmd_id = 0;
+  size_t arg_id = 0;
+  size_t val_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !name || (!args && argc) || argc >= MAX_ARG_COUNT) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  command_list = find_cmd_list(sys, name_key(name));
+  if(!command_list) {
+    RECORD_ERROR(sys, COMMAND_NOT_FOUND, 1, &name, name, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+  if(syntax_hint != SIZE_MAX && syntax_hint >= command_list->count) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  err = build_cmd_list(sys, command_list, SIZE_MAX, NULL);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  /* The syntaxes are listed from the last added one. */
+  for(cmd_id = 0; cmd_id < command_list->count; ++cmd_id) {
+    const size_t id = syntax_hint == SIZE_MAX
+      ? cmd_id : command_list->count - 1 - syntax_hint;
+    enum cmdsys_error_code arg_code = CMDSYS_ERROR_INVALID_SYNTAX;
+    const size_t arg_id = check_invoke_args
+      (command_list->cmds + id, args, argc, &arg_code);
+
+    if(arg_id == argc && argc == command_list->cmds[id].argc - 1) {
+      cmd = command_list->cmds + id;
+      break;
+    }
+    if(best_syntax == SIZE_MAX || arg_id > best_arg) {
+      best_syntax = command_list->count - 1 - id;
+      best_arg = arg_id;
+      code = arg_code;
+      expected_type = arg_id + 1 < command_list->cmds[id].argc
+        ? command_list->cmds[id].argv[arg_id + 1]->type : CMDARG_TYPES_COUNT;
+    }
+    if(syntax_hint != SIZE_MAX)
+      break;
+  }
+  if(!cmd) {
+    errlog_record(&sys->errlog, sys->version, code, 1, &name, NULL,
+      expected_type, best_syntax);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+  err = bind_stub(cmd, command_list->infos + (cmd - command_list->cmds));
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  cmd->argv[0]->value_list[0].is_defined = true;
+  cmd->argv[0]->value_list[0].data.string = name;
+  cmd->argv[0]->value_list[0].length = strlen(name);
+  argv[0] = cmd->argv[0];
+  if(argc)
+    memcpy(argv + 1, args, argc * sizeof(const struct cmdarg*));
+  /* Stream the caller built values of the streamed arguments. */
+  for(arg_id = 1; arg_id <= argc; ++arg_id) {
+    struct cmdarg* arg = cmd->argv[arg_id];
+    if(!arg->cursor)
+      continue;
+    arg->count = 0;
+    for(val_id = 0; val_id < args[arg_id - 1]->count; ++val_id)
+      arg->count += args[arg_id - 1]->value_list[val_id].is_defined;
+    arg->value_list = NULL;
+    arg->cursor->tokens = NULL;
+    arg->cursor->values = args[arg_id - 1]->value_list;
+    arg->cursor->count = args[arg_id - 1]->count;
+    arg->cursor->next = 0;
+    argv[arg_id] = arg;
+  }
+  begin_command(sys);
+  err = call_command(sys, cmd->func, argc + 1, argv, cmd->data);
+
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_cursor_next
+  (struct cmdarg_cursor* cursor,
+   struct cmdarg_value* value,
+   bool* has_value)
+{
+  const char* str = NULL;
+  const char** value_list = NULL;
+  size_t i = 0;
+  bool is_valid = true;
+
+  if(!cursor || !value || !has_value)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  if(!cursor->tokens) { /* Caller built values, checked on invocation. */
+    while(cursor->next < cursor->count
+    && !cursor->values[cursor->next].is_defined)
+      ++cursor->next;
+    *has_value = cursor->next < cursor->count;
+    if(*has_value)
+      *value = cursor->values[cursor->next++];
+    return CMDSYS_NO_ERROR;
+  }
+
+  *has_value = cursor->next < cursor->count;
+  if(!*has_value)
+    return CMDSYS_NO_ERROR;
+  str = cursor->tokens[cursor->next++];
+  value->is_defined = true;
+  value->length = 0;
+  switch(cursor->type) {
+    case CMDARG_INT:
+      is_valid = decode_int(str, cursor->domain.integer.min,
+        cursor->domain.integer.max, &value->data.integer);
+      break;
+    case CMDARG_FLOAT:
+      is_valid = decode_float(str, cursor->domain.real.min,
+        cursor->domain.real.max, &value->data.real);
+      break;
+    case CMDARG_STRING:
+      value_list = cursor->domain.string.value_list;
+      for(i = 0; value_list && value_list[i]; ++i) {
+        if(strcmp(str, value_list[i]) == 0)
+          break;
+      }
+      is_valid = !value_list || value_list[i];
+      value->data.string = str;
+      value->length = strlen(str);
+      break;
+    case CMDARG_FILE:
+      value->data.string = str;
+      value->length = strlen(str);
+      break;
+    default: ASSERT(0); /* Unreachable code */ break;
+  }
+  return is_valid ? CMDSYS_NO_ERROR : CMDSYS_COMMAND_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_execute_command
+  (struct cmdsys* sys,
+   const char* command,
+   const char* inverse)
+{
+  if(!command)
+    return CMDSYS_INVALID_ARGUMENT;
+  return cmdsys_execute_commandn(sys, command, strlen(command), inverse);
+}
+
+enum cmdsys_error
+cmdsys_execute_commandn
+  (struct cmdsys* sys,
+   const char* buf,
+   size_t len,
+   const char* inverse)
+{
+  (void)inverse;
+
+  /* The tokens are not stored in the command system in order to support the
+   * commands executed by the command functions. */
+  char scratch[SCRATCH_LEN];
+  char* argv[MAX_ARG_COUNT];
+  struct cmd_segment segments[MAX_ARG_COUNT + 1];
+  int argc = 0;
+  int nsegments = 0;
+  int seg = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || (!buf && len)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  begin_command(sys);
+  err = tokenize_command
+    (sys, buf ? buf : "", len, true, scratch, sizeof(scratch), MAX_ARG_COUNT,
+     &argc, argv, &nsegments, segments);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  if(!argc) { /* Empty command. */
+    RECORD_ERROR(sys, COMMAND_NOT_FOUND, 0, NULL, NULL, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+
+  for(seg = 0; seg < nsegments; ++seg) {
+    if(segments[seg].argc == 0 || SKIP_SEGMENT(segments[seg], err))
+      continue;
+    err = execute_command
+      (sys, segments[seg].argc, argv + segments[seg].first_arg);
+  }
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_set_variable(struct cmdsys* sys, const char* name, const char* value)
+{
+  struct var_key key;
+  struct var var = { NULL, 0 };
+  struct var* found = NULL;
+  char* key_name = NULL;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  enum sl_error sl_err = SL_NO_ERROR;
+
+  if(!sys || !name || !value || !is_var_char(name[0], true)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  for(i = 1; name[i] != '\0'; ++i) {
+    if(!is_var_char(name[i], false)) {
+      err = CMDSYS_INVALID_ARGUMENT;
+      goto error;
+    }
+  }
+  key.name = name;
+  key.len = i;
+
+  var.len = strlen(value);
+  var.value = MEM_ALLOC(sys->allocator, var.len + 1);
+  if(!var.value) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  memcpy(var.value, value, var.len + 1);
+
+  SL(hash_table_find(sys->var_tbl, &key, (void**)&found));
+  if(found) {
+    MEM_FREE(sys->allocator, found->value);
+    *found = var;
+  } else {
+    key_name = MEM_ALLOC(sys->allocator, key.len + 1);
+    if(!key_name) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+    memcpy(key_name, name, key.len + 1);
+    key.name = key_name;
+    sl_err = sl_hash_table_insert(sys->var_tbl, &key, &var);
+    if(sl_err != SL_NO_ERROR) {
+      err = sl_to_cmdsys_error(sl_err);
+      goto error;
+    }
+  }
+
+exit:
+  return err;
+error:
+  if(key_name)
+    MEM_FREE(sys->allocator, key_name);
+  if(var.value)
+    MEM_FREE(sys->allocator, var.value);
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_get_variable
+  (struct cmdsys* sys,
+   const char* name,
+   const char** value)
+{
+  struct var_key key;
+  struct var* var = NULL;
+
+  if(!sys || !name || !value)
+    return CMDSYS_INVALID_ARGUMENT;
+  key.name = name;
+  key.len = strlen(name);
+  SL(hash_table_find(sys->var_tbl, &key, (void**)&var));
+  *value = var ? var->value : NULL;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_unset_variable(struct cmdsys* sys, const char* name)
+{
+  struct sl_pair pair;
+  struct var_key key;
+  char* key_name = NULL;
+  size_t i = 0;
+
+  if(!sys || !name)
+    return CMDSYS_INVALID_ARGUMENT;
+  key.name = name;
+  key.len = strlen(name);
+  SL(hash_table_find_pair(sys->var_tbl, &key, &pair));
+  if(!SL_IS_PAIR_VALID(&pair))
+    return CMDSYS_INVALID_ARGUMENT;
+  key_name = (char*)((struct var_key*)pair.key)->name;
+  MEM_FREE(sys->allocator, ((struct var*)pair.data)->value);
+  SL(hash_table_erase(sys->var_tbl, &key, &i));
+  ASSERT(i == 1);
+  MEM_FREE(sys->allocator, key_name);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_define_macro(struct cmdsys* sys, const char* name, const char* body)
+{
+  char* argv[MAX_ARG_COUNT];
+  struct cmd_segment segments[MAX_ARG_COUNT + 1];
+  struct macro* macro = NULL;
+  struct macro** found = NULL;
+  char* macro_name = NULL;
+  size_t len = 0;
+  int nsegments = 0;
+  int i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  enum sl_error sl_err = SL_NO_ERROR;
+
+  if(!sys || !name || !body || *name == '\0') {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  macro = MEM_CALLOC(sys->allocator, 1, sizeof(struct macro));
+  if(!macro) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  macro->allocator = sys->allocator;
+  ref_init(&macro->ref);
+
+  /* Pre-tokenize the body without expanding its variables. */
+  len = strlen(body);
+  macro->tokens = MEM_ALLOC(sys->allocator, len + 1);
+  if(!macro->tokens) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  err = tokenize_command
+    (sys, body, len, false, macro->tokens, len + 1, MAX_ARG_COUNT,
+     &macro->argc, argv, &nsegments, segments);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  if(!macro->argc) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  macro->nsegments = nsegments;
+  macro->argv = MEM_ALLOC(sys->allocator, (size_t)macro->argc*sizeof(char*));
+  macro->has_variable = MEM_ALLOC(sys->allocator, (size_t)macro->argc);
+  macro->segments = MEM_ALLOC
+    (sys->allocator, (size_t)nsegments * sizeof(struct cmd_segment));
+  if(!macro->argv || !macro->has_variable || !macro->segments) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  memcpy(macro->segments, segments, (size_t)nsegments * sizeof(*segments));
+  for(i = 0; i < macro->argc; ++i) {
+    macro->argv[i] = argv[i];
+    macro->has_variable[i] = strchr(argv[i], '$') != NULL;
+  }
+  resolve_macro(sys, macro);
+
+  SL(hash_table_find(sys->macro_tbl, &name, (void**)&found));
+  if(found) {
+    ref_put(&(*found)->ref, release_macro);
+    *found = macro;
+  } else {
+    macro_name = MEM_ALLOC(sys->allocator, strlen(name) + 1);
+    if(!macro_name) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+    strcpy(macro_name, name);
+    sl_err = sl_hash_table_insert(sys->macro_tbl, &macro_name, &macro);
+    if(sl_err != SL_NO_ERROR) {
+      err = sl_to_cmdsys_error(sl_err);
+      goto error;
+    }
+  }
+
+exit:
+  return err;
+error:
+  if(macro_name)
+    MEM_FREE(sys->allocator, macro_name);
+  if(macro)
+    ref_put(&macro->ref, release_macro);
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_undefine_macro(struct cmdsys* sys, const char* name)
+{
+  struct sl_pair pair;
+  char* macro_name = NULL;
+  size_t i = 0;
+
+  if(!sys || !name)
+    return CMDSYS_INVALID_ARGUMENT;
+  SL(hash_table_find_pair(sys->macro_tbl, &name, &pair));
+  if(!SL_IS_PAIR_VALID(&pair))
+    return CMDSYS_INVALID_ARGUMENT;
+  macro_name = *(char**)pair.key;
+  ref_put(&(*(struct macro**)pair.data)->ref, release_macro);
+  SL(hash_table_erase(sys->macro_tbl, &macro_name, &i));
+  ASSERT(i == 1);
+  MEM_FREE(sys->allocator, macro_name);
+  return CMDSYS_NO_ERROR;
+}
+
+#undef SKIP_SEGMENT
+#undef MAX_MACRO_DEPTH
+#undef MAX_ARG_COUNT
+
+enum cmdsys_error
+cmdsys_man_command
+  (struct cmdsys* sys,
+   const char* name,
+   size_t* len,
+   size_t max_buf_len,
+   char* buffer)
+{
+  struct cmd_list* cmd_list = NULL;
+  size_t cmd_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  long fpos = 0;
+
+  if(!sys || !name || (max_buf_len && !buffer)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  cmd_list = find_cmd_list(sys, name_key(name));
+  if(!cmd_list) {
+    RECORD_ERROR(sys, COMMAND_NOT_FOUND, 1, &name, name, CMDARG_TYPES_COUNT,
+      SIZE_MAX);
+    err = CMDSYS_COMMAND_ERROR;
+    goto error;
+  }
+  ASSERT(cmd_list->count);
+  /* The manual of a schema syntax is rendered at build time: the arg tables
+   * are only required by the other syntaxes. The manual does not use the
+   * functions, i.e. the plugin modules are not loaded. */
+  for(cmd_id = 0; cmd_id < cmd_list->count; ++cmd_id) {
+    if(!cmd_list->infos[cmd_id].schema)
+      break;
+  }
+  if(cmd_id < cmd_list->count) {
+    err = build_cmd_list(sys, cmd_list, SIZE_MAX, NULL);
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+  }
+
+  rewind(sys->stream);
+  for(cmd_id = 0; cmd_id < cmd_list->count; ++cmd_id) {
+    const struct cmd* cmd = cmd_list->cmds + cmd_id;
+    const struct cmd_info* info = cmd_list->infos + cmd_id;
+
+    if(cmd_id != 0)
+       fprintf(sys->stream, "\n");
+
+    if(info->schema) {
+      fputs(info->schema->man, sys->stream);
+    } else {
+      fprintf(sys->stream, "%s", name);
+      arg_print_syntaxv(sys->stream, cmd->arg_table, "\n");
+      if(info->description)
+        fprintf(sys->stream, "%s\n", info->description);
+      arg_print_glossary(sys->stream, cmd->arg_table, NULL);
+    }
+    fpos = ftell(sys->stream);
+    ASSERT(fpos > 0);
+  }
+
+  if(len)
+    *len = (size_t)fpos / sizeof(char);
+  if(buffer && max_buf_len) {
+    const size_t size = MIN((max_buf_len - 1) * sizeof(char), (size_t)fpos);
+    size_t nb = 0;
+    (void)nb;
+
+    fflush(sys->stream);
+    rewind(sys->stream);
+    nb = fread(buffer, size, 1, sys->stream);
+    ASSERT(nb == 1);
+    buffer[size/sizeof(char)] = '\0';
+  }
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_command_arg_completion
+  (struct cmdsys* sys,
+   const char* cmd_name,
+   const char* arg_str,
+   size_t arg_str_len,
+   size_t hint_argc,
+   char* hint_argv[],
+   size_t* completion_list_len,
+   const char** completion_list[])
+{
+  struct cmd_list* cmd_list = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys
+  || !cmd_name
+  || (arg_str_len && !arg_str)
+  || (hint_argc && !hint_argv)
+  || !completion_list_len
+  || !completion_list) {
+    err =  CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  /* Default completion list value. */
+  *completion_list_len = 0;
+  *completion_list = NULL;
+
+  cmd_list = find_cmd_list(sys, name_key(cmd_name));
+  if(cmd_list != NULL) {
+    void (*completion)
+      (struct cmdsys*, const char*, size_t, size_t*, const char**[]) = NULL;
+
+    err = load_cmd_list(sys, cmd_list);
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    completion = select_completion_syntax(cmd_list, hint_argc, hint_argv);
+    if(completion) {
+      completion
+        (sys, arg_str, arg_str_len, completion_list_len, completion_list);
+    }
+  }
+  if(*completion_list_len == 0)
+    *completion_list = NULL;
+exit:
+  return err;
+error:
+  if(completion_list_len)
+    *completion_list_len = 0;
+  if(completion_list)
+    *completion_list = NULL;
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_create_completion_session
+  (struct cmdsys* sys,
+   struct cmdsys_completion_session** out_session)
+{
+  struct cmdsys_completion_session* session = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !out_session) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  session = MEM_CALLOC
+    (sys->allocator, 1, sizeof(struct cmdsys_completion_session));
+  if(!session) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  CMDSYS(ref_get(sys));
+  session->sys = sys;
+  ref_init(&session->ref);
+exit:
+  if(out_session)
+    *out_session = session;
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_completion_session_ref_get(struct cmdsys_completion_session* session)
+{
+  if(!session)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&session->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_completion_session_ref_put(struct cmdsys_completion_session* session)
+{
+  if(!session)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&session->ref, release_completion_session);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_session_arg_completion
+  (struct cmdsys_completion_session* session,
+   const char* cmd_name,
+   const char* arg_str,
+   size_t arg_str_len,
+   size_t hint_argc,
+   char* hint_argv[],
+   size_t* completion_list_len,
+   const char** completion_list[])
+{
+  struct cmdsys* sys = NULL;
+  size_t key_len = 0;
+  size_t i = 0;
+  bool is_key_cached = false;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!session
+  || !cmd_name
+  || (arg_str_len && !arg_str)
+  || (hint_argc && !hint_argv)
+  || !completion_list_len
+  || !completion_list) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  sys = session->sys;
+
+  /* Check that the command name and the hint arguments are the cached ones. */
+  key_len = strlen(cmd_name) + 1;
+  for(i = 0; i < hint_argc; ++i)
+    key_len += strlen(hint_argv[i]) + 1;
+  is_key_cached = session->is_cached
+    && session->version == sys->version
+    && session->key_len == key_len;
+  if(is_key_cached) {
+    const char* key = session->key;
+    is_key_cached = strcmp(key, cmd_name) == 0;
+    key += strlen(key) + 1;
+    for(i = 0; is_key_cached && i < hint_argc; ++i) {
+      is_key_cached = strcmp(key, hint_argv[i]) == 0;
+      key += strlen(key) + 1;
+    }
+  }
+
+  if(is_key_cached
+  && arg_str_len >= session->input_len
+  && (session->input_len == 0
+   || memcmp(arg_str, session->input, session->input_len) == 0)) {
+    /* The argument string extends the cached one: narrow the cached
+     * candidates rather than querying the completion callback again. */
+    size_t count = 0;
+    for(i = 0; i < session->candidate_count; ++i) {
+      if(strncmp(session->candidate_list[i], arg_str, arg_str_len) == 0)
+        session->candidate_list[count++] = session->candidate_list[i];
+    }
+    session->candidate_count = count;
+  } else {
+    const char** list = NULL;
+    size_t len = 0;
+
+    if(!is_key_cached) {
+      struct cmd_list* cmd_list = NULL;
+      char* key = NULL;
+
+      session->is_cached = false;
+      err = reserve_buffer
+        (sys->allocator, (void**)&session->key, &session->key_capacity,
+         key_len);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      key = session->key;
+      strcpy(key, cmd_name);
+      key += strlen(key) + 1;
+      for(i = 0; i < hint_argc; ++i) {
+        strcpy(key, hint_argv[i]);
+        key += strlen(key) + 1;
+      }
+      session->key_len = key_len;
+      session->version = sys->version;
+
+      cmd_list = find_cmd_list(sys, name_key(cmd_name));
+      session->completion = NULL;
+      if(cmd_list) {
+        err = load_cmd_list(sys, cmd_list);
+        if(err != CMDSYS_NO_ERROR)
+          goto error;
+        session->completion =
+          select_completion_syntax(cmd_list, hint_argc, hint_argv);
+      }
+    }
+    if(session->completion) {
+      session->completion(sys, arg_str, arg_str_len, &len, &list);
+    }
+    err = reserve_buffer
+      (sys->allocator, (void**)&session->candidate_list,
+       &session->candidate_capacity, len * sizeof(const char*));
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    if(len)
+      memcpy((void*)session->candidate_list, list, len * sizeof(const char*));
+    session->candidate_count = len;
+  }
+  /* Save the argument string whose completion is cached. */
+  err = reserve_buffer
+    (sys->allocator, (void**)&session->input, &session->input_capacity,
+     arg_str_len + 1);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  if(arg_str_len)
+    memcpy(session->input, arg_str, arg_str_len);
+  session->input[arg_str_len] = '\0';
+  session->input_len = arg_str_len;
+  session->is_cached = true;
+
+  *completion_list_len = session->candidate_count;
+  *completion_list = session->candidate_count ? session->candidate_list : NULL;
+exit:
+  return err;
+error:
+  if(session)
+    session->is_cached = false;
+  if(completion_list_len)
+    *completion_list_len = 0;
+  if(completion_list)
+    *completion_list = NULL;
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_command_name_completion
+  (struct cmdsys* sys,
+   const char* cmd_name,
+   size_t cmd_name_len,
+   size_t* completion_list_len,
+   const char** completion_list[])
+{
+  const char** name_list = NULL;
+  size_t len = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys
+  || (cmd_name_len && !cmd_name)
+  || !completion_list_len
+  || !completion_list) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  SL(flat_set_buffer(sys->name_set, &len, NULL, NULL, (void**)&name_list));
+  if(0 == cmd_name_len) {
+    *completion_list_len = len;
+    *completion_list = name_list;
+  } else {
+    #define CHARBUF_SIZE 32
+    char buf[CHARBUF_SIZE];
+    const char* ptr = buf;
+    size_t begin = 0;
+    size_t end = 0;
+
+    if(cmd_name_len > CHARBUF_SIZE - 1) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+    strncpy(buf, cmd_name, cmd_name_len);
+    buf[cmd_name_len] = '\0';
+    SL(flat_set_lower_bound(sys->name_set, &ptr, &begin));
+    buf[cmd_name_len] = 127;
+    buf[cmd_name_len + 1] = '\0';
+    SL(flat_set_upper_bound(sys->name_set, &ptr, &end));
+    *completion_list = name_list + begin;
+    *completion_list_len = (size_t)((name_list + end) - (*completion_list));
+    if(0 == *completion_list_len)
+      *completion_list = NULL;
+    #undef CHARBUF_SIZE
+  }
+exit:
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_list_namespace
+  (struct cmdsys* sys,
+   const char* ns,
+   size_t* list_len,
+   const char** list[])
+{
+  const char** name_list = NULL;
+  size_t len = 0;
+  size_t begin = 0;
+  size_t end = 0;
+
+  if(!sys || !ns || !list_len || !list)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  SL(flat_set_buffer(sys->name_set, &len, NULL, NULL, (void**)&name_list));
+  if(*ns == '\0') {
+    begin = 0;
+    end = len;
+  } else {
+    prefix_range(name_list, len, ns, strlen(ns), '.', &begin, &end);
+  }
+  *list_len = end - begin;
+  *list = begin == end ? NULL : name_list + begin;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_del_namespace(struct cmdsys* sys, const char* ns)
+{
+  const char** name_list = NULL;
+  size_t len = 0;
+  size_t begin = 0;
+  size_t end = 0;
+
+  if(!sys || !ns || *ns == '\0')
+    return CMDSYS_INVALID_ARGUMENT;
+
+  SL(flat_set_buffer(sys->name_set, &len, NULL, NULL, (void**)&name_list));
+  prefix_range(name_list, len, ns, strlen(ns), '.', &begin, &end);
+  if(begin == end)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  /* Delete the commands from the last one in order to keep the flat set
+   * entries that precede them in place. */
+  while(end-- > begin) {
+    SL(flat_set_buffer(sys->name_set, &len, NULL, NULL, (void**)&name_list));
+    ASSERT(end < len);
+    CMDSYS(del_command(sys, name_list[end]));
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_namespace_completion
+  (struct cmdsys* sys,
+   const char* path,
+   size_t path_len,
+   size_t* completion_list_len,
+   const char** completion_list[])
+{
+  struct ns_node* node = NULL;
+  const char** name_list = NULL;
+  const char* partial = NULL;
+  size_t len = 0;
+  size_t begin = 0;
+  size_t end = 0;
+
+  if(!sys
+  || (path_len && !path)
+  || !completion_list_len
+  || !completion_list)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  /* Split the path in its namespace and the partial last component. */
+  partial = path + path_len;
+  while(partial > path && partial[-1] != '.')
+    --partial;
+  if(partial == path) {
+    node = sys->ns_root;
+  } else if(partial == path + 1) { /* Empty first component. */
+    node = find_ns_child(sys->ns_root, path, 0);
+  } else {
+    node = find_ns_node(sys, path, (size_t)(partial - path) - 1);
+  }
+
+  if(node && node->children) {
+    SL(flat_set_buffer(node->children, &len, NULL, NULL, (void**)&name_list));
+    prefix_range
+      (name_list, len, partial, path_len - (size_t)(partial - path), -1,
+       &begin, &end);
+  }
+  *completion_list_len = end - begin;
+  *completion_list = begin == end ? NULL : name_list + begin;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_save_image(struct cmdsys* sys, const char* filename)
+{
+  struct image_writer writer = { NULL, 0, 0 };
+  struct image_header* header = NULL;
+  struct image_name* names = NULL;
+  struct image_syntax* syntaxes = NULL;
+  struct image_arg* args = NULL;
+  const char** name_list = NULL;
+  FILE* file = NULL;
+  size_t nnames = 0;
+  size_t nsyntaxes = 0;
+  size_t nargs = 0;
+  size_t nentries = 0;
+  size_t strings_size = 0;
+  size_t size = 0;
+  size_t arg_id = 0;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !filename) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* The commands are saved in the order of the name set, i.e. the name index
+   * of the image is sorted. */
+  SL(flat_set_buffer(sys->name_set, &nnames, NULL, NULL, (void**)&name_list));
+
+  /* Compute the size of the image. */
+  for(i = 0; i < nnames; ++i) {
+    struct cmd_list* list = NULL;
+    size_t cmd_id = 0;
+
+    list = find_cmd_list(sys, interned_name_key(name_list[i]));
+    ASSERT(list != NULL);
+    /* The descriptors are saved as rebuilt from the arg tables. */
+    err = build_cmd_list(sys, list, SIZE_MAX, NULL);
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    strings_size += image_string_size(name_list[i]);
+    for(cmd_id = 0; cmd_id < list->count; ++cmd_id) {
+      struct cmd* cmd = list->cmds + cmd_id;
+
+      ++nsyntaxes;
+      strings_size +=
+        image_string_size(list->infos[cmd_id].description);
+      for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+        struct cmdarg_desc desc;
+        get_arg_desc(cmd, arg_id, &desc);
+        ++nargs;
+        strings_size += image_string_size(desc.short_options);
+        strings_size += image_string_size(desc.long_options);
+        strings_size += image_string_size(desc.data_type);
+        strings_size += image_string_size(desc.glossary);
+        if(desc.type == CMDARG_STRING && desc.domain.string.value_list) {
+          const char** value_list = desc.domain.string.value_list;
+          for(; *value_list; ++value_list, ++nentries)
+            strings_size += image_string_size(*value_list);
+          ++nentries; /* +1 <=> list terminator. */
+        }
+      }
+    }
+  }
+  size = sizeof(struct image_header)
+    + nnames * sizeof(struct image_name)
+    + nsyntaxes * sizeof(struct image_syntax)
+    + nargs * sizeof(struct image_arg)
+    + nentries * sizeof(uint64_t)
+    + strings_size;
+
+  writer.buffer = MEM_CALLOC(sys->allocator, size, sizeof(char));
+  if(NULL == writer.buffer) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  header = (struct image_header*)writer.buffer;
+  memcpy(header->magic, IMAGE_MAGIC, sizeof(header->magic));
+  header->version = IMAGE_VERSION;
+  header->byte_order = IMAGE_BYTE_ORDER;
+  header->nnames = (uint32_t)nnames;
+  header->nsyntaxes = (uint32_t)nsyntaxes;
+  header->nargs = (uint32_t)nargs;
+  header->hash_probe = image_hash_probe();
+  header->names = sizeof(struct image_header);
+  header->syntaxes = header->names + nnames * sizeof(struct image_name);
+  header->args = header->syntaxes + nsyntaxes * sizeof(struct image_syntax);
+  header->lists = header->args + nargs * sizeof(struct image_arg);
+  header->strings = header->lists + nentries * sizeof(uint64_t);
+  header->size = size;
+  names = (struct image_name*)(writer.buffer + header->names);
+  syntaxes = (struct image_syntax*)(writer.buffer + header->syntaxes);
+  args = (struct image_arg*)(writer.buffer + header->args);
+  writer.list_id = header->lists;
+  writer.string_id = header->strings;
+
+  /* Fill the image. */
+  nsyntaxes = nargs = 0;
+  for(i = 0; i < nnames; ++i) {
+    struct cmd_list* list = NULL;
+    size_t cmd_id = 0;
+
+    list = find_cmd_list(sys, interned_name_key(name_list[i]));
+    names[i].name = image_push_string(&writer, name_list[i]);
+    names[i].hash = (uint64_t)interned_name_key(name_list[i]).hash;
+    names[i].first_syntax = (uint32_t)nsyntaxes;
+    names[i].nsyntaxes = (uint32_t)list->count;
+    /* Syntaxes are stored in their dispatch order: walk them backward to
+     * save them in their add order. */
+    for(cmd_id = list->count; cmd_id-- > 0; ) {
+      struct cmd* cmd = list->cmds + cmd_id;
+      struct image_syntax* syntax = syntaxes + nsyntaxes++;
+
+      syntax->description =
+        image_push_string(&writer, list->infos[cmd_id].description);
+      syntax->first_arg = (uint32_t)nargs;
+      syntax->argc = (uint32_t)(cmd->argc - 1); /* -1 <=> command name. */
+
+      for(arg_id = 1; arg_id < cmd->argc; ++arg_id) {
+        struct image_arg* arg = args + nargs++;
+        struct cmdarg_desc desc;
+
+        get_arg_desc(cmd, arg_id, &desc);
+        arg->type = (uint32_t)desc.type;
+        arg->min_count = desc.min_count;
+        arg->max_count = desc.max_count;
+        arg->flags = desc.is_streamed ? IMAGE_ARG_STREAMED : 0;
+        arg->short_options = image_push_string(&writer, desc.short_options);
+        arg->long_options = image_push_string(&writer, desc.long_options);
+        arg->data_type = image_push_string(&writer, desc.data_type);
+        arg->glossary = image_push_string(&writer, desc.glossary);
+        switch(desc.type) {
+          case CMDARG_INT:
+            arg->domain.integer.min = desc.domain.integer.min;
+            arg->domain.integer.max = desc.domain.integer.max;
+            break;
+          case CMDARG_FLOAT:
+            arg->domain.real.min = desc.domain.real.min;
+            arg->domain.real.max = desc.domain.real.max;
+            break;
+          default:
+            arg->domain.value_list = IMAGE_NIL;
+            if(desc.type == CMDARG_STRING && desc.domain.string.value_list) {
+              const char** value_list = desc.domain.string.value_list;
+              arg->domain.value_list = writer.list_id;
+              for(; *value_list; ++value_list) {
+                image_push_list_entry
+                  (&writer, image_push_string(&writer, *value_list));
+              }
+              image_push_list_entry(&writer, IMAGE_NIL);
+            }
+            break;
+        }
+      }
+    }
+  }
+  ASSERT(writer.list_id == header->strings);
+  ASSERT(writer.string_id == header->size);
+
+  file = fopen(filename, "wb");
+  if(!file) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  if(fwrite(writer.buffer, size, 1, file) != 1) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+exit:
+  if(file && fclose(file) != 0 && err == CMDSYS_NO_ERROR)
+    err = CMDSYS_IO_ERROR;
+  if(writer.buffer)
+    MEM_FREE(sys->allocator, writer.buffer);
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_load_image
+  (struct cmdsys* sys,
+   const char* filename,
+   enum cmdsys_error (*resolve)
+    (const char*, size_t, struct cmdsys_binding*, void*),
+   void* resolve_data)
+{
+  const struct image_header* header = NULL;
+  const struct image_name* names = NULL;
+  const struct image_syntax* syntaxes = NULL;
+  const struct image_arg* args = NULL;
+  struct image* img = NULL;
+  struct stat st;
+  size_t nregistered = 0; /* Number of commands whose registration began. */
+  size_t desc_id = 0;
+  size_t i = 0;
+  int fd = -1;
+  bool is_hash_valid = false;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !filename || !resolve) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd < 0 || fstat(fd, &st) != 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  if(st.st_size < (off_t)sizeof(struct image_header)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  img = MEM_CALLOC(sys->allocator, 1, sizeof(struct image));
+  if(NULL == img) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  ref_init(&img->ref);
+  img->sys = sys;
+  /* The mapping is private since the value lists are relocated in place; the
+   * other pages are shared with the page cache. */
+  img->size = (size_t)st.st_size;
+  img->buffer = mmap
+    (NULL, img->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(MAP_FAILED == img->buffer) {
+    img->buffer = NULL;
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  if(!is_image_valid(img->buffer, img->size)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  relocate_image_lists(img->buffer);
+
+  header = (const struct image_header*)img->buffer;
+  names = (const struct image_name*)(img->buffer + header->names);
+  syntaxes = (const struct image_syntax*)(img->buffer + header->syntaxes);
+  args = (const struct image_arg*)(img->buffer + header->args);
+  is_hash_valid = header->hash_probe == image_hash_probe();
+
+  /* The image commands must not be already registered. */
+  for(i = 0; i < header->nnames; ++i) {
+    struct name_key key;
+    key.str = img->buffer + names[i].name;
+    key.hash = is_hash_valid ? (size_t)names[i].hash : name_key(key.str).hash;
+    if(find_cmd_list(sys, key)) {
+      err = CMDSYS_INVALID_ARGUMENT;
+      goto error;
+    }
+  }
+
+  /* The syntaxes reference their CMDARG_END terminated descriptors, stored
+   * in the syntax order and whose texts and value lists lie into the
+   * mapping. */
+  if(header->nargs) {
+    struct cmdarg_desc* desc = NULL;
+
+    img->argv_desc = MEM_ALLOC(sys->allocator,
+      (header->nargs + header->nsyntaxes) * sizeof(struct cmdarg_desc));
+    if(NULL == img->argv_desc) {
+      err = CMDSYS_MEMORY_ERROR;
+      goto error;
+    }
+    desc = img->argv_desc;
+    for(i = 0; i < header->nsyntaxes; ++i) {
+      size_t arg_id = 0;
+      for(arg_id = 0; arg_id < syntaxes[i].argc; ++arg_id) {
+        image_arg_desc
+          (img->buffer, args + syntaxes[i].first_arg + arg_id, desc++);
+      }
+      *desc++ = CMDARG_END;
+    }
+  }
+
+  (void)format_errors(sys); /* See add_syntax. */
+
+  /* Register the syntaxes as lazy ones; only their callbacks are resolved. */
+  for(i = 0; i < header->nnames; ++i) {
+    struct name_key key;
+    size_t syntax_id = 0;
+
+    key.str = img->buffer + names[i].name;
+    key.hash = is_hash_valid ? (size_t)names[i].hash : name_key(key.str).hash;
+    ++nregistered;
+    for(syntax_id = 0; syntax_id < names[i].nsyntaxes; ++syntax_id) {
+      const struct image_syntax* syntax =
+        syntaxes + names[i].first_syntax + syntax_id;
+      struct cmdsys_binding binding = { NULL, NULL, NULL };
+      struct cmd cmd;
+      struct cmd_info info;
+
+      err = resolve(key.str, syntax_id, &binding, resolve_data);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      if(!binding.func) {
+        err = CMDSYS_INVALID_ARGUMENT;
+        goto error;
+      }
+      memset(&cmd, 0, sizeof(cmd));
+      memset(&info, 0, sizeof(info));
+      cmd.argc = (size_t)syntax->argc + 1; /* +1 <=> command name. */
+      cmd.func = binding.func;
+      cmd.data = binding.data;
+      info.description = image_string(img->buffer, syntax->description);
+      if(syntax->argc)
+        info.argv_desc = img->argv_desc + desc_id;
+      desc_id += syntax->argc + 1u; /* +1 <=> CMDARG_END. */
+      info.completion = binding.arg_completion;
+      info.image = img;
+
+      err = register_command(sys, &cmd, &info, key);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      ref_get(&img->ref);
+    }
+  }
+  if(header->nsyntaxes)
+    ++sys->version;
+
+exit:
+  if(fd >= 0)
+    close(fd);
+  /* The image is unmapped once its syntaxes are deleted. */
+  if(img)
+    ref_put(&img->ref, release_image);
+  return err;
+error:
+  for(i = 0; i < nregistered; ++i) {
+    bool has_command = false; /* The failed command may have no syntax. */
+    CMDSYS(has_command(sys, img->buffer + names[i].name, &has_command));
+    if(has_command)
+      CMDSYS(del_command(sys, img->buffer + names[i].name));
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_adopt_schema
+  (struct cmdsys* sys,
+   const struct cmdsys_schema* schema,
+   enum cmdsys_error (*resolve)
+    (const char*, size_t, struct cmdsys_binding*, void*),
+   void* resolve_data)
+{
+  size_t nadopted = 0; /* Number of commands whose adoption began. */
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !schema || !resolve) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* The schema commands must not be already registered. */
+  for(i = 0; i < schema->ncommands; ++i) {
+    if(find_cmd_list(sys, name_key(schema->commands[i].name))) {
+      err = CMDSYS_INVALID_ARGUMENT;
+      goto error;
+    }
+  }
+
+  for(i = 0; i < schema->ncommands; ++i) {
+    const struct cmdsys_schema_command* command = schema->commands + i;
+    size_t syntax_id = 0;
+
+    ++nadopted;
+    for(syntax_id = 0; syntax_id < command->nsyntaxes; ++syntax_id) {
+      const struct cmdsys_schema_syntax* syntax =
+        schema->syntaxes + command->first_syntax + syntax_id;
+      struct cmdsys_binding binding = { NULL, NULL, NULL };
+
+      err = resolve(command->name, syntax_id, &binding, resolve_data);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      err = add_syntax
+        (sys, command->name, binding.func, binding.data,
+         binding.arg_completion, syntax->argv_desc, syntax->description,
+         syntax, true);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+    }
+  }
 
-  #undef MAX_ARG_COUNT
 exit:
   return err;
 error:
+  for(i = 0; i < nadopted; ++i) {
+    bool has_command = false; /* The failed command may have no syntax. */
+    CMDSYS(has_command(sys, schema->commands[i].name, &has_command));
+    if(has_command)
+      CMDSYS(del_command(sys, schema->commands[i].name));
+  }
   goto exit;
 }
 
+/* Bind the syntaxes of a plugin manifest to stubs that reference the syntax
+ * to resolve once the module is loaded. */
+static enum cmdsys_error
+resolve_stub
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  struct plugin* plugin = data;
+  struct plugin_stub* stub = NULL;
+  ASSERT(name && binding && plugin);
+  ASSERT(plugin->nstubs < plugin->manifest->nsyntaxes);
+
+  stub = plugin->stubs + plugin->nstubs++;
+  stub->plugin = plugin;
+  stub->name = name;
+  stub->syntax_id = syntax_id;
+  binding->func = plugin_stub;
+  binding->data = stub;
+  return CMDSYS_NO_ERROR;
+}
+
 enum cmdsys_error
-cmdsys_man_command
+cmdsys_add_plugin
   (struct cmdsys* sys,
-   const char* name,
-   size_t* len,
-   size_t max_buf_len,
-   char* buffer)
+   const char* path,
+   const struct cmdsys_schema* manifest,
+   void* plugin_data)
 {
-  struct list_node* cmd_list = NULL;
-  struct list_node* node = NULL;
+  struct plugin* plugin = NULL;
+  size_t len = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
-  long fpos = 0;
 
-  if(!sys || !name || (max_buf_len && !buffer)) {
+  if(!sys || !path || !manifest) {
     err = CMDSYS_INVALID_ARGUMENT;
     goto error;
   }
-
-  SL(hash_table_find(sys->htbl, &name, (void**)&cmd_list));
-  if(!cmd_list) {
-    errbuf_print(&sys->errbuf, "%s: command not found\n", name);
-    err = CMDSYS_COMMAND_ERROR;
+  len = strlen(path);
+  plugin = MEM_CALLOC(sys->allocator, 1,
+      sizeof(struct plugin)
+    + manifest->nsyntaxes * sizeof(struct plugin_stub)
+    + len + 1);
+  if(!plugin) {
+    err = CMDSYS_MEMORY_ERROR;
     goto error;
   }
-  ASSERT(is_list_empty(cmd_list) == false);
+  list_init(&plugin->node);
+  plugin->manifest = manifest;
+  plugin->path = (char*)(plugin->stubs + manifest->nsyntaxes);
+  memcpy(plugin->path, path, len + 1);
+  plugin->data = plugin_data;
 
-  rewind(sys->stream);
-  LIST_FOR_EACH(node, cmd_list) {
-    struct cmd* cmd = CONTAINER_OF(node, struct cmd, node);
+  err = cmdsys_adopt_schema(sys, manifest, resolve_stub, plugin);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  list_add(&sys->plugin_list, &plugin->node);
 
-    if(node != list_head(cmd_list))
-       fprintf(sys->stream, "\n");
+exit:
+  return err;
+error:
+  if(plugin)
+    MEM_FREE(sys->allocator, plugin);
+  goto exit;
+}
 
-    fprintf(sys->stream, "%s", name);
-    arg_print_syntaxv(sys->stream, cmd->arg_table, "\n");
-    if(cmd->description) {
-      const char* cstr = NULL;
-      SL(string_get(cmd->description, &cstr));
-      fprintf(sys->stream, "%s\n", cstr);
-    }
-    arg_print_glossary(sys->stream, cmd->arg_table, NULL);
-    fpos = ftell(sys->stream);
-    ASSERT(fpos > 0);
+/* Write the message of a recorded error into the stream of `sys'. */
+static void
+print_error(struct cmdsys* sys, const struct error_record* rec)
+{
+  char* argv[ERRLOG_MAX_TOKENS];
+  const char* command = rec->info.command ? rec->info.command : "";
+  struct cmd_list* command_list = NULL;
+  size_t arena_id = rec->first_token;
+  size_t cmd_id = 0;
+  int min_nerror = INT_MAX;
+  int i = 0;
+  ASSERT(sys && rec && rec->ntokens <= ERRLOG_MAX_TOKENS);
+
+  for(i = 0; i < rec->ntokens; ++i) {
+    argv[i] = sys->errlog.arena + arena_id;
+    arena_id += strlen(argv[i]) + 1;
   }
 
-  if(len)
-    *len = (size_t)fpos / sizeof(char);
-  if(buffer && max_buf_len) {
-    const size_t size = MIN((max_buf_len - 1) * sizeof(char), (size_t)fpos);
-    size_t nb = 0;
-    (void)nb;
+  switch(rec->info.code) {
+    case CMDSYS_ERROR_COMMAND_NOT_FOUND:
+      fprintf(sys->stream, "%s: command not found\n", command);
+      break;
+    case CMDSYS_ERROR_INVALID_SYNTAX:
+      /* Parse the tokens again to print the errors of the syntaxes, unless
+       * the syntaxes were updated since the failure. */
+      if(rec->version == sys->version)
+        command_list = find_cmd_list(sys, name_key(argv[0]));
+      if(!command_list) {
+        fprintf(sys->stream, "%s: invalid command syntax\n", command);
+        break;
+      }
+      for(cmd_id = 0; cmd_id < command_list->count; ++cmd_id) {
+        struct cmd* cmd = command_list->cmds + cmd_id;
+        int nerror = 0;
+        int ndecode_error = 0;
+
+        nerror = arg_parse(rec->ntokens, argv, cmd->arg_table);
+        ndecode_error =
+          nerror == 0
+          ? decode_numeric_args(cmd, false, NULL, NULL, NULL, NULL) : 0;
+        nerror += ndecode_error;
+        if(nerror > min_nerror)
+          continue;
+        if(nerror < min_nerror) {
+          min_nerror = nerror;
+          rewind(sys->stream);
+        }
+        fprintf(sys->stream, "\n%s", command);
+        arg_print_syntaxv(sys->stream, cmd->arg_table, "\n");
+        arg_print_errors
+          (sys->stream, (struct arg_end*)cmd->arg_table[cmd->argc - 1],
+           command);
+        if(ndecode_error)
+          decode_numeric_args(cmd, false, sys->stream, command, NULL, NULL);
+      }
+      break;
+    case CMDSYS_ERROR_INVALID_VALUE:
+      if(rec->info.token < 0) { /* Invoked command. */
+        fprintf(sys->stream, "%s: unexpected option value\n", command);
+      } else {
+        fprintf(sys->stream, "%s: unexpected option value `%s'\n",
+          command, argv[rec->info.token] + rec->info.offset);
+      }
+      break;
+    case CMDSYS_ERROR_UNEXPECTED_ARGUMENT:
+      ASSERT(rec->ntokens > 1);
+      fprintf(sys->stream, "%s: unexpected argument `%s'\n",
+        command, argv[1]);
+      break;
+    case CMDSYS_ERROR_CHAIN_SYNTAX:
+      fprintf(sys->stream, "syntax error near `%s'\n", command);
+      break;
+    case CMDSYS_ERROR_MACRO_DEPTH:
+      fprintf(sys->stream, "too many nested macros\n");
+      break;
+    case CMDSYS_ERROR_PLUGIN_NOT_BOUND:
+      fprintf(sys->stream, "%s: plugin syntax not bound to its module\n",
+        command);
+      break;
+    default: ASSERT(0); /* Unreachable code */ break;
+  }
+}
+
+/* Append the content written into the stream of `sys' to the error text. The
+ * text length is only updated if `commit' is true. */
+static enum cmdsys_error
+append_error_text(struct cmdsys* sys, const bool commit)
+{
+  struct errlog* log = &sys->errlog;
+  const long fpos = ftell(sys->stream);
+  size_t size = 0;
+  size_t nb = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  (void)nb;
+  ASSERT(sys);
 
+  if(fpos < 0)
+    return CMDSYS_IO_ERROR;
+  size = (size_t)fpos;
+  err = reserve_buffer
+    (sys->allocator, (void**)&log->text, &log->text_capacity,
+     log->text_len + size + 1);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  if(size) {
     fflush(sys->stream);
     rewind(sys->stream);
-    nb = fread(buffer, size, 1, sys->stream);
+    nb = fread(log->text + log->text_len, size, 1, sys->stream);
     ASSERT(nb == 1);
-    buffer[size/sizeof(char)] = '\0';
   }
-exit:
-  return err;
-error:
-  goto exit;
+  log->text[log->text_len + size] = '\0';
+  if(commit)
+    log->text_len += size;
+  return CMDSYS_NO_ERROR;
 }
 
-enum cmdsys_error
-cmdsys_command_arg_completion
-  (struct cmdsys* sys,
-   const char* cmd_name,
-   const char* arg_str,
-   size_t arg_str_len,
-   size_t hint_argc,
-   char* hint_argv[],
-   size_t* completion_list_len,
-   const char** completion_list[])
+/* Format the messages of the errors recorded since the last call. */
+static enum cmdsys_error
+format_errors(struct cmdsys* sys)
 {
-  struct list_node* cmd_list = NULL;
+  struct errlog* log = &sys->errlog;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys);
 
-  if(!sys
-  || !cmd_name
-  || (arg_str_len && !arg_str)
-  || (hint_argc && !hint_argv)
-  || !completion_list_len
-  || !completion_list) {
-    err =  CMDSYS_INVALID_ARGUMENT;
-    goto error;
+  for(; log->nformatted < log->nrecords; ++log->nformatted) {
+    log->records[log->nformatted].text_offset = log->text_len;
+    rewind(sys->stream);
+    print_error(sys, log->records + log->nformatted);
+    err = append_error_text(sys, true);
+    if(err != CMDSYS_NO_ERROR)
+      break;
   }
-  /* Default completion list value. */
-  *completion_list_len = 0;
-  *completion_list = NULL;
+  return err;
+}
 
-  SL(hash_table_find(sys->htbl, &cmd_name, (void**)&cmd_list));
-  if(cmd_list != NULL) {
-    struct cmd* cmd = NULL;
-    ASSERT(is_list_empty(cmd_list) == false);
-
-    /* No multi syntax. */
-    if(list_head(cmd_list) == list_tail(cmd_list)) {
-      cmd = CONTAINER_OF(list_head(cmd_list), struct cmd, node);
-      if(cmd->completion) {
-        cmd->completion
-          (sys, arg_str, arg_str_len, completion_list_len, completion_list);
-      }
-    /* Multi syntax. */
-    } else {
-      struct cmd* valid_cmd = NULL;
-      struct list_node* node = NULL;
-      int nb_valid_cmd = 0;
-      int min_nerror = INT_MAX;
-      int max_ndefargs = INT_MIN;
+/* Message of the errors recorded since `mark'. */
+static enum cmdsys_error
+get_error_string
+  (const struct cmdsys* sys,
+   const struct cmdsys_error_mark* mark,
+   const char** error)
+{
+  /* Formatting the pending errors does not alter the logical state of the
+   * command system. */
+  struct cmdsys* cmdsys = (struct cmdsys*)sys;
+  struct errlog* log = NULL;
+  size_t nlost = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && mark && error);
 
-      LIST_FOR_EACH(node, cmd_list) {
-        int nerror = 0;
-        int ndefargs = 0;
-
-        cmd = CONTAINER_OF(node, struct cmd, node);
-        set_optvalue_flag(cmd, true);
-        nerror = arg_parse((int)hint_argc, hint_argv, cmd->arg_table);
-        ndefargs = defined_args_count(cmd);
-
-        /* Define as the completion function the one defined by the command
-         * syntax which match the best the hint arguments. If the minimal
-         * number of parsing error is obtained by several syntaxes, we select
-         * the syntax which have the maximum of its argument defined by the
-         * hint command. */
-        if(nerror < min_nerror
-        || (nerror == min_nerror && ndefargs > max_ndefargs)) {
-          valid_cmd = cmd;
-          nb_valid_cmd = 0;
-        }
-        min_nerror = MIN(nerror, min_nerror);
-        max_ndefargs = MAX(ndefargs, max_ndefargs);
-        nb_valid_cmd += ((ndefargs == max_ndefargs) & (nerror == min_nerror));
-        set_optvalue_flag(cmd, false);
-      }
-      /* Perform the completion only if an unique syntax match the previous
-       * completion heuristic and and if its completion process is defined. */
-      if(nb_valid_cmd == 1 && valid_cmd->completion) {
-        valid_cmd->completion
-          (sys, arg_str, arg_str_len, completion_list_len, completion_list);
-      }
-    }
+  log = &cmdsys->errlog;
+  nlost = log->nlost - mark->nlost;
+  if(log->nrecords == mark->nrecords && !nlost) {
+    *error = NULL;
+    goto exit;
   }
-  if(*completion_list_len == 0)
-    *completion_list = NULL;
+  err = format_errors(cmdsys);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  /* The count of the lost errors follows the text and is thus rewritten on
+   * each call. */
+  rewind(cmdsys->stream);
+  if(nlost)
+    fprintf(cmdsys->stream, "%lu more errors\n", (unsigned long)nlost);
+  err = append_error_text(cmdsys, false);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  *error = log->text + (mark->nrecords < log->nrecords
+    ? log->records[mark->nrecords].text_offset : log->text_len);
+
 exit:
   return err;
 error:
-  if(completion_list_len)
-    *completion_list_len = 0;
-  if(completion_list)
-    *completion_list = NULL;
   goto exit;
 }
 
+static FINLINE bool
+is_error_mark_valid
+  (const struct cmdsys* sys,
+   const struct cmdsys_error_mark* mark)
+{
+  ASSERT(sys && mark);
+  return mark->nrecords <= sys->errlog.nrecords
+      && mark->nlost <= sys->errlog.nlost;
+}
+
 enum cmdsys_error
-cmdsys_command_name_completion
-  (struct cmdsys* sys,
-   const char* cmd_name,
-   size_t cmd_name_len,
-   size_t* completion_list_len,
-   const char** completion_list[])
+cmdsys_get_error_string(const struct cmdsys* sys, const char** error)
 {
-  const char** name_list = NULL;
+  const struct cmdsys_error_mark mark = { 0, 0 };
+  if(!sys || !error)
+    return CMDSYS_INVALID_ARGUMENT;
+  return get_error_string(sys, &mark, error);
+}
+
+enum cmdsys_error
+cmdsys_mark_error(const struct cmdsys* sys, struct cmdsys_error_mark* mark)
+{
+  if(!sys || !mark)
+    return CMDSYS_INVALID_ARGUMENT;
+  mark->nrecords = sys->errlog.nrecords;
+  mark->nlost = sys->errlog.nlost;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_get_error_string_since
+  (const struct cmdsys* sys,
+   const struct cmdsys_error_mark* mark,
+   const char** error)
+{
+  if(!sys || !mark || !error || !is_error_mark_valid(sys, mark))
+    return CMDSYS_INVALID_ARGUMENT;
+  return get_error_string(sys, mark, error);
+}
+
+enum cmdsys_error
+cmdsys_rewind_error(struct cmdsys* sys, const struct cmdsys_error_mark* mark)
+{
+  struct errlog* log = NULL;
+  if(!sys || !mark || !is_error_mark_valid(sys, mark))
+    return CMDSYS_INVALID_ARGUMENT;
+  log = &sys->errlog;
+  if(mark->nrecords < log->nrecords) {
+    log->arena_len = log->records[mark->nrecords].first_token;
+    if(mark->nrecords < log->nformatted) {
+      log->text_len = log->records[mark->nrecords].text_offset;
+      log->nformatted = mark->nrecords;
+    }
+  }
+  log->nrecords = mark->nrecords;
+  log->nlost = mark->nlost;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_get_error_count(const struct cmdsys* sys, size_t* count)
+{
+  if(!sys || !count)
+    return CMDSYS_INVALID_ARGUMENT;
+  *count = sys->errlog.nrecords;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_get_error
+  (const struct cmdsys* sys,
+   const size_t error_id,
+   struct cmdsys_error_info* info)
+{
+  if(!sys || !info || error_id >= sys->errlog.nrecords)
+    return CMDSYS_INVALID_ARGUMENT;
+  *info = sys->errlog.records[error_id].info;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_flush_error(struct cmdsys* sys)
+{
+  if(!sys)
+    return CMDSYS_INVALID_ARGUMENT;
+  sys->errlog.nrecords = 0;
+  sys->errlog.nlost = 0;
+  sys->errlog.arena_len = 0;
+  sys->errlog.text_len = 0;
+  sys->errlog.nformatted = 0;
+  return CMDSYS_NO_ERROR;
+}
+
+
+/* Number of bytes that can still be written to the output. */
+static FINLINE size_t
+output_room(const struct output* output)
+{
+  ASSERT(output);
+  return output->config.max_size > output->len
+    ? output->config.max_size - output->len : 0;
+}
+
+/* Append `size' bytes to the output. The bytes beyond its maximum size are
+ * dropped. */
+static enum cmdsys_error
+output_append(struct cmdsys* sys, const char* data, const size_t size)
+{
+  struct output* output = &sys->output;
   size_t len = 0;
   enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(sys && (data || !size));
 
-  if(!sys
-  || (cmd_name_len && !cmd_name)
-  || !completion_list_len
-  || !completion_list) {
-    err = CMDSYS_INVALID_ARGUMENT;
-    goto error;
+  len = MIN(size, output_room(output));
+  err = reserve_output(sys, len);
+  if(err != CMDSYS_NO_ERROR)
+    return err;
+  if(len)
+    memcpy(output->buffer + output->len, data, len);
+  output->len += len;
+  output->buffer[output->len] = '\0';
+  if(len < size) {
+    output->is_truncated = true;
+    return CMDSYS_MEMORY_ERROR;
   }
-  SL(flat_set_buffer(sys->name_set, &len, NULL, NULL, (void**)&name_list));
-  if(0 == cmd_name_len) {
-    *completion_list_len = len;
-    *completion_list = name_list;
-  } else {
-    #define CHARBUF_SIZE 32
-    char buf[CHARBUF_SIZE];
-    const char* ptr = buf;
-    size_t begin = 0;
-    size_t end = 0;
+  return CMDSYS_NO_ERROR;
+}
 
-    if(cmd_name_len > CHARBUF_SIZE - 1) {
-      err = CMDSYS_MEMORY_ERROR;
-      goto error;
-    }
-    strncpy(buf, cmd_name, cmd_name_len);
-    buf[cmd_name_len] = '\0';
-    SL(flat_set_lower_bound(sys->name_set, &ptr, &begin));
-    buf[cmd_name_len] = 127;
-    buf[cmd_name_len + 1] = '\0';
-    SL(flat_set_upper_bound(sys->name_set, &ptr, &end));
-    *completion_list = name_list + begin;
-    *completion_list_len = (size_t)((name_list + end) - (*completion_list));
-    if(0 == *completion_list_len)
-      *completion_list = NULL;
-    #undef CHARBUF_SIZE
+enum cmdsys_error
+cmdsys_configure_output
+  (struct cmdsys* sys,
+   const struct cmdsys_output_config* config)
+{
+  if(!sys || !config)
+    return CMDSYS_INVALID_ARGUMENT;
+  sys->output.config = *config;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_write(struct cmdsys* sys, const void* data, const size_t size)
+{
+  if(!sys || (!data && size))
+    return CMDSYS_INVALID_ARGUMENT;
+  return output_append(sys, data, size);
+}
+
+enum cmdsys_error
+cmdsys_vprintf(struct cmdsys* sys, const char* fmt, va_list args)
+{
+  struct output* output = NULL;
+  va_list args_copy;
+  size_t avail = 0;
+  size_t room = 0;
+  int len = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !fmt)
+    return CMDSYS_INVALID_ARGUMENT;
+  output = &sys->output;
+
+  /* Try first to format in the free space of the buffer. */
+  avail = output->capacity ? output->capacity - output->len : 0;
+  va_copy(args_copy, args);
+  len = vsnprintf
+    (avail ? output->buffer + output->len : NULL, avail, fmt, args_copy);
+  va_end(args_copy);
+  if(len < 0)
+    return CMDSYS_UNKNOWN_ERROR;
+  if((size_t)len < avail && (size_t)len <= output_room(output)) {
+    output->len += (size_t)len;
+    return CMDSYS_NO_ERROR;
   }
-exit:
+
+  /* Grow the buffer up to the maximum size and format again. */
+  room = MIN((size_t)len, output_room(output));
+  err = reserve_output(sys, room);
+  if(err != CMDSYS_NO_ERROR) {
+    if(output->buffer)
+      output->buffer[output->len] = '\0';
+    return err;
+  }
+  vsnprintf(output->buffer + output->len, room + 1, fmt, args);
+  output->len += room;
+  if(room < (size_t)len) {
+    output->is_truncated = true;
+    return CMDSYS_MEMORY_ERROR;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_printf(struct cmdsys* sys, const char* fmt, ...)
+{
+  va_list args;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !fmt)
+    return CMDSYS_INVALID_ARGUMENT;
+  va_start(args, fmt);
+  err = cmdsys_vprintf(sys, fmt, args);
+  va_end(args);
   return err;
-error:
-  goto exit;
 }
 
 enum cmdsys_error
-cmdsys_get_error_string(const struct cmdsys* sys, const char** error)
+cmdsys_get_output
+  (const struct cmdsys* sys,
+   const char** output,
+   size_t* len,
+   bool* is_truncated)
 {
-  if(!sys || !error)
+  if(!sys || !output || !len)
     return CMDSYS_INVALID_ARGUMENT;
-  *error = sys->errbuf.buffer_id == 0 ? NULL : sys->errbuf.buffer;
+  *output = sys->output.buffer ? sys->output.buffer : "";
+  *len = sys->output.len;
+  if(is_truncated)
+    *is_truncated = sys->output.is_truncated;
   return CMDSYS_NO_ERROR;
 }
 
 enum cmdsys_error
-cmdsys_flush_error(struct cmdsys* sys)
+cmdsys_reset_output(struct cmdsys* sys)
 {
   if(!sys)
     return CMDSYS_INVALID_ARGUMENT;
-  sys->errbuf.buffer_id = 0;
-  sys->errbuf.buffer[0] = '\0';
+  sys->output.len = 0;
+  sys->output.is_truncated = false;
+  if(sys->output.buffer)
+    sys->output.buffer[0] = '\0';
   return CMDSYS_NO_ERROR;
 }
 
+enum cmdsys_error
+cmdsys_get_memory_usage
+  (const struct cmdsys* sys,
+   struct cmdsys_memory_usage* usage)
+{
+  if(!sys || !usage)
+    return CMDSYS_INVALID_ARGUMENT;
+  *usage = sys->mem.usage;
+  return CMDSYS_NO_ERROR;
+}
@@ -2,6 +2,7 @@
 #define CMDSYS_H
 
 #include <snlsys/snlsys.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -19,7 +20,10 @@
 # define CMDSYS(func) cmdsys_##func
 #endif /* NDEBUG */
 
+struct cmdarg_cursor;
 struct cmdsys;
+struct cmdsys_completion_session;
+struct cmdsys_prepared;
 struct mem_allocator;
 
 /*******************************************************************************
@@ -59,23 +63,35 @@ struct cmdarg_desc {
     struct { float min, max; } real;
     struct { const char** value_list; } string;
   } domain;
+  /* Pass the values to the command function through a cursor that decodes
+   * them one at a time rather than through the value list. Not allowed for
+   * LITERAL arguments. */
+  bool is_streamed;
 };
 
+/* Initializer of CMDARG_END, usable in a constant expression. */
+#define CMDARG_END_INITIALIZER {                                               \
+    .type = CMDARG_TYPES_COUNT,                                                \
+    .short_options = (void*)0xDEADBEEF,                                        \
+    .long_options = (void*)0xDEADBEEF,                                         \
+    .data_type = (void*)0xDEADBEEF,                                            \
+    .glossary = (void*)0xDEADBEEF,                                             \
+    .min_count = 1,                                                            \
+    .max_count = 0,                                                            \
+    .domain = { .integer = { .min = 1, .max = 0 } }                            \
+  }
+
 /* Mark the end of cmdarg desc list declaration. */
-static const struct cmdarg_desc CMDARG_END = {
-  .type = CMDARG_TYPES_COUNT,
-  .short_options = (void*)0xDEADBEEF,
-  .long_options = (void*)0xDEADBEEF,
-  .data_type = (void*)0xDEADBEEF,
-  .glossary = (void*)0xDEADBEEF,
-  .min_count = 1,
-  .max_count = 0,
-  .domain = { .integer = { .min = 1, .max = 0 } }
-};
+static const struct cmdarg_desc CMDARG_END = CMDARG_END_INITIALIZER;
 
+/* Argument given to a command function. Only the supplied values are stored;
+ * the values of a parsed command are followed by an undefined value, i.e.
+ * `value_list[count].is_defined' is false. The values of a streamed argument
+ * are read through its cursor and its value list is NULL. */
 struct cmdarg {
   enum cmdarg_type type;
-  size_t count;
+  size_t count; /* Number of supplied values. */
+  struct cmdarg_cursor* cursor; /* NULL if the argument is not streamed. */
   struct cmdarg_value {
     /* Used to define if an optionnal arg is setup by the command or not.
      * Required arguments are always defined. */
@@ -85,7 +101,103 @@ struct cmdarg {
       int integer;
       const char* string; /* Valid for string, and file arg types. */
     } data;
-  } value_list[];
+    /* Length of the string and file values. Both the string and its length
+     * are only valid during the invocation of the command function. */
+    size_t length;
+  }* value_list;
+};
+
+/* Callbacks bound to a command syntax loaded from a registry image. */
+struct cmdsys_binding {
+  void (*func)(struct cmdsys*, size_t argc, const struct cmdarg**, void*);
+  void* data;
+  void (*arg_completion) /* May be NULL. */
+    (struct cmdsys*, const char*, size_t, size_t*, const char**[]);
+};
+
+/* Kind of the failure of a command. */
+enum cmdsys_error_code {
+  CMDSYS_ERROR_COMMAND_NOT_FOUND,
+  CMDSYS_ERROR_INVALID_SYNTAX, /* No syntax of the command matches. */
+  CMDSYS_ERROR_INVALID_VALUE, /* Value out of the domain of a STRING arg. */
+  CMDSYS_ERROR_UNEXPECTED_ARGUMENT, /* Argument given to a macro. */
+  CMDSYS_ERROR_CHAIN_SYNTAX, /* `&&' or `||' without command on one side. */
+  CMDSYS_ERROR_MACRO_DEPTH, /* Too many nested macros. */
+  CMDSYS_ERROR_PLUGIN_NOT_BOUND, /* Plugin syntax without module function. */
+  CMDSYS_ERROR_CODES_COUNT
+};
+
+/* Structured description of a failed command. The strings are owned by the
+ * command system and remain valid until the errors are flushed. */
+struct cmdsys_error_info {
+  enum cmdsys_error_code code;
+  const char* command; /* Name of the failed command. NULL if none. */
+  /* Index of the offending token in the expanded command tokens and span of
+   * the offending text into it. The index is -1 if no token is at fault, e.g.
+   * on a missing argument. */
+  int token;
+  size_t offset;
+  size_t length;
+  /* Type of the argument the offending text is parsed against.
+   * CMDARG_TYPES_COUNT if unknown. */
+  enum cmdarg_type expected_type;
+  /* Best matching syntax in the order in which the syntaxes were added.
+   * SIZE_MAX if the failure is not related to a syntax. */
+  size_t syntax_id;
+  size_t line; /* Line of the command in a validated script. 0 otherwise. */
+};
+
+/* Position into the errors of a command system. */
+struct cmdsys_error_mark {
+  size_t nrecords;
+  size_t nlost;
+};
+
+/* Syntax matched by a validated command. */
+struct cmdsys_validation {
+  /* Matched syntax in the order in which the syntaxes were added. SIZE_MAX
+   * if the command invokes a macro. */
+  size_t syntax_id;
+  /* Arguments as they would be given to the command function. They are valid
+   * until the next command is validated or executed. NULL for a macro. */
+  size_t argc;
+  const struct cmdarg** argv;
+};
+
+struct cmdsys_output_config {
+  size_t max_size; /* Bytes written beyond are dropped. SIZE_MAX if none. */
+  /* Reset the output before each command that is not executed by a command
+   * function. */
+  bool reset_per_command;
+};
+
+#define CMDSYS_OUTPUT_CONFIG_DEFAULT { (size_t)-1, false }
+
+/* Components of the memory used by a command system. */
+enum cmdsys_memory_category {
+  CMDSYS_MEMORY_NAMES, /* Pool of the interned command names. */
+  CMDSYS_MEMORY_DESCRIPTORS, /* Syntax descriptors and their arg lists. */
+  CMDSYS_MEMORY_VALUES, /* Storage of the argument values. */
+  /* Objects allocated by argtable2. Since argtable2 directly uses malloc, their
+   * size is computed from the argtable2 allocation scheme. */
+  CMDSYS_MEMORY_ARGTABLE,
+  CMDSYS_MEMORY_INDICES, /* Hash table, name set and namespace tree. */
+  /* Pool of the interned descriptions and argument texts. */
+  CMDSYS_MEMORY_DESCRIPTIONS,
+  /* Variables, macros, images, completion sessions and the command system
+   * itself. */
+  CMDSYS_MEMORY_OTHERS,
+  CMDSYS_MEMORY_CATEGORIES_COUNT
+};
+
+struct cmdsys_memory_usage {
+  struct cmdsys_memory_stat {
+    size_t size; /* In bytes. */
+    size_t count; /* Number of allocations. */
+  } category[CMDSYS_MEMORY_CATEGORIES_COUNT];
+  size_t size; /* Overall size in bytes. */
+  size_t count; /* Overall number of allocations. */
+  size_t peak_size; /* Highest overall size since the creation. */
 };
 
 /*******************************************************************************
@@ -161,7 +273,10 @@ CMDSYS_API enum cmdsys_error
 cmdsys_ref_put
   (struct cmdsys* cmdsys);
 
-/* Multi syntax is supported by adding several commands with the same name. */
+/* Multi syntax is supported by adding several commands with the same name.
+ * The name, the description and the option, data type and glossary texts of
+ * `argv_desc' are interned, i.e. each distinct text is copied once per
+ * command system and freed once no more syntax references it. */
 CMDSYS_API enum cmdsys_error
 cmdsys_add_command
   (struct cmdsys* cmdsys,
@@ -173,6 +288,30 @@ cmdsys_add_command
    const struct cmdarg_desc argv_desc[],
    const char* description); /* May be NULL. */
 
+/* Register a command syntax whose arg table and argument values are built on
+ * its first use, i.e. when it is executed, its manual is printed or its
+ * arguments are completed. `argv_desc' and `description' are referenced
+ * rather than copied and must thus outlive the command. */
+CMDSYS_API enum cmdsys_error
+cmdsys_add_lazy_command
+  (struct cmdsys* cmdsys,
+   const char* name,
+   void (*func)(struct cmdsys*, size_t argc, const struct cmdarg**, void*),
+   void *data,
+   void (*arg_completion) /* May be NULL.*/
+    (struct cmdsys*, const char*, size_t, size_t*, const char**[]),
+   const struct cmdarg_desc argv_desc[],
+   const char* description); /* May be NULL. */
+
+/* Build at most `max_count' of the lazy syntaxes that are not used yet, e.g.
+ * when the application is idle. `count' is lower than `max_count' once every
+ * syntax is built. */
+CMDSYS_API enum cmdsys_error
+cmdsys_prewarm
+  (struct cmdsys* cmdsys,
+   const size_t max_count,
+   size_t* count); /* May be NULL. */
+
 CMDSYS_API enum cmdsys_error
 cmdsys_del_command
   (struct cmdsys* cmdsys,
@@ -184,12 +323,207 @@ cmdsys_has_command
    const char* name,
    bool* has_command);
 
+/* The command may chain several commands with the `;', `&&' and `||'
+ * operators of the shell. It returns the status of the last executed one.
+ * Blanks and operators between quotes are not interpreted. */
 CMDSYS_API enum cmdsys_error
 cmdsys_execute_command
   (struct cmdsys* cmdsys,
    const char* command,
    const char* inverse); /* May be NULL */
 
+/* Parse the command as cmdsys_execute_command does, without invoking any
+ * command function. On chained commands, `result' is set from the last one.
+ * The body of an invoked macro is not validated. */
+CMDSYS_API enum cmdsys_error
+cmdsys_validate_command
+  (struct cmdsys* sys,
+   const char* command,
+   struct cmdsys_validation* result); /* May be NULL */
+
+/* Validate each non blank line of a script. The script is split in chunks
+ * validated by up to `nworkers' threads, the calling one included. The lazy
+ * syntaxes are built beforehand; each thread then parses its chunk against
+ * private clones of the arg tables while the registry is only read. The
+ * allocator must thus be thread safe if `nworkers' is greater than 1. The
+ * failures are recorded in the line order with their line number; the
+ * function returns CMDSYS_COMMAND_ERROR if a line is invalid. */
+CMDSYS_API enum cmdsys_error
+cmdsys_validate_file
+  (struct cmdsys* sys,
+   const char* path,
+   const size_t nworkers);
+
+/* Resolve the syntax of a command and decode its arguments once. The command
+ * cannot be chained nor invoke a macro nor have streamed arguments and its
+ * variables are expanded at preparation. A token `$N', N in [1, 16], is a
+ * placeholder of an argument value; the placeholders are numbered from 1
+ * without gap and their values must be bound before the execution. The syntax
+ * is resolved with each placeholder parsed as the value "0", i.e. the bound
+ * values do not take part in the syntax selection: a value whose type differs
+ * from the one of its argument in the resolved syntax is rejected when bound.
+ * The preparation does not invalidate the arguments of a validated
+ * command. */
+CMDSYS_API enum cmdsys_error
+cmdsys_prepare
+  (struct cmdsys* cmdsys,
+   const char* command,
+   struct cmdsys_prepared** prepared);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_prepared_ref_get
+  (struct cmdsys_prepared* prepared);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_prepared_ref_put
+  (struct cmdsys_prepared* prepared);
+
+/* Bind a value to the `$N' placeholder of a prepared command, N being `id'.
+ * The value is clamped to the domain of its INT or FLOAT argument while a
+ * value out of the domain of its STRING argument is rejected as on
+ * execution. A bound value remains until the next binding of the
+ * placeholder. */
+CMDSYS_API enum cmdsys_error
+cmdsys_bind_int
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   int value);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_bind_float
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   float value);
+
+/* Also binds FILE arguments. The string is copied. */
+CMDSYS_API enum cmdsys_error
+cmdsys_bind_string
+  (struct cmdsys_prepared* prepared,
+   const size_t id,
+   const char* value);
+
+/* Invoke the prepared command function with the stored arguments. Once a
+ * command is added or deleted, the command is prepared again on its next
+ * execution, which fails as cmdsys_prepare does if the command no longer
+ * matches a syntax, e.g. when it was deleted. The execution also fails with
+ * CMDSYS_INVALID_ARGUMENT if a placeholder is not bound. */
+CMDSYS_API enum cmdsys_error
+cmdsys_execute_prepared
+  (struct cmdsys_prepared* prepared);
+
+/* Invoke the command `name' with caller built arguments, i.e. without text.
+ * `args' lists the arguments of the syntax without the command name; each one
+ * has the type of its descriptor and at most `max_count' values, and its
+ * defined values lie in the descriptor domain; the length of the string
+ * values must be set. `syntax_hint' is the syntax to
+ * invoke in the order in which the syntaxes were added; if it is SIZE_MAX,
+ * the syntaxes are tried as on execution. Out of domain values are rejected
+ * rather than clamped. The defined values of a streamed argument are given to
+ * the command function through a cursor. */
+CMDSYS_API enum cmdsys_error
+cmdsys_invoke
+  (struct cmdsys* sys,
+   const char* name,
+   const size_t syntax_hint,
+   const struct cmdarg* args[],
+   const size_t argc);
+
+/* Read the next value of a streamed argument; `has_value' is false once the
+ * values are exhausted. The values are decoded from the command tokens as they
+ * are read: an invalid value is skipped and CMDSYS_COMMAND_ERROR is returned.
+ * The cursor is valid during the invocation of the command function. */
+CMDSYS_API enum cmdsys_error
+cmdsys_cursor_next
+  (struct cmdarg_cursor* cursor,
+   struct cmdarg_value* value,
+   bool* has_value);
+
+/* The command functions write their output into a buffer of the command
+ * system rather than into a stream, i.e. without stdio locks; the buffer
+ * grows by doubling and is kept across the resets. The write functions
+ * return CMDSYS_MEMORY_ERROR if the bytes beyond the maximum size of the
+ * output are dropped. */
+CMDSYS_API enum cmdsys_error
+cmdsys_configure_output
+  (struct cmdsys* sys,
+   const struct cmdsys_output_config* config);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_write
+  (struct cmdsys* sys,
+   const void* data,
+   const size_t size);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_printf
+  (struct cmdsys* sys,
+   const char* fmt,
+   ...) FORMAT_PRINTF(2, 3);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_vprintf
+  (struct cmdsys* sys,
+   const char* fmt,
+   va_list args);
+
+/* The output is NULL terminated and valid until the next write. */
+CMDSYS_API enum cmdsys_error
+cmdsys_get_output
+  (const struct cmdsys* sys,
+   const char** output,
+   size_t* len,
+   bool* is_truncated); /* May be NULL */
+
+CMDSYS_API enum cmdsys_error
+cmdsys_reset_output
+  (struct cmdsys* sys);
+
+/* Execute the command stored in the `len' first bytes of `buf'. The buffer
+ * does not have to be NULL terminated. */
+CMDSYS_API enum cmdsys_error
+cmdsys_execute_commandn
+  (struct cmdsys* cmdsys,
+   const char* buf,
+   size_t len,
+   const char* inverse); /* May be NULL */
+
+/* Variables are referenced in the commands with $NAME or ${NAME}, except
+ * between single quotes. Their value is substituted into the token that
+ * references them; it is not split in several tokens. An undefined variable
+ * is empty. The name is made of letters, digits and underscores and does not
+ * begin with a digit. */
+CMDSYS_API enum cmdsys_error
+cmdsys_set_variable
+  (struct cmdsys* cmdsys,
+   const char* name,
+   const char* value);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_get_variable
+  (struct cmdsys* cmdsys,
+   const char* name,
+   const char** value); /* Set to NULL if the variable is not defined. */
+
+CMDSYS_API enum cmdsys_error
+cmdsys_unset_variable
+  (struct cmdsys* cmdsys,
+   const char* name);
+
+/* Define a macro, i.e. a command without argument that executes `body'. The
+ * body may chain several commands; it is tokenized once and its variables are
+ * expanded on each execution. A registered command hides the macro of the
+ * same name. */
+CMDSYS_API enum cmdsys_error
+cmdsys_define_macro
+  (struct cmdsys* cmdsys,
+   const char* name,
+   const char* body);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_undefine_macro
+  (struct cmdsys* cmdsys,
+   const char* name);
+
 CMDSYS_API enum cmdsys_error
 cmdsys_man_command
   (struct cmdsys* cmdsys,
@@ -209,6 +543,38 @@ cmdsys_command_arg_completion
    size_t* completion_list_len,
    const char** completion_list[]);
 
+/* A completion session caches the syntax selected for the last hint arguments
+ * and its candidate list. When only characters are appended to the completed
+ * argument, the cached candidates are narrowed without parsing the hint
+ * arguments nor invoking the completion callback; the session thus assumes
+ * that the candidates of an argument are the candidates of its prefix that
+ * start with it. */
+CMDSYS_API enum cmdsys_error
+cmdsys_create_completion_session
+  (struct cmdsys* cmdsys,
+   struct cmdsys_completion_session** session);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_completion_session_ref_get
+  (struct cmdsys_completion_session* session);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_completion_session_ref_put
+  (struct cmdsys_completion_session* session);
+
+/* Session counterpart of cmdsys_command_arg_completion. The returned list is
+ * valid until the next call on the session. */
+CMDSYS_API enum cmdsys_error
+cmdsys_session_arg_completion
+  (struct cmdsys_completion_session* session,
+   const char* cmd_name,
+   const char* arg_str,
+   size_t arg_str_len,
+   size_t hint_argc,
+   char* hint_argv[],
+   size_t* completion_list_len,
+   const char** completion_list[]);
+
 /* The returned list is valid until the add/del command function is called. */
 CMDSYS_API enum cmdsys_error
 cmdsys_command_name_completion
@@ -218,15 +584,108 @@ cmdsys_command_name_completion
    size_t* completion_list_len,
    const char** completion_list[]);
 
+/* Command names are organized in namespaces delimited by dots, e.g. the
+ * `render.shadow.set' command lies in the `render' and `render.shadow'
+ * namespaces. Return the sorted names of the commands in the `ns' namespace
+ * and its sub namespaces. An empty `ns' lists all the commands. The returned
+ * list is valid until the add/del command function is called. */
+CMDSYS_API enum cmdsys_error
+cmdsys_list_namespace
+  (struct cmdsys* cmdsys,
+   const char* ns,
+   size_t* list_len,
+   const char** list[]);
+
+/* Delete all the commands of the `ns' namespace and its sub namespaces. */
+CMDSYS_API enum cmdsys_error
+cmdsys_del_namespace
+  (struct cmdsys* cmdsys,
+   const char* ns);
+
+/* Complete the last component of a dot separated path, i.e. the returned
+ * list contains the names of the next path component only and not the full
+ * command names. The list is valid until the add/del command function is
+ * called. */
+CMDSYS_API enum cmdsys_error
+cmdsys_namespace_completion
+  (struct cmdsys* cmdsys,
+   const char* path,
+   size_t path_len,
+   size_t* completion_list_len,
+   const char** completion_list[]);
+
+/* Serialize the registered commands into a relocatable image. Callbacks and
+ * user data are not saved; they are rebound when the image is loaded. */
+CMDSYS_API enum cmdsys_error
+cmdsys_save_image
+  (struct cmdsys* cmdsys,
+   const char* filename);
+
+/* Register the commands of an image. The `resolve' function is invoked on
+ * each loaded syntax to retrieve its callbacks; `syntax_id' is the rank of
+ * the syntax in the order in which it was added. None of the image commands
+ * may already be registered. The image file is mapped in memory and its
+ * syntaxes are registered as lazy ones referencing the mapping, which is
+ * released once all the image commands are deleted. */
+CMDSYS_API enum cmdsys_error
+cmdsys_load_image
+  (struct cmdsys* cmdsys,
+   const char* filename,
+   enum cmdsys_error (*resolve)
+    (const char* name, size_t syntax_id, struct cmdsys_binding*, void*),
+   void* resolve_data); /* May be NULL. */
+
+/* The failures are recorded as structured errors and their message is only
+ * formatted here. */
 CMDSYS_API enum cmdsys_error
 cmdsys_get_error_string
   (const struct cmdsys* sys,
    const char** error);
 
+/* Number of recorded errors. Once the error log is full, the following
+ * failures are only counted in the error string. */
+CMDSYS_API enum cmdsys_error
+cmdsys_get_error_count
+  (const struct cmdsys* sys,
+   size_t* count);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_get_error
+  (const struct cmdsys* sys,
+   const size_t error_id,
+   struct cmdsys_error_info* info);
+
 CMDSYS_API enum cmdsys_error
 cmdsys_flush_error
   (struct cmdsys* sys);
 
+/* The errors of a command can be isolated from the pending ones: its errors
+ * are those recorded since the mark taken before its execution and rewinding
+ * to the mark discards them while keeping the former errors pending. */
+CMDSYS_API enum cmdsys_error
+cmdsys_mark_error
+  (const struct cmdsys* sys,
+   struct cmdsys_error_mark* mark);
+
+/* NULL if no error was recorded since `mark'. */
+CMDSYS_API enum cmdsys_error
+cmdsys_get_error_string_since
+  (const struct cmdsys* sys,
+   const struct cmdsys_error_mark* mark,
+   const char** error);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_rewind_error
+  (struct cmdsys* sys,
+   const struct cmdsys_error_mark* mark);
+
+/* The sizes are the requested ones and thus do not include the overhead of
+ * the allocator. */
+CMDSYS_API enum cmdsys_error
+cmdsys_get_memory_usage
+  (const struct cmdsys* sys,
+   struct cmdsys_memory_usage* usage);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,679 @@
+#include "cmdsys_decode.h"
+
+#include <snlsys/math.h>
+#include <snlsys/snlsys.h>
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Single precision floating point format. */
+#define MANTISSA_BITS 23
+#define MINIMUM_EXPONENT -127
+#define INFINITE_POWER 0xFF
+#define SIGN_BIT 0x80000000u
+
+/* Range of the decimal exponents for which the Eisel-Lemire algorithm is
+ * invoked. Beyond it, any 19 digits mantissa rounds to zero or infinity. */
+#define SMALLEST_POWER_OF_TEN -65
+#define LARGEST_POWER_OF_TEN 38
+#define MIN_EXPONENT_ROUND_TO_EVEN -17
+#define MAX_EXPONENT_ROUND_TO_EVEN 10
+
+/* Maximum number of significant digits exactly stored in a 64-bits integer. */
+#define MAX_MANTISSA_DIGITS 19
+
+/* Maximum number of significant digits taken into account by the slow path.
+ * The remaining digits only define if the value is above the truncated one. */
+#define MAX_BIGNUM_DIGITS 768
+#define BIGNUM_LIMBS 160
+
+/* 128 most significant bits of 5^q, q in [SMALLEST_POWER_OF_TEN,
+ * LARGEST_POWER_OF_TEN]. Negative powers are rounded up. */
+static const uint64_t power_of_five_128[][2] = {
+  {0x86ccbb52ea94baeau, 0x98e947129fc2b4e9u},
+  {0xa87fea27a539e9a5u, 0x3f2398d747b36224u},
+  {0xd29fe4b18e88640eu, 0x8eec7f0d19a03aadu},
+  {0x83a3eeeef9153e89u, 0x1953cf68300424acu},
+  {0xa48ceaaab75a8e2bu, 0x5fa8c3423c052dd7u},
+  {0xcdb02555653131b6u, 0x3792f412cb06794du},
+  {0x808e17555f3ebf11u, 0xe2bbd88bbee40bd0u},
+  {0xa0b19d2ab70e6ed6u, 0x5b6aceaeae9d0ec4u},
+  {0xc8de047564d20a8bu, 0xf245825a5a445275u},
+  {0xfb158592be068d2eu, 0xeed6e2f0f0d56712u},
+  {0x9ced737bb6c4183du, 0x55464dd69685606bu},
+  {0xc428d05aa4751e4cu, 0xaa97e14c3c26b886u},
+  {0xf53304714d9265dfu, 0xd53dd99f4b3066a8u},
+  {0x993fe2c6d07b7fabu, 0xe546a8038efe4029u},
+  {0xbf8fdb78849a5f96u, 0xde98520472bdd033u},
+  {0xef73d256a5c0f77cu, 0x963e66858f6d4440u},
+  {0x95a8637627989aadu, 0xdde7001379a44aa8u},
+  {0xbb127c53b17ec159u, 0x5560c018580d5d52u},
+  {0xe9d71b689dde71afu, 0xaab8f01e6e10b4a6u},
+  {0x9226712162ab070du, 0xcab3961304ca70e8u},
+  {0xb6b00d69bb55c8d1u, 0x3d607b97c5fd0d22u},
+  {0xe45c10c42a2b3b05u, 0x8cb89a7db77c506au},
+  {0x8eb98a7a9a5b04e3u, 0x77f3608e92adb242u},
+  {0xb267ed1940f1c61cu, 0x55f038b237591ed3u},
+  {0xdf01e85f912e37a3u, 0x6b6c46dec52f6688u},
+  {0x8b61313bbabce2c6u, 0x2323ac4b3b3da015u},
+  {0xae397d8aa96c1b77u, 0xabec975e0a0d081au},
+  {0xd9c7dced53c72255u, 0x96e7bd358c904a21u},
+  {0x881cea14545c7575u, 0x7e50d64177da2e54u},
+  {0xaa242499697392d2u, 0xdde50bd1d5d0b9e9u},
+  {0xd4ad2dbfc3d07787u, 0x955e4ec64b44e864u},
+  {0x84ec3c97da624ab4u, 0xbd5af13bef0b113eu},
+  {0xa6274bbdd0fadd61u, 0xecb1ad8aeacdd58eu},
+  {0xcfb11ead453994bau, 0x67de18eda5814af2u},
+  {0x81ceb32c4b43fcf4u, 0x80eacf948770ced7u},
+  {0xa2425ff75e14fc31u, 0xa1258379a94d028du},
+  {0xcad2f7f5359a3b3eu, 0x096ee45813a04330u},
+  {0xfd87b5f28300ca0du, 0x8bca9d6e188853fcu},
+  {0x9e74d1b791e07e48u, 0x775ea264cf55347eu},
+  {0xc612062576589ddau, 0x95364afe032a819eu},
+  {0xf79687aed3eec551u, 0x3a83ddbd83f52205u},
+  {0x9abe14cd44753b52u, 0xc4926a9672793543u},
+  {0xc16d9a0095928a27u, 0x75b7053c0f178294u},
+  {0xf1c90080baf72cb1u, 0x5324c68b12dd6339u},
+  {0x971da05074da7beeu, 0xd3f6fc16ebca5e04u},
+  {0xbce5086492111aeau, 0x88f4bb1ca6bcf585u},
+  {0xec1e4a7db69561a5u, 0x2b31e9e3d06c32e6u},
+  {0x9392ee8e921d5d07u, 0x3aff322e62439fd0u},
+  {0xb877aa3236a4b449u, 0x09befeb9fad487c3u},
+  {0xe69594bec44de15bu, 0x4c2ebe687989a9b4u},
+  {0x901d7cf73ab0acd9u, 0x0f9d37014bf60a11u},
+  {0xb424dc35095cd80fu, 0x538484c19ef38c95u},
+  {0xe12e13424bb40e13u, 0x2865a5f206b06fbau},
+  {0x8cbccc096f5088cbu, 0xf93f87b7442e45d4u},
+  {0xafebff0bcb24aafeu, 0xf78f69a51539d749u},
+  {0xdbe6fecebdedd5beu, 0xb573440e5a884d1cu},
+  {0x89705f4136b4a597u, 0x31680a88f8953031u},
+  {0xabcc77118461cefcu, 0xfdc20d2b36ba7c3eu},
+  {0xd6bf94d5e57a42bcu, 0x3d32907604691b4du},
+  {0x8637bd05af6c69b5u, 0xa63f9a49c2c1b110u},
+  {0xa7c5ac471b478423u, 0x0fcf80dc33721d54u},
+  {0xd1b71758e219652bu, 0xd3c36113404ea4a9u},
+  {0x83126e978d4fdf3bu, 0x645a1cac083126eau},
+  {0xa3d70a3d70a3d70au, 0x3d70a3d70a3d70a4u},
+  {0xccccccccccccccccu, 0xcccccccccccccccdu},
+  {0x8000000000000000u, 0x0000000000000000u},
+  {0xa000000000000000u, 0x0000000000000000u},
+  {0xc800000000000000u, 0x0000000000000000u},
+  {0xfa00000000000000u, 0x0000000000000000u},
+  {0x9c40000000000000u, 0x0000000000000000u},
+  {0xc350000000000000u, 0x0000000000000000u},
+  {0xf424000000000000u, 0x0000000000000000u},
+  {0x9896800000000000u, 0x0000000000000000u},
+  {0xbebc200000000000u, 0x0000000000000000u},
+  {0xee6b280000000000u, 0x0000000000000000u},
+  {0x9502f90000000000u, 0x0000000000000000u},
+  {0xba43b74000000000u, 0x0000000000000000u},
+  {0xe8d4a51000000000u, 0x0000000000000000u},
+  {0x9184e72a00000000u, 0x0000000000000000u},
+  {0xb5e620f480000000u, 0x0000000000000000u},
+  {0xe35fa931a0000000u, 0x0000000000000000u},
+  {0x8e1bc9bf04000000u, 0x0000000000000000u},
+  {0xb1a2bc2ec5000000u, 0x0000000000000000u},
+  {0xde0b6b3a76400000u, 0x0000000000000000u},
+  {0x8ac7230489e80000u, 0x0000000000000000u},
+  {0xad78ebc5ac620000u, 0x0000000000000000u},
+  {0xd8d726b7177a8000u, 0x0000000000000000u},
+  {0x878678326eac9000u, 0x0000000000000000u},
+  {0xa968163f0a57b400u, 0x0000000000000000u},
+  {0xd3c21bcecceda100u, 0x0000000000000000u},
+  {0x84595161401484a0u, 0x0000000000000000u},
+  {0xa56fa5b99019a5c8u, 0x0000000000000000u},
+  {0xcecb8f27f4200f3au, 0x0000000000000000u},
+  {0x813f3978f8940984u, 0x4000000000000000u},
+  {0xa18f07d736b90be5u, 0x5000000000000000u},
+  {0xc9f2c9cd04674edeu, 0xa400000000000000u},
+  {0xfc6f7c4045812296u, 0x4d00000000000000u},
+  {0x9dc5ada82b70b59du, 0xf020000000000000u},
+  {0xc5371912364ce305u, 0x6c28000000000000u},
+  {0xf684df56c3e01bc6u, 0xc732000000000000u},
+  {0x9a130b963a6c115cu, 0x3c7f400000000000u},
+  {0xc097ce7bc90715b3u, 0x4b9f100000000000u},
+  {0xf0bdc21abb48db20u, 0x1e86d40000000000u},
+  {0x96769950b50d88f4u, 0x1314448000000000u},
+};
+
+/* Powers of ten exactly represented in single precision. */
+static const float exact_power_of_ten[] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+struct uint128 {
+  uint64_t high;
+  uint64_t low;
+};
+
+/* Binary representation of a float without its sign bit, i.e. its biased
+ * exponent and its explicit mantissa bits. */
+struct adjusted_mantissa {
+  uint64_t mantissa;
+  int32_t power2;
+};
+
+struct decimal {
+  const char* int_digits;
+  const char* frac_digits;
+  size_t int_len;
+  size_t frac_len;
+  int64_t exp10; /* Explicit exponent. */
+  uint64_t mantissa; /* Up to MAX_MANTISSA_DIGITS significant digits. */
+  int64_t exponent; /* Value ~= mantissa * 10^exponent. */
+  bool is_truncated; /* Non zero digits were dropped from the mantissa. */
+  bool is_negative;
+};
+
+struct bignum {
+  uint32_t limbs[BIGNUM_LIMBS]; /* Little endian. */
+  size_t len;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static FINLINE bool
+is_digit(const char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static FINLINE char
+to_lower(const char c)
+{
+  return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool
+match_nocase(const char* str, const char* ref)
+{
+  for(; *ref; ++str, ++ref) {
+    if(to_lower(*str) != *ref)
+      return false;
+  }
+  return *str == '\0';
+}
+
+static FINLINE struct uint128
+mul64(const uint64_t a, const uint64_t b)
+{
+  const uint64_t a_lo = a & 0xFFFFFFFFu;
+  const uint64_t a_hi = a >> 32;
+  const uint64_t b_lo = b & 0xFFFFFFFFu;
+  const uint64_t b_hi = b >> 32;
+  const uint64_t lo_lo = a_lo * b_lo;
+  const uint64_t hi_lo = a_hi * b_lo;
+  const uint64_t lo_hi = a_lo * b_hi;
+  const uint64_t hi_hi = a_hi * b_hi;
+  const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+  struct uint128 r;
+  r.high = hi_hi + (hi_lo >> 32) + (cross >> 32);
+  r.low = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+  return r;
+}
+
+static FINLINE uint32_t
+to_bits(const struct adjusted_mantissa am)
+{
+  return (uint32_t)am.mantissa | ((uint32_t)am.power2 << MANTISSA_BITS);
+}
+
+static FINLINE float
+from_bits(const uint32_t bits)
+{
+  float f = 0.f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/* Split the string in its integer part, fraction and exponent and compute its
+ * first MAX_MANTISSA_DIGITS significant digits. */
+static bool
+parse_decimal(const char* str, struct decimal* dec)
+{
+  const char* p = str;
+  size_t nsignificant = 0;
+  size_t ndropped = 0;
+  size_t i = 0;
+  ASSERT(str && dec);
+
+  memset(dec, 0, sizeof(struct decimal));
+  if(*p == '-' || *p == '+') {
+    dec->is_negative = *p == '-';
+    ++p;
+  }
+  dec->int_digits = p;
+  while(is_digit(*p))
+    ++p;
+  dec->int_len = (size_t)(p - dec->int_digits);
+  dec->frac_digits = p;
+  if(*p == '.') {
+    dec->frac_digits = ++p;
+    while(is_digit(*p))
+      ++p;
+    dec->frac_len = (size_t)(p - dec->frac_digits);
+  }
+  if(dec->int_len + dec->frac_len == 0)
+    return false;
+
+  if(*p == 'e' || *p == 'E') {
+    bool is_exp_negative = false;
+    ++p;
+    if(*p == '-' || *p == '+') {
+      is_exp_negative = *p == '-';
+      ++p;
+    }
+    if(!is_digit(*p))
+      return false;
+    for(; is_digit(*p); ++p) {
+      if(dec->exp10 < 0x10000) /* Saturate the exponent. */
+        dec->exp10 = dec->exp10 * 10 + (*p - '0');
+    }
+    if(is_exp_negative)
+      dec->exp10 = -dec->exp10;
+  }
+  if(*p != '\0')
+    return false;
+
+  for(i = 0; i < dec->int_len + dec->frac_len; ++i) {
+    const char c = i < dec->int_len
+      ? dec->int_digits[i] : dec->frac_digits[i - dec->int_len];
+    if(nsignificant == 0 && c == '0')
+      continue;
+    if(nsignificant < MAX_MANTISSA_DIGITS) {
+      dec->mantissa = dec->mantissa * 10 + (uint64_t)(c - '0');
+      ++nsignificant;
+    } else {
+      dec->is_truncated |= c != '0';
+      ++ndropped;
+    }
+  }
+  dec->exponent = dec->exp10 - (int64_t)dec->frac_len + (int64_t)ndropped;
+  return true;
+}
+
+/*******************************************************************************
+ *
+ * Eisel-Lemire algorithm.
+ *
+ ******************************************************************************/
+static FINLINE int32_t
+power(const int32_t q)
+{
+  return (((152170 + 65536) * q) >> 16) + 63;
+}
+
+static struct uint128
+compute_product_approximation(const int64_t q, const uint64_t w)
+{
+  const size_t id = (size_t)(q - SMALLEST_POWER_OF_TEN);
+  /* Precision required to round the mantissa: explicit bits + 3. */
+  const uint64_t precision_mask = UINT64_MAX >> (MANTISSA_BITS + 3);
+  struct uint128 first = mul64(w, power_of_five_128[id][0]);
+
+  if((first.high & precision_mask) == precision_mask) {
+    const struct uint128 second = mul64(w, power_of_five_128[id][1]);
+    first.low += second.high;
+    if(second.high > first.low)
+      ++first.high;
+  }
+  return first;
+}
+
+/* Compute the float nearest to w * 10^q. Exact if w is the exact mantissa. */
+static struct adjusted_mantissa
+compute_float(const int64_t q, uint64_t w)
+{
+  struct adjusted_mantissa am = { 0, 0 };
+  struct uint128 product;
+  int upperbit = 0;
+  int shift = 0;
+  int lz = 0;
+
+  if(w == 0 || q < SMALLEST_POWER_OF_TEN)
+    return am;
+  if(q > LARGEST_POWER_OF_TEN) {
+    am.power2 = INFINITE_POWER;
+    return am;
+  }
+  lz = __builtin_clzll(w);
+  w <<= lz;
+  product = compute_product_approximation(q, w);
+  upperbit = (int)(product.high >> 63);
+  shift = upperbit + 64 - MANTISSA_BITS - 3;
+
+  am.mantissa = product.high >> shift;
+  am.power2 = power((int32_t)q) + upperbit - lz - MINIMUM_EXPONENT;
+  if(am.power2 <= 0) { /* Subnormal. */
+    if(-am.power2 + 1 >= 64) {
+      am.mantissa = 0;
+      am.power2 = 0;
+      return am;
+    }
+    am.mantissa >>= -am.power2 + 1;
+    am.mantissa += am.mantissa & 1;
+    am.mantissa >>= 1;
+    am.power2 = am.mantissa < ((uint64_t)1 << MANTISSA_BITS) ? 0 : 1;
+    return am;
+  }
+  /* Exact halfway case: round to even. */
+  if(product.low <= 1
+  && q >= MIN_EXPONENT_ROUND_TO_EVEN
+  && q <= MAX_EXPONENT_ROUND_TO_EVEN
+  && (am.mantissa & 3) == 1
+  && (am.mantissa << shift) == product.high) {
+    am.mantissa &= ~(uint64_t)1;
+  }
+  am.mantissa += am.mantissa & 1;
+  am.mantissa >>= 1;
+  if(am.mantissa >= ((uint64_t)2 << MANTISSA_BITS)) {
+    am.mantissa = (uint64_t)1 << MANTISSA_BITS;
+    ++am.power2;
+  }
+  am.mantissa &= ~((uint64_t)1 << MANTISSA_BITS);
+  if(am.power2 >= INFINITE_POWER) {
+    am.power2 = INFINITE_POWER;
+    am.mantissa = 0;
+  }
+  return am;
+}
+
+/*******************************************************************************
+ *
+ * Slow path of the truncated mantissas: compare the decimal digits against
+ * the halfway point between the two float candidates.
+ *
+ ******************************************************************************/
+static bool
+bignum_mul_add(struct bignum* num, const uint32_t mul, const uint32_t add)
+{
+  uint64_t carry = add;
+  size_t i = 0;
+  ASSERT(num);
+
+  for(i = 0; i < num->len; ++i) {
+    const uint64_t x = (uint64_t)num->limbs[i] * mul + carry;
+    num->limbs[i] = (uint32_t)x;
+    carry = x >> 32;
+  }
+  if(carry) {
+    if(num->len >= BIGNUM_LIMBS)
+      return false;
+    num->limbs[num->len++] = (uint32_t)carry;
+  }
+  return true;
+}
+
+static bool
+bignum_mul_pow5(struct bignum* num, size_t exp)
+{
+  static const uint32_t small_power_of_five[] = {
+    1u, 5u, 25u, 125u, 625u, 3125u, 15625u, 78125u, 390625u, 1953125u,
+    9765625u, 48828125u, 244140625u, 1220703125u
+  };
+  ASSERT(num);
+
+  /* 5^13 is the largest power of 5 that fits in 32-bits. */
+  for(; exp >= 13; exp -= 13) {
+    if(!bignum_mul_add(num, small_power_of_five[13], 0))
+      return false;
+  }
+  return bignum_mul_add(num, small_power_of_five[exp], 0);
+}
+
+static bool
+bignum_shift_left(struct bignum* num, const size_t nbits)
+{
+  const size_t nlimbs = nbits / 32;
+  const unsigned nrem = (unsigned)(nbits % 32);
+  size_t i = 0;
+  ASSERT(num);
+
+  if(num->len == 0)
+    return true;
+  if(num->len + nlimbs + 1 > BIGNUM_LIMBS)
+    return false;
+  if(nrem) {
+    uint32_t carry = 0;
+    for(i = 0; i < num->len; ++i) {
+      const uint32_t x = num->limbs[i];
+      num->limbs[i] = (x << nrem) | carry;
+      carry = x >> (32 - nrem);
+    }
+    if(carry)
+      num->limbs[num->len++] = carry;
+  }
+  if(nlimbs) {
+    memmove(num->limbs + nlimbs, num->limbs, num->len * sizeof(uint32_t));
+    memset(num->limbs, 0, nlimbs * sizeof(uint32_t));
+    num->len += nlimbs;
+  }
+  return true;
+}
+
+static int
+bignum_cmp(const struct bignum* a, const struct bignum* b)
+{
+  size_t i = 0;
+  ASSERT(a && b);
+
+  if(a->len != b->len)
+    return a->len < b->len ? -1 : 1;
+  for(i = a->len; i-- > 0; ) {
+    if(a->limbs[i] != b->limbs[i])
+      return a->limbs[i] < b->limbs[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Select between the float `lower' and its successor the one nearest to the
+ * decimal value. */
+static uint32_t
+compare_digits(const struct decimal* dec, const struct adjusted_mantissa lower)
+{
+  struct bignum digits;
+  struct bignum halfway;
+  const uint32_t bits = to_bits(lower);
+  uint64_t m = 0;
+  int64_t e = 0;
+  int64_t exp = 0;
+  int64_t pow2_digits = 0;
+  int64_t pow2_halfway = 0;
+  size_t nsignificant = 0;
+  size_t ndropped = 0;
+  size_t i = 0;
+  bool is_truncated = false;
+  bool ok = true;
+  int cmp = 0;
+  ASSERT(dec);
+
+  if(lower.power2 >= INFINITE_POWER)
+    return bits;
+
+  /* Load the significant digits. */
+  memset(&digits, 0, sizeof(digits));
+  for(i = 0; i < dec->int_len + dec->frac_len; ++i) {
+    const char c = i < dec->int_len
+      ? dec->int_digits[i] : dec->frac_digits[i - dec->int_len];
+    if(nsignificant == 0 && c == '0')
+      continue;
+    if(nsignificant < MAX_BIGNUM_DIGITS) {
+      ok = ok && bignum_mul_add(&digits, 10, (uint32_t)(c - '0'));
+      ++nsignificant;
+    } else {
+      is_truncated |= c != '0';
+      ++ndropped;
+    }
+  }
+  exp = dec->exp10 - (int64_t)dec->frac_len + (int64_t)ndropped;
+
+  /* Halfway point (2m + 1) * 2^(e - 1) between `lower' and its successor. */
+  if(lower.power2 == 0) {
+    m = lower.mantissa;
+    e = 1 + MINIMUM_EXPONENT - MANTISSA_BITS;
+  } else {
+    m = lower.mantissa | ((uint64_t)1 << MANTISSA_BITS);
+    e = lower.power2 + MINIMUM_EXPONENT - MANTISSA_BITS;
+  }
+  memset(&halfway, 0, sizeof(halfway));
+  halfway.limbs[0] = (uint32_t)(2 * m + 1);
+  halfway.len = 1;
+  pow2_halfway = e - 1;
+
+  /* digits * 5^exp * 2^exp <=> halfway */
+  if(exp >= 0) {
+    ok = ok && bignum_mul_pow5(&digits, (size_t)exp);
+    pow2_digits += exp;
+  } else {
+    ok = ok && bignum_mul_pow5(&halfway, (size_t)-exp);
+    pow2_halfway -= exp;
+  }
+  if(pow2_digits > pow2_halfway) {
+    ok = ok && bignum_shift_left(&digits, (size_t)(pow2_digits-pow2_halfway));
+  } else {
+    ok = ok && bignum_shift_left(&halfway, (size_t)(pow2_halfway-pow2_digits));
+  }
+  ASSERT(ok); /* The bignum capacity covers the single precision range. */
+  if(!ok)
+    return bits;
+
+  cmp = bignum_cmp(&digits, &halfway);
+  if(cmp > 0 || (cmp == 0 && (is_truncated || (m & 1))))
+    return bits + 1;
+  return bits;
+}
+
+/*******************************************************************************
+ *
+ * Decoders.
+ *
+ ******************************************************************************/
+bool
+decode_int(const char* str, const int min, const int max, int* val)
+{
+  const char* p = str;
+  unsigned long long limit = INT_MAX;
+  unsigned long long u = 0;
+  unsigned base = 10;
+  size_t ndigits = 0;
+  bool is_negative = false;
+  bool is_overflowed = false;
+  int i = 0;
+
+  if(!str || !val)
+    return false;
+
+  if(*p == '-' || *p == '+') {
+    is_negative = *p == '-';
+    ++p;
+  }
+  if(p[0] == '0') {
+    switch(p[1]) {
+      case 'x': case 'X': base = 16; p += 2; break;
+      case 'o': case 'O': base = 8; p += 2; break;
+      case 'b': case 'B': base = 2; p += 2; break;
+      default: /* Decimal */ break;
+    }
+  }
+  if(is_negative)
+    limit = (unsigned long long)INT_MAX + 1;
+
+  for(;; ++p, ++ndigits) {
+    unsigned digit = 0;
+    if(is_digit(*p)) {
+      digit = (unsigned)(*p - '0');
+    } else if(to_lower(*p) >= 'a' && to_lower(*p) <= 'f') {
+      digit = (unsigned)(to_lower(*p) - 'a' + 10);
+    } else {
+      break;
+    }
+    if(digit >= base)
+      break;
+    u = u * base + digit;
+    if(u > limit) { /* Saturate to avoid the wrap around. */
+      is_overflowed = true;
+      u = limit + 1;
+    }
+  }
+  if(ndigits == 0)
+    return false;
+
+  /* Multiplier suffix. */
+  if(to_lower(p[0]) == 'k' && to_lower(p[1]) == 'b') {
+    u *= 1024ull;
+    p += 2;
+  } else if(to_lower(p[0]) == 'm' && to_lower(p[1]) == 'b') {
+    u *= 1048576ull;
+    p += 2;
+  } else if(to_lower(p[0]) == 'g' && to_lower(p[1]) == 'b') {
+    u *= 1073741824ull;
+    p += 2;
+  }
+  if(*p != '\0' || is_overflowed || u > limit)
+    return false;
+
+  if(!is_negative) {
+    i = (int)u;
+  } else {
+    i = u == limit ? INT_MIN : -(int)u;
+  }
+  *val = MAX(MIN(i, max), min);
+  return true;
+}
+
+bool
+decode_float(const char* str, const float min, const float max, float* val)
+{
+  struct decimal dec;
+  uint32_t bits = 0;
+  float f = 0.f;
+
+  if(!str || !val)
+    return false;
+
+  if(!parse_decimal(str, &dec)) {
+    const char* p = str + (*str == '-' || *str == '+');
+    if(match_nocase(p, "inf") || match_nocase(p, "infinity")) {
+      bits = (uint32_t)INFINITE_POWER << MANTISSA_BITS;
+    } else if(match_nocase(p, "nan")) {
+      bits = ((uint32_t)INFINITE_POWER << MANTISSA_BITS) | (1u << 22);
+    } else {
+      return false;
+    }
+    bits |= *str == '-' ? SIGN_BIT : 0;
+    f = from_bits(bits);
+  } else if(!dec.is_truncated
+         && dec.mantissa <= ((uint64_t)1 << (MANTISSA_BITS + 1))
+         && dec.exponent >= -10
+         && dec.exponent <= 10) {
+    /* Clinger fast path: both the mantissa and the power of ten are exact
+     * floats and thus a single correctly rounded operation is required. */
+    f = (float)dec.mantissa;
+    if(dec.exponent < 0) {
+      f = f / exact_power_of_ten[-dec.exponent];
+    } else {
+      f = f * exact_power_of_ten[dec.exponent];
+    }
+    f = dec.is_negative ? -f : f;
+  } else {
+    const struct adjusted_mantissa am =
+      compute_float(dec.exponent, dec.mantissa);
+    bits = to_bits(am);
+    if(dec.is_truncated) {
+      /* The value lies in [mantissa, mantissa+1) * 10^exponent. */
+      const uint32_t upper =
+        to_bits(compute_float(dec.exponent, dec.mantissa + 1));
+      if(upper != bits)
+        bits = compare_digits(&dec, am);
+    }
+    bits |= dec.is_negative ? SIGN_BIT : 0;
+    f = from_bits(bits);
+  }
+  *val = MAX(MIN(f, max), min);
+  return true;
+}
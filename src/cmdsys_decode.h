@@ -0,0 +1,29 @@
+#ifndef CMDSYS_DECODE_H
+#define CMDSYS_DECODE_H
+
+#include <stdbool.h>
+
+/* Locale independent decoders of the INT and FLOAT argument values. They
+ * return false if the string is not a valid value; otherwise the decoded
+ * value is clamped to [min, max]. */
+
+/* Decimal, hexadecimal (0x), octal (0o) and binary (0b) integers with an
+ * optional KB, MB or GB suffix, as accepted by argtable2. A value that does
+ * not fit in an int is invalid. */
+extern bool
+decode_int
+  (const char* str,
+   const int min,
+   const int max,
+   int* val);
+
+/* Decimal floating point numbers, `inf', `infinity' and `nan'. The value is
+ * rounded to the nearest float, ties to even. */
+extern bool
+decode_float
+  (const char* str,
+   const float min,
+   const float max,
+   float* val);
+
+#endif /* CMDSYS_DECODE_H */
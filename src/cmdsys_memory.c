@@ -0,0 +1,291 @@
+#include "cmdsys_memory.h"
+
+#include <snlsys/math.h>
+#include <snlsys/snlsys.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/* The header size preserves the alignment of the parent allocations. */
+#define HEADER_SIZE 16
+
+struct mem_header {
+  size_t size; /* Requested size. */
+  uint32_t category;
+  uint32_t offset; /* Distance from the parent block to the user block. */
+};
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static FINLINE struct mem_header*
+header_of(void* mem)
+{
+  ASSERT(mem);
+  return (struct mem_header*)((char*)mem - HEADER_SIZE);
+}
+
+static void
+track
+  (struct mem_account* account,
+   const uint32_t category,
+   const size_t size,
+   const size_t count)
+{
+  struct cmdsys_memory_usage* usage = NULL;
+  ASSERT(account && category < CMDSYS_MEMORY_CATEGORIES_COUNT);
+
+  usage = &account->usage;
+  usage->category[category].size += size;
+  usage->category[category].count += count;
+  usage->size += size;
+  usage->count += count;
+  usage->peak_size = MAX(usage->peak_size, usage->size);
+}
+
+static void
+untrack
+  (struct mem_account* account,
+   const uint32_t category,
+   const size_t size,
+   const size_t count)
+{
+  struct cmdsys_memory_usage* usage = NULL;
+  ASSERT(account && category < CMDSYS_MEMORY_CATEGORIES_COUNT);
+
+  usage = &account->usage;
+  ASSERT(usage->category[category].size >= size);
+  ASSERT(usage->category[category].count >= count);
+  usage->category[category].size -= size;
+  usage->category[category].count -= count;
+  usage->size -= size;
+  usage->count -= count;
+}
+
+/* Setup the header of the parent block `base' and return the user block. */
+static void*
+setup_block
+  (struct mem_proxy* proxy,
+   char* base,
+   const size_t size,
+   const size_t offset)
+{
+  struct mem_header* header = NULL;
+  void* mem = NULL;
+  ASSERT(proxy && offset >= HEADER_SIZE && offset <= UINT32_MAX);
+
+  if(!base)
+    return NULL;
+  mem = base + offset;
+  header = header_of(mem);
+  header->size = size;
+  header->category = (uint32_t)proxy->category;
+  header->offset = (uint32_t)offset;
+  track(proxy->account, header->category, size, 1);
+  return mem;
+}
+
+/*******************************************************************************
+ *
+ * Proxy allocator functions.
+ *
+ ******************************************************************************/
+static void*
+proxy_alloc
+  (void* data,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct mem_proxy* proxy = data;
+  struct mem_allocator* parent = NULL;
+  ASSERT(proxy);
+
+  if(size > SIZE_MAX - HEADER_SIZE)
+    return NULL;
+  parent = proxy->account->parent;
+  return setup_block
+    (proxy,
+     parent->alloc(parent->data, size + HEADER_SIZE, filename, fileline),
+     size, HEADER_SIZE);
+}
+
+static void*
+proxy_calloc
+  (void* data,
+   const size_t nbelmts,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  void* mem = NULL;
+
+  if(size && nbelmts > SIZE_MAX / size)
+    return NULL;
+  mem = proxy_alloc(data, nbelmts * size, filename, fileline);
+  if(mem)
+    memset(mem, 0, nbelmts * size);
+  return mem;
+}
+
+static void*
+proxy_aligned_alloc
+  (void* data,
+   const size_t size,
+   const size_t alignment,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct mem_proxy* proxy = data;
+  struct mem_allocator* parent = NULL;
+  ASSERT(proxy);
+
+  if(!IS_POWER_OF_2(alignment))
+    return NULL;
+  if(alignment <= HEADER_SIZE)
+    return proxy_alloc(data, size, filename, fileline);
+  if(size > SIZE_MAX - alignment || alignment > UINT32_MAX)
+    return NULL;
+  parent = proxy->account->parent;
+  return setup_block
+    (proxy,
+     parent->aligned_alloc
+      (parent->data, size + alignment, alignment, filename, fileline),
+     size, alignment);
+}
+
+static void
+proxy_free(void* data, void* mem)
+{
+  struct mem_proxy* proxy = data;
+  struct mem_allocator* parent = NULL;
+  struct mem_header* header = NULL;
+  ASSERT(proxy);
+
+  if(!mem)
+    return;
+  header = header_of(mem);
+  untrack(proxy->account, header->category, header->size, 1);
+  parent = proxy->account->parent;
+  parent->free(parent->data, (char*)mem - header->offset);
+}
+
+static void*
+proxy_realloc
+  (void* data,
+   void* mem,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct mem_proxy* proxy = data;
+  struct mem_allocator* parent = NULL;
+  struct mem_header* header = NULL;
+  struct mem_header copy;
+  char* base = NULL;
+  void* new_mem = NULL;
+  ASSERT(proxy);
+
+  if(!mem)
+    return proxy_alloc(data, size, filename, fileline);
+  if(!size) {
+    proxy_free(data, mem);
+    return NULL;
+  }
+  header = header_of(mem);
+  if(header->offset != HEADER_SIZE) {
+    /* Aligned block. */
+    new_mem = proxy_aligned_alloc
+      (&proxy->account->proxies[header->category],
+       size, header->offset, filename, fileline);
+    if(new_mem) {
+      memcpy(new_mem, mem, MIN(size, header->size));
+      proxy_free(data, mem);
+    }
+    return new_mem;
+  }
+  if(size > SIZE_MAX - HEADER_SIZE)
+    return NULL;
+  copy = *header;
+  parent = proxy->account->parent;
+  base = parent->realloc
+    (parent->data, (char*)mem - HEADER_SIZE, size + HEADER_SIZE,
+     filename, fileline);
+  if(!base)
+    return NULL;
+  /* The block keeps its category. */
+  untrack(proxy->account, copy.category, copy.size, 1);
+  return setup_block
+    (&proxy->account->proxies[copy.category], base, size, HEADER_SIZE);
+}
+
+static size_t
+proxy_allocated_size(const void* data)
+{
+  const struct mem_proxy* proxy = data;
+  ASSERT(proxy);
+  return proxy->account->usage.category[proxy->category].size;
+}
+
+static size_t
+proxy_dump(const void* data, char* dump, const size_t max_dump_len)
+{
+  const struct mem_proxy* proxy = data;
+  const struct mem_allocator* parent = NULL;
+  ASSERT(proxy);
+  parent = proxy->account->parent;
+  return parent->dump(parent->data, dump, max_dump_len);
+}
+
+/*******************************************************************************
+ *
+ * Memory account functions.
+ *
+ ******************************************************************************/
+void
+mem_account_init(struct mem_account* account, struct mem_allocator* parent)
+{
+  int i = 0;
+  ASSERT(account && parent);
+  ASSERT(sizeof(struct mem_header) <= HEADER_SIZE);
+
+  memset(account, 0, sizeof(struct mem_account));
+  account->parent = parent;
+  for(i = 0; i < CMDSYS_MEMORY_CATEGORIES_COUNT; ++i) {
+    struct mem_proxy* proxy = account->proxies + i;
+    proxy->account = account;
+    proxy->category = (enum cmdsys_memory_category)i;
+    proxy->allocator.alloc = proxy_alloc;
+    proxy->allocator.calloc = proxy_calloc;
+    proxy->allocator.realloc = proxy_realloc;
+    proxy->allocator.aligned_alloc = proxy_aligned_alloc;
+    proxy->allocator.free = proxy_free;
+    proxy->allocator.allocated_size = proxy_allocated_size;
+    proxy->allocator.dump = proxy_dump;
+    proxy->allocator.data = proxy;
+  }
+}
+
+void
+mem_account_track
+  (struct mem_account* account,
+   const enum cmdsys_memory_category category,
+   const size_t size,
+   const size_t count)
+{
+  ASSERT(account);
+  track(account, (uint32_t)category, size, count);
+}
+
+void
+mem_account_untrack
+  (struct mem_account* account,
+   const enum cmdsys_memory_category category,
+   const size_t size,
+   const size_t count)
+{
+  ASSERT(account);
+  untrack(account, (uint32_t)category, size, count);
+}
@@ -0,0 +1,53 @@
+#ifndef CMDSYS_MEMORY_H
+#define CMDSYS_MEMORY_H
+
+#include "cmdsys.h"
+#include <snlsys/mem_allocator.h>
+
+/* Memory accounting of a command system. Each category owns a proxy
+ * allocator that forwards the allocations to the parent allocator and keeps
+ * track of the allocated bytes. The size of a block is stored in a small
+ * header that precedes it; a block can thus be freed through any proxy of
+ * the same account. */
+struct mem_proxy {
+  struct mem_allocator allocator;
+  struct mem_account* account;
+  enum cmdsys_memory_category category;
+};
+
+struct mem_account {
+  struct mem_allocator* parent;
+  struct mem_proxy proxies[CMDSYS_MEMORY_CATEGORIES_COUNT];
+  struct cmdsys_memory_usage usage;
+};
+
+extern void
+mem_account_init
+  (struct mem_account* account,
+   struct mem_allocator* parent);
+
+/* Account the memory allocated outside of the proxy allocators. */
+extern void
+mem_account_track
+  (struct mem_account* account,
+   const enum cmdsys_memory_category category,
+   const size_t size,
+   const size_t count);
+
+extern void
+mem_account_untrack
+  (struct mem_account* account,
+   const enum cmdsys_memory_category category,
+   const size_t size,
+   const size_t count);
+
+static FINLINE struct mem_allocator*
+mem_account_allocator
+  (struct mem_account* account,
+   const enum cmdsys_memory_category category)
+{
+  ASSERT(account && category < CMDSYS_MEMORY_CATEGORIES_COUNT);
+  return &account->proxies[category].allocator;
+}
+
+#endif /* CMDSYS_MEMORY_H */
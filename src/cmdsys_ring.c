@@ -0,0 +1,390 @@
+#define _GNU_SOURCE /* memfd_create, syscall */
+
+#include "cmdsys_ring.h"
+
+#include <snlsys/mem_allocator.h>
+#include <snlsys/ref_count.h>
+#include <snlsys/snlsys.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_MAGIC 0x434D4452u /* "CMDR" */
+#define RECORD_HEADER_LEN 4
+#define RECORD_ALIGNMENT ((uint64_t)8)
+/* Record length of the padding that skips the end of the ring data. */
+#define WRAP_MARKER UINT32_MAX
+#define CACHE_LINE 64
+
+/* Shared memory layout. The positions are monotonically increasing byte
+ * counters; each one lies in its own cache line to avoid false sharing
+ * between the producer and the consumer. */
+struct ring_header {
+  uint32_t magic;
+  uint32_t pad0;
+  uint64_t capacity;
+  char pad1[CACHE_LINE - 16];
+  uint64_t head; /* Written by the producer. */
+  char pad2[CACHE_LINE - 8];
+  uint64_t tail; /* Written by the consumer. */
+  char pad3[CACHE_LINE - 8];
+  uint32_t consumer_waiting; /* Futex word. */
+  char pad4[CACHE_LINE - 4];
+};
+
+struct cmdsys_ring {
+  struct ring_header* header;
+  char* data;
+  uint64_t capacity;
+  size_t map_size;
+  int fd;
+  /* Local copies of the positions owned by the other side. They are only
+   * reloaded when they do not allow to progress. */
+  uint64_t cached_tail;
+  uint64_t cached_head;
+  struct mem_allocator* allocator;
+  struct ref ref;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static FINLINE uint64_t
+record_size(const size_t len)
+{
+  return ALIGN_SIZE((uint64_t)(RECORD_HEADER_LEN + len), RECORD_ALIGNMENT);
+}
+
+static long
+futex(uint32_t* addr, const int op, const uint32_t val, const int timeout_ms)
+{
+  struct timespec ts;
+  struct timespec* pts = NULL;
+
+  if(timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    pts = &ts;
+  }
+  /* Not FUTEX_PRIVATE since the word is shared between processes. */
+  return syscall(SYS_futex, addr, op, val, pts, NULL, 0);
+}
+
+static void
+release_ring(struct ref* ref)
+{
+  struct cmdsys_ring* ring = NULL;
+  ASSERT(ref);
+
+  ring = CONTAINER_OF(ref, struct cmdsys_ring, ref);
+  if(ring->header)
+    munmap(ring->header, ring->map_size);
+  if(ring->fd >= 0)
+    close(ring->fd);
+  MEM_FREE(ring->allocator, ring);
+}
+
+static enum cmdsys_error
+map_ring(struct cmdsys_ring* ring)
+{
+  void* mem = NULL;
+  ASSERT(ring && ring->fd >= 0 && ring->map_size);
+
+  mem = mmap
+    (NULL, ring->map_size, PROT_READ|PROT_WRITE, MAP_SHARED, ring->fd, 0);
+  if(mem == MAP_FAILED)
+    return CMDSYS_IO_ERROR;
+  ring->header = mem;
+  ring->data = (char*)mem + sizeof(struct ring_header);
+  return CMDSYS_NO_ERROR;
+}
+
+static struct cmdsys_ring*
+alloc_ring(struct mem_allocator* allocator)
+{
+  struct cmdsys_ring* ring = NULL;
+  ASSERT(allocator);
+
+  ring = MEM_CALLOC(allocator, 1, sizeof(struct cmdsys_ring));
+  if(ring) {
+    ring->allocator = allocator;
+    ring->fd = -1;
+    ref_init(&ring->ref);
+  }
+  return ring;
+}
+
+/*******************************************************************************
+ *
+ * Ring functions.
+ *
+ ******************************************************************************/
+enum cmdsys_error
+cmdsys_create_ring
+  (struct mem_allocator* mem_allocator,
+   size_t capacity,
+   struct cmdsys_ring** out_ring)
+{
+  struct mem_allocator* allocator =
+    mem_allocator ? mem_allocator : &mem_default_allocator;
+  struct cmdsys_ring* ring = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!out_ring || capacity < 64 || !IS_POWER_OF_2(capacity)
+  || capacity > (size_t)UINT32_MAX) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  ring = alloc_ring(allocator);
+  if(!ring) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  ring->capacity = capacity;
+  ring->map_size = sizeof(struct ring_header) + capacity;
+  ring->fd = memfd_create("cmdsys_ring", MFD_CLOEXEC);
+  if(ring->fd < 0 || ftruncate(ring->fd, (off_t)ring->map_size) != 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  err = map_ring(ring);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+  ring->header->capacity = capacity;
+  __atomic_store_n(&ring->header->magic, RING_MAGIC, __ATOMIC_RELEASE);
+
+exit:
+  if(out_ring)
+    *out_ring = ring;
+  return err;
+error:
+  if(ring) {
+    CMDSYS(ring_ref_put(ring));
+    ring = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_open_ring
+  (struct mem_allocator* mem_allocator,
+   int fd,
+   struct cmdsys_ring** out_ring)
+{
+  struct mem_allocator* allocator =
+    mem_allocator ? mem_allocator : &mem_default_allocator;
+  struct stat st;
+  struct cmdsys_ring* ring = NULL;
+  uint64_t capacity = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(fd < 0 || !out_ring) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  ring = alloc_ring(allocator);
+  if(!ring) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  ring->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if(ring->fd < 0 || fstat(ring->fd, &st) != 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  if((size_t)st.st_size <= sizeof(struct ring_header)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  ring->map_size = (size_t)st.st_size;
+  err = map_ring(ring);
+  if(err != CMDSYS_NO_ERROR)
+    goto error;
+
+  capacity = ring->header->capacity;
+  if(__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) != RING_MAGIC
+  || !IS_POWER_OF_2(capacity)
+  || capacity != ring->map_size - sizeof(struct ring_header)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  ring->capacity = capacity;
+  ring->cached_tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+  ring->cached_head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+
+exit:
+  if(out_ring)
+    *out_ring = ring;
+  return err;
+error:
+  if(ring) {
+    CMDSYS(ring_ref_put(ring));
+    ring = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_ring_ref_get(struct cmdsys_ring* ring)
+{
+  if(!ring)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&ring->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_ring_ref_put(struct cmdsys_ring* ring)
+{
+  if(!ring)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&ring->ref, release_ring);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_ring_get_fd(struct cmdsys_ring* ring, int* fd)
+{
+  if(!ring || !fd)
+    return CMDSYS_INVALID_ARGUMENT;
+  *fd = ring->fd;
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_ring_submit(struct cmdsys_ring* ring, const char* command, size_t len)
+{
+  struct ring_header* header = NULL;
+  uint64_t head = 0;
+  uint64_t size = 0;
+  uint64_t offset = 0;
+  uint64_t contiguous = 0;
+  uint64_t required = 0;
+  uint32_t record_len = 0;
+
+  if(!ring || (!command && len))
+    return CMDSYS_INVALID_ARGUMENT;
+  size = record_size(len);
+  if(size > ring->capacity / 2)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  header = ring->header;
+  head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+  offset = head & (ring->capacity - 1);
+  contiguous = ring->capacity - offset;
+  /* A record does not wrap around the end of the ring data. */
+  required = size <= contiguous ? size : contiguous + size;
+  if(head + required - ring->cached_tail > ring->capacity) {
+    ring->cached_tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+    if(head + required - ring->cached_tail > ring->capacity)
+      return CMDSYS_MEMORY_ERROR;
+  }
+  if(size > contiguous) {
+    record_len = WRAP_MARKER;
+    memcpy(ring->data + offset, &record_len, RECORD_HEADER_LEN);
+    head += contiguous;
+    offset = 0;
+  }
+  record_len = (uint32_t)len;
+  memcpy(ring->data + offset, &record_len, RECORD_HEADER_LEN);
+  if(len)
+    memcpy(ring->data + offset + RECORD_HEADER_LEN, command, len);
+
+  /* The sequentially consistent store of the head and load of the waiting
+   * flag pair with the ones of cmdsys_ring_wait: either the consumer sees the
+   * new head or the producer sees that the consumer waits. */
+  __atomic_store_n(&header->head, head + size, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&header->consumer_waiting, __ATOMIC_SEQ_CST)
+  && __atomic_exchange_n(&header->consumer_waiting, 0, __ATOMIC_SEQ_CST))
+    futex(&header->consumer_waiting, FUTEX_WAKE, 1, -1);
+
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_drain_ring
+  (struct cmdsys* sys,
+   struct cmdsys_ring* ring,
+   size_t max,
+   size_t* out_count)
+{
+  struct ring_header* header = NULL;
+  uint64_t tail = 0;
+  size_t count = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !ring) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  header = ring->header;
+  tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+  if(tail == ring->cached_head)
+    ring->cached_head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+  while(count < max && tail != ring->cached_head) {
+    const uint64_t offset = tail & (ring->capacity - 1);
+    uint32_t len = 0;
+
+    memcpy(&len, ring->data + offset, RECORD_HEADER_LEN);
+    if(len == WRAP_MARKER) {
+      tail += ring->capacity - offset;
+    } else {
+      if(record_size(len) > ring->capacity - offset) {
+        err = CMDSYS_IO_ERROR; /* Corrupted ring. */
+        goto error;
+      }
+      /* The record is executed in place; its space is released afterwards. */
+      cmdsys_execute_commandn
+        (sys, ring->data + offset + RECORD_HEADER_LEN, len, NULL);
+      tail += record_size(len);
+      ++count;
+    }
+    __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+    if(tail == ring->cached_head)
+      ring->cached_head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+  }
+
+exit:
+  if(out_count)
+    *out_count = count;
+  return err;
+error:
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_ring_wait(struct cmdsys_ring* ring, int timeout_ms)
+{
+  struct ring_header* header = NULL;
+  uint64_t tail = 0;
+
+  if(!ring)
+    return CMDSYS_INVALID_ARGUMENT;
+  header = ring->header;
+  tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+  ring->cached_head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+  if(ring->cached_head != tail)
+    return CMDSYS_NO_ERROR;
+
+  __atomic_store_n(&header->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+  ring->cached_head = __atomic_load_n(&header->head, __ATOMIC_SEQ_CST);
+  if(ring->cached_head == tail) {
+    /* Fails with EAGAIN if the producer already reset the flag. */
+    if(futex(&header->consumer_waiting, FUTEX_WAIT, 1, timeout_ms) != 0
+    && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+      return CMDSYS_IO_ERROR;
+  }
+  __atomic_store_n(&header->consumer_waiting, 0, __ATOMIC_RELAXED);
+  return CMDSYS_NO_ERROR;
+}
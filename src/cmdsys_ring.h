@@ -0,0 +1,80 @@
+#ifndef CMDSYS_RING_H
+#define CMDSYS_RING_H
+
+#include "cmdsys.h"
+
+/* Single producer single consumer ring of commands stored in a shared memory
+ * segment. The consumer creates the ring and transmits its file descriptor to
+ * the producer process, e.g. with a SCM_RIGHTS message or through
+ * /proc/<pid>/fd/<fd>, that maps it with cmdsys_open_ring. The producer
+ * submits commands that the consumer executes by draining the ring.
+ *
+ * The ring is lock free. A system call is only issued to wake up a consumer
+ * that is blocked in cmdsys_ring_wait; neither the submission nor the drain
+ * of commands enter the kernel otherwise. At most one thread may submit
+ * commands and at most one thread may drain them. */
+struct cmdsys_ring;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* `capacity' is the size in bytes of the ring data. It must be a power of 2
+ * greater or equal to 64. A command cannot be longer than capacity/2 - 4. */
+CMDSYS_API enum cmdsys_error
+cmdsys_create_ring
+  (struct mem_allocator* allocator, /* May be NULL */
+   size_t capacity,
+   struct cmdsys_ring** ring);
+
+/* Map the ring of the shared memory file descriptor `fd'. The descriptor is
+ * duplicated and can thus be closed by the caller. */
+CMDSYS_API enum cmdsys_error
+cmdsys_open_ring
+  (struct mem_allocator* allocator, /* May be NULL */
+   int fd,
+   struct cmdsys_ring** ring);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_ring_ref_get
+  (struct cmdsys_ring* ring);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_ring_ref_put
+  (struct cmdsys_ring* ring);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_ring_get_fd
+  (struct cmdsys_ring* ring,
+   int* fd);
+
+/* Producer side. Return CMDSYS_MEMORY_ERROR if the ring has not enough free
+ * space for the command; the submission can be retried once the consumer
+ * drained the ring. */
+CMDSYS_API enum cmdsys_error
+cmdsys_ring_submit
+  (struct cmdsys_ring* ring,
+   const char* command,
+   size_t len);
+
+/* Consumer side. Execute up to `max' pending commands. The execution errors
+ * are reported in the error buffer of `sys' and do not stop the drain. */
+CMDSYS_API enum cmdsys_error
+cmdsys_drain_ring
+  (struct cmdsys* sys,
+   struct cmdsys_ring* ring,
+   size_t max,
+   size_t* count); /* Number of executed commands. May be NULL */
+
+/* Consumer side. Block until the ring is not empty or `timeout_ms'
+ * milliseconds are elapsed. A negative timeout waits indefinitely. */
+CMDSYS_API enum cmdsys_error
+cmdsys_ring_wait
+  (struct cmdsys_ring* ring,
+   int timeout_ms);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CMDSYS_RING_H */
@@ -0,0 +1,397 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "cmdsys_scheduler.h"
+
+#include <snlsys/list.h>
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <snlsys/ref_count.h>
+#include <snlsys/snlsys.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define NO_DEADLINE UINT64_MAX
+
+struct request {
+  struct list_node node;
+  enum cmdsys_priority priority;
+  uint64_t deadline; /* Monotonic time in nanoseconds. NO_DEADLINE if none. */
+  void (*done)(struct cmdsys*, enum cmdsys_error, void*);
+  void* data;
+  char command[]; /* NULL terminated. */
+};
+
+struct worker {
+  struct cmdsys_scheduler* scheduler;
+  struct cmdsys* sys;
+  pthread_t thread;
+};
+
+struct cmdsys_scheduler {
+  struct mem_allocator* allocator;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond; /* Signaled when a command may be dispatched. */
+  pthread_cond_t idle_cond; /* Signaled when a command is completed. */
+  struct list_node queues[CMDSYS_PRIORITIES_COUNT];
+  size_t nrunning[CMDSYS_PRIORITIES_COUNT];
+  size_t max_running[CMDSYS_PRIORITIES_COUNT];
+  size_t npending; /* Number of queued or running commands. */
+  /* Nearest deadline of the queued commands, or an earlier one whose command
+   * was dequeued since. NO_DEADLINE if none. */
+  uint64_t next_deadline;
+  bool is_stopped;
+  struct worker* workers;
+  size_t nworkers;
+  size_t nthreads; /* Number of started worker threads. */
+  struct ref ref;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static FINLINE uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Wait for the work condition until the monotonic time `deadline'. The mutex
+ * must be locked. */
+static void
+wait_work(struct cmdsys_scheduler* scheduler, const uint64_t deadline)
+{
+  struct timespec ts;
+  ASSERT(scheduler);
+
+  if(deadline == NO_DEADLINE) {
+    pthread_cond_wait(&scheduler->work_cond, &scheduler->mutex);
+  } else {
+    ts.tv_sec = (time_t)(deadline / 1000000000u);
+    ts.tv_nsec = (long)(deadline % 1000000000u);
+    pthread_cond_timedwait(&scheduler->work_cond, &scheduler->mutex, &ts);
+  }
+}
+
+/* Invoke the completion function of a request and release it. The mutex must
+ * not be locked. */
+static void
+complete_request
+  (struct cmdsys_scheduler* scheduler,
+   struct request* req,
+   struct cmdsys* sys,
+   const enum cmdsys_error err)
+{
+  ASSERT(scheduler && req);
+
+  if(req->done)
+    req->done(sys, err, req->data);
+  MEM_FREE(scheduler->allocator, req);
+
+  pthread_mutex_lock(&scheduler->mutex);
+  ASSERT(scheduler->npending);
+  if(!--scheduler->npending)
+    pthread_cond_broadcast(&scheduler->idle_cond);
+  pthread_mutex_unlock(&scheduler->mutex);
+}
+
+/* Move the queued commands whose deadline is elapsed into `expired' and
+ * update the nearest deadline. The queues are only scanned once the nearest
+ * deadline is elapsed. The mutex must be locked. */
+static void
+sweep_expired(struct cmdsys_scheduler* scheduler, struct list_node* expired)
+{
+  const uint64_t now = now_ns();
+  size_t prio = 0;
+  ASSERT(scheduler && expired);
+
+  if(scheduler->next_deadline > now)
+    return;
+  scheduler->next_deadline = NO_DEADLINE;
+  for(prio = 0; prio < CMDSYS_PRIORITIES_COUNT; ++prio) {
+    struct list_node* pos = NULL;
+    struct list_node* tmp = NULL;
+    LIST_FOR_EACH_SAFE(pos, tmp, scheduler->queues + prio) {
+      struct request* req = CONTAINER_OF(pos, struct request, node);
+      if(req->deadline > now) {
+        scheduler->next_deadline =
+          MIN(scheduler->next_deadline, req->deadline);
+      } else {
+        list_del(pos);
+        list_add_tail(expired, pos);
+      }
+    }
+  }
+}
+
+/* Dequeue the next command to execute, the most urgent class first. The
+ * expired commands are moved into `expired'. Return NULL if no class has both
+ * a queued command and a free execution slot. The mutex must be locked. */
+static struct request*
+dequeue_request(struct cmdsys_scheduler* scheduler, struct list_node* expired)
+{
+  size_t prio = 0;
+  ASSERT(scheduler && expired);
+
+  sweep_expired(scheduler, expired);
+  for(prio = 0; prio < CMDSYS_PRIORITIES_COUNT; ++prio) {
+    struct list_node* queue = scheduler->queues + prio;
+    if(!is_list_empty(queue)
+    && scheduler->nrunning[prio] < scheduler->max_running[prio]) {
+      struct list_node* node = list_head(queue);
+      list_del(node);
+      ++scheduler->nrunning[prio];
+      return CONTAINER_OF(node, struct request, node);
+    }
+  }
+  return NULL;
+}
+
+static void
+drop_requests(struct cmdsys_scheduler* scheduler, struct list_node* list)
+{
+  struct list_node* pos = NULL;
+  struct list_node* tmp = NULL;
+  ASSERT(scheduler && list);
+
+  LIST_FOR_EACH_SAFE(pos, tmp, list) {
+    list_del(pos);
+    complete_request(scheduler, CONTAINER_OF(pos, struct request, node),
+      NULL, CMDSYS_COMMAND_ERROR);
+  }
+}
+
+static void*
+run_worker(void* arg)
+{
+  struct worker* worker = arg;
+  struct cmdsys_scheduler* scheduler = NULL;
+  ASSERT(worker);
+
+  scheduler = worker->scheduler;
+  pthread_mutex_lock(&scheduler->mutex);
+  while(!scheduler->is_stopped) {
+    struct list_node expired;
+    struct request* req = NULL;
+    enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+    list_init(&expired);
+    req = dequeue_request(scheduler, &expired);
+    if(!req && is_list_empty(&expired)) {
+      /* Wake up on the nearest deadline to drop its command even if no slot
+       * is released until then. */
+      wait_work(scheduler, scheduler->next_deadline);
+      continue;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    drop_requests(scheduler, &expired);
+    if(req) {
+      err = cmdsys_execute_command(worker->sys, req->command, NULL);
+      pthread_mutex_lock(&scheduler->mutex);
+      --scheduler->nrunning[req->priority];
+      /* A slot of the class is released. */
+      pthread_cond_broadcast(&scheduler->work_cond);
+      pthread_mutex_unlock(&scheduler->mutex);
+      complete_request(scheduler, req, worker->sys, err);
+    }
+    pthread_mutex_lock(&scheduler->mutex);
+  }
+  pthread_mutex_unlock(&scheduler->mutex);
+  return NULL;
+}
+
+static void
+release_scheduler(struct ref* ref)
+{
+  struct cmdsys_scheduler* scheduler = NULL;
+  struct list_node pending;
+  size_t i = 0;
+  ASSERT(ref);
+
+  scheduler = CONTAINER_OF(ref, struct cmdsys_scheduler, ref);
+
+  pthread_mutex_lock(&scheduler->mutex);
+  scheduler->is_stopped = true;
+  pthread_cond_broadcast(&scheduler->work_cond);
+  pthread_mutex_unlock(&scheduler->mutex);
+  for(i = 0; i < scheduler->nthreads; ++i)
+    pthread_join(scheduler->workers[i].thread, NULL);
+
+  list_init(&pending);
+  for(i = 0; i < CMDSYS_PRIORITIES_COUNT; ++i) {
+    while(!is_list_empty(scheduler->queues + i)) {
+      struct list_node* node = list_head(scheduler->queues + i);
+      list_del(node);
+      list_add_tail(&pending, node);
+    }
+  }
+  drop_requests(scheduler, &pending);
+
+  if(scheduler->workers) {
+    for(i = 0; i < scheduler->nworkers; ++i) {
+      if(scheduler->workers[i].sys)
+        CMDSYS(ref_put(scheduler->workers[i].sys));
+    }
+    MEM_FREE(scheduler->allocator, scheduler->workers);
+  }
+  pthread_cond_destroy(&scheduler->idle_cond);
+  pthread_cond_destroy(&scheduler->work_cond);
+  pthread_mutex_destroy(&scheduler->mutex);
+  MEM_FREE(scheduler->allocator, scheduler);
+}
+
+/*******************************************************************************
+ *
+ * Scheduler functions.
+ *
+ ******************************************************************************/
+enum cmdsys_error
+cmdsys_create_scheduler
+  (struct mem_allocator* mem_allocator,
+   struct cmdsys* systems[],
+   const size_t nworkers,
+   const struct cmdsys_scheduler_config* config,
+   struct cmdsys_scheduler** out_scheduler)
+{
+  struct mem_allocator* allocator = NULL;
+  struct cmdsys_scheduler* scheduler = NULL;
+  pthread_condattr_t attr;
+  size_t i = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!systems || !nworkers || !out_scheduler) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  for(i = 0; i < nworkers && systems[i]; ++i);
+  if(i < nworkers) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  allocator = mem_allocator ? mem_allocator : &mem_default_allocator;
+  scheduler = MEM_CALLOC(allocator, 1, sizeof(struct cmdsys_scheduler));
+  if(!scheduler) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  scheduler->allocator = allocator;
+  pthread_mutex_init(&scheduler->mutex, NULL);
+  /* The deadlines are monotonic times. */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&scheduler->work_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&scheduler->idle_cond, NULL);
+  scheduler->next_deadline = NO_DEADLINE;
+  for(i = 0; i < CMDSYS_PRIORITIES_COUNT; ++i) {
+    list_init(scheduler->queues + i);
+    scheduler->max_running[i] = config && config->max_running[i]
+      ? config->max_running[i] : nworkers;
+  }
+  ref_init(&scheduler->ref);
+
+  scheduler->workers = MEM_CALLOC(allocator, nworkers, sizeof(struct worker));
+  if(!scheduler->workers) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  scheduler->nworkers = nworkers;
+  for(i = 0; i < nworkers; ++i) {
+    CMDSYS(ref_get(systems[i]));
+    scheduler->workers[i].sys = systems[i];
+    scheduler->workers[i].scheduler = scheduler;
+  }
+  for(i = 0; i < nworkers; ++i) {
+    struct worker* worker = scheduler->workers + i;
+    if(pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+      err = CMDSYS_UNKNOWN_ERROR;
+      goto error;
+    }
+    ++scheduler->nthreads;
+  }
+
+exit:
+  if(out_scheduler)
+    *out_scheduler = scheduler;
+  return err;
+error:
+  if(scheduler) {
+    CMDSYS(scheduler_ref_put(scheduler));
+    scheduler = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_scheduler_ref_get(struct cmdsys_scheduler* scheduler)
+{
+  if(!scheduler)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&scheduler->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_scheduler_ref_put(struct cmdsys_scheduler* scheduler)
+{
+  if(!scheduler)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&scheduler->ref, release_scheduler);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_scheduler_submit
+  (struct cmdsys_scheduler* scheduler,
+   const char* command,
+   const enum cmdsys_priority priority,
+   const long deadline_ms,
+   void (*done)(struct cmdsys*, enum cmdsys_error, void*),
+   void* data)
+{
+  struct request* req = NULL;
+  size_t len = 0;
+
+  if(!scheduler || !command || (unsigned)priority >= CMDSYS_PRIORITIES_COUNT)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  len = strlen(command);
+  req = MEM_ALLOC(scheduler->allocator, sizeof(struct request) + len + 1);
+  if(!req)
+    return CMDSYS_MEMORY_ERROR;
+  req->priority = priority;
+  req->deadline = deadline_ms < 0
+    ? NO_DEADLINE : now_ns() + (uint64_t)deadline_ms * 1000000u;
+  req->done = done;
+  req->data = data;
+  memcpy(req->command, command, len + 1);
+
+  pthread_mutex_lock(&scheduler->mutex);
+  list_add_tail(scheduler->queues + priority, &req->node);
+  ++scheduler->npending;
+  /* The woken up worker waits until the new nearest deadline. */
+  scheduler->next_deadline = MIN(scheduler->next_deadline, req->deadline);
+  pthread_cond_signal(&scheduler->work_cond);
+  pthread_mutex_unlock(&scheduler->mutex);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_scheduler_wait(struct cmdsys_scheduler* scheduler)
+{
+  if(!scheduler)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  pthread_mutex_lock(&scheduler->mutex);
+  while(scheduler->npending)
+    pthread_cond_wait(&scheduler->idle_cond, &scheduler->mutex);
+  pthread_mutex_unlock(&scheduler->mutex);
+  return CMDSYS_NO_ERROR;
+}
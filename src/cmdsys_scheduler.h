@@ -0,0 +1,83 @@
+#ifndef CMDSYS_SCHEDULER_H
+#define CMDSYS_SCHEDULER_H
+
+#include "cmdsys.h"
+
+/* Scheduler of submitted commands. The commands are queued per priority
+ * class and dispatched to worker threads, the most urgent class first and in
+ * the submission order within a class. The number of commands of a class run
+ * concurrently can be limited, e.g. to keep workers available to the
+ * interactive commands under a heavy batch load. A command whose deadline
+ * elapses before it is started is dropped rather than executed, as soon as a
+ * worker is idle, even if its class has no free execution slot.
+ *
+ * Since a command system is not thread safe, each worker executes the
+ * commands on its own command system; the systems must register the same
+ * commands. The allocator must be thread safe. */
+struct cmdsys_scheduler;
+
+enum cmdsys_priority {
+  CMDSYS_PRIORITY_INTERACTIVE,
+  CMDSYS_PRIORITY_NORMAL,
+  CMDSYS_PRIORITY_BATCH,
+  CMDSYS_PRIORITIES_COUNT
+};
+
+struct cmdsys_scheduler_config {
+  /* Maximum number of commands of a class executed concurrently. 0 <=> the
+   * number of workers. */
+  size_t max_running[CMDSYS_PRIORITIES_COUNT];
+};
+
+#define CMDSYS_SCHEDULER_CONFIG_DEFAULT { { 0, 0, 0 } }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create one worker thread per command system of `systems'. */
+CMDSYS_API enum cmdsys_error
+cmdsys_create_scheduler
+  (struct mem_allocator* allocator, /* May be NULL */
+   struct cmdsys* systems[],
+   const size_t nworkers,
+   const struct cmdsys_scheduler_config* config, /* May be NULL */
+   struct cmdsys_scheduler** scheduler);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_scheduler_ref_get
+  (struct cmdsys_scheduler* scheduler);
+
+/* The last reference drops the pending commands and joins the workers once
+ * their running command is executed. */
+CMDSYS_API enum cmdsys_error
+cmdsys_scheduler_ref_put
+  (struct cmdsys_scheduler* scheduler);
+
+/* Queue a copy of `command'. `deadline_ms' is the delay in milliseconds from
+ * the submission beyond which the command is dropped if it is not started
+ * yet. A negative deadline never elapses. The `done' function is invoked by a
+ * worker once the command is executed, with the command system of the worker
+ * and the status of the execution; `sys' is NULL if the command was dropped,
+ * i.e. its deadline was elapsed or the scheduler was released before its
+ * execution. */
+CMDSYS_API enum cmdsys_error
+cmdsys_scheduler_submit
+  (struct cmdsys_scheduler* scheduler,
+   const char* command,
+   const enum cmdsys_priority priority,
+   const long deadline_ms,
+   void (*done) /* May be NULL */
+    (struct cmdsys* sys, enum cmdsys_error err, void* data),
+   void* data);
+
+/* Block until every submitted command is executed or dropped. */
+CMDSYS_API enum cmdsys_error
+cmdsys_scheduler_wait
+  (struct cmdsys_scheduler* scheduler);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CMDSYS_SCHEDULER_H */
@@ -0,0 +1,47 @@
+#include "cmdsys_schema.h"
+#include <string.h>
+
+uint32_t
+cmdsys_schema_hash(const char* str, size_t len, uint32_t seed)
+{
+  /* FNV-1a followed by the murmur3 finalizer to mix the seed. */
+  uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+  size_t i = 0;
+
+  for(i = 0; i < len; ++i) {
+    h ^= (unsigned char)str[i];
+    h *= 16777619u;
+  }
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  return h;
+}
+
+enum cmdsys_error
+cmdsys_schema_find
+  (const struct cmdsys_schema* schema,
+   const char* name,
+   uint32_t* id)
+{
+  size_t len = 0;
+  uint32_t seed = 0;
+  uint32_t slot = 0;
+
+  if(!schema || !name || !id)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  *id = CMDSYS_SCHEMA_NIL;
+  if(!schema->nslots || !schema->nseeds)
+    return CMDSYS_NO_ERROR;
+
+  len = strlen(name);
+  seed = schema->seeds[cmdsys_schema_hash(name, len, 0) % schema->nseeds];
+  slot = schema->slots[cmdsys_schema_hash(name, len, seed) % schema->nslots];
+  if(slot != CMDSYS_SCHEMA_NIL
+  && strcmp(schema->commands[slot].name, name) == 0)
+    *id = slot;
+  return CMDSYS_NO_ERROR;
+}
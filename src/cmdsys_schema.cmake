@@ -0,0 +1,22 @@
+# cmdsys_compile_schema(<schema> <output_base> <symbol>)
+#
+# Compile the command schema <schema> in <output_base>.c and <output_base>.h
+# that define the `const struct cmdsys_schema <symbol>' registered at runtime
+# with cmdsys_adopt_schema. The generated source must be added to a target.
+# CMDSYS_SCHEMAC is the schema compiler to use and defaults to the
+# cmdsys_schemac target or program.
+function(cmdsys_compile_schema schema output symbol)
+  if(NOT CMDSYS_SCHEMAC)
+    set(CMDSYS_SCHEMAC cmdsys_schemac)
+  endif()
+  get_filename_component(schema_path ${schema} ABSOLUTE)
+  set(depends ${schema_path})
+  if(TARGET ${CMDSYS_SCHEMAC})
+    set(depends ${depends} ${CMDSYS_SCHEMAC})
+  endif()
+  add_custom_command(
+    OUTPUT ${output}.c ${output}.h
+    COMMAND ${CMDSYS_SCHEMAC} ${schema_path} ${output} ${symbol}
+    DEPENDS ${depends}
+    COMMENT "Compiling the command schema ${schema}")
+endfunction()
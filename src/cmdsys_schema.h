@@ -0,0 +1,94 @@
+#ifndef CMDSYS_SCHEMA_H
+#define CMDSYS_SCHEMA_H
+
+#include "cmdsys.h"
+#include <stdint.h>
+
+/* Read only command tables generated at build time by cmdsys_schemac from a
+ * command schema file; see cmdsys_schema.cmake. */
+
+#define CMDSYS_SCHEMA_NIL UINT32_MAX
+
+/* Symbol of the resolve function exported by a plugin module, with the
+ * signature of the cmdsys_adopt_schema resolve function. */
+#define CMDSYS_PLUGIN_RESOLVE "cmdsys_plugin_resolve"
+
+struct cmdsys_schema_syntax {
+  const struct cmdarg_desc* argv_desc; /* Terminated by CMDARG_END. */
+  const char* description; /* May be NULL. */
+  /* Manual of the syntax, as printed by cmdsys_man_command. */
+  const char* man;
+};
+
+struct cmdsys_schema_command {
+  const char* name;
+  uint32_t first_syntax; /* Syntaxes are listed in their add order. */
+  uint32_t nsyntaxes;
+};
+
+struct cmdsys_schema {
+  const struct cmdsys_schema_command* commands;
+  size_t ncommands;
+  const struct cmdsys_schema_syntax* syntaxes;
+  size_t nsyntaxes;
+  /* Perfect hash of the command names. The command of `name' is
+   *   slots[hash(name, seeds[hash(name, 0) % nseeds]) % nslots]
+   * where hash is cmdsys_schema_hash. Empty slots are CMDSYS_SCHEMA_NIL. */
+  const uint32_t* seeds;
+  size_t nseeds;
+  const uint32_t* slots;
+  size_t nslots;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+CMDSYS_API uint32_t
+cmdsys_schema_hash
+  (const char* str,
+   size_t len,
+   uint32_t seed);
+
+/* Look up the command `name' of the schema. `id' is set to
+ * CMDSYS_SCHEMA_NIL if the schema has no such command. */
+CMDSYS_API enum cmdsys_error
+cmdsys_schema_find
+  (const struct cmdsys_schema* schema,
+   const char* name,
+   uint32_t* id);
+
+/* Register the commands of a schema as cmdsys_load_image does for an image.
+ * The schema is referenced rather than copied, i.e. the descriptions and the
+ * manuals are neither duplicated nor rendered, and it must thus outlive the
+ * registered commands. The commands are registered lazily, as with
+ * cmdsys_add_lazy_command. */
+CMDSYS_API enum cmdsys_error
+cmdsys_adopt_schema
+  (struct cmdsys* cmdsys,
+   const struct cmdsys_schema* schema,
+   enum cmdsys_error (*resolve)
+    (const char* name, size_t syntax_id, struct cmdsys_binding*, void*),
+   void* resolve_data); /* May be NULL. */
+
+/* Register the commands of the manifest of a plugin, i.e. of the shared
+ * object `path', as cmdsys_adopt_schema does. The commands are bound to stubs
+ * and the module is only loaded on the first execution or completion of one
+ * of them; its CMDSYS_PLUGIN_RESOLVE function is then invoked with
+ * `plugin_data' to bind each syntax in place. The manuals are rendered from
+ * the manifest, and the validation and the preparation of a command parse it
+ * against the manifest descriptors; a prepared command is bound on its
+ * execution. A request that loads the module returns CMDSYS_IO_ERROR if it
+ * cannot be loaded. The module is unloaded with the command system. */
+CMDSYS_API enum cmdsys_error
+cmdsys_add_plugin
+  (struct cmdsys* cmdsys,
+   const char* path,
+   const struct cmdsys_schema* manifest,
+   void* plugin_data); /* May be NULL. */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CMDSYS_SCHEMA_H */
@@ -0,0 +1,834 @@
+/* Compile a command schema in C tables that are registered at runtime with
+ * cmdsys_adopt_schema. The schema is a text file with one statement per line;
+ * `#' starts a comment and `-' stands for a NULL string. The options are
+ * given without their leading dashes, as in a struct cmdarg_desc:
+ *
+ *   command NAME
+ *   description "text"
+ *   int|float SOPT LOPT DATATYPE GLOSSARY MIN_COUNT MAX_COUNT MIN MAX
+ *   string SOPT LOPT DATATYPE GLOSSARY MIN_COUNT MAX_COUNT [VALUE ...]
+ *   file SOPT LOPT DATATYPE GLOSSARY MIN_COUNT MAX_COUNT
+ *   literal SOPT LOPT GLOSSARY MIN_COUNT MAX_COUNT
+ *
+ * Each `command' statement begins a new syntax of NAME; the following
+ * statements describe its arguments in their argv order. The syntaxes are
+ * checked and their manual rendered by registering them against a scratch
+ * command system. */
+#include "cmdsys_schema.h"
+
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TOKENS 256
+#define MAX_SEED (1u << 20)
+
+struct token {
+  char* str; /* NULL for `-'. */
+  bool is_quoted;
+};
+
+struct schema_arg {
+  struct cmdarg_desc desc;
+  size_t nvalues;
+};
+
+struct schema_syntax {
+  char* name;
+  char* description;
+  struct schema_arg* args;
+  size_t nargs;
+  char* man;
+  size_t line;
+};
+
+struct schema {
+  struct schema_syntax* syntaxes;
+  size_t nsyntaxes;
+  /* Id of the first syntax of each command in their first appearance
+   * order. */
+  size_t* commands;
+  size_t ncommands;
+  uint32_t* seeds;
+  size_t nseeds;
+  uint32_t* slots;
+  size_t nslots;
+};
+
+static struct mem_allocator* allocator = &mem_default_allocator;
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static char*
+dup_str(const char* str)
+{
+  char* dup = NULL;
+  if(!str)
+    return NULL;
+  dup = MEM_ALLOC(allocator, strlen(str) + 1);
+  if(dup)
+    strcpy(dup, str);
+  return dup;
+}
+
+static void
+release(void* mem)
+{
+  if(mem)
+    MEM_FREE(allocator, mem);
+}
+
+static void*
+grow(void* mem, const size_t count, const size_t size)
+{
+  /* Grow the array when its size reaches a power of 2. */
+  if(count && !IS_POWER_OF_2(count))
+    return mem;
+  return MEM_REALLOC(allocator, mem, (count ? count * 2 : 1) * size);
+}
+
+static void
+fail(const char* path, const size_t line, const char* msg)
+{
+  if(line)
+    fprintf(stderr, "%s:%lu: %s\n", path, (unsigned long)line, msg);
+  else
+    fprintf(stderr, "%s: %s\n", path, msg);
+}
+
+/* Split a line in place. Return the number of tokens or -1 on a syntax
+ * error. */
+static int
+tokenize(char* line, struct token tokens[MAX_TOKENS])
+{
+  char* r = line;
+  int ntokens = 0;
+
+  for(;;) {
+    char* w = NULL;
+
+    while(*r == ' ' || *r == '\t' || *r == '\r' || *r == '\n')
+      ++r;
+    if(*r == '\0' || *r == '#')
+      return ntokens;
+    if(ntokens == MAX_TOKENS)
+      return -1;
+
+    tokens[ntokens].str = w = r;
+    tokens[ntokens].is_quoted = (*r == '"');
+    if(tokens[ntokens].is_quoted) {
+      tokens[ntokens].str = w = ++r;
+      for(; *r != '"'; ++r, ++w) {
+        if(*r == '\0')
+          return -1;
+        if(*r == '\\') {
+          switch(*++r) {
+            case 'n': *w = '\n'; break;
+            case 't': *w = '\t'; break;
+            case '"': *w = '"'; break;
+            case '\\': *w = '\\'; break;
+            default: return -1;
+          }
+        } else {
+          *w = *r;
+        }
+      }
+      ++r;
+      if(*r != '\0' && *r != ' ' && *r != '\t' && *r != '\r' && *r != '\n')
+        return -1;
+    } else {
+      while(*r && *r != ' ' && *r != '\t' && *r != '\r' && *r != '\n')
+        ++r;
+      w = r;
+    }
+    if(*r != '\0')
+      ++r;
+    *w = '\0';
+    if(!tokens[ntokens].is_quoted && strcmp(tokens[ntokens].str, "-") == 0)
+      tokens[ntokens].str = NULL;
+    ++ntokens;
+  }
+}
+
+static bool
+parse_uint(const char* str, unsigned int* val)
+{
+  char* end = NULL;
+  unsigned long l = 0;
+  if(!str || *str == '-')
+    return false;
+  errno = 0;
+  l = strtoul(str, &end, 10);
+  if(errno || *end != '\0' || end == str || l > UINT_MAX)
+    return false;
+  *val = (unsigned int)l;
+  return true;
+}
+
+static bool
+parse_int(const char* str, int* val)
+{
+  char* end = NULL;
+  long l = 0;
+  if(!str)
+    return false;
+  errno = 0;
+  l = strtol(str, &end, 10);
+  if(errno || *end != '\0' || end == str || l < INT_MIN || l > INT_MAX)
+    return false;
+  *val = (int)l;
+  return true;
+}
+
+static bool
+parse_float(const char* str, float* val)
+{
+  char* end = NULL;
+  if(!str)
+    return false;
+  *val = strtof(str, &end);
+  return *end == '\0' && end != str && *val == *val; /* Reject NaN. */
+}
+
+/* Parse the argument statement `tokens'. Return false on a syntax error. */
+static bool
+parse_arg(struct token* tokens, const int ntokens, struct schema_arg* arg)
+{
+  struct cmdarg_desc* desc = &arg->desc;
+  const char* type = tokens[0].str;
+  int id = 1;
+  int i = 0;
+
+  memset(arg, 0, sizeof(struct schema_arg));
+  if(!type)
+    return false;
+  if(strcmp(type, "int") == 0) desc->type = CMDARG_INT;
+  else if(strcmp(type, "float") == 0) desc->type = CMDARG_FLOAT;
+  else if(strcmp(type, "string") == 0) desc->type = CMDARG_STRING;
+  else if(strcmp(type, "file") == 0) desc->type = CMDARG_FILE;
+  else if(strcmp(type, "literal") == 0) desc->type = CMDARG_LITERAL;
+  else return false;
+
+  if(ntokens < (desc->type == CMDARG_LITERAL ? 6 : 7))
+    return false;
+  desc->short_options = dup_str(tokens[id++].str);
+  desc->long_options = dup_str(tokens[id++].str);
+  if(desc->type != CMDARG_LITERAL)
+    desc->data_type = dup_str(tokens[id++].str);
+  desc->glossary = dup_str(tokens[id++].str);
+  if(!parse_uint(tokens[id++].str, &desc->min_count)
+  || !parse_uint(tokens[id++].str, &desc->max_count))
+    return false;
+
+  switch(desc->type) {
+    case CMDARG_INT:
+      return ntokens == id + 2
+        && parse_int(tokens[id].str, &desc->domain.integer.min)
+        && parse_int(tokens[id+1].str, &desc->domain.integer.max);
+    case CMDARG_FLOAT:
+      return ntokens == id + 2
+        && parse_float(tokens[id].str, &desc->domain.real.min)
+        && parse_float(tokens[id+1].str, &desc->domain.real.max);
+    case CMDARG_STRING:
+      if(ntokens == id)
+        return true;
+      arg->nvalues = (size_t)(ntokens - id);
+      desc->domain.string.value_list =
+        MEM_CALLOC(allocator, arg->nvalues + 1, sizeof(char*));
+      if(!desc->domain.string.value_list)
+        return false;
+      for(i = id; i < ntokens; ++i) {
+        if(!tokens[i].str)
+          return false;
+        desc->domain.string.value_list[i - id] = dup_str(tokens[i].str);
+      }
+      return true;
+    default:
+      return ntokens == id;
+  }
+}
+
+static void
+release_schema(struct schema* schema)
+{
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+
+  for(i = 0; i < schema->nsyntaxes; ++i) {
+    struct schema_syntax* syntax = schema->syntaxes + i;
+    for(j = 0; j < syntax->nargs; ++j) {
+      struct cmdarg_desc* desc = &syntax->args[j].desc;
+      release((char*)desc->short_options);
+      release((char*)desc->long_options);
+      release((char*)desc->data_type);
+      release((char*)desc->glossary);
+      if(desc->type == CMDARG_STRING && desc->domain.string.value_list) {
+        for(k = 0; k < syntax->args[j].nvalues; ++k)
+          release((char*)desc->domain.string.value_list[k]);
+        release(desc->domain.string.value_list);
+      }
+    }
+    release(syntax->args);
+    release(syntax->name);
+    release(syntax->description);
+    release(syntax->man);
+  }
+  release(schema->syntaxes);
+  release(schema->commands);
+  release(schema->seeds);
+  release(schema->slots);
+}
+
+/*******************************************************************************
+ *
+ * Schema compilation.
+ *
+ ******************************************************************************/
+static bool
+parse_schema(const char* path, struct schema* schema)
+{
+  struct token tokens[MAX_TOKENS];
+  struct schema_syntax* syntax = NULL;
+  FILE* file = NULL;
+  char line[4096];
+  size_t line_id = 0;
+  bool is_ok = false;
+
+  file = fopen(path, "r");
+  if(!file) {
+    fail(path, 0, "cannot open the schema");
+    goto exit;
+  }
+  while(fgets(line, sizeof(line), file)) {
+    const size_t len = strlen(line);
+    int ntokens = 0;
+
+    ++line_id;
+    if(len == sizeof(line) - 1 && line[len-1] != '\n') {
+      fail(path, line_id, "line too long");
+      goto exit;
+    }
+    ntokens = tokenize(line, tokens);
+    if(ntokens < 0) {
+      fail(path, line_id, "invalid token");
+      goto exit;
+    }
+    if(ntokens == 0)
+      continue;
+
+    if(tokens[0].str && strcmp(tokens[0].str, "command") == 0) {
+      if(ntokens != 2 || !tokens[1].str) {
+        fail(path, line_id, "invalid command statement");
+        goto exit;
+      }
+      schema->syntaxes = grow
+        (schema->syntaxes, schema->nsyntaxes, sizeof(struct schema_syntax));
+      if(!schema->syntaxes) {
+        fail(path, line_id, "out of memory");
+        goto exit;
+      }
+      syntax = schema->syntaxes + schema->nsyntaxes++;
+      memset(syntax, 0, sizeof(struct schema_syntax));
+      syntax->name = dup_str(tokens[1].str);
+      syntax->line = line_id;
+    } else if(!syntax) {
+      fail(path, line_id, "statement outside of a command");
+      goto exit;
+    } else if(tokens[0].str && strcmp(tokens[0].str, "description") == 0) {
+      if(ntokens != 2 || syntax->description) {
+        fail(path, line_id, "invalid description statement");
+        goto exit;
+      }
+      syntax->description = dup_str(tokens[1].str);
+    } else {
+      syntax->args = grow
+        (syntax->args, syntax->nargs, sizeof(struct schema_arg));
+      if(!syntax->args) {
+        fail(path, line_id, "out of memory");
+        goto exit;
+      }
+      if(!parse_arg(tokens, ntokens, syntax->args + syntax->nargs++)) {
+        fail(path, line_id, "invalid argument statement");
+        goto exit;
+      }
+    }
+  }
+  is_ok = !ferror(file);
+exit:
+  if(file)
+    fclose(file);
+  return is_ok;
+}
+
+static void
+dummy_func(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* d)
+{
+  (void)sys, (void)argc, (void)argv, (void)d;
+}
+
+/* Register each syntax alone against a scratch command system to check it and
+ * render its manual. */
+static bool
+check_syntaxes(const char* path, struct schema* schema)
+{
+  struct cmdsys* sys = NULL;
+  struct cmdarg_desc* argv_desc = NULL;
+  size_t i = 0;
+  size_t j = 0;
+  size_t len = 0;
+  bool is_ok = false;
+
+  if(cmdsys_create(NULL, &sys) != CMDSYS_NO_ERROR) {
+    fail(path, 0, "cannot create the command system");
+    goto exit;
+  }
+  for(i = 0; i < schema->nsyntaxes; ++i) {
+    struct schema_syntax* syntax = schema->syntaxes + i;
+
+    argv_desc = MEM_CALLOC
+      (allocator, syntax->nargs + 1, sizeof(struct cmdarg_desc));
+    if(!argv_desc) {
+      fail(path, syntax->line, "out of memory");
+      goto exit;
+    }
+    for(j = 0; j < syntax->nargs; ++j)
+      argv_desc[j] = syntax->args[j].desc;
+    argv_desc[syntax->nargs] = CMDARG_END;
+
+    if(cmdsys_add_command
+        (sys, syntax->name, dummy_func, NULL, NULL, argv_desc,
+         syntax->description) != CMDSYS_NO_ERROR) {
+      fail(path, syntax->line, "invalid command syntax");
+      goto exit;
+    }
+    CMDSYS(man_command(sys, syntax->name, &len, 0, NULL));
+    syntax->man = MEM_ALLOC(allocator, len + 1);
+    if(!syntax->man) {
+      fail(path, syntax->line, "out of memory");
+      goto exit;
+    }
+    CMDSYS(man_command(sys, syntax->name, NULL, len + 1, syntax->man));
+    CMDSYS(del_command(sys, syntax->name));
+    release(argv_desc);
+    argv_desc = NULL;
+  }
+  is_ok = true;
+exit:
+  release(argv_desc);
+  if(sys)
+    CMDSYS(ref_put(sys));
+  return is_ok;
+}
+
+static bool
+list_commands(const char* path, struct schema* schema)
+{
+  size_t i = 0;
+  size_t j = 0;
+
+  if(!schema->nsyntaxes) {
+    fail(path, 0, "no command");
+    return false;
+  }
+  for(i = 0; i < schema->nsyntaxes; ++i) {
+    for(j = 0; j < schema->ncommands; ++j) {
+      if(!strcmp(schema->syntaxes[schema->commands[j]].name,
+                 schema->syntaxes[i].name))
+        break;
+    }
+    if(j < schema->ncommands)
+      continue;
+    if(schema->ncommands == UINT32_MAX) {
+      fail(path, 0, "too many commands");
+      return false;
+    }
+    schema->commands = grow
+      (schema->commands, schema->ncommands, sizeof(size_t));
+    if(!schema->commands) {
+      fail(path, 0, "out of memory");
+      return false;
+    }
+    schema->commands[schema->ncommands++] = i;
+  }
+  return true;
+}
+
+static uint32_t
+command_hash(const struct schema* schema, const size_t id, const uint32_t seed)
+{
+  const char* name = schema->syntaxes[schema->commands[id]].name;
+  return cmdsys_schema_hash(name, strlen(name), seed);
+}
+
+/* Build the perfect hash of the command names with the "hash, displace and
+ * compress" scheme: the names are distributed in buckets whose seed is
+ * searched, from the largest bucket to the smallest, such that the names of
+ * the bucket land in free slots. */
+static bool
+build_perfect_hash(const char* path, struct schema* schema)
+{
+  size_t* bucket_of = NULL; /* Bucket of each command. */
+  size_t* order = NULL; /* Buckets sorted by decreasing size. */
+  size_t* bucket_size = NULL;
+  uint32_t* bucket_slots = NULL;
+  size_t max_size = 0;
+  size_t i = 0;
+  size_t j = 0;
+  bool is_ok = false;
+
+  schema->nseeds = schema->ncommands / 2 + 1;
+  schema->nslots = schema->ncommands + schema->ncommands / 4 + 1;
+  schema->seeds = MEM_CALLOC(allocator, schema->nseeds, sizeof(uint32_t));
+  schema->slots = MEM_ALLOC(allocator, schema->nslots * sizeof(uint32_t));
+  bucket_of = MEM_ALLOC(allocator, (schema->ncommands+1) * sizeof(size_t));
+  order = MEM_ALLOC(allocator, schema->nseeds * sizeof(size_t));
+  bucket_size = MEM_CALLOC(allocator, schema->nseeds, sizeof(size_t));
+  bucket_slots = MEM_ALLOC(allocator, (schema->ncommands+1)*sizeof(uint32_t));
+  if(!schema->seeds || !schema->slots || !bucket_of || !order
+  || !bucket_size || !bucket_slots) {
+    fail(path, 0, "out of memory");
+    goto exit;
+  }
+  for(i = 0; i < schema->nslots; ++i)
+    schema->slots[i] = CMDSYS_SCHEMA_NIL;
+  for(i = 0; i < schema->ncommands; ++i) {
+    bucket_of[i] = command_hash(schema, i, 0) % schema->nseeds;
+    max_size = MAX(max_size, ++bucket_size[bucket_of[i]]);
+  }
+  /* Counting sort of the buckets. */
+  for(i = 0, j = max_size + 1; j-- > 1; ) {
+    size_t k = 0;
+    for(k = 0; k < schema->nseeds; ++k) {
+      if(bucket_size[k] == j)
+        order[i++] = k;
+    }
+  }
+
+  for(i = 0; i < schema->nseeds && bucket_size[order[i]]; ++i) {
+    const size_t bucket = order[i];
+    uint32_t seed = 0;
+
+    for(seed = 1; seed < MAX_SEED; ++seed) {
+      size_t n = 0;
+      size_t k = 0;
+
+      for(k = 0; k < schema->ncommands; ++k) {
+        uint32_t slot = 0;
+        size_t l = 0;
+
+        if(bucket_of[k] != bucket)
+          continue;
+        slot = (uint32_t)(command_hash(schema, k, seed) % schema->nslots);
+        if(schema->slots[slot] != CMDSYS_SCHEMA_NIL)
+          break;
+        for(l = 0; l < n && bucket_slots[l] != slot; ++l);
+        if(l < n)
+          break;
+        bucket_slots[n++] = slot;
+      }
+      if(k == schema->ncommands)
+        break;
+    }
+    if(seed == MAX_SEED) {
+      fail(path, 0, "cannot build the perfect hash of the command names");
+      goto exit;
+    }
+    schema->seeds[bucket] = seed;
+    for(j = 0; j < schema->ncommands; ++j) {
+      if(bucket_of[j] == bucket) {
+        const uint32_t slot =
+          (uint32_t)(command_hash(schema, j, seed) % schema->nslots);
+        schema->slots[slot] = (uint32_t)j;
+      }
+    }
+  }
+  is_ok = true;
+exit:
+  release(bucket_of);
+  release(order);
+  release(bucket_size);
+  release(bucket_slots);
+  return is_ok;
+}
+
+/*******************************************************************************
+ *
+ * Code generation.
+ *
+ ******************************************************************************/
+static void
+write_str(FILE* out, const char* str)
+{
+  if(!str) {
+    fputs("NULL", out);
+    return;
+  }
+  fputc('"', out);
+  for(; *str; ++str) {
+    switch(*str) {
+      case '\n': /* Split the literal after each line. */
+        fputs(str[1] ? "\\n\"\n    \"" : "\\n", out);
+        break;
+      case '\t': fputs("\\t", out); break;
+      case '"': fputs("\\\"", out); break;
+      case '\\': fputs("\\\\", out); break;
+      default:
+        if((unsigned char)*str < 0x20)
+          fprintf(out, "\\%03o", (unsigned char)*str);
+        else
+          fputc(*str, out);
+        break;
+    }
+  }
+  fputc('"', out);
+}
+
+static void
+write_int(FILE* out, const int i)
+{
+  if(i == INT_MIN)
+    fputs("INT_MIN", out);
+  else
+    fprintf(out, "%d", i);
+}
+
+static void
+write_float(FILE* out, const float f)
+{
+  if(isinf(f))
+    fputs(f < 0 ? "-INFINITY" : "INFINITY", out);
+  else
+    fprintf(out, "%af", (double)f); /* Exact hexadecimal literal. */
+}
+
+static void
+write_arg(FILE* out, const struct cmdarg_desc* desc, const size_t list_id)
+{
+  static const char* types[] = {
+    "CMDARG_INT", "CMDARG_FLOAT", "CMDARG_STRING", "CMDARG_LITERAL",
+    "CMDARG_FILE"
+  };
+
+  fprintf(out, "  { .type = %s,\n    .short_options = ", types[desc->type]);
+  write_str(out, desc->short_options);
+  fputs(",\n    .long_options = ", out);
+  write_str(out, desc->long_options);
+  fputs(",\n    .data_type = ", out);
+  write_str(out, desc->data_type);
+  fputs(",\n    .glossary = ", out);
+  write_str(out, desc->glossary);
+  fprintf(out, ",\n    .min_count = %u, .max_count = %u,\n",
+    desc->min_count, desc->max_count);
+  switch(desc->type) {
+    case CMDARG_INT:
+      fputs("    .domain = { .integer = { .min = ", out);
+      write_int(out, desc->domain.integer.min);
+      fputs(", .max = ", out);
+      write_int(out, desc->domain.integer.max);
+      fputs(" } } },\n", out);
+      break;
+    case CMDARG_FLOAT:
+      fputs("    .domain = { .real = { .min = ", out);
+      write_float(out, desc->domain.real.min);
+      fputs(", .max = ", out);
+      write_float(out, desc->domain.real.max);
+      fputs(" } } },\n", out);
+      break;
+    default:
+      if(desc->type == CMDARG_STRING && desc->domain.string.value_list) {
+        fprintf(out,
+          "    .domain = { .string = { .value_list = value_list_%lu } } },\n",
+          (unsigned long)list_id);
+      } else {
+        fputs("    .domain = { .string = { .value_list = NULL } } },\n", out);
+      }
+      break;
+  }
+}
+
+static void
+write_u32_array
+  (FILE* out, const char* name, const uint32_t* array, const size_t count)
+{
+  size_t i = 0;
+  fprintf(out, "static const uint32_t %s[] = {", name);
+  for(i = 0; i < count; ++i) {
+    if(i % 8 == 0)
+      fputs("\n ", out);
+    fprintf(out, " %lu,", (unsigned long)array[i]);
+  }
+  fputs("\n};\n\n", out);
+}
+
+static bool
+write_source(const char* path, const char* header, const char* symbol,
+             const struct schema* schema)
+{
+  FILE* out = NULL;
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  size_t id = 0;
+  size_t list_id = 0;
+
+  out = fopen(path, "w");
+  if(!out) {
+    fail(path, 0, "cannot open the output file");
+    return false;
+  }
+  fprintf(out, "/* Generated by cmdsys_schemac. Do not edit. */\n");
+  fprintf(out, "#include \"%s\"\n\n", header);
+  fputs("#include <limits.h>\n#include <math.h>\n#include <stddef.h>\n\n", out);
+
+  /* Value lists and argument descriptors, in the syntax order. */
+  for(i = 0; i < schema->nsyntaxes; ++i) {
+    const struct schema_syntax* syntax = schema->syntaxes + i;
+    size_t first_list = list_id;
+
+    for(j = 0; j < syntax->nargs; ++j) {
+      const struct cmdarg_desc* desc = &syntax->args[j].desc;
+      if(desc->type != CMDARG_STRING || !desc->domain.string.value_list)
+        continue;
+      /* Not const qualified since the descriptor field is not. */
+      fprintf(out, "static const char* value_list_%lu[] = {\n",
+        (unsigned long)list_id++);
+      for(k = 0; k < syntax->args[j].nvalues; ++k) {
+        fputs("  ", out);
+        write_str(out, desc->domain.string.value_list[k]);
+        fputs(",\n", out);
+      }
+      fputs("  NULL\n};\n\n", out);
+    }
+    fprintf(out, "static const struct cmdarg_desc argv_desc_%lu[] = {\n",
+      (unsigned long)i);
+    for(j = 0; j < syntax->nargs; ++j) {
+      const struct cmdarg_desc* desc = &syntax->args[j].desc;
+      write_arg(out, desc, first_list);
+      if(desc->type == CMDARG_STRING && desc->domain.string.value_list)
+        ++first_list;
+    }
+    fputs("  CMDARG_END_INITIALIZER\n};\n\n", out);
+  }
+
+  /* Syntaxes grouped by command, in their add order. */
+  fputs("static const struct cmdsys_schema_syntax syntaxes[] = {\n", out);
+  for(i = 0; i < schema->ncommands; ++i) {
+    const char* name = schema->syntaxes[schema->commands[i]].name;
+    for(j = schema->commands[i]; j < schema->nsyntaxes; ++j) {
+      const struct schema_syntax* syntax = schema->syntaxes + j;
+      if(strcmp(syntax->name, name))
+        continue;
+      fprintf(out, "  { argv_desc_%lu,\n    ", (unsigned long)j);
+      write_str(out, syntax->description);
+      fputs(",\n    ", out);
+      write_str(out, syntax->man);
+      fputs(" },\n", out);
+    }
+  }
+  fputs("};\n\n", out);
+
+  fputs("static const struct cmdsys_schema_command commands[] = {\n", out);
+  for(i = 0; i < schema->ncommands; ++i) {
+    const char* name = schema->syntaxes[schema->commands[i]].name;
+    size_t n = 0;
+    for(j = schema->commands[i]; j < schema->nsyntaxes; ++j)
+      n += strcmp(schema->syntaxes[j].name, name) == 0;
+    fputs("  { ", out);
+    write_str(out, name);
+    fprintf(out, ", %lu, %lu },\n", (unsigned long)id, (unsigned long)n);
+    id += n;
+  }
+  fputs("};\n\n", out);
+
+  write_u32_array(out, "seeds", schema->seeds, schema->nseeds);
+  write_u32_array(out, "slots", schema->slots, schema->nslots);
+
+  fprintf(out, "const struct cmdsys_schema %s = {\n", symbol);
+  fprintf(out, "  commands, %lu,\n", (unsigned long)schema->ncommands);
+  fprintf(out, "  syntaxes, %lu,\n", (unsigned long)schema->nsyntaxes);
+  fprintf(out, "  seeds, %lu,\n", (unsigned long)schema->nseeds);
+  fprintf(out, "  slots, %lu\n};\n", (unsigned long)schema->nslots);
+
+  if(fclose(out) != 0) {
+    fail(path, 0, "cannot write the output file");
+    return false;
+  }
+  return true;
+}
+
+static bool
+write_header(const char* path, const char* symbol)
+{
+  FILE* out = NULL;
+
+  out = fopen(path, "w");
+  if(!out) {
+    fail(path, 0, "cannot open the output file");
+    return false;
+  }
+  fprintf(out, "/* Generated by cmdsys_schemac. Do not edit. */\n");
+  fprintf(out, "#ifndef CMDSYS_SCHEMA_%s_H\n", symbol);
+  fprintf(out, "#define CMDSYS_SCHEMA_%s_H\n\n", symbol);
+  fprintf(out, "#include <cmdsys_schema.h>\n\n");
+  fprintf(out, "extern const struct cmdsys_schema %s;\n\n", symbol);
+  fprintf(out, "#endif /* CMDSYS_SCHEMA_%s_H */\n", symbol);
+  if(fclose(out) != 0) {
+    fail(path, 0, "cannot write the output file");
+    return false;
+  }
+  return true;
+}
+
+int
+main(int argc, char** argv)
+{
+  struct schema schema;
+  char* source = NULL;
+  char* header = NULL;
+  const char* header_name = NULL;
+  size_t len = 0;
+  int ret = 1;
+
+  memset(&schema, 0, sizeof(schema));
+  if(argc != 4) {
+    fprintf(stderr, "usage: %s SCHEMA OUTPUT_BASE SYMBOL\n", argv[0]);
+    goto exit;
+  }
+  len = strlen(argv[2]);
+  source = MEM_ALLOC(allocator, len + 3);
+  header = MEM_ALLOC(allocator, len + 3);
+  if(!source || !header) {
+    fail(argv[0], 0, "out of memory");
+    goto exit;
+  }
+  sprintf(source, "%s.c", argv[2]);
+  sprintf(header, "%s.h", argv[2]);
+  header_name = strrchr(header, '/');
+  header_name = header_name ? header_name + 1 : header;
+
+  if(!parse_schema(argv[1], &schema)
+  || !check_syntaxes(argv[1], &schema)
+  || !list_commands(argv[1], &schema)
+  || !build_perfect_hash(argv[1], &schema)
+  || !write_header(header, argv[3])
+  || !write_source(source, header_name, argv[3], &schema))
+    goto exit;
+  ret = 0;
+exit:
+  release_schema(&schema);
+  release(source);
+  release(header);
+  return ret;
+}
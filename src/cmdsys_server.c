@@ -0,0 +1,537 @@
+#define _GNU_SOURCE /* accept4 */
+
+#include "cmdsys_server.h"
+
+#include <snlsys/list.h>
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <snlsys/ref_count.h>
+#include <snlsys/snlsys.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define FRAME_HEADER_LEN 4
+#define READ_CHUNK_LEN 65536
+#define MAX_EVENTS 64
+/* Pending output size beyond which the requests of a client are no more
+ * read until its responses are sent. */
+#define MAX_PENDING_OUTPUT (1024 * 1024)
+
+struct connection {
+  struct list_node node;
+  int fd;
+  uint32_t events; /* Registered epoll events. */
+  bool is_closed; /* The client closed its side of the connection. */
+  /* An invalid request was received. No more request is read and the
+   * connection is closed once the pending responses are sent. */
+  bool is_rejected;
+  /* Received bytes that are not consumed yet. */
+  char* input;
+  size_t input_len;
+  size_t input_capacity;
+  /* Responses to send. The bytes before output_id are already sent. */
+  char* output;
+  size_t output_len;
+  size_t output_id;
+  size_t output_capacity;
+};
+
+struct cmdsys_server {
+  struct cmdsys* sys;
+  struct mem_allocator* allocator;
+  char* path;
+  int listen_fd;
+  int epoll_fd;
+  struct list_node connection_list;
+  struct ref ref;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions.
+ *
+ ******************************************************************************/
+static FINLINE uint32_t
+read_be32(const char* buf)
+{
+  const unsigned char* b = (const unsigned char*)buf;
+  return ((uint32_t)b[0] << 24)
+       | ((uint32_t)b[1] << 16)
+       | ((uint32_t)b[2] << 8)
+       | ((uint32_t)b[3]);
+}
+
+static FINLINE void
+write_be32(char* buf, const uint32_t val)
+{
+  unsigned char* b = (unsigned char*)buf;
+  b[0] = (unsigned char)(val >> 24);
+  b[1] = (unsigned char)(val >> 16);
+  b[2] = (unsigned char)(val >> 8);
+  b[3] = (unsigned char)val;
+}
+
+static bool
+reserve(struct mem_allocator* allocator, char** buf, size_t* cap, size_t size)
+{
+  char* mem = NULL;
+  size_t new_cap = 0;
+  ASSERT(allocator && buf && cap);
+
+  if(size <= *cap)
+    return true;
+  new_cap = MAX(size, *cap * 2);
+  mem = MEM_REALLOC(allocator, *buf, new_cap);
+  if(!mem)
+    return false;
+  *buf = mem;
+  *cap = new_cap;
+  return true;
+}
+
+/*******************************************************************************
+ *
+ * Connection functions.
+ *
+ ******************************************************************************/
+static void
+close_connection(struct cmdsys_server* server, struct connection* conn)
+{
+  ASSERT(server && conn);
+
+  list_del(&conn->node);
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  if(conn->input)
+    MEM_FREE(server->allocator, conn->input);
+  if(conn->output)
+    MEM_FREE(server->allocator, conn->output);
+  MEM_FREE(server->allocator, conn);
+}
+
+/* Register the events of interest with respect to the connection state. */
+static bool
+update_events(struct cmdsys_server* server, struct connection* conn)
+{
+  struct epoll_event event;
+  const size_t pending = conn->output_len - conn->output_id;
+  uint32_t events = 0;
+  ASSERT(server && conn);
+
+  if(!conn->is_closed && !conn->is_rejected && pending < MAX_PENDING_OUTPUT)
+    events |= EPOLLIN;
+  if(pending)
+    events |= EPOLLOUT;
+  if(events == conn->events)
+    return true;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = conn;
+  if(epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0)
+    return false;
+  conn->events = events;
+  return true;
+}
+
+/* Append a response frame to the output buffer of the connection. */
+static enum cmdsys_error
+queue_response
+  (struct cmdsys_server* server,
+   struct connection* conn,
+   const enum cmdsys_error status,
+   const char* error, /* May be NULL */
+   const char* output,
+   const size_t output_len)
+{
+  const size_t error_len = error ? strlen(error) : 0;
+  char* response = NULL;
+  ASSERT(server && conn && (output || !output_len));
+
+  if(!reserve(server->allocator, &conn->output, &conn->output_capacity,
+     conn->output_len + 3 * FRAME_HEADER_LEN + error_len + output_len))
+    return CMDSYS_MEMORY_ERROR;
+  response = conn->output + conn->output_len;
+  write_be32
+    (response, (uint32_t)(2 * FRAME_HEADER_LEN + error_len + output_len));
+  write_be32(response + FRAME_HEADER_LEN, status);
+  write_be32(response + 2 * FRAME_HEADER_LEN, (uint32_t)error_len);
+  response += 3 * FRAME_HEADER_LEN;
+  if(error_len)
+    memcpy(response, error, error_len);
+  if(output_len)
+    memcpy(response + error_len, output, output_len);
+  conn->output_len += 3 * FRAME_HEADER_LEN + error_len + output_len;
+  return CMDSYS_NO_ERROR;
+}
+
+/* Execute the complete requests of the input buffer and queue their
+ * responses. The errors of a request are removed from the command system once
+ * sent, i.e. the errors pending before the request are left untouched. */
+static enum cmdsys_error
+process_requests(struct cmdsys_server* server, struct connection* conn)
+{
+  size_t input_id = 0;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(server && conn);
+
+  while(!conn->is_rejected
+     && conn->input_len - input_id >= FRAME_HEADER_LEN
+     && conn->output_len - conn->output_id < MAX_PENDING_OUTPUT) {
+    struct cmdsys_error_mark mark;
+    const char* frame = conn->input + input_id;
+    const uint32_t len = read_be32(frame);
+    const char* error = NULL;
+    const char* output = NULL;
+    size_t output_len = 0;
+    enum cmdsys_error status = CMDSYS_NO_ERROR;
+
+    if(len > CMDSYS_SERVER_MAX_REQUEST_LEN) {
+      /* The frames that follow cannot be delimited: the remaining input is
+       * dropped and the connection is closed once the error is sent. */
+      err = queue_response(server, conn, CMDSYS_INVALID_ARGUMENT,
+        "request too long\n", NULL, 0);
+      if(err != CMDSYS_NO_ERROR)
+        goto error;
+      conn->is_rejected = true;
+      input_id = conn->input_len;
+      break;
+    }
+    if(conn->input_len - input_id < FRAME_HEADER_LEN + len)
+      break;
+
+    CMDSYS(mark_error(server->sys, &mark));
+    CMDSYS(reset_output(server->sys));
+    status = cmdsys_execute_commandn
+      (server->sys, frame + FRAME_HEADER_LEN, len, NULL);
+    CMDSYS(get_error_string_since(server->sys, &mark, &error));
+    CMDSYS(get_output(server->sys, &output, &output_len, NULL));
+    err = queue_response(server, conn, status, error, output, output_len);
+    CMDSYS(rewind_error(server->sys, &mark));
+    if(err != CMDSYS_NO_ERROR)
+      goto error;
+    input_id += FRAME_HEADER_LEN + len;
+  }
+
+exit:
+  /* Remove the consumed requests. */
+  memmove(conn->input, conn->input + input_id, conn->input_len - input_id);
+  conn->input_len -= input_id;
+  return err;
+error:
+  goto exit;
+}
+
+static enum cmdsys_error
+send_responses(struct connection* conn)
+{
+  ASSERT(conn);
+
+  while(conn->output_id < conn->output_len) {
+    const ssize_t n = send
+      (conn->fd,
+       conn->output + conn->output_id,
+       conn->output_len - conn->output_id,
+       MSG_NOSIGNAL);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return CMDSYS_IO_ERROR;
+    }
+    conn->output_id += (size_t)n;
+  }
+  if(conn->output_id == conn->output_len)
+    conn->output_id = conn->output_len = 0;
+  return CMDSYS_NO_ERROR;
+}
+
+static enum cmdsys_error
+receive_requests(struct cmdsys_server* server, struct connection* conn)
+{
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(server && conn);
+
+  while(!conn->is_closed && !conn->is_rejected
+     && conn->output_len - conn->output_id < MAX_PENDING_OUTPUT) {
+    ssize_t n = 0;
+
+    if(!reserve(server->allocator, &conn->input, &conn->input_capacity,
+       conn->input_len + READ_CHUNK_LEN))
+      return CMDSYS_MEMORY_ERROR;
+    n = recv(conn->fd, conn->input + conn->input_len, READ_CHUNK_LEN, 0);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return CMDSYS_IO_ERROR;
+    }
+    if(n == 0) {
+      conn->is_closed = true;
+    } else {
+      conn->input_len += (size_t)n;
+    }
+    err = process_requests(server, conn);
+    if(err != CMDSYS_NO_ERROR)
+      return err;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+static void
+handle_connection
+  (struct cmdsys_server* server,
+   struct connection* conn,
+   const uint32_t events)
+{
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+  ASSERT(server && conn);
+
+  if(events & EPOLLIN) {
+    err = receive_requests(server, conn);
+  } else if(events & (EPOLLERR | EPOLLHUP)) {
+    err = CMDSYS_IO_ERROR;
+  }
+  if(err == CMDSYS_NO_ERROR) {
+    /* Execute the requests postponed until the pending output is sent. */
+    err = send_responses(conn);
+    if(err == CMDSYS_NO_ERROR && conn->input_len) {
+      err = process_requests(server, conn);
+      if(err == CMDSYS_NO_ERROR)
+        err = send_responses(conn);
+    }
+  }
+  if(err != CMDSYS_NO_ERROR
+  || ((conn->is_closed || conn->is_rejected)
+    && conn->output_len == conn->output_id)
+  || !update_events(server, conn))
+    close_connection(server, conn);
+}
+
+static void
+accept_clients(struct cmdsys_server* server)
+{
+  ASSERT(server);
+
+  for(;;) {
+    struct epoll_event event;
+    struct connection* conn = NULL;
+    /* The descriptors are not inherited by the processes the host spawns. */
+    const int fd = accept4
+      (server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if(fd < 0) {
+      if(errno == EINTR)
+        continue;
+      break; /* EAGAIN or an error of the pending connection. */
+    }
+    conn = MEM_CALLOC(server->allocator, 1, sizeof(struct connection));
+    if(!conn) {
+      close(fd);
+      continue;
+    }
+    list_init(&conn->node);
+    conn->fd = fd;
+    conn->events = EPOLLIN;
+    memset(&event, 0, sizeof(event));
+    event.events = conn->events;
+    event.data.ptr = conn;
+    if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      MEM_FREE(server->allocator, conn);
+      close(fd);
+      continue;
+    }
+    list_add(&server->connection_list, &conn->node);
+  }
+}
+
+/* Define whether a server accepts the connections on the socket `addr'. */
+static bool
+is_server_running(const struct sockaddr_un* addr)
+{
+  bool is_running = false;
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  ASSERT(addr);
+
+  if(fd < 0)
+    return false;
+  /* A full backlog still means that a server listens on the socket. */
+  is_running = connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == 0
+    || errno == EAGAIN;
+  close(fd);
+  return is_running;
+}
+
+static void
+release_server(struct ref* ref)
+{
+  struct cmdsys_server* server = NULL;
+  struct list_node* pos = NULL;
+  struct list_node* tmp = NULL;
+  ASSERT(ref);
+
+  server = CONTAINER_OF(ref, struct cmdsys_server, ref);
+  LIST_FOR_EACH_SAFE(pos, tmp, &server->connection_list) {
+    close_connection(server, CONTAINER_OF(pos, struct connection, node));
+  }
+  if(server->listen_fd >= 0) {
+    close(server->listen_fd);
+    unlink(server->path);
+  }
+  if(server->epoll_fd >= 0)
+    close(server->epoll_fd);
+  if(server->path)
+    MEM_FREE(server->allocator, server->path);
+  CMDSYS(ref_put(server->sys));
+  MEM_FREE(server->allocator, server);
+}
+
+/*******************************************************************************
+ *
+ * Server functions.
+ *
+ ******************************************************************************/
+enum cmdsys_error
+cmdsys_create_server
+  (struct mem_allocator* mem_allocator,
+   struct cmdsys* sys,
+   const char* path,
+   struct cmdsys_server** out_server)
+{
+  struct mem_allocator* allocator =
+    mem_allocator ? mem_allocator : &mem_default_allocator;
+  struct sockaddr_un addr;
+  struct epoll_event event;
+  struct stat st;
+  struct cmdsys_server* server = NULL;
+  enum cmdsys_error err = CMDSYS_NO_ERROR;
+
+  if(!sys || !path || !out_server || strlen(path) >= sizeof(addr.sun_path)) {
+    err = CMDSYS_INVALID_ARGUMENT;
+    goto error;
+  }
+  server = MEM_CALLOC(allocator, 1, sizeof(struct cmdsys_server));
+  if(!server) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  server->allocator = allocator;
+  server->listen_fd = server->epoll_fd = -1;
+  list_init(&server->connection_list);
+  ref_init(&server->ref);
+  CMDSYS(ref_get(sys));
+  server->sys = sys;
+
+  server->path = MEM_ALLOC(allocator, strlen(path) + 1);
+  if(!server->path) {
+    err = CMDSYS_MEMORY_ERROR;
+    goto error;
+  }
+  strcpy(server->path, path);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /* The socket file of another server is never removed, even if that server
+   * has stopped. */
+  if(lstat(path, &st) == 0) {
+    err = S_ISSOCK(st.st_mode) && is_server_running(&addr)
+      ? CMDSYS_INVALID_ARGUMENT : CMDSYS_IO_ERROR;
+    goto error;
+  }
+  server->listen_fd = socket
+    (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(server->listen_fd < 0
+  || bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    if(server->listen_fd >= 0) {
+      close(server->listen_fd);
+      server->listen_fd = -1;
+    }
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(listen(server->listen_fd, SOMAXCONN) != 0 || server->epoll_fd < 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = NULL; /* The listening socket. */
+  if(epoll_ctl(server->epoll_fd,EPOLL_CTL_ADD,server->listen_fd,&event) != 0) {
+    err = CMDSYS_IO_ERROR;
+    goto error;
+  }
+
+exit:
+  if(out_server)
+    *out_server = server;
+  return err;
+error:
+  if(server) {
+    CMDSYS(server_ref_put(server));
+    server = NULL;
+  }
+  goto exit;
+}
+
+enum cmdsys_error
+cmdsys_server_ref_get(struct cmdsys_server* server)
+{
+  if(!server)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_get(&server->ref);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_server_ref_put(struct cmdsys_server* server)
+{
+  if(!server)
+    return CMDSYS_INVALID_ARGUMENT;
+  ref_put(&server->ref, release_server);
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_server_poll(struct cmdsys_server* server, int timeout_ms)
+{
+  struct epoll_event events[MAX_EVENTS];
+  int nevents = 0;
+  int i = 0;
+
+  if(!server)
+    return CMDSYS_INVALID_ARGUMENT;
+
+  nevents = epoll_wait(server->epoll_fd, events, MAX_EVENTS, timeout_ms);
+  if(nevents < 0)
+    return errno == EINTR ? CMDSYS_NO_ERROR : CMDSYS_IO_ERROR;
+
+  for(i = 0; i < nevents; ++i) {
+    if(events[i].data.ptr == NULL) {
+      accept_clients(server);
+    } else {
+      handle_connection(server, events[i].data.ptr, events[i].events);
+    }
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+enum cmdsys_error
+cmdsys_server_get_fd(struct cmdsys_server* server, int* fd)
+{
+  if(!server || !fd)
+    return CMDSYS_INVALID_ARGUMENT;
+  *fd = server->epoll_fd;
+  return CMDSYS_NO_ERROR;
+}
@@ -0,0 +1,72 @@
+#ifndef CMDSYS_SERVER_H
+#define CMDSYS_SERVER_H
+
+#include "cmdsys.h"
+
+/* Server that executes the commands received on a Unix domain socket. The
+ * requests and the responses are framed by a 32-bits big endian length:
+ *
+ *   request:  <length> <command bytes>
+ *   response: <length> <status> <error length> <error bytes> <output bytes>
+ *
+ * where <status> is the 32-bits big endian cmdsys_error returned by the
+ * command execution, <error bytes> the content of the error buffer after its
+ * execution and <output bytes> the output written by the command. The output
+ * of the command system is reset before each request while the errors that
+ * were pending before it remain pending. A request longer than
+ * CMDSYS_SERVER_MAX_REQUEST_LEN is answered with a CMDSYS_INVALID_ARGUMENT
+ * status and the connection is then closed. A client may send several
+ * requests without waiting for their response; the responses are sent in the
+ * order of the requests.
+ *
+ * The connections have no parse context of their own: the requests of all the
+ * clients are serialized on the thread that polls the server and executed one
+ * at a time by the shared command system. A request thus sees the variables,
+ * the macros and the commands defined by the requests executed before it,
+ * whatever their client. */
+struct cmdsys_server;
+
+#define CMDSYS_SERVER_MAX_REQUEST_LEN 65536
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The server is not created if a file exists at `path': the function returns
+ * CMDSYS_INVALID_ARGUMENT if a server answers on it and CMDSYS_IO_ERROR
+ * otherwise. Removing the socket file left by a server that is no more running
+ * is up to the caller. */
+CMDSYS_API enum cmdsys_error
+cmdsys_create_server
+  (struct mem_allocator* allocator, /* May be NULL */
+   struct cmdsys* sys,
+   const char* path,
+   struct cmdsys_server** server);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_server_ref_get
+  (struct cmdsys_server* server);
+
+CMDSYS_API enum cmdsys_error
+cmdsys_server_ref_put
+  (struct cmdsys_server* server);
+
+/* Wait up to `timeout_ms' milliseconds for events and handle them, i.e.
+ * accept the new clients, execute their complete requests and send their
+ * responses. A negative timeout waits indefinitely. */
+CMDSYS_API enum cmdsys_error
+cmdsys_server_poll
+  (struct cmdsys_server* server,
+   int timeout_ms);
+
+/* File descriptor that is readable when the server has events to handle. */
+CMDSYS_API enum cmdsys_error
+cmdsys_server_get_fd
+  (struct cmdsys_server* server,
+   int* fd);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CMDSYS_SERVER_H */
@@ -1,13 +1,17 @@
 #include "cmdsys.h"
+#include "test_cmdsys_alloc.h"
 #include <snlsys/mem_allocator.h>
 #include <snlsys/snlsys.h>
 #include <float.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define BAD_ARG CMDSYS_INVALID_ARGUMENT
 #define CMD_ERR CMDSYS_COMMAND_ERROR
+#define IO_ERR CMDSYS_IO_ERROR
 #define OK CMDSYS_NO_ERROR
 
 static void
@@ -35,8 +39,175 @@ foo
     printf("%s\n", argv[0]->value_list[0].data.string);
   }
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__foo"), 0);
+  CHECK(argv[0]->value_list[0].length, 5);
 }
 
+static void
+nop(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+}
+
+static int count__ = 0;
+
+static void
+count(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+  ++count__;
+}
+
+static int prepared_int__ = 0;
+static float prepared_real__ = 0.f;
+static const char* prepared_str__ = NULL;
+
+static void
+prepared
+  (struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)data;
+  CHECK(argc, 3);
+  if(argv[1]->type == CMDARG_INT) {
+    prepared_int__ = argv[1]->value_list[0].data.integer;
+  } else {
+    prepared_real__ = argv[1]->value_list[0].data.real;
+  }
+  prepared_str__ = argv[2]->value_list[0].is_defined
+    ? argv[2]->value_list[0].data.string : NULL;
+}
+
+static void
+print_value
+  (struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)data;
+  CHECK(argc, 2);
+  CHECK(cmdsys_printf(sys, "%s=%d;", argv[0]->value_list[0].data.string,
+    argv[1]->value_list[0].data.integer), OK);
+}
+
+static void
+print_nested
+  (struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)argc, (void)argv, (void)data;
+  CHECK(cmdsys_write(sys, "<", 1), OK);
+  CHECK(cmdsys_execute_command(sys, "__out -i 1", NULL), OK);
+  CHECK(cmdsys_write(sys, ">", 1), OK);
+}
+
+static size_t sum_count__ = 0;
+static int sum__ = 0;
+
+static void
+sum(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  size_t i = 0;
+  (void)sys, (void)data;
+  CHECK(argc, 2);
+  CHECK(argv[1]->value_list[argv[1]->count].is_defined, false);
+  sum_count__ = argv[1]->count;
+  for(sum__ = 0, i = 0; i < argv[1]->count; ++i)
+    sum__ += argv[1]->value_list[i].data.integer;
+}
+
+static void
+sum_nested
+  (struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  size_t i = 0;
+  (void)data;
+  CHECK(argc, 2);
+  CHECK(argv[1]->count, 3);
+  CHECK(cmdsys_execute_command(sys, "__sum -i 1 -i 2", NULL), OK);
+  CHECK(sum__, 3);
+  /* The values of the nested command do not overwrite those of the caller. */
+  for(i = 0; i < argv[1]->count; ++i)
+    CHECK(strcmp(argv[1]->value_list[i].data.string, "abc" + i), 0);
+}
+
+static int stream_sum__ = 0;
+static size_t stream_count__ = 0;
+static size_t stream_nerrors__ = 0;
+
+static void
+stream(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  struct cmdarg_value val;
+  bool has_value = true;
+  (void)sys, (void)data;
+  CHECK(argc, 2);
+  NCHECK(argv[1]->cursor, NULL);
+  CHECK(argv[1]->value_list, NULL);
+  stream_sum__ = 0;
+  stream_count__ = 0;
+  stream_nerrors__ = 0;
+  while(has_value) {
+    if(cmdsys_cursor_next(argv[1]->cursor, &val, &has_value) != OK) {
+      ++stream_nerrors__;
+    } else if(has_value) {
+      CHECK(val.is_defined, true);
+      stream_sum__ += argv[1]->type == CMDARG_INT
+        ? val.data.integer : (int)val.length;
+      ++stream_count__;
+    }
+  }
+  CHECK(stream_count__ + stream_nerrors__, argv[1]->count);
+}
+
+static enum cmdsys_error
+resolve_stream
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  (void)name, (void)syntax_id, (void)data;
+  binding->func = stream;
+  return OK;
+}
+
+/* Syntax ids bound to the syntaxes of the image commands. */
+static size_t image_syntax_ids__[] = { 0, 1, 2 };
+static size_t image_syntax__ = SIZE_MAX;
+
+static void
+image_syntax
+  (struct cmdsys* sys,
+   size_t argc,
+   const struct cmdarg** argv,
+   void* data)
+{
+  (void)sys, (void)argc, (void)argv;
+  image_syntax__ = *(size_t*)data;
+}
+
+static enum cmdsys_error
+resolve_image_syntax
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  CHECK(data, NULL);
+  if(strncmp(name, "__img", 5) != 0 || syntax_id >= 3)
+    return CMDSYS_INVALID_ARGUMENT;
+  binding->func = image_syntax;
+  binding->data = image_syntax_ids__ + syntax_id;
+  return OK;
+}
+
+/* Descriptors of the lazy commands, referenced by the registry. */
+static const struct cmdarg_desc lazy_desc__[] = {
+  CMDARG_APPEND_INT("i", NULL, NULL, "value", 1, 1, 0, 10),
+  CMDARG_END_INITIALIZER
+};
+
+static const struct cmdarg_desc lazy_bad_desc__[] = {
+  CMDARG_APPEND_INT("i", NULL, NULL, "value", 2, 1, 0, 10),
+  CMDARG_END_INITIALIZER
+};
+
 static const char* load_name__ = NULL;
 static const char* load_model__ = NULL;
 static bool load_verbose_opt__ = false;
@@ -59,7 +230,7 @@ load
   CHECK(argv[0]->value_list[0].is_defined, true);
   /* Verbose option. */
   CHECK(argv[1]->type, CMDARG_LITERAL);
-  CHECK(argv[1]->count, 1);
+  CHECK(argv[1]->count, (size_t)load_verbose_opt__);
   CHECK(argv[1]->value_list[0].is_defined, load_verbose_opt__);
   /* Model path option. */
   CHECK(argv[2]->type, CMDARG_FILE);
@@ -67,7 +238,7 @@ load
   CHECK(argv[2]->value_list[0].is_defined, true);
   /* Model name option. */
   CHECK(argv[3]->type, CMDARG_STRING);
-  CHECK(argv[3]->count, 1);
+  CHECK(argv[3]->count, (size_t)load_name_opt__);
   CHECK(argv[3]->value_list[0].is_defined, load_name_opt__);
 
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__load"), 0);
@@ -112,15 +283,15 @@ setf3
   CHECK(argv[0]->value_list[0].is_defined, true);
   /* Red option. */
   CHECK(argv[1]->type, CMDARG_FLOAT);
-  CHECK(argv[1]->count, 1);
+  CHECK(argv[1]->count, (size_t)setf3_r_opt__);
   CHECK(argv[1]->value_list[0].is_defined, setf3_r_opt__);
   /* Green option. */
   CHECK(argv[2]->type, CMDARG_FLOAT);
-  CHECK(argv[2]->count, 1);
+  CHECK(argv[2]->count, (size_t)setf3_g_opt__);
   CHECK(argv[2]->value_list[0].is_defined, setf3_g_opt__);
   /* Blue option. */
   CHECK(argv[3]->type, CMDARG_FLOAT);
-  CHECK(argv[3]->count, 1);
+  CHECK(argv[3]->count, (size_t)setf3_b_opt__);
   CHECK(argv[3]->value_list[0].is_defined, setf3_b_opt__);
 
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__setf3"), 0);
@@ -148,6 +319,8 @@ static const char* days[] = {
   NULL
 };
 
+static size_t day_completion_count__ = 0;
+
 static void
 day_completion
   (struct cmdsys* sys,
@@ -158,6 +331,7 @@ day_completion
 {
   const size_t len = sizeof(days)/sizeof(const char*) - 1; /* -1 <=> NULL. */
   (void)sys;
+  ++day_completion_count__;
 
   ASSERT
     (  sys
@@ -243,8 +417,9 @@ day
   CHECK(argv[0]->value_list[0].is_defined, true);
   /* Filter name. */
   CHECK(argv[1]->type, CMDARG_STRING);
-  CHECK(argv[1]->count, MAX_DAY_COUNT);
+  CHECK(argv[1]->count <= MAX_DAY_COUNT, true);
   CHECK(argv[1]->value_list[0].is_defined, true);
+  CHECK(argv[1]->value_list[argv[1]->count].is_defined, false);
 
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__day"), 0);
 
@@ -345,7 +520,7 @@ cat
   CHECK(argv[0]->value_list[0].is_defined, true);
   /* Filter name. */
   CHECK(argv[1]->type, CMDARG_FILE);
-  CHECK(argv[1]->count, MAX_FILE_COUNT);
+  CHECK(argv[1]->count <= MAX_FILE_COUNT, true);
 
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__cat"), 0);
   for(i = 0; i < argv[1]->count && argv[1]->value_list[i].is_defined; ++i) {
@@ -376,7 +551,7 @@ seti
   CHECK(argv[0]->value_list[0].is_defined, true);
   /* Filter name. */
   CHECK(argv[1]->type, CMDARG_INT);
-  CHECK(argv[1]->count, MAX_INT_COUNT);
+  CHECK(argv[1]->count <= MAX_INT_COUNT, true);
 
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__seti"), 0);
   for(i=0; (size_t)i<argv[1]->count && argv[1]->value_list[i].is_defined; ++i) {
@@ -405,11 +580,1019 @@ print
   CHECK(strcmp(argv[0]->value_list[0].data.string, "__print"), 0);
 }
 
+static enum cmdsys_error
+resolve_command
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  CHECK(syntax_id, 0);
+  CHECK(data, NULL);
+  if(strcmp(name, "__load") == 0) {
+    binding->func = load;
+  } else if(strcmp(name, "__setf3") == 0) {
+    binding->func = setf3;
+  } else if(strcmp(name, "__day") == 0) {
+    binding->func = day;
+    binding->arg_completion = day_completion;
+  } else if(strcmp(name, "__cat") == 0) {
+    binding->func = cat;
+  } else if(strcmp(name, "__print") == 0) {
+    binding->func = print;
+    binding->data = "hello world!";
+  } else {
+    return CMDSYS_INVALID_ARGUMENT;
+  }
+  return CMDSYS_NO_ERROR;
+}
+
+/* Check the structured errors and their lazily formatted messages. */
+static void
+test_structured_errors(void)
+{
+  static const char* str_values[] = { "a", "b", NULL };
+  char text[1024];
+  struct cmdsys_error_info info;
+  struct cmdsys_error_mark mark;
+  struct cmdsys* sys = NULL;
+  const char* err_str = NULL;
+  size_t count = 0;
+  int i = 0;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__err", foo, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 0, 1, 0, 10),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 1, str_values),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command(sys, "__err", foo, NULL, NULL, NULL, NULL), OK);
+
+  CHECK(cmdsys_get_error_count(NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_get_error_count(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_get_error_count(NULL, &count), BAD_ARG);
+  CHECK(cmdsys_get_error_count(sys, &count), OK);
+  CHECK(count, 0);
+  CHECK(cmdsys_get_error(sys, 0, &info), BAD_ARG);
+
+  CHECK(cmdsys_execute_command(sys, "__err -i abc", NULL), CMD_ERR);
+  CHECK(cmdsys_execute_command(sys, "__err -s c", NULL), CMD_ERR);
+  CHECK(cmdsys_execute_command(sys, "__nope 1", NULL), CMD_ERR);
+  CHECK(cmdsys_execute_command(sys, "__err && || __err", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_count(sys, &count), OK);
+  CHECK(count, 4);
+
+  CHECK(cmdsys_get_error(NULL, 0, &info), BAD_ARG);
+  CHECK(cmdsys_get_error(sys, 0, NULL), BAD_ARG);
+  CHECK(cmdsys_get_error(sys, 4, &info), BAD_ARG);
+  CHECK(cmdsys_get_error(sys, 0, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_INVALID_SYNTAX);
+  CHECK(strcmp(info.command, "__err"), 0);
+  CHECK(info.token, 2);
+  CHECK(info.offset, 0);
+  CHECK(info.length, 3);
+  CHECK(info.expected_type, CMDARG_INT);
+  CHECK(info.syntax_id, 0);
+  CHECK(cmdsys_get_error(sys, 1, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_INVALID_VALUE);
+  CHECK(info.token, 2);
+  CHECK(info.length, 1);
+  CHECK(info.expected_type, CMDARG_STRING);
+  CHECK(info.syntax_id, 0);
+  CHECK(cmdsys_get_error(sys, 2, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_COMMAND_NOT_FOUND);
+  CHECK(strcmp(info.command, "__nope"), 0);
+  CHECK(info.token, 0);
+  CHECK(info.length, 6);
+  CHECK(info.syntax_id, SIZE_MAX);
+  CHECK(cmdsys_get_error(sys, 3, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_CHAIN_SYNTAX);
+
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  NCHECK(strstr(err_str, "invalid argument \"abc\""), NULL);
+  NCHECK(strstr(err_str, "__err: unexpected option value `c'\n"), NULL);
+  NCHECK(strstr(err_str, "__nope: command not found\n"), NULL);
+  NCHECK(strstr(err_str, "syntax error near `&&'\n"), NULL);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+
+  /* The pending messages are formatted before the syntaxes are updated. */
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__err -i abc", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strlen(err_str) < sizeof(text), true);
+  strcpy(text, err_str);
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__err -i abc", NULL), CMD_ERR);
+  CHECK(cmdsys_del_command(sys, "__err"), OK);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strcmp(err_str, text), 0);
+
+  /* The errors beyond the capacity of the log are only counted. */
+  CHECK(cmdsys_flush_error(sys), OK);
+  for(i = 0; i < 70; ++i)
+    CHECK(cmdsys_execute_command(sys, "__nope", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_count(sys, &count), OK);
+  CHECK(count, 64);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strcmp(err_str + strlen(err_str) - 14, "6 more errors\n"), 0);
+  CHECK(cmdsys_execute_command(sys, "__nope", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strcmp(err_str + strlen(err_str) - 14, "7 more errors\n"), 0);
+
+  /* The errors of a command are isolated from the pending ones. */
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__nope 1", NULL), CMD_ERR);
+  CHECK(cmdsys_mark_error(NULL, &mark), BAD_ARG);
+  CHECK(cmdsys_mark_error(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_mark_error(sys, &mark), OK);
+  CHECK(cmdsys_get_error_string_since(sys, &mark, &err_str), OK);
+  CHECK(err_str, NULL);
+  CHECK(cmdsys_execute_command(sys, "__nope 2", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string_since(NULL, &mark, &err_str), BAD_ARG);
+  CHECK(cmdsys_get_error_string_since(sys, NULL, &err_str), BAD_ARG);
+  CHECK(cmdsys_get_error_string_since(sys, &mark, NULL), BAD_ARG);
+  CHECK(cmdsys_get_error_string_since(sys, &mark, &err_str), OK);
+  CHECK(strcmp(err_str, "__nope: command not found\n"), 0);
+  CHECK(cmdsys_rewind_error(NULL, &mark), BAD_ARG);
+  CHECK(cmdsys_rewind_error(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_rewind_error(sys, &mark), OK);
+  CHECK(cmdsys_get_error_count(sys, &count), OK);
+  CHECK(count, 1);
+  CHECK(cmdsys_get_error(sys, 0, &info), OK);
+  CHECK(info.token, 0);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strcmp(err_str, "__nope: command not found\n"), 0);
+  /* A mark beyond the recorded errors is invalid. */
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_rewind_error(sys, &mark), BAD_ARG);
+  CHECK(cmdsys_get_error_string_since(sys, &mark, &err_str), BAD_ARG);
+  /* The errors lost since the mark are counted in its messages only. */
+  for(i = 0; i < 64; ++i)
+    CHECK(cmdsys_execute_command(sys, "__nope", NULL), CMD_ERR);
+  CHECK(cmdsys_mark_error(sys, &mark), OK);
+  CHECK(cmdsys_execute_command(sys, "__nope", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string_since(sys, &mark, &err_str), OK);
+  CHECK(strcmp(err_str, "1 more errors\n"), 0);
+  CHECK(cmdsys_rewind_error(sys, &mark), OK);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strstr(err_str, "more errors"), NULL);
+
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_get_error_count(sys, &count), OK);
+  CHECK(count, 0);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(err_str, NULL);
+  CHECK(cmdsys_ref_put(sys), OK);
+}
+
+/* Check the validation of commands and scripts without execution. */
+static void
+test_validation(void)
+{
+  struct cmdsys_validation result;
+  struct cmdsys_error_info info;
+  struct cmdsys_memory_usage usage0;
+  struct cmdsys_memory_usage usage1;
+  struct cmdsys* sys = NULL;
+  const char* err_str = NULL;
+  FILE* file = NULL;
+  size_t nerrors = 0;
+  size_t nworkers = 0;
+  size_t len = 0;
+  int i = 0;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__val", count, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 1, 1, 0, 10),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 1, NULL),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command(sys, "__val", count, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_define_macro(sys, "__val.macro", "__val -i 1"), OK);
+
+  count__ = 0;
+  CHECK(cmdsys_validate_command(NULL, "__val", &result), BAD_ARG);
+  CHECK(cmdsys_validate_command(sys, NULL, &result), BAD_ARG);
+  CHECK(cmdsys_validate_command(sys, "__val", NULL), OK);
+  CHECK(cmdsys_validate_command(sys, "__val", &result), OK);
+  CHECK(result.syntax_id, 1);
+  CHECK(result.argc, 1);
+  CHECK(cmdsys_validate_command(sys, "__val -i 3 -s abc", &result), OK);
+  CHECK(result.syntax_id, 0);
+  CHECK(result.argc, 3);
+  CHECK(result.argv[1]->value_list[0].is_defined, true);
+  CHECK(result.argv[1]->value_list[0].data.integer, 3);
+  CHECK(strcmp(result.argv[2]->value_list[0].data.string, "abc"), 0);
+  CHECK(cmdsys_validate_command(sys, "__val && __val.macro", &result), OK);
+  CHECK(result.syntax_id, SIZE_MAX);
+  CHECK(result.argv, NULL);
+  CHECK(count__, 0);
+
+  CHECK(cmdsys_validate_command(sys, "__val -i abc", &result), CMD_ERR);
+  CHECK(cmdsys_validate_command(sys, "__val ; __nope", &result), CMD_ERR);
+  CHECK(cmdsys_validate_command(sys, "__val.macro 1", &result), CMD_ERR);
+  CHECK(cmdsys_validate_command(sys, "", &result), CMD_ERR);
+  CHECK(cmdsys_get_error_count(sys, &nerrors), OK);
+  CHECK(nerrors, 4);
+  CHECK(cmdsys_get_error(sys, 1, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_COMMAND_NOT_FOUND);
+  CHECK(strcmp(info.command, "__nope"), 0);
+  CHECK(info.line, 0);
+  CHECK(count__, 0);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  /* Large enough to be split among the workers. */
+  file = fopen("test_cmdsys_script.txt", "w");
+  NCHECK(file, NULL);
+  for(i = 0; i < 100000; ++i) {
+    if(i == 10 || i == 50000 || i == 99999) {
+      fprintf(file, "__val -i abc\n");
+    } else if(i % 7 == 0) {
+      fprintf(file, "  \n");
+    } else {
+      fprintf(file, "__val -i %d -s x%d\n", i % 10, i);
+    }
+  }
+  fclose(file);
+
+  CHECK(cmdsys_validate_file(NULL, "test_cmdsys_script.txt", 4), BAD_ARG);
+  CHECK(cmdsys_validate_file(sys, NULL, 4), BAD_ARG);
+  CHECK(cmdsys_validate_file(sys, "test_cmdsys_script.txt", 0), BAD_ARG);
+  CHECK(cmdsys_validate_file(sys, "__no_such_script", 4), CMDSYS_IO_ERROR);
+  for(nworkers = 1; nworkers <= 4; nworkers += 3) {
+    /* The pending errors are kept ahead of the script failures. */
+    CHECK(cmdsys_execute_command(sys, "__nope", NULL), CMD_ERR);
+    CHECK(cmdsys_validate_file(sys, "test_cmdsys_script.txt", nworkers),
+      CMD_ERR);
+    CHECK(cmdsys_get_error_count(sys, &nerrors), OK);
+    CHECK(nerrors, 4);
+    CHECK(cmdsys_get_error(sys, 0, &info), OK);
+    CHECK(info.code, CMDSYS_ERROR_COMMAND_NOT_FOUND);
+    CHECK(info.line, 0);
+    CHECK(cmdsys_get_error(sys, 1, &info), OK);
+    CHECK(info.code, CMDSYS_ERROR_INVALID_SYNTAX);
+    CHECK(strcmp(info.command, "__val"), 0);
+    CHECK(info.token, 2);
+    CHECK(info.line, 11);
+    CHECK(cmdsys_get_error(sys, 2, &info), OK);
+    CHECK(info.line, 50001);
+    CHECK(cmdsys_get_error(sys, 3, &info), OK);
+    CHECK(strcmp(info.command, "__val"), 0);
+    CHECK(info.line, 100000);
+    CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+    NCHECK(strstr(err_str, "__nope: command not found\n"), NULL);
+    NCHECK(strstr(err_str, "invalid argument \"abc\""), NULL);
+    CHECK(cmdsys_flush_error(sys), OK);
+  }
+  CHECK(count__, 0);
+
+  /* The lazy syntaxes are built by the workers, not in the registry. */
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__val.lazy", count, NULL, NULL, lazy_desc__, NULL), OK);
+  file = fopen("test_cmdsys_script.txt", "w");
+  NCHECK(file, NULL);
+  for(i = 0; i < 100000; ++i) {
+    if(i == 70000) {
+      fprintf(file, "__val.lazy -i x\n");
+    } else {
+      fprintf(file, "__val.lazy -i %d\n", i % 10);
+    }
+  }
+  fclose(file);
+  CHECK(cmdsys_get_memory_usage(sys, &usage0), OK);
+  CHECK(cmdsys_validate_file(sys, "test_cmdsys_script.txt", 4), CMD_ERR);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(usage1.category[CMDSYS_MEMORY_ARGTABLE].count,
+    usage0.category[CMDSYS_MEMORY_ARGTABLE].count);
+  CHECK(usage1.category[CMDSYS_MEMORY_VALUES].size,
+    usage0.category[CMDSYS_MEMORY_VALUES].size);
+  CHECK(cmdsys_get_error_count(sys, &nerrors), OK);
+  CHECK(nerrors, 1);
+  CHECK(cmdsys_get_error(sys, 0, &info), OK);
+  CHECK(info.line, 70001);
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_prewarm(sys, SIZE_MAX, &len), OK);
+  CHECK(len, 1);
+  CHECK(count__, 0);
+
+  file = fopen("test_cmdsys_script.txt", "w");
+  NCHECK(file, NULL);
+  fprintf(file, "__val\n\n__val -i 1\n__val.macro");
+  fclose(file);
+  CHECK(cmdsys_validate_file(sys, "test_cmdsys_script.txt", 4), OK);
+  CHECK(remove("test_cmdsys_script.txt"), 0);
+  CHECK(count__, 0);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+}
+
+/* Check the execution of prepared commands. */
+static void
+test_prepared(void)
+{
+  static const char* str_values[] = { "a", "b", NULL };
+  struct test_allocator allocator;
+  struct cmdsys* sys = NULL;
+  struct cmdsys_prepared* prep = NULL;
+  struct cmdsys_prepared* prep2 = NULL;
+  struct cmdsys_prepared* prep3 = NULL;
+  struct cmdsys_validation result;
+  size_t nallocs = 0;
+  int i = 0;
+
+  test_allocator_init(&allocator);
+  CHECK(cmdsys_create(&allocator.allocator, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__prep", prepared, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 1, 1, 0, 10),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 1, NULL),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command(sys, "__prep.count", count, NULL, NULL, NULL, NULL),
+    OK);
+  CHECK(cmdsys_define_macro(sys, "__prep.macro", "__prep.count"), OK);
+
+  CHECK(cmdsys_prepare(NULL, "__prep -i 1", &prep), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, NULL, &prep), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep -i 1", NULL), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "", &prep), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep -i 1 ; __prep -i 2", &prep), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep.macro", &prep), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep.none", &prep), CMD_ERR);
+  CHECK(cmdsys_prepare(sys, "__prep -i abc", &prep), CMD_ERR);
+  CHECK(prep, NULL);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_set_variable(sys, "STR", "abc"), OK);
+  CHECK(cmdsys_prepare(sys, "__prep -i 7 -s $STR", &prep), OK);
+  CHECK(cmdsys_prepare(sys, "__prep.count", &prep2), OK);
+  CHECK(cmdsys_set_variable(sys, "STR", "def"), OK);
+  /* The tokens referenced by the parsed arguments are overwritten. */
+  CHECK(cmdsys_execute_command(sys, "__prep -i 3", NULL), OK);
+  CHECK(prepared_int__, 3);
+  CHECK(prepared_str__, NULL);
+
+  CHECK(cmdsys_execute_prepared(NULL), BAD_ARG);
+  nallocs = allocator.nallocs;
+  count__ = 0;
+  for(i = 0; i < 16; ++i) {
+    CHECK(cmdsys_execute_prepared(prep), OK);
+    CHECK(cmdsys_execute_prepared(prep2), OK);
+  }
+  CHECK(allocator.nallocs, nallocs);
+  CHECK(count__, 16);
+  CHECK(prepared_int__, 7);
+  CHECK(strcmp(prepared_str__, "abc"), 0);
+
+  /* A deleted command fails until it is registered again. */
+  CHECK(cmdsys_del_command(sys, "__prep.count"), OK);
+  CHECK(cmdsys_execute_prepared(prep2), CMD_ERR);
+  CHECK(cmdsys_execute_prepared(prep), OK);
+  CHECK(cmdsys_add_command(sys, "__prep.count", count, NULL, NULL, NULL, NULL),
+    OK);
+  CHECK(cmdsys_execute_prepared(prep2), OK);
+  CHECK(count__, 17);
+
+  /* Preparing a command keeps the arguments of the validated one. */
+  CHECK(cmdsys_validate_command(sys, "__prep -i 5 -s uvw", &result), OK);
+  CHECK(cmdsys_prepare(sys, "__prep -i 6 -s xyz", &prep3), OK);
+  CHECK(result.argv[1]->value_list[0].data.integer, 5);
+  CHECK(strcmp(result.argv[2]->value_list[0].data.string, "uvw"), 0);
+  CHECK(cmdsys_prepared_ref_put(prep3), OK);
+
+  /* Templates. */
+  CHECK(cmdsys_add_command
+    (sys, "__prep.tmpl", prepared, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_FLOAT("f", NULL, NULL, NULL, 1, 1, -1.f, 1.f),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 1, 1, str_values),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_prepare(sys, "__prep -i $2", &prep3), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep -i $1 -s $1", &prep3), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep -i $17", &prep3), BAD_ARG);
+  CHECK(cmdsys_prepare(sys, "__prep -i $1 -s $2", &prep3), OK);
+  CHECK(cmdsys_execute_prepared(prep3), BAD_ARG); /* Unbound. */
+  CHECK(cmdsys_bind_int(NULL, 1, 0), BAD_ARG);
+  CHECK(cmdsys_bind_int(prep3, 0, 0), BAD_ARG);
+  CHECK(cmdsys_bind_int(prep3, 3, 0), BAD_ARG);
+  CHECK(cmdsys_bind_float(prep3, 1, 0.f), BAD_ARG);
+  CHECK(cmdsys_bind_string(prep3, 1, "1"), BAD_ARG);
+  CHECK(cmdsys_bind_string(prep3, 2, NULL), BAD_ARG);
+  CHECK(cmdsys_bind_int(prep3, 1, 42), OK);
+  CHECK(cmdsys_bind_string(prep3, 2, "xyz"), OK);
+  nallocs = allocator.nallocs;
+  CHECK(cmdsys_execute_prepared(prep3), OK);
+  CHECK(prepared_int__, 10); /* Clamped. */
+  CHECK(strcmp(prepared_str__, "xyz"), 0);
+  CHECK(cmdsys_bind_int(prep3, 1, -3), OK);
+  CHECK(cmdsys_execute_prepared(prep3), OK);
+  CHECK(prepared_int__, 0);
+  CHECK(allocator.nallocs, nallocs);
+  /* The bindings are applied again to a new preparation. */
+  CHECK(cmdsys_add_command(sys, "__prep.other", count, NULL, NULL, NULL, NULL),
+    OK);
+  CHECK(cmdsys_execute_prepared(prep3), OK);
+  CHECK(prepared_int__, 0);
+  CHECK(strcmp(prepared_str__, "xyz"), 0);
+  CHECK(cmdsys_prepared_ref_put(prep3), OK);
+
+  CHECK(cmdsys_prepare(sys, "__prep.tmpl -f $1 -s $2", &prep3), OK);
+  CHECK(cmdsys_bind_int(prep3, 1, 0), BAD_ARG);
+  CHECK(cmdsys_bind_float(prep3, 1, 0.5f), OK);
+  CHECK(cmdsys_bind_string(prep3, 2, "c"), CMD_ERR);
+  CHECK(cmdsys_execute_prepared(prep3), BAD_ARG);
+  CHECK(cmdsys_bind_string(prep3, 2, "b"), OK);
+  CHECK(cmdsys_execute_prepared(prep3), OK);
+  CHECK(strcmp(prepared_str__, "b"), 0);
+  CHECK(prepared_real__, 0.5f);
+  CHECK(cmdsys_bind_float(prep3, 1, 3.f), OK);
+  CHECK(cmdsys_execute_prepared(prep3), OK);
+  CHECK(prepared_real__, 1.f);
+  CHECK(cmdsys_prepared_ref_put(prep3), OK);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_prepared_ref_get(NULL), BAD_ARG);
+  CHECK(cmdsys_prepared_ref_get(prep), OK);
+  CHECK(cmdsys_prepared_ref_put(NULL), BAD_ARG);
+  CHECK(cmdsys_prepared_ref_put(prep), OK);
+  CHECK(cmdsys_prepared_ref_put(prep), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(cmdsys_prepared_ref_put(prep2), OK);
+  CHECK(allocator.allocated_size, 0);
+}
+
+static struct cmdarg*
+create_arg(const enum cmdarg_type type, const size_t count)
+{
+  struct cmdarg* arg = calloc
+    (1, sizeof(struct cmdarg) + count * sizeof(struct cmdarg_value));
+  NCHECK(arg, NULL);
+  arg->type = type;
+  arg->count = count;
+  arg->value_list = (struct cmdarg_value*)(arg + 1);
+  return arg;
+}
+
+/* Check the invocation of commands with caller built arguments. */
+static void
+test_invoke(void)
+{
+  static const char* str_values[] = { "a", "b", NULL };
+  struct cmdsys_error_info info;
+  struct cmdsys* sys = NULL;
+  struct cmdarg* i_arg = create_arg(CMDARG_INT, 1);
+  struct cmdarg* f_arg = create_arg(CMDARG_FLOAT, 1);
+  struct cmdarg* s_arg = create_arg(CMDARG_STRING, 1);
+  struct cmdarg* s2_arg = create_arg(CMDARG_STRING, 2);
+  const struct cmdarg* args[2];
+  const char* err_str = NULL;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__inv", prepared, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 1, 1, 0, 10),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 1, str_values),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__inv", prepared, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_FLOAT("f", NULL, NULL, NULL, 1, 1, -1.f, 1.f),
+       CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 1, NULL),
+       CMDARG_END), NULL), OK);
+
+  i_arg->value_list[0].is_defined = true;
+  i_arg->value_list[0].data.integer = 5;
+  f_arg->value_list[0].is_defined = true;
+  f_arg->value_list[0].data.real = 0.5f;
+  s_arg->value_list[0].is_defined = true;
+  s_arg->value_list[0].data.string = "a";
+  s_arg->value_list[0].length = 1;
+  args[0] = i_arg;
+  args[1] = s_arg;
+
+  CHECK(cmdsys_invoke(NULL, "__inv", SIZE_MAX, args, 2), BAD_ARG);
+  CHECK(cmdsys_invoke(sys, NULL, SIZE_MAX, args, 2), BAD_ARG);
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, NULL, 2), BAD_ARG);
+  CHECK(cmdsys_invoke(sys, "__inv", 2, args, 2), BAD_ARG);
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), OK);
+  CHECK(prepared_int__, 5);
+  CHECK(strcmp(prepared_str__, "a"), 0);
+  CHECK(cmdsys_invoke(sys, "__inv", 0, args, 2), OK);
+  CHECK(cmdsys_invoke(sys, "__inv", 1, args, 2), CMD_ERR);
+
+  args[0] = f_arg;
+  s_arg->value_list[0].is_defined = false;
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), OK);
+  CHECK(prepared_real__, 0.5f);
+  CHECK(prepared_str__, NULL);
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_invoke(sys, "__inv", 0, args, 2), CMD_ERR);
+  CHECK(cmdsys_get_error(sys, 0, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_INVALID_SYNTAX);
+  CHECK(strcmp(info.command, "__inv"), 0);
+  CHECK(info.syntax_id, 0);
+  CHECK(info.expected_type, CMDARG_INT);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  /* Out of the domains. */
+  f_arg->value_list[0].data.real = 2.f;
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), CMD_ERR);
+  args[0] = i_arg;
+  i_arg->value_list[0].data.integer = 11;
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), CMD_ERR);
+  i_arg->value_list[0].data.integer = 10;
+  s_arg->value_list[0].is_defined = true;
+  s_arg->value_list[0].data.string = "c";
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), CMD_ERR);
+  CHECK(cmdsys_get_error(sys, 2, &info), OK);
+  CHECK(info.code, CMDSYS_ERROR_INVALID_VALUE);
+  CHECK(info.syntax_id, 0);
+  CHECK(info.expected_type, CMDARG_STRING);
+  s_arg->value_list[0].data.string = "b";
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), OK);
+  CHECK(prepared_int__, 10);
+
+  /* Invalid value counts. */
+  i_arg->value_list[0].is_defined = false;
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), CMD_ERR);
+  i_arg->value_list[0].is_defined = true;
+  args[1] = s2_arg;
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 2), CMD_ERR);
+  CHECK(cmdsys_invoke(sys, "__inv", SIZE_MAX, args, 1), CMD_ERR);
+  CHECK(cmdsys_invoke(sys, "__none", SIZE_MAX, args, 2), CMD_ERR);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  NCHECK(strstr(err_str, "__none: command not found\n"), NULL);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  free(i_arg);
+  free(f_arg);
+  free(s_arg);
+  free(s2_arg);
+}
+
+/* Check the streamed arguments. */
+static void
+test_streamed(void)
+{
+  static const char* tags[] = { "red", "green", NULL };
+  struct cmdarg_desc int_desc[] = {
+    CMDARG_APPEND_INT("i", NULL, NULL, NULL, 0, 100000, 0, 100), CMDARG_END
+  };
+  struct cmdarg_desc str_desc[] = {
+    CMDARG_APPEND_STRING("t", NULL, NULL, NULL, 1, 100000, tags), CMDARG_END
+  };
+  struct cmdarg_desc lit_desc[] = {
+    CMDARG_APPEND_LITERAL("v", NULL, NULL, 0, 1), CMDARG_END
+  };
+  struct cmdarg_value values[3];
+  struct cmdarg arg;
+  const struct cmdarg* args[1];
+  struct cmdsys_prepared* prepared = NULL;
+  struct cmdsys* sys = NULL;
+  struct cmdsys* sys2 = NULL;
+  struct cmdarg_value val;
+  bool has_value = false;
+
+  int_desc[0].is_streamed = true;
+  str_desc[0].is_streamed = true;
+  lit_desc[0].is_streamed = true;
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__tag", stream, NULL, NULL, lit_desc, NULL), BAD_ARG);
+  CHECK(cmdsys_add_command
+    (sys, "__tag", stream, NULL, NULL, int_desc, NULL), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__tag.name", stream, NULL, NULL, str_desc, NULL), OK);
+
+  CHECK(cmdsys_cursor_next(NULL, &val, &has_value), BAD_ARG);
+
+  CHECK(cmdsys_execute_command(sys, "__tag", NULL), OK);
+  CHECK(stream_count__, 0);
+  /* Out of range values are clamped and invalid ones are reported on read. */
+  CHECK(cmdsys_execute_command(sys, "__tag -i 1 -i 2 -i 500 -i abc", NULL), OK);
+  CHECK(stream_count__, 3);
+  CHECK(stream_sum__, 103);
+  CHECK(stream_nerrors__, 1);
+  CHECK(cmdsys_execute_command
+    (sys, "__tag.name -t red -t blue -t green", NULL), OK);
+  CHECK(stream_count__, 2);
+  CHECK(stream_sum__, 8);
+  CHECK(stream_nerrors__, 1);
+  CHECK(cmdsys_execute_command(sys, "__tag.name", NULL), CMD_ERR);
+  CHECK(cmdsys_prepare(sys, "__tag -i 1", &prepared), BAD_ARG);
+
+  /* Caller built values are streamed too. */
+  memset(values, 0, sizeof(values));
+  values[0].is_defined = true;
+  values[0].data.integer = 4;
+  values[2].is_defined = true;
+  values[2].data.integer = 5;
+  arg.type = CMDARG_INT;
+  arg.count = 3;
+  arg.cursor = NULL;
+  arg.value_list = values;
+  args[0] = &arg;
+  CHECK(cmdsys_invoke(sys, "__tag", SIZE_MAX, args, 1), OK);
+  CHECK(stream_count__, 2);
+  CHECK(stream_sum__, 9);
+
+  /* The streamed flag is saved into the images. */
+  CHECK(cmdsys_save_image(sys, "test_cmdsys_stream.img"), OK);
+  CHECK(cmdsys_create(NULL, &sys2), OK);
+  CHECK(cmdsys_load_image
+    (sys2, "test_cmdsys_stream.img", resolve_stream, NULL), OK);
+  CHECK(cmdsys_execute_command(sys2, "__tag -i 7 -i 8", NULL), OK);
+  CHECK(stream_count__, 2);
+  CHECK(stream_sum__, 15);
+
+  CHECK(cmdsys_ref_put(sys2), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(remove("test_cmdsys_stream.img"), 0);
+}
+
+/* Check the images of commands with several syntaxes or many commands. */
+static void
+test_image_syntaxes(void)
+{
+  static const char* modes[] = { "fast", "safe", NULL };
+  const struct cmdarg_desc int_desc[] = {
+    CMDARG_APPEND_INT("i", NULL, NULL, "level", 1, 1, 0, 9), CMDARG_END
+  };
+  const struct cmdarg_desc str_desc[] = {
+    CMDARG_APPEND_STRING("m", NULL, "<mode>", NULL, 1, 1, modes), CMDARG_END
+  };
+  const struct cmdarg_desc many_desc[] = {
+    CMDARG_APPEND_INT("i", NULL, NULL, "level", 0, 1, 0, 9),
+    CMDARG_APPEND_FLOAT("f", NULL, NULL, "factor", 0, 1, 0.f, 1.f),
+    CMDARG_APPEND_STRING("m", NULL, "<mode>", NULL, 0, 1, modes),
+    CMDARG_END
+  };
+  char man0[1024] = { [0] = '\0' };
+  char man1[1024] = { [0] = '\0' };
+  char name[32];
+  struct cmdsys_memory_usage usage0;
+  struct cmdsys_memory_usage usage1;
+  struct cmdsys* sys = NULL;
+  struct cmdsys* sys2 = NULL;
+  size_t syntax_id = 0;
+  int i = 0;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  #define ADD(name, desc)                                                      \
+    CHECK(cmdsys_add_command(sys, name, image_syntax,                          \
+      image_syntax_ids__ + syntax_id++, NULL, desc, "image syntax"), OK)
+  ADD("__img", NULL);
+  ADD("__img", int_desc);
+  ADD("__img", str_desc);
+  syntax_id = 0;
+  ADD("__img.b", str_desc);
+  ADD("__img.b", NULL);
+  #undef ADD
+  CHECK(cmdsys_save_image(sys, "test_cmdsys_syntaxes.img"), OK);
+
+  CHECK(cmdsys_create(NULL, &sys2), OK);
+  CHECK(cmdsys_get_memory_usage(sys2, &usage0), OK);
+  CHECK(cmdsys_load_image
+    (sys2, "test_cmdsys_syntaxes.img", resolve_image_syntax, NULL), OK);
+  CHECK(cmdsys_execute_command(sys2, "__img", NULL), OK);
+  CHECK(image_syntax__, 0);
+  CHECK(cmdsys_execute_command(sys2, "__img -i 3", NULL), OK);
+  CHECK(image_syntax__, 1);
+  CHECK(cmdsys_execute_command(sys2, "__img -m safe", NULL), OK);
+  CHECK(image_syntax__, 2);
+  CHECK(cmdsys_execute_command(sys2, "__img.b -m fast", NULL), OK);
+  CHECK(image_syntax__, 0);
+  CHECK(cmdsys_execute_command(sys2, "__img.b", NULL), OK);
+  CHECK(image_syntax__, 1);
+  CHECK(cmdsys_man_command(sys, "__img", NULL, sizeof(man0), man0), OK);
+  CHECK(cmdsys_man_command(sys2, "__img", NULL, sizeof(man1), man1), OK);
+  CHECK(strcmp(man0, man1), 0);
+  CHECK(cmdsys_man_command(sys, "__img.b", NULL, sizeof(man0), man0), OK);
+  CHECK(cmdsys_man_command(sys2, "__img.b", NULL, sizeof(man1), man1), OK);
+  CHECK(strcmp(man0, man1), 0);
+
+  /* The image is released with its last command. */
+  CHECK(cmdsys_del_command(sys2, "__img"), OK);
+  CHECK(cmdsys_execute_command(sys2, "__img.b", NULL), OK);
+  CHECK(cmdsys_del_command(sys2, "__img.b"), OK);
+  CHECK(cmdsys_get_memory_usage(sys2, &usage1), OK);
+  CHECK(usage1.category[CMDSYS_MEMORY_OTHERS].size,
+    usage0.category[CMDSYS_MEMORY_OTHERS].size);
+  CHECK(usage1.category[CMDSYS_MEMORY_OTHERS].count,
+    usage0.category[CMDSYS_MEMORY_OTHERS].count);
+  CHECK(cmdsys_load_image
+    (sys2, "test_cmdsys_syntaxes.img", resolve_image_syntax, NULL), OK);
+  CHECK(cmdsys_ref_put(sys2), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(remove("test_cmdsys_syntaxes.img"), 0);
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  for(i = 0; i < 4096; ++i) {
+    CHECK((size_t)snprintf(name, sizeof(name), "__img.%d", i) < sizeof(name),
+      true);
+    CHECK(cmdsys_add_command(sys, name, image_syntax, image_syntax_ids__,
+      NULL, many_desc, "image syntax"), OK);
+  }
+  CHECK(cmdsys_save_image(sys, "test_cmdsys_many.img"), OK);
+  CHECK(cmdsys_create(NULL, &sys2), OK);
+  CHECK(cmdsys_load_image
+    (sys2, "test_cmdsys_many.img", resolve_image_syntax, NULL), OK);
+  CHECK(cmdsys_man_command(sys, "__img.4095", NULL, sizeof(man0), man0), OK);
+  CHECK(cmdsys_man_command(sys2, "__img.4095", NULL, sizeof(man1), man1), OK);
+  CHECK(strcmp(man0, man1), 0);
+  CHECK(cmdsys_execute_command(sys2, "__img.4095 -i 2 -m fast", NULL), OK);
+  CHECK(cmdsys_ref_put(sys2), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(remove("test_cmdsys_many.img"), 0);
+}
+
+/* Check that the argument values are only allocated for the given values. */
+static void
+test_sparse_values(void)
+{
+  struct cmdsys_memory_usage usage;
+  struct test_allocator allocator;
+  struct cmdsys* sys = NULL;
+  char command[512];
+  size_t nallocs = 0;
+  size_t len = 0;
+  int i = 0;
+
+  test_allocator_init(&allocator);
+  CHECK(cmdsys_create(&allocator.allocator, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__sum", sum, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 0, 100000, 0, 1000),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__sum.nested", sum_nested, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 100000, NULL),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage), OK);
+  CHECK(usage.category[CMDSYS_MEMORY_VALUES].size,
+    4 * sizeof(struct cmdarg) + 4 * sizeof(struct cmdarg_value));
+
+  CHECK(cmdsys_execute_command(sys, "__sum", NULL), OK);
+  CHECK(sum_count__, 0);
+  CHECK(cmdsys_execute_command(sys, "__sum -i 3 -i 4 -i 5", NULL), OK);
+  CHECK(sum_count__, 3);
+  CHECK(sum__, 12);
+  CHECK(cmdsys_execute_command
+    (sys, "__sum.nested -s abc -s bc -s c", NULL), OK);
+
+  /* The arena is reused by the next commands. */
+  len = (size_t)snprintf(command, sizeof(command), "__sum");
+  for(i = 0; i < 60; ++i)
+    len += (size_t)snprintf(command + len, sizeof(command) - len, " -i 1");
+  CHECK(cmdsys_execute_command(sys, command, NULL), OK);
+  CHECK(sum_count__, 60);
+  CHECK(sum__, 60);
+  nallocs = allocator.nallocs;
+  CHECK(cmdsys_execute_command(sys, command, NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__sum -i 7", NULL), OK);
+  CHECK(sum__, 7);
+  CHECK(allocator.nallocs, nallocs);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(allocator.allocated_size, 0);
+}
+
+/* Check the capture of the output of the command functions. */
+static void
+test_output(void)
+{
+  struct cmdsys_output_config config = CMDSYS_OUTPUT_CONFIG_DEFAULT;
+  struct test_allocator allocator;
+  struct cmdsys* sys = NULL;
+  const char* output = NULL;
+  size_t len = 0;
+  size_t nallocs = 0;
+  bool is_truncated = true;
+  int i = 0;
+
+  test_allocator_init(&allocator);
+  CHECK(cmdsys_create(&allocator.allocator, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__out", print_value, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 1, 1, 0, 1000),
+       CMDARG_END), NULL), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__out.nested", print_nested, NULL, NULL, NULL, NULL), OK);
+
+  CHECK(cmdsys_get_output(NULL, &output, &len, NULL), BAD_ARG);
+  CHECK(cmdsys_get_output(sys, NULL, &len, NULL), BAD_ARG);
+  CHECK(cmdsys_get_output(sys, &output, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_get_output(sys, &output, &len, &is_truncated), OK);
+  CHECK(strcmp(output, ""), 0);
+  CHECK(len, 0);
+  CHECK(is_truncated, false);
+  CHECK(cmdsys_write(NULL, "a", 1), BAD_ARG);
+  CHECK(cmdsys_write(sys, NULL, 1), BAD_ARG);
+  CHECK(cmdsys_write(sys, NULL, 0), OK);
+  CHECK(cmdsys_printf(NULL, "a"), BAD_ARG);
+  CHECK(cmdsys_printf(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_configure_output(NULL, &config), BAD_ARG);
+  CHECK(cmdsys_configure_output(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_reset_output(NULL), BAD_ARG);
+
+  CHECK(cmdsys_execute_command(sys, "__out -i 3", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__out -i 4 ; __out.nested", NULL), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "__out=3;__out=4;<__out=1;>"), 0);
+  CHECK(len, strlen(output));
+
+  /* Reset per command, except for the commands of the command functions. */
+  config.reset_per_command = true;
+  CHECK(cmdsys_configure_output(sys, &config), OK);
+  CHECK(cmdsys_execute_command(sys, "__out.nested", NULL), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "<__out=1;>"), 0);
+
+  /* The output grows without allocation once it is warmed up. */
+  for(i = 0; i < 1000; ++i)
+    CHECK(cmdsys_printf(sys, "%04d", i), OK);
+  CHECK(cmdsys_reset_output(sys), OK);
+  nallocs = allocator.nallocs;
+  for(i = 0; i < 1000; ++i)
+    CHECK(cmdsys_printf(sys, "%04d", i), OK);
+  CHECK(allocator.nallocs, nallocs);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(len, 4000);
+  CHECK(strncmp(output + 3996, "0999", 4), 0);
+
+  config.max_size = 10;
+  CHECK(cmdsys_configure_output(sys, &config), OK);
+  CHECK(cmdsys_execute_command(sys, "__out -i 100", NULL), OK);
+  CHECK(cmdsys_write(sys, "abcdef", 6), CMDSYS_MEMORY_ERROR);
+  CHECK(cmdsys_get_output(sys, &output, &len, &is_truncated), OK);
+  CHECK(strcmp(output, "__out=100;"), 0);
+  CHECK(is_truncated, true);
+  CHECK(cmdsys_printf(sys, "%d", 1), CMDSYS_MEMORY_ERROR);
+  CHECK(cmdsys_reset_output(sys), OK);
+  CHECK(cmdsys_printf(sys, "%s", "0123456789abc"), CMDSYS_MEMORY_ERROR);
+  CHECK(cmdsys_get_output(sys, &output, &len, &is_truncated), OK);
+  CHECK(strcmp(output, "0123456789"), 0);
+  CHECK(is_truncated, true);
+  CHECK(cmdsys_reset_output(sys), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, &is_truncated), OK);
+  CHECK(len, 0);
+  CHECK(is_truncated, false);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(allocator.allocated_size, 0);
+}
+
+/* Check that the hot paths do not allocate once they are warmed up. */
+static void
+test_allocation_budgets(void)
+{
+  struct test_allocator allocator;
+  struct test_malloc_count count0;
+  struct test_malloc_count count1;
+  struct cmdsys* sys = NULL;
+  char man[1024];
+  const char** lst = NULL;
+  size_t nallocs = 0;
+  size_t len = 0;
+  bool has_hooks = false;
+  int i = 0;
+
+  test_allocator_init(&allocator);
+  CHECK(cmdsys_create(&allocator.allocator, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__budget", count, NULL, NULL, CMDARGV
+      (CMDARG_APPEND_INT("i", NULL, NULL, NULL, 1, 1, 0, 10),
+       CMDARG_END), "budget"), OK);
+  CHECK(cmdsys_add_command(sys, "__budget", count, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__budget.lazy", count, NULL, NULL, lazy_desc__, NULL), OK);
+  NCHECK(allocator.nallocs, 0);
+
+  /* Warm up the lazy syntaxes and the buffers of the man stream. */
+  CHECK(cmdsys_execute_command(sys, "__budget.lazy -i 1", NULL), OK);
+  CHECK(cmdsys_man_command(sys, "__budget", NULL, sizeof(man), man), OK);
+
+  nallocs = allocator.nallocs;
+  has_hooks = test_get_malloc_count(&count0);
+  count__ = 0;
+  for(i = 0; i < 100; ++i) {
+    CHECK(cmdsys_execute_command(sys, "__budget -i 3", NULL), OK);
+    CHECK(cmdsys_execute_command(sys, "__budget", NULL), OK);
+    CHECK(cmdsys_execute_command(sys, "__budget.lazy -i 2", NULL), OK);
+  }
+  CHECK(count__, 300);
+  CHECK(allocator.nallocs, nallocs);
+  /* argtable2 allocates the parsing buffers on the heap: they must at least
+   * be released. */
+  test_get_malloc_count(&count1);
+  if(has_hooks)
+    CHECK(count1.nallocs - count0.nallocs, count1.nfrees - count0.nfrees);
+
+  has_hooks = test_get_malloc_count(&count0);
+  for(i = 0; i < 100; ++i) {
+    CHECK(cmdsys_command_name_completion(sys, "__bu", 4, &len, &lst), OK);
+    CHECK(len, 2);
+  }
+  CHECK(allocator.nallocs, nallocs);
+  test_get_malloc_count(&count1);
+  if(has_hooks)
+    CHECK(count1.nallocs, count0.nallocs);
+
+  has_hooks = test_get_malloc_count(&count0);
+  for(i = 0; i < 100; ++i)
+    CHECK(cmdsys_man_command(sys, "__budget", NULL, sizeof(man), man), OK);
+  CHECK(allocator.nallocs, nallocs);
+  test_get_malloc_count(&count1);
+  if(has_hooks)
+    CHECK(count1.nallocs, count0.nallocs);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(MEM_ALLOCATED_SIZE(&allocator.allocator), 0);
+  CHECK(allocator.nallocs, allocator.nfrees);
+}
+
+static void
+test_interned_strings(void)
+{
+  struct test_allocator allocator;
+  struct cmdsys_memory_usage usage0;
+  struct cmdsys_memory_usage usage1;
+  struct cmdsys* sys = NULL;
+  char name[32];
+  int i = 0;
+
+  test_allocator_init(&allocator);
+  CHECK(cmdsys_create(&allocator.allocator, &sys), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage0), OK);
+  CHECK(usage0.category[CMDSYS_MEMORY_NAMES].count, 0);
+  CHECK(usage0.category[CMDSYS_MEMORY_DESCRIPTIONS].count, 0);
+
+  #define USAGE(cat, field) \
+    usage1.category[CONCAT(CMDSYS_MEMORY_, cat)].field
+  CHECK(cmdsys_add_command
+    (sys, "__str", foo, NULL, NULL, CMDARGV(
+      CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 4, NULL),
+      CMDARG_APPEND_LITERAL("v", NULL, NULL, 0, 1),
+      CMDARG_END),
+     "interned strings"),
+    OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  /* One chunk per pool. */
+  CHECK(USAGE(NAMES, count), 1);
+  CHECK(USAGE(DESCRIPTIONS, count), 1);
+  usage0 = usage1;
+
+  /* The texts are shared by the syntaxes. */
+  CHECK(cmdsys_add_command
+    (sys, "__str", foo, NULL, NULL, CMDARGV(
+      CMDARG_APPEND_LITERAL("v", NULL, NULL, 0, 1),
+      CMDARG_END),
+     "interned strings"),
+    OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(USAGE(NAMES, size), usage0.category[CMDSYS_MEMORY_NAMES].size);
+  CHECK(USAGE(DESCRIPTIONS, size),
+    usage0.category[CMDSYS_MEMORY_DESCRIPTIONS].size);
+
+  /* The chunks are freed with their last string. */
+  CHECK(cmdsys_del_command(sys, "__str"), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(USAGE(NAMES, size), 0);
+  CHECK(USAGE(NAMES, count), 0);
+  CHECK(USAGE(DESCRIPTIONS, size), 0);
+  CHECK(USAGE(DESCRIPTIONS, count), 0);
+
+  /* Registering and deleting distinct names does not grow the pools. */
+  for(i = 0; i < 1000; ++i) {
+    sprintf(name, "__churn%d", i);
+    CHECK(cmdsys_add_command
+      (sys, name, count, NULL, NULL, CMDARGV(
+        CMDARG_APPEND_INT("i", NULL, NULL, name, 0, 1, 0, 10),
+        CMDARG_END),
+       name),
+      OK);
+    CHECK(cmdsys_execute_command(sys, name, NULL), OK);
+    CHECK(cmdsys_del_command(sys, name), OK);
+  }
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(USAGE(NAMES, size), 0);
+  CHECK(USAGE(DESCRIPTIONS, size), 0);
+  #undef USAGE
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(MEM_ALLOCATED_SIZE(&allocator.allocator), 0);
+  CHECK(allocator.nallocs, allocator.nfrees);
+}
+
 int
 main(int argc, char **argv)
 {
   char buf[16] = { [0] = '\0' };
+  char man0[1024] = { [0] = '\0' };
+  char man1[1024] = { [0] = '\0' };
   struct cmdsys* sys = NULL;
+  struct cmdsys* sys2 = NULL;
+  struct cmdsys_completion_session* session = NULL;
+  struct cmdsys_memory_usage usage0;
+  struct cmdsys_memory_usage usage1;
+  size_t i = 0;
   const char** lst = NULL;
   const char* err_str = NULL;
   size_t len = 0;
@@ -459,6 +1642,12 @@ main(int argc, char **argv)
 
   CHECK(cmdsys_execute_command(sys, "__foo", NULL), OK);
   CHECK(cmdsys_execute_command(sys, "__foo -v", NULL), OK);
+  CHECK(cmdsys_execute_commandn(NULL, "__foo", 5, NULL), BAD_ARG);
+  CHECK(cmdsys_execute_commandn(sys, NULL, 5, NULL), BAD_ARG);
+  CHECK(cmdsys_execute_commandn(sys, NULL, 0, NULL), CMD_ERR);
+  CHECK(cmdsys_execute_commandn(sys, "  __foo -v", 7, NULL), OK);
+  CHECK(cmdsys_execute_commandn(sys, "__foo -v\n__foo", 8, NULL), OK);
+  CHECK(cmdsys_execute_commandn(sys, "__foo -vx", 9, NULL), CMD_ERR);
 
   CHECK(cmdsys_del_command(NULL, NULL), BAD_ARG);
   CHECK(cmdsys_del_command(sys, NULL), BAD_ARG);
@@ -505,6 +1694,111 @@ main(int argc, char **argv)
   CHECK(cmdsys_execute_command(sys, "__load -m \"my_model.obj\"", NULL), OK);
   CHECK(cmdsys_execute_command(sys, "__load -M \"my_model.obj\"", NULL), OK);
 
+  CHECK(cmdsys_add_command(sys, "__count", count, NULL, NULL, NULL, NULL), OK);
+  count__ = 0;
+  CHECK(cmdsys_execute_command(sys, "__count && __count", NULL), OK);
+  CHECK(count__, 2);
+  CHECK(cmdsys_execute_command(sys, "__count;__count&&__count", NULL), OK);
+  CHECK(count__, 5);
+  CHECK(cmdsys_execute_command(sys, "__load && __count", NULL), CMD_ERR);
+  CHECK(count__, 5);
+  CHECK(cmdsys_execute_command(sys, "__load || __count", NULL), OK);
+  CHECK(count__, 6);
+  CHECK(cmdsys_execute_command(sys, "__count || __count", NULL), OK);
+  CHECK(count__, 7);
+  CHECK(cmdsys_execute_command(sys, "__load && __count || __count", NULL), OK);
+  CHECK(count__, 8);
+  CHECK(cmdsys_execute_command(sys, "__count ; __load", NULL), CMD_ERR);
+  CHECK(count__, 9);
+  CHECK(cmdsys_execute_command(sys, "; __load ; __count ;", NULL), OK);
+  CHECK(count__, 10);
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "&& __count", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strcmp(err_str, "syntax error near `&&'\n"), 0);
+  CHECK(cmdsys_execute_command(sys, "__count ||", NULL), CMD_ERR);
+  CHECK(cmdsys_execute_command(sys, "__count && ; __count", NULL), CMD_ERR);
+  CHECK(count__, 10);
+  CHECK(cmdsys_execute_command(sys, "__count & __count", NULL), CMD_ERR);
+  CHECK(count__, 10);
+  load_model__ = "\"my model && 'b'.obj\"";
+  CHECK(cmdsys_execute_command
+    (sys, "__load -m \"my model && 'b'.obj\"&&__count", NULL), OK);
+  CHECK(count__, 11);
+  load_model__ = "'my;model'";
+  CHECK(cmdsys_execute_command(sys, "__load -m 'my;model'", NULL), OK);
+
+  CHECK(cmdsys_set_variable(NULL, "DIR", "/data"), BAD_ARG);
+  CHECK(cmdsys_set_variable(sys, NULL, "/data"), BAD_ARG);
+  CHECK(cmdsys_set_variable(sys, "DIR", NULL), BAD_ARG);
+  CHECK(cmdsys_set_variable(sys, "0DIR", "/data"), BAD_ARG);
+  CHECK(cmdsys_set_variable(sys, "DIR-", "/data"), BAD_ARG);
+  CHECK(cmdsys_set_variable(sys, "DIR", "/tmp"), OK);
+  CHECK(cmdsys_set_variable(sys, "DIR", "/data"), OK);
+  CHECK(cmdsys_set_variable(sys, "_0", "a b"), OK);
+  CHECK(cmdsys_get_variable(sys, "DIR", &err_str), OK);
+  CHECK(strcmp(err_str, "/data"), 0);
+  CHECK(cmdsys_get_variable(sys, "DIR0", &err_str), OK);
+  CHECK(err_str, NULL);
+  load_model__ = "/data/a.obj";
+  CHECK(cmdsys_execute_command(sys, "__load -m $DIR/a.obj", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__load -m ${DIR}/a.obj", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__load -m $DIR/a.obj $UNDEF", NULL), OK);
+  load_model__ = "\"/data/a b.obj\"";
+  CHECK(cmdsys_execute_command(sys, "__load -m \"$DIR/$_0.obj\"", NULL), OK);
+  load_model__ = "'$DIR'";
+  CHECK(cmdsys_execute_command(sys, "__load -m '$DIR'", NULL), OK);
+  load_model__ = "$/${DIR";
+  CHECK(cmdsys_execute_command(sys, "__load -m $/${DIR", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__load -m $UNDEF", NULL), CMD_ERR);
+
+  CHECK(cmdsys_define_macro(NULL, "__m", "__count"), BAD_ARG);
+  CHECK(cmdsys_define_macro(sys, NULL, "__count"), BAD_ARG);
+  CHECK(cmdsys_define_macro(sys, "__m", NULL), BAD_ARG);
+  CHECK(cmdsys_define_macro(sys, "__m", " "), BAD_ARG);
+  CHECK(cmdsys_define_macro(sys, "__m", "__count &&"), CMD_ERR);
+  CHECK(cmdsys_define_macro(sys, "__m", "__count"), OK);
+  CHECK(cmdsys_define_macro(sys, "__m", "__count && __count"), OK);
+  count__ = 0;
+  CHECK(cmdsys_execute_command(sys, "__m", NULL), OK);
+  CHECK(count__, 2);
+  CHECK(cmdsys_execute_command(sys, "__m && __m", NULL), OK);
+  CHECK(count__, 6);
+  CHECK(cmdsys_execute_command(sys, "__m -v", NULL), CMD_ERR);
+  CHECK(count__, 6);
+  load_model__ = "/data/a.obj";
+  CHECK(cmdsys_define_macro(sys, "__m2", "__load -m $MODEL || __m"), OK);
+  CHECK(cmdsys_execute_command(sys, "__m2", NULL), OK);
+  CHECK(count__, 8);
+  CHECK(cmdsys_set_variable(sys, "MODEL", "$DIR/a.obj"), OK);
+  load_model__ = "$DIR/a.obj"; /* Values are not expanded. */
+  CHECK(cmdsys_execute_command(sys, "__m2", NULL), OK);
+  CHECK(count__, 8);
+  CHECK(cmdsys_set_variable(sys, "DIR", "/tmp"), OK);
+  CHECK(cmdsys_set_variable(sys, "MODEL", "/tmp/a.obj"), OK);
+  load_model__ = "/tmp/a.obj";
+  CHECK(cmdsys_execute_command(sys, "__m2", NULL), OK);
+  CHECK(count__, 8);
+  CHECK(cmdsys_unset_variable(sys, "MODEL"), OK);
+  CHECK(cmdsys_unset_variable(sys, "DIR"), OK);
+  CHECK(cmdsys_unset_variable(sys, "DIR"), BAD_ARG);
+  CHECK(cmdsys_unset_variable(sys, "_0"), OK);
+  CHECK(cmdsys_define_macro(sys, "__m3", "__later; __m3"), OK);
+  CHECK(cmdsys_execute_command(sys, "__m3", NULL), CMD_ERR);
+  CHECK(cmdsys_add_command(sys, "__later", count, NULL, NULL, NULL, NULL), OK);
+  count__ = 0;
+  CHECK(cmdsys_execute_command(sys, "__m3", NULL), CMD_ERR);
+  CHECK(count__, 16); /* Stopped by the nesting limit. */
+  CHECK(cmdsys_undefine_macro(sys, "__m3"), OK);
+  CHECK(cmdsys_undefine_macro(sys, "__m3"), BAD_ARG);
+  CHECK(cmdsys_execute_command(sys, "__m3", NULL), CMD_ERR);
+  CHECK(cmdsys_undefine_macro(sys, "__m"), OK);
+  CHECK(cmdsys_del_command(sys, "__later"), OK);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_del_command(sys, "__count"), OK);
+  load_model__ = "\"my_model.obj\"";
+
   load_verbose_opt__ = true;
   CHECK(cmdsys_execute_command
     (sys, "__load --verbose -m \"my_model.obj\"", NULL), OK);
@@ -630,6 +1924,11 @@ main(int argc, char **argv)
     (sys, "__setf3 --red=-1.5 --blue 0.5 -g 0.78", NULL), OK);
   CHECK(cmdsys_execute_command
     (sys, "__setf3 -r -1.5 -b 0.5e0 -g 0.78 -g 1", NULL), CMD_ERR);
+  CHECK(cmdsys_execute_command(sys, "__setf3 -g 0,5", NULL), CMD_ERR);
+  CHECK(cmdsys_flush_error(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__setf3 -g abc", NULL), CMD_ERR);
+  CHECK(cmdsys_get_error_string(sys, &err_str), OK);
+  CHECK(strstr(err_str, "invalid argument \"abc\"") != NULL, true);
 
   CHECK(cmdsys_add_command
     (sys, "__day", day, NULL, day_completion,
@@ -856,7 +2155,77 @@ main(int argc, char **argv)
   CHECK(len, 0);
   CHECK(lst, NULL);
 
+  CHECK(cmdsys_create_completion_session(NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_create_completion_session(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_create_completion_session(NULL, &session), BAD_ARG);
+  CHECK(cmdsys_create_completion_session(sys, &session), OK);
+  CHECK(cmdsys_session_arg_completion
+    (NULL, "__date", NULL, 0, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     BAD_ARG);
+  CHECK(cmdsys_session_arg_completion
+    (session, NULL, NULL, 0, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     BAD_ARG);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", NULL, 0, 2, (char*[]){"__date", "-d"}, NULL, &lst),
+     BAD_ARG);
+  day_completion_count__ = 0;
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", NULL, 0, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     OK);
+  CHECK(len, 7);
+  CHECK(day_completion_count__, 1);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "T", 1, 2, (char*[]){"__date", "-d"}, &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "Thursday"), 0);
+  CHECK(strcmp(lst[1], "Tuesday"), 0);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Th", 2, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     OK);
+  CHECK(len, 1);
+  CHECK(strcmp(lst[0], "Thursday"), 0);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Thx", 3, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     OK);
+  CHECK(len, 0);
+  CHECK(lst, NULL);
+  CHECK(day_completion_count__, 1);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "S", 1, 2, (char*[]){"__date", "-d"}, &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "Saturday"), 0);
+  CHECK(strcmp(lst[1], "Sunday"), 0);
+  CHECK(day_completion_count__, 2);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Ju", 2, 2, (char*[]){"__date", "-m"}, &len, &lst),
+     OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "July"), 0);
+  CHECK(strcmp(lst[1], "June"), 0);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Jul", 3, 2, (char*[]){"__date", "-m"}, &len, &lst),
+     OK);
+  CHECK(len, 1);
+  CHECK(strcmp(lst[0], "July"), 0);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Sep", 3, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     OK);
+  CHECK(len, 0);
+  CHECK(lst, NULL);
+  CHECK(day_completion_count__, 3);
+
   CHECK(cmdsys_del_command(sys, "__date"), OK);
+  CHECK(cmdsys_session_arg_completion
+    (session, "__date", "Sep", 3, 2, (char*[]){"__date", "-d"}, &len, &lst),
+     OK);
+  CHECK(len, 0);
+  CHECK(lst, NULL);
+  CHECK(day_completion_count__, 3);
+  CHECK(cmdsys_completion_session_ref_get(NULL), BAD_ARG);
+  CHECK(cmdsys_completion_session_ref_get(session), OK);
+  CHECK(cmdsys_completion_session_ref_put(NULL), BAD_ARG);
+  CHECK(cmdsys_completion_session_ref_put(session), OK);
+  CHECK(cmdsys_completion_session_ref_put(session), OK);
 
   CHECK(cmdsys_add_command
     (sys, "__cat", cat, NULL, NULL,
@@ -967,8 +2336,242 @@ main(int argc, char **argv)
     (sys, "__print", print, "hello world!", NULL, NULL, NULL), OK);
   CHECK(cmdsys_execute_command(sys, "__print", NULL), OK);
 
+  CHECK(cmdsys_save_image(NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_save_image(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_save_image(NULL, "test_cmdsys.img"), BAD_ARG);
+  CHECK(cmdsys_save_image(sys, "test_cmdsys.img"), OK);
+
+  CHECK(cmdsys_create(NULL, &sys2), OK);
+  CHECK(cmdsys_load_image(NULL, NULL, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_load_image(sys2, NULL, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_load_image(sys2, "test_cmdsys.img", NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_load_image(sys2, "__foo.img", resolve_command, NULL), IO_ERR);
+  CHECK(cmdsys_load_image(sys2, "test_cmdsys.img", resolve_command, NULL), OK);
+  CHECK(cmdsys_load_image(sys2, "test_cmdsys.img", resolve_command, NULL),
+    BAD_ARG);
+  CHECK(cmdsys_command_name_completion(sys2, NULL, 0, &len, &lst), OK);
+  CHECK(len, 5);
+  CHECK(strcmp(lst[0], "__cat"), 0);
+  CHECK(strcmp(lst[4], "__setf3"), 0);
+  CHECK(cmdsys_man_command(sys, "__load", NULL, sizeof(man0), man0), OK);
+  CHECK(cmdsys_man_command(sys2, "__load", NULL, sizeof(man1), man1), OK);
+  CHECK(strcmp(man0, man1), 0);
+  CHECK(cmdsys_man_command(sys, "__day", NULL, sizeof(man0), man0), OK);
+  CHECK(cmdsys_man_command(sys2, "__day", NULL, sizeof(man1), man1), OK);
+  CHECK(strcmp(man0, man1), 0);
+  CHECK(cmdsys_execute_command(sys2, "__print", NULL), OK);
+  day_list__[0] = "Monday";
+  day_list__[1] = "Friday";
+  day_count__ = 2;
+  CHECK(cmdsys_execute_command(sys2, "__day Monday Friday", NULL), OK);
+  CHECK(cmdsys_execute_command(sys2, "__day Monday foo", NULL), CMD_ERR);
+  setf3_r_opt__ = setf3_b_opt__ = false;
+  setf3_g_opt__ = true;
+  setf3_g__ = 1.f;
+  CHECK(cmdsys_execute_command(sys2, "__setf3 -g 5.1", NULL), OK);
+  CHECK(cmdsys_command_arg_completion
+    (sys2, "__day", "Sat", 2, 0, NULL, &len, &lst), OK);
+  CHECK(len, 1);
+  CHECK(strcmp(lst[0], "Saturday"), 0);
+  CHECK(cmdsys_ref_put(sys2), OK);
+  CHECK(remove("test_cmdsys.img"), 0);
+
+  #define ADD(name) \
+    CHECK(cmdsys_add_command(sys, name, nop, NULL, NULL, NULL, NULL), OK)
+  ADD("__ns.render.shadow.set");
+  ADD("__ns.render.shadow.get");
+  ADD("__ns.render.shadow.get");
+  ADD("__ns.render.light");
+  ADD("__ns.render");
+  ADD("__ns.audio.volume");
+  ADD("__nsx.foo");
+  #undef ADD
+  CHECK(cmdsys_list_namespace(NULL, "__ns", &len, &lst), BAD_ARG);
+  CHECK(cmdsys_list_namespace(sys, NULL, &len, &lst), BAD_ARG);
+  CHECK(cmdsys_list_namespace(sys, "__ns", NULL, &lst), BAD_ARG);
+  CHECK(cmdsys_list_namespace(sys, "__ns", &len, NULL), BAD_ARG);
+  CHECK(cmdsys_list_namespace(sys, "__ns", &len, &lst), OK);
+  CHECK(len, 5);
+  CHECK(strcmp(lst[0], "__ns.audio.volume"), 0);
+  CHECK(strcmp(lst[1], "__ns.render"), 0);
+  CHECK(strcmp(lst[4], "__ns.render.shadow.set"), 0);
+  CHECK(cmdsys_list_namespace(sys, "__ns.render.shadow", &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(cmdsys_list_namespace(sys, "__ns.rend", &len, &lst), OK);
+  CHECK(len, 0);
+  CHECK(lst, NULL);
+
+  CHECK(cmdsys_namespace_completion(NULL, "__", 2, &len, &lst), BAD_ARG);
+  CHECK(cmdsys_namespace_completion(sys, NULL, 2, &len, &lst), BAD_ARG);
+  CHECK(cmdsys_namespace_completion(sys, "__", 2, NULL, &lst), BAD_ARG);
+  CHECK(cmdsys_namespace_completion(sys, "__", 2, &len, NULL), BAD_ARG);
+  CHECK(cmdsys_namespace_completion(sys, "__n", 3, &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "__ns"), 0);
+  CHECK(strcmp(lst[1], "__nsx"), 0);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.", 5, &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "audio"), 0);
+  CHECK(strcmp(lst[1], "render"), 0);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.render.sxx", 13, &len, &lst),OK);
+  CHECK(len, 1);
+  CHECK(strcmp(lst[0], "shadow"), 0);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.render.shadow.", 19, &len, &lst),
+    OK);
+  CHECK(len, 2);
+  CHECK(strcmp(lst[0], "get"), 0);
+  CHECK(strcmp(lst[1], "set"), 0);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.foo.", 9, &len, &lst), OK);
+  CHECK(len, 0);
+
+  CHECK(cmdsys_del_namespace(NULL, "__ns.render"), BAD_ARG);
+  CHECK(cmdsys_del_namespace(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_del_namespace(sys, ""), BAD_ARG);
+  CHECK(cmdsys_del_namespace(sys, "__ns.rend"), BAD_ARG);
+  CHECK(cmdsys_del_namespace(sys, "__ns.render"), OK);
+  CHECK(cmdsys_has_command(sys, "__ns.render", &b), OK);
+  CHECK(b, true);
+  CHECK(cmdsys_has_command(sys, "__ns.render.light", &b), OK);
+  CHECK(b, false);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.render.", 12, &len, &lst), OK);
+  CHECK(len, 0);
+  CHECK(cmdsys_list_namespace(sys, "__ns", &len, &lst), OK);
+  CHECK(len, 2);
+  CHECK(cmdsys_del_command(sys, "__ns.render"), OK);
+  CHECK(cmdsys_namespace_completion(sys, "__ns.", 5, &len, &lst), OK);
+  CHECK(len, 1);
+  CHECK(strcmp(lst[0], "audio"), 0);
+  CHECK(cmdsys_del_namespace(sys, "__ns"), OK);
+  CHECK(cmdsys_del_namespace(sys, "__nsx"), OK);
+  CHECK(cmdsys_namespace_completion(sys, "__n", 3, &len, &lst), OK);
+  CHECK(len, 0);
+
+  CHECK(cmdsys_get_memory_usage(NULL, &usage0), BAD_ARG);
+  CHECK(cmdsys_get_memory_usage(sys, NULL), BAD_ARG);
+  CHECK(cmdsys_get_memory_usage(sys, &usage0), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__mem", foo, NULL, NULL, CMDARGV(
+      CMDARG_APPEND_STRING("s", NULL, NULL, NULL, 0, 4, NULL),
+      CMDARG_APPEND_LITERAL("v", NULL, NULL, 0, 1),
+      CMDARG_END),
+     "memory usage"),
+    OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  #define DELTA(cat, field)                                                    \
+    (usage1.category[CONCAT(CMDSYS_MEMORY_, cat)].field                        \
+   - usage0.category[CONCAT(CMDSYS_MEMORY_, cat)].field)
+  /* The syntax block and the syntax arrays of the new command name. */
+  CHECK(DELTA(DESCRIPTORS, count), 3);
+  /* The values of the arguments are only allocated on execution. */
+  CHECK(DELTA(VALUES, size),
+    3 * sizeof(struct cmdarg) + 2 * sizeof(struct cmdarg_value));
+  CHECK(DELTA(VALUES, count), 1);
+  CHECK(DELTA(ARGTABLE, count), 3);
+  NCHECK(DELTA(ARGTABLE, size), 0);
+  CHECK(cmdsys_add_command(sys, "__mem", foo, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_add_command(sys, "__mem", foo, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(DESCRIPTORS, count), 5);
+  CHECK(DELTA(VALUES, count), 3);
+  for(i = 0, len = 0; i < CMDSYS_MEMORY_CATEGORIES_COUNT; ++i)
+    len += usage1.category[i].size;
+  CHECK(len, usage1.size);
+  CHECK(usage1.peak_size >= usage1.size, true);
+  CHECK(cmdsys_del_command(sys, "__mem"), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(DESCRIPTORS, size), 0);
+  CHECK(DELTA(VALUES, size), 0);
+  CHECK(DELTA(ARGTABLE, size), 0);
+  CHECK(DELTA(ARGTABLE, count), 0);
+  /* The name and the texts are released with the last syntax using them. */
+  CHECK(DELTA(NAMES, size), 0);
+  CHECK(DELTA(NAMES, count), 0);
+  CHECK(DELTA(DESCRIPTIONS, size), 0);
+  CHECK(DELTA(DESCRIPTIONS, count), 0);
+  CHECK(usage1.peak_size > usage1.size, true);
+
+  /* The texts are copied, i.e. the buffers of the caller can be reused. */
+  strcpy(buf, "reused text");
+  CHECK(cmdsys_add_command
+    (sys, "__mem", foo, NULL, NULL, CMDARGV(
+      CMDARG_APPEND_LITERAL("v", NULL, buf, 0, 1),
+      CMDARG_END),
+     buf), OK);
+  memset(buf, 0, sizeof(buf));
+  CHECK(cmdsys_man_command(sys, "__mem", NULL, sizeof(man0), man0), OK);
+  NCHECK(strstr(man0, "reused text"), NULL);
+  CHECK(cmdsys_del_command(sys, "__mem"), OK);
+
+  /* Lazy syntaxes are built on their first use. */
+  CHECK(cmdsys_get_memory_usage(sys, &usage0), OK);
+  CHECK(cmdsys_add_lazy_command
+    (NULL, "__lazy", count, NULL, NULL, lazy_desc__, NULL), BAD_ARG);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy", count, NULL, NULL, lazy_bad_desc__, NULL), BAD_ARG);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy", count, NULL, NULL, lazy_desc__, "lazy command"), OK);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy", count, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy.a", count, NULL, NULL, lazy_desc__, NULL), OK);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy.b", count, NULL, NULL, lazy_desc__, NULL), OK);
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy.b", count, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(VALUES, count), 0);
+  CHECK(DELTA(ARGTABLE, count), 0);
+  CHECK(DELTA(DESCRIPTIONS, size), 0);
+
+  count__ = 0;
+  CHECK(cmdsys_execute_command(sys, "__lazy -i 3", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__lazy", NULL), OK);
+  CHECK(count__, 2);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(VALUES, count), 2);
+  CHECK(DELTA(ARGTABLE, count), 3);
+  CHECK(cmdsys_man_command(sys, "__lazy", NULL, sizeof(man0), man0), OK);
+  NCHECK(strstr(man0, "lazy command"), NULL);
+
+  CHECK(cmdsys_prewarm(NULL, 1, &len), BAD_ARG);
+  CHECK(cmdsys_prewarm(sys, 0, &len), OK);
+  CHECK(len, 0);
+  CHECK(cmdsys_prewarm(sys, 2, &len), OK);
+  CHECK(len, 2);
+  CHECK(cmdsys_prewarm(sys, 2, NULL), OK);
+  CHECK(cmdsys_prewarm(sys, 2, &len), OK);
+  CHECK(len, 0);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(VALUES, count), 5);
+  CHECK(cmdsys_execute_command(sys, "__lazy.b -i abc", NULL),
+    CMDSYS_COMMAND_ERROR);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_add_lazy_command
+    (sys, "__lazy.c", count, NULL, NULL, NULL, NULL), OK);
+  CHECK(cmdsys_del_namespace(sys, "__lazy"), OK);
+  CHECK(cmdsys_del_command(sys, "__lazy"), OK);
+  CHECK(cmdsys_prewarm(sys, 2, &len), OK);
+  CHECK(len, 0);
+  CHECK(cmdsys_get_memory_usage(sys, &usage1), OK);
+  CHECK(DELTA(DESCRIPTORS, size), 0);
+  CHECK(DELTA(VALUES, size), 0);
+  CHECK(DELTA(ARGTABLE, count), 0);
+  #undef DELTA
+
   CHECK(cmdsys_ref_put(sys), CMDSYS_NO_ERROR);
 
+  test_structured_errors();
+  test_interned_strings();
+  test_validation();
+  test_prepared();
+  test_invoke();
+  test_output();
+  test_sparse_values();
+  test_streamed();
+  test_image_syntaxes();
+  test_allocation_budgets();
+
   CHECK(MEM_ALLOCATED_SIZE(&mem_default_allocator), 0);
   return 0;
 }
@@ -0,0 +1,262 @@
+#include "test_cmdsys_alloc.h"
+#include <snlsys/math.h>
+#include <snlsys/snlsys.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HEADER_SIZE 16
+
+struct header {
+  size_t size;
+  size_t offset; /* Distance from the parent block to the user block. */
+};
+
+/*******************************************************************************
+ *
+ * Counting allocator.
+ *
+ ******************************************************************************/
+static FINLINE struct header*
+header_of(void* mem)
+{
+  return (struct header*)((char*)mem - HEADER_SIZE);
+}
+
+static void*
+setup_block
+  (struct test_allocator* test,
+   char* base,
+   const size_t size,
+   const size_t offset)
+{
+  struct header* header = NULL;
+  if(!base)
+    return NULL;
+  header = header_of(base + offset);
+  header->size = size;
+  header->offset = offset;
+  ++test->nallocs;
+  test->allocated_size += size;
+  return base + offset;
+}
+
+static void*
+test_alloc
+  (void* data, const size_t size, const char* filename, const unsigned line)
+{
+  (void)filename, (void)line;
+  if(size > SIZE_MAX - HEADER_SIZE)
+    return NULL;
+  return setup_block
+    (data, MEM_ALLOC(&mem_default_allocator, size + HEADER_SIZE), size,
+     HEADER_SIZE);
+}
+
+static void*
+test_calloc
+  (void* data,
+   const size_t nbelmts,
+   const size_t size,
+   const char* filename,
+   const unsigned line)
+{
+  void* mem = NULL;
+  if(size && nbelmts > SIZE_MAX / size)
+    return NULL;
+  mem = test_alloc(data, nbelmts * size, filename, line);
+  if(mem)
+    memset(mem, 0, nbelmts * size);
+  return mem;
+}
+
+static void*
+test_aligned_alloc
+  (void* data,
+   const size_t size,
+   const size_t alignment,
+   const char* filename,
+   const unsigned line)
+{
+  if(alignment <= HEADER_SIZE)
+    return test_alloc(data, size, filename, line);
+  if(!IS_POWER_OF_2(alignment) || size > SIZE_MAX - alignment)
+    return NULL;
+  return setup_block
+    (data,
+     MEM_ALIGNED_ALLOC(&mem_default_allocator, size + alignment, alignment),
+     size, alignment);
+}
+
+static void
+test_free(void* data, void* mem)
+{
+  struct test_allocator* test = data;
+  struct header* header = NULL;
+  if(!mem)
+    return;
+  header = header_of(mem);
+  ASSERT(test->allocated_size >= header->size);
+  ++test->nfrees;
+  test->allocated_size -= header->size;
+  MEM_FREE(&mem_default_allocator, (char*)mem - header->offset);
+}
+
+static void*
+test_realloc
+  (void* data,
+   void* mem,
+   const size_t size,
+   const char* filename,
+   const unsigned line)
+{
+  void* new_mem = NULL;
+
+  if(!mem)
+    return test_alloc(data, size, filename, line);
+  if(!size) {
+    test_free(data, mem);
+    return NULL;
+  }
+  /* Always move the block to catch the dangling references. A reallocation
+   * thus counts as an allocation and a free. */
+  new_mem = test_alloc(data, size, filename, line);
+  if(new_mem) {
+    memcpy(new_mem, mem, MIN(size, header_of(mem)->size));
+    test_free(data, mem);
+  }
+  return new_mem;
+}
+
+static size_t
+test_allocated_size(const void* data)
+{
+  return ((const struct test_allocator*)data)->allocated_size;
+}
+
+static size_t
+test_dump(const void* data, char* dump, const size_t max_dump_len)
+{
+  (void)data;
+  return MEM_DUMP(&mem_default_allocator, dump, max_dump_len);
+}
+
+void
+test_allocator_init(struct test_allocator* test)
+{
+  ASSERT(test && sizeof(struct header) <= HEADER_SIZE);
+  memset(test, 0, sizeof(struct test_allocator));
+  test->allocator.alloc = test_alloc;
+  test->allocator.calloc = test_calloc;
+  test->allocator.realloc = test_realloc;
+  test->allocator.aligned_alloc = test_aligned_alloc;
+  test->allocator.free = test_free;
+  test->allocator.allocated_size = test_allocated_size;
+  test->allocator.dump = test_dump;
+  test->allocator.data = test;
+}
+
+/*******************************************************************************
+ *
+ * Malloc hooks. The malloc family is interposed and forwarded to the glibc
+ * implementation, unless a sanitizer already intercepts it. The hooks are
+ * exported to be also used by the shared libraries, e.g. argtable2.
+ *
+ ******************************************************************************/
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+  #define MALLOC_HOOKS 0
+#elif defined(__has_feature)
+  #if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+    #define MALLOC_HOOKS 0
+  #endif
+#endif
+#if !defined(MALLOC_HOOKS) && defined(__GLIBC__)
+  #define MALLOC_HOOKS 1
+#elif !defined(MALLOC_HOOKS)
+  #define MALLOC_HOOKS 0
+#endif
+
+#if MALLOC_HOOKS
+#include <errno.h>
+#include <stdlib.h>
+
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+extern void* __libc_memalign(size_t, size_t);
+extern void __libc_free(void*);
+extern void* memalign(size_t, size_t);
+extern void* aligned_alloc(size_t, size_t);
+extern int posix_memalign(void**, size_t, size_t);
+
+static struct test_malloc_count malloc_count;
+
+EXPORT_SYM void*
+malloc(size_t size)
+{
+  ++malloc_count.nallocs;
+  return __libc_malloc(size);
+}
+
+EXPORT_SYM void*
+calloc(size_t nbelmts, size_t size)
+{
+  ++malloc_count.nallocs;
+  return __libc_calloc(nbelmts, size);
+}
+
+EXPORT_SYM void*
+realloc(void* mem, size_t size)
+{
+  /* Count a reallocation as an allocation and a free. */
+  malloc_count.nallocs += size != 0;
+  malloc_count.nfrees += mem != NULL;
+  return __libc_realloc(mem, size);
+}
+
+EXPORT_SYM void*
+memalign(size_t alignment, size_t size)
+{
+  ++malloc_count.nallocs;
+  return __libc_memalign(alignment, size);
+}
+
+EXPORT_SYM void*
+aligned_alloc(size_t alignment, size_t size)
+{
+  return memalign(alignment, size);
+}
+
+EXPORT_SYM int
+posix_memalign(void** mem, size_t alignment, size_t size)
+{
+  void* ptr = NULL;
+  if(!IS_POWER_OF_2(alignment) || alignment % sizeof(void*))
+    return EINVAL;
+  ptr = memalign(alignment, size);
+  if(!ptr)
+    return ENOMEM;
+  *mem = ptr;
+  return 0;
+}
+
+EXPORT_SYM void
+free(void* mem)
+{
+  if(mem)
+    ++malloc_count.nfrees;
+  __libc_free(mem);
+}
+#endif /* MALLOC_HOOKS */
+
+bool
+test_get_malloc_count(struct test_malloc_count* count)
+{
+  ASSERT(count);
+#if MALLOC_HOOKS
+  *count = malloc_count;
+  return true;
+#else
+  memset(count, 0, sizeof(struct test_malloc_count));
+  return false;
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef TEST_CMDSYS_ALLOC_H
+#define TEST_CMDSYS_ALLOC_H
+
+#include <snlsys/mem_allocator.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Allocator of the tests. It forwards the allocations to the default
+ * allocator while counting them and tracking the allocated bytes. */
+struct test_allocator {
+  struct mem_allocator allocator;
+  size_t nallocs; /* Calls to alloc, calloc, aligned_alloc and realloc. */
+  size_t nfrees;
+  size_t allocated_size;
+};
+
+/* Calls to the malloc family of the whole process, including the ones of
+ * argtable2 that bypass the allocators. */
+struct test_malloc_count {
+  size_t nallocs;
+  size_t nfrees;
+};
+
+extern void
+test_allocator_init
+  (struct test_allocator* allocator);
+
+/* Return false if the malloc calls are not hooked, e.g. when the process is
+ * instrumented by a sanitizer that owns them. */
+extern bool
+test_get_malloc_count
+  (struct test_malloc_count* count);
+
+#endif /* TEST_CMDSYS_ALLOC_H */
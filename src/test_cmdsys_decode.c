@@ -0,0 +1,154 @@
+#include "cmdsys_decode.h"
+#include <snlsys/math.h>
+#include <snlsys/snlsys.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t
+float_bits(const float f)
+{
+  uint32_t bits = 0;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+/* Check that the decoded float is the one returned by strtof. */
+static void
+check_float(const char* str)
+{
+  float f = 0.f;
+  float ref = 0.f;
+  CHECK(decode_float(str, -FLT_MAX, FLT_MAX, &f), true);
+  ref = MAX(MIN(strtof(str, NULL), FLT_MAX), -FLT_MAX);
+  if(float_bits(f) != float_bits(ref)) {
+    fprintf(stderr, "%s: %.9g\n", str, f);
+    CHECK(0, 1);
+  }
+}
+
+static void
+check_int(const char* str, const int ref)
+{
+  int i = 0;
+  CHECK(decode_int(str, INT_MIN, INT_MAX, &i), true);
+  CHECK(i, ref);
+}
+
+int
+main(int argc, char** argv)
+{
+  char buf[1024];
+  float f = 0.f;
+  int i = 0;
+  int j = 0;
+  (void)argc, (void)argv;
+
+  CHECK(decode_int(NULL, 0, 1, &i), false);
+  CHECK(decode_int("0", 0, 1, NULL), false);
+  CHECK(decode_int("", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("-", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("0x", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("12a", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("1.5", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("0b102", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("2147483648", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("-2147483649", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("99999999999999999999999", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("4GB", INT_MIN, INT_MAX, &i), false);
+  CHECK(decode_int("12KBB", INT_MIN, INT_MAX, &i), false);
+  check_int("0", 0);
+  check_int("-0", 0);
+  check_int("+42", 42);
+  check_int("-42", -42);
+  check_int("007", 7);
+  check_int("2147483647", INT_MAX);
+  check_int("-2147483648", INT_MIN);
+  check_int("0x7fffFFFF", INT_MAX);
+  check_int("-0x80000000", INT_MIN);
+  check_int("0o777", 0777);
+  check_int("0B1011", 11);
+  check_int("3KB", 3 * 1024);
+  check_int("2mb", 2 * 1024 * 1024);
+  check_int("1GB", 1024 * 1024 * 1024);
+  CHECK(decode_int("-5", 0, 10, &i), true);
+  CHECK(i, 0);
+  CHECK(decode_int("0x20", 0, 10, &i), true);
+  CHECK(i, 10);
+  for(j = 0; j < 100000; ++j) {
+    const int ref = (int)((unsigned)rand() ^ ((unsigned)rand() << 16));
+    sprintf(buf, "%d", ref);
+    check_int(buf, ref);
+  }
+
+  CHECK(decode_float(NULL, 0.f, 1.f, &f), false);
+  CHECK(decode_float("0", 0.f, 1.f, NULL), false);
+  CHECK(decode_float("", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float(".", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("1e", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("1e+", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("1.2.3", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("1,5", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("infinite", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("abc", -FLT_MAX, FLT_MAX, &f), false);
+  CHECK(decode_float("nan", -FLT_MAX, FLT_MAX, &f), true);
+  CHECK(f, FLT_MAX); /* Clamped as the strtod results were. */
+  CHECK(decode_float("-Infinity", -FLT_MAX, FLT_MAX, &f), true);
+  CHECK(f, -FLT_MAX);
+  CHECK(decode_float("2.5", -1.f, 1.f, &f), true);
+  CHECK(f, 1.f);
+  CHECK(decode_float("-2.5", -1.f, 1.f, &f), true);
+  CHECK(f, -1.f);
+
+  check_float("0");
+  check_float("-0.0");
+  check_float(".5");
+  check_float("5.");
+  check_float("1e10");
+  check_float("16777217");
+  check_float("0.1");
+  check_float("3.14159265358979323846");
+  check_float("1.00000005960464477539");
+  check_float("1.000000059604644775390625");
+  check_float("1.000000059604644775390625000000000000000000000000001");
+  check_float("7.038531e-26");
+  check_float("1e-45");
+  check_float("7e-46");
+  check_float("7.006492321624085354618e-46");
+  check_float("7.006492321624085354619e-46");
+  check_float("1.17549435e-38");
+  check_float("1.1754942e-38");
+  check_float("3.4028235e38");
+  check_float("3.4028236e38");
+  check_float("3.40282356779733661637539395458142568448e38");
+  check_float("3.40282356779733661637539395458142568447e38");
+  check_float("1e39");
+  check_float("1e-50");
+  check_float("1e-100000");
+  check_float("1e100000");
+  check_float("0.000000000000000000000000000000000000000000000000000001e60");
+  check_float("123456789012345678901234567890e-10");
+
+  for(j = 0; j < 1000000; ++j) {
+    const uint32_t bits = ((uint32_t)rand() ^ ((uint32_t)rand() << 16));
+    float ref = 0.f;
+    if((bits & 0x7F800000u) == 0x7F800000u)
+      continue; /* Skip the infinities and the NaNs. */
+    memcpy(&ref, &bits, sizeof(ref));
+    sprintf(buf, "%.9g", ref);
+    check_float(buf);
+    sprintf(buf, "%.7e", ref);
+    check_float(buf);
+    sprintf(buf, "%.40g", ref);
+    check_float(buf);
+    /* Midpoint between two consecutive floats. */
+    sprintf(buf, "%.60e",
+      (double)ref + (double)(nextafterf(ref, FLT_MAX) - ref) * 0.5);
+    check_float(buf);
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+/* Plugin module of the test_cmdsys_schema.cmd commands. */
+#include "cmdsys_schema.h"
+#include <string.h>
+
+static void
+set(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)argc, (void)data;
+  if(argv[1]->type == CMDARG_INT) {
+    CMDSYS(printf(sys, "set %d", argv[1]->value_list[0].data.integer));
+  } else {
+    CMDSYS(printf(sys, "mode %s", argv[1]->value_list[0].data.string));
+  }
+}
+
+static void
+nop(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)argc, (void)argv;
+  CMDSYS(printf(sys, "%s", (const char*)data));
+}
+
+static void
+complete_file
+  (struct cmdsys* sys,
+   const char* arg,
+   size_t arg_len,
+   size_t* list_len,
+   const char** list[])
+{
+  static const char* files[] = { "plugin.txt" };
+  (void)sys, (void)arg, (void)arg_len;
+  *list_len = 1;
+  *list = files;
+}
+
+EXPORT_SYM enum cmdsys_error
+cmdsys_plugin_resolve
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data);
+
+enum cmdsys_error
+cmdsys_plugin_resolve
+  (const char* name,
+   size_t syntax_id,
+   struct cmdsys_binding* binding,
+   void* data)
+{
+  (void)syntax_id, (void)data;
+  if(strcmp(name, "__set") == 0) {
+    binding->func = set;
+  } else if(strcmp(name, "__io.load") == 0) {
+    binding->func = nop;
+    binding->data = "load";
+    binding->arg_completion = complete_file;
+  } else if(strcmp(name, "__nop") == 0) {
+    binding->func = nop;
+    binding->data = "nop";
+  } else {
+    return CMDSYS_INVALID_ARGUMENT;
+  }
+  return CMDSYS_NO_ERROR;
+}
@@ -0,0 +1,172 @@
+#include "cmdsys_ring.h"
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define OK CMDSYS_NO_ERROR
+#define BAD_ARG CMDSYS_INVALID_ARGUMENT
+#define FULL CMDSYS_MEMORY_ERROR
+#define NCOMMANDS 100000
+
+static int count__ = 0;
+static long sum__ = 0;
+
+static void
+add(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)data;
+  CHECK(argc, 2);
+  ++count__;
+  sum__ += argv[1]->value_list[0].data.integer;
+}
+
+static void
+submit(struct cmdsys_ring* ring, const char* cmd)
+{
+  enum cmdsys_error err = OK;
+  while((err = cmdsys_ring_submit(ring, cmd, strlen(cmd))) == FULL)
+    sched_yield();
+  CHECK(err, OK);
+}
+
+/* Submit the commands from a child process and execute them in the parent. */
+static void
+test_process(struct cmdsys* sys)
+{
+  struct cmdsys_ring* ring = NULL;
+  size_t n = 0;
+  long sum = 0;
+  pid_t pid = 0;
+  int status = 0;
+  int fd = -1;
+  int i = 0;
+
+  CHECK(cmdsys_create_ring(NULL, 4096, &ring), OK);
+  CHECK(cmdsys_ring_get_fd(ring, &fd), OK);
+
+  pid = fork();
+  CHECK(pid >= 0, true);
+  if(pid == 0) {
+    struct cmdsys_ring* producer = NULL;
+    char cmd[32];
+    CHECK(cmdsys_open_ring(NULL, fd, &producer), OK);
+    for(i = 0; i < NCOMMANDS; ++i) {
+      snprintf(cmd, sizeof(cmd), "__add %d", i % 1000);
+      submit(producer, cmd);
+    }
+    CHECK(cmdsys_ring_ref_put(producer), OK);
+    CHECK(cmdsys_ring_ref_put(ring), OK);
+    _exit(0);
+  }
+
+  count__ = 0;
+  sum__ = 0;
+  while(count__ < NCOMMANDS) {
+    CHECK(cmdsys_drain_ring(sys, ring, 64, &n), OK);
+    if(!n)
+      CHECK(cmdsys_ring_wait(ring, 1000), OK);
+  }
+  CHECK(waitpid(pid, &status, 0), pid);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, true);
+  for(i = 0; i < NCOMMANDS; ++i)
+    sum += i % 1000;
+  CHECK(sum__, sum);
+  CHECK(cmdsys_drain_ring(sys, ring, 64, &n), OK);
+  CHECK(n, 0);
+  CHECK(cmdsys_ring_ref_put(ring), OK);
+}
+
+int
+main(int argc, char** argv)
+{
+  struct cmdsys* sys = NULL;
+  struct cmdsys_ring* ring = NULL;
+  struct cmdsys_ring* producer = NULL;
+  char cmd[64];
+  size_t n = 0;
+  int fd = -1;
+  int i = 0;
+  (void)argc, (void)argv;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__add", add, NULL, NULL,
+     CMDARGV
+      (CMDARG_APPEND_INT(NULL, NULL, NULL, NULL, 1, 1, 0, 1000),
+       CMDARG_END),
+     NULL), OK);
+
+  CHECK(cmdsys_create_ring(NULL, 4096, NULL), BAD_ARG);
+  CHECK(cmdsys_create_ring(NULL, 0, &ring), BAD_ARG);
+  CHECK(cmdsys_create_ring(NULL, 32, &ring), BAD_ARG);
+  CHECK(cmdsys_create_ring(NULL, 100, &ring), BAD_ARG);
+  CHECK(cmdsys_create_ring(NULL, 256, &ring), OK);
+
+  CHECK(cmdsys_ring_get_fd(NULL, &fd), BAD_ARG);
+  CHECK(cmdsys_ring_get_fd(ring, NULL), BAD_ARG);
+  CHECK(cmdsys_ring_get_fd(ring, &fd), OK);
+  CHECK(fd >= 0, true);
+  CHECK(cmdsys_open_ring(NULL, -1, &producer), BAD_ARG);
+  CHECK(cmdsys_open_ring(NULL, fd, NULL), BAD_ARG);
+  CHECK(cmdsys_open_ring(NULL, STDIN_FILENO, &producer) != OK, true);
+  CHECK(cmdsys_open_ring(NULL, fd, &producer), OK);
+
+  CHECK(cmdsys_ring_submit(NULL, "__add 1", 7), BAD_ARG);
+  CHECK(cmdsys_ring_submit(producer, NULL, 7), BAD_ARG);
+  memset(cmd, 'a', sizeof(cmd));
+  CHECK(cmdsys_ring_submit(producer, cmd, 128), BAD_ARG);
+  CHECK(cmdsys_drain_ring(NULL, ring, 1, &n), BAD_ARG);
+  CHECK(cmdsys_drain_ring(sys, NULL, 1, &n), BAD_ARG);
+  CHECK(cmdsys_drain_ring(sys, ring, 16, &n), OK);
+  CHECK(n, 0);
+  CHECK(cmdsys_ring_wait(NULL, 0), BAD_ARG);
+  CHECK(cmdsys_ring_wait(ring, 0), OK);
+
+  /* 16 bytes per record: 16 records fill the ring. */
+  for(i = 0; i < 16; ++i)
+    CHECK(cmdsys_ring_submit(producer, "__add 1", 7), OK);
+  CHECK(cmdsys_ring_submit(producer, "__add 1", 7), FULL);
+  count__ = 0;
+  sum__ = 0;
+  CHECK(cmdsys_ring_wait(ring, -1), OK);
+  CHECK(cmdsys_drain_ring(sys, ring, 10, &n), OK);
+  CHECK(n, 10);
+  CHECK(cmdsys_drain_ring(sys, ring, 10, NULL), OK);
+  CHECK(count__, 16);
+  CHECK(sum__, 16);
+
+  /* Wrap around the end of the ring data. The failed commands are reported
+   * in the error buffer and do not stop the drain. */
+  CHECK(cmdsys_ring_submit(producer, "__add 2", 7), OK);
+  CHECK(cmdsys_ring_submit(producer, "__add abc", 9), OK);
+  CHECK(cmdsys_ring_submit(producer, "__add 3", 7), OK);
+  for(i = 0; i < 10; ++i) {
+    snprintf(cmd, sizeof(cmd), "__add %d ; __add %d", i, i);
+    CHECK(cmdsys_ring_submit(producer, cmd, strlen(cmd)), OK);
+    CHECK(cmdsys_drain_ring(sys, ring, 4, NULL), OK);
+  }
+  CHECK(cmdsys_ring_submit(producer, "", 0), OK);
+  CHECK(cmdsys_drain_ring(sys, ring, 4, &n), OK);
+  CHECK(n, 1);
+  CHECK(count__, 16 + 2 + 20);
+  CHECK(sum__, 16 + 5 + 2 * 45);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_ring_ref_get(NULL), BAD_ARG);
+  CHECK(cmdsys_ring_ref_get(ring), OK);
+  CHECK(cmdsys_ring_ref_put(NULL), BAD_ARG);
+  CHECK(cmdsys_ring_ref_put(ring), OK);
+  CHECK(cmdsys_ring_ref_put(ring), OK);
+  CHECK(cmdsys_ring_ref_put(producer), OK);
+
+  test_process(sys);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(MEM_ALLOCATED_SIZE(&mem_default_allocator), 0);
+  return 0;
+}
@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L /* nanosleep */
+
+#include "cmdsys_scheduler.h"
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define OK CMDSYS_NO_ERROR
+#define BAD_ARG CMDSYS_INVALID_ARGUMENT
+#define NWORKERS 2
+#define NCOMMANDS 1000
+
+static pthread_mutex_t mutex__ = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond__ = PTHREAD_COND_INITIALIZER;
+static bool is_gate_open__ = false;
+static int nblocked__ = 0;
+static int records__[NCOMMANDS];
+static int nrecords__ = 0;
+static int ndropped__ = 0;
+static int ndone__ = 0;
+
+/* Block until the gate is open. */
+static void
+block(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+  pthread_mutex_lock(&mutex__);
+  ++nblocked__;
+  pthread_cond_broadcast(&cond__);
+  while(!is_gate_open__)
+    pthread_cond_wait(&cond__, &mutex__);
+  --nblocked__;
+  pthread_mutex_unlock(&mutex__);
+}
+
+static void
+record(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)data;
+  CHECK(argc, 2);
+  pthread_mutex_lock(&mutex__);
+  records__[nrecords__++] = argv[1]->value_list[0].data.integer;
+  pthread_mutex_unlock(&mutex__);
+}
+
+static void
+done(struct cmdsys* sys, enum cmdsys_error err, void* data)
+{
+  (void)data;
+  pthread_mutex_lock(&mutex__);
+  if(!sys) {
+    CHECK(err, CMDSYS_COMMAND_ERROR);
+    ++ndropped__;
+  } else {
+    CHECK(err, OK);
+  }
+  ++ndone__;
+  pthread_mutex_unlock(&mutex__);
+}
+
+static void
+wait_blocked(const int count)
+{
+  pthread_mutex_lock(&mutex__);
+  while(nblocked__ != count)
+    pthread_cond_wait(&cond__, &mutex__);
+  pthread_mutex_unlock(&mutex__);
+}
+
+static void
+set_gate(const bool is_open)
+{
+  pthread_mutex_lock(&mutex__);
+  is_gate_open__ = is_open;
+  pthread_cond_broadcast(&cond__);
+  pthread_mutex_unlock(&mutex__);
+}
+
+static void
+reset_records(void)
+{
+  pthread_mutex_lock(&mutex__);
+  nrecords__ = ndropped__ = ndone__ = 0;
+  pthread_mutex_unlock(&mutex__);
+}
+
+int
+main(int argc, char** argv)
+{
+  struct cmdsys_scheduler_config config = CMDSYS_SCHEDULER_CONFIG_DEFAULT;
+  struct cmdsys* systems[NWORKERS];
+  struct cmdsys_scheduler* scheduler = NULL;
+  struct timespec delay;
+  char cmd[32];
+  long sum = 0;
+  int ndropped = 0;
+  int i = 0;
+  (void)argc, (void)argv;
+
+  for(i = 0; i < NWORKERS; ++i) {
+    CHECK(cmdsys_create(NULL, systems + i), OK);
+    CHECK(cmdsys_add_command
+      (systems[i], "__block", block, NULL, NULL, NULL, NULL), OK);
+    CHECK(cmdsys_add_command
+      (systems[i], "__record", record, NULL, NULL, CMDARGV
+        (CMDARG_APPEND_INT(NULL, NULL, NULL, NULL, 1, 1, 0, NCOMMANDS),
+         CMDARG_END), NULL), OK);
+  }
+
+  config.max_running[CMDSYS_PRIORITY_BATCH] = 1;
+  CHECK(cmdsys_create_scheduler(NULL, NULL, NWORKERS, NULL, &scheduler),
+    BAD_ARG);
+  CHECK(cmdsys_create_scheduler(NULL, systems, 0, NULL, &scheduler), BAD_ARG);
+  CHECK(cmdsys_create_scheduler(NULL, systems, NWORKERS, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_create_scheduler
+    (NULL, systems, NWORKERS, &config, &scheduler), OK);
+  CHECK(cmdsys_scheduler_ref_get(NULL), BAD_ARG);
+  CHECK(cmdsys_scheduler_ref_get(scheduler), OK);
+  CHECK(cmdsys_scheduler_ref_put(NULL), BAD_ARG);
+  CHECK(cmdsys_scheduler_ref_put(scheduler), OK);
+  CHECK(cmdsys_scheduler_submit
+    (NULL, "__block", CMDSYS_PRIORITY_BATCH, -1, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, NULL, CMDSYS_PRIORITY_BATCH, -1, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITIES_COUNT, -1, NULL, NULL), BAD_ARG);
+  CHECK(cmdsys_scheduler_wait(NULL), BAD_ARG);
+
+  /* The batch class is limited to one worker: an interactive command submitted
+   * after a batch one runs on the other worker before it. */
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_BATCH, -1, NULL, NULL), OK);
+  wait_blocked(1);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 1", CMDSYS_PRIORITY_BATCH, -1, done, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 2", CMDSYS_PRIORITY_INTERACTIVE, -1, done, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 3", CMDSYS_PRIORITY_NORMAL, -1, done, NULL), OK);
+  do {
+    pthread_mutex_lock(&mutex__);
+    i = nrecords__;
+    pthread_mutex_unlock(&mutex__);
+  } while(i < 2);
+  set_gate(true);
+  CHECK(cmdsys_scheduler_wait(scheduler), OK);
+  CHECK(nrecords__, 3);
+  CHECK(records__[0], 2);
+  CHECK(records__[1], 3);
+  CHECK(records__[2], 1);
+  CHECK(ndone__, 3);
+  CHECK(ndropped__, 0);
+
+  /* Expired commands are dropped. */
+  reset_records();
+  set_gate(false);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_NORMAL, -1, NULL, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_NORMAL, -1, NULL, NULL), OK);
+  wait_blocked(2);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 4", CMDSYS_PRIORITY_INTERACTIVE, 1, done, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 5", CMDSYS_PRIORITY_INTERACTIVE, -1, done, NULL), OK);
+  delay.tv_sec = 0;
+  delay.tv_nsec = 20000000;
+  nanosleep(&delay, NULL);
+  set_gate(true);
+  CHECK(cmdsys_scheduler_wait(scheduler), OK);
+  CHECK(nrecords__, 1);
+  CHECK(records__[0], 5);
+  CHECK(ndone__, 2);
+  CHECK(ndropped__, 1);
+
+  /* An expired command is dropped by an idle worker although its class has
+   * no free slot, even if it is queued behind a command without deadline. */
+  reset_records();
+  set_gate(false);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_BATCH, -1, NULL, NULL), OK);
+  wait_blocked(1);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 6", CMDSYS_PRIORITY_BATCH, -1, done, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 7", CMDSYS_PRIORITY_BATCH, 1, done, NULL), OK);
+  delay.tv_sec = 0;
+  delay.tv_nsec = 1000000;
+  for(i = 0; i < 5000; ++i) {
+    pthread_mutex_lock(&mutex__);
+    ndropped = ndropped__;
+    pthread_mutex_unlock(&mutex__);
+    if(ndropped)
+      break;
+    nanosleep(&delay, NULL);
+  }
+  CHECK(ndropped, 1);
+  CHECK(ndone__, 1);
+  set_gate(true);
+  CHECK(cmdsys_scheduler_wait(scheduler), OK);
+  CHECK(nrecords__, 1);
+  CHECK(records__[0], 6);
+  CHECK(ndone__, 2);
+
+  /* Many commands dispatched to the workers. */
+  reset_records();
+  for(i = 0; i < NCOMMANDS; ++i) {
+    snprintf(cmd, sizeof(cmd), "__record %d", i);
+    CHECK(cmdsys_scheduler_submit
+      (scheduler, cmd, (enum cmdsys_priority)(i % CMDSYS_PRIORITIES_COUNT),
+       -1, done, NULL), OK);
+  }
+  CHECK(cmdsys_scheduler_wait(scheduler), OK);
+  CHECK(nrecords__, NCOMMANDS);
+  CHECK(ndone__, NCOMMANDS);
+  for(i = 0; i < NCOMMANDS; ++i)
+    sum += records__[i];
+  CHECK(sum, (long)NCOMMANDS * (NCOMMANDS - 1) / 2);
+
+  /* A command pending on release is either executed or dropped. */
+  reset_records();
+  set_gate(false);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_NORMAL, -1, NULL, NULL), OK);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__block", CMDSYS_PRIORITY_NORMAL, -1, NULL, NULL), OK);
+  wait_blocked(2);
+  CHECK(cmdsys_scheduler_submit
+    (scheduler, "__record 8", CMDSYS_PRIORITY_BATCH, -1, done, NULL), OK);
+  set_gate(true);
+  CHECK(cmdsys_scheduler_ref_put(scheduler), OK);
+  CHECK(ndone__, 1);
+
+  for(i = 0; i < NWORKERS; ++i)
+    CHECK(cmdsys_ref_put(systems[i]), OK);
+  CHECK(MEM_ALLOCATED_SIZE(&mem_default_allocator), 0);
+  return 0;
+}
@@ -0,0 +1,316 @@
+#include "cmdsys_schema.h"
+#include "test_schema.h"
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BAD_ARG CMDSYS_INVALID_ARGUMENT
+#define OK CMDSYS_NO_ERROR
+
+static int set__ = -1;
+static const char* mode__ = NULL;
+static float scale__ = 0.f;
+static bool verbose__ = false;
+static int nop__ = 0;
+
+static void
+set(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)data;
+  CHECK(argc, 2);
+  if(argv[1]->type == CMDARG_INT) {
+    set__ = argv[1]->value_list[0].data.integer;
+  } else {
+    CHECK(argv[1]->type, CMDARG_STRING);
+    mode__ = strcmp(argv[1]->value_list[0].data.string, "fast") == 0
+      ? "fast" : "slow";
+  }
+}
+
+static void
+scale(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  size_t i = 0;
+  (void)sys;
+  CHECK(argc, 3);
+  CHECK(data, &scale__);
+  scale__ = 1.f;
+  for(i = 0; i < argv[1]->count && argv[1]->value_list[i].is_defined; ++i)
+    scale__ *= argv[1]->value_list[i].data.real;
+  verbose__ = argv[2]->value_list[0].is_defined;
+}
+
+static void
+nop(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)sys, (void)argc, (void)argv, (void)data;
+  ++nop__;
+}
+
+static enum cmdsys_error
+resolve(const char* name, size_t syntax_id, struct cmdsys_binding* binding,
+        void* data)
+{
+  (void)data;
+  if(strcmp(name, "__set") == 0) {
+    CHECK(syntax_id < 2, true);
+    binding->func = set;
+  } else if(strcmp(name, "__scale") == 0) {
+    binding->func = scale;
+    binding->data = &scale__;
+  } else if(strcmp(name, "__io.load") == 0 || strcmp(name, "__nop") == 0) {
+    binding->func = nop;
+  } else {
+    return BAD_ARG;
+  }
+  return OK;
+}
+
+static enum cmdsys_error
+resolve_nop(const char* name, size_t syntax_id, struct cmdsys_binding* binding,
+            void* data)
+{
+  (void)syntax_id, (void)data;
+  if(strcmp(name, "__io.load") == 0)
+    return BAD_ARG;
+  binding->func = nop;
+  return OK;
+}
+
+/* Register by hand the commands described by test_cmdsys_schema.cmd. */
+static void
+add_commands(struct cmdsys* sys)
+{
+  static const char* modes[] = { "fast", "slow", NULL };
+
+  CHECK(cmdsys_add_command
+    (sys, "__set", set, NULL, NULL,
+     CMDARGV
+      (CMDARG_APPEND_INT("n", "num", "<n>", "number to set", 1, 1, 0, 100),
+       CMDARG_END),
+     "Set the \"number\"."), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__set", set, NULL, NULL,
+     CMDARGV
+      (CMDARG_APPEND_STRING("m", "mode", NULL, "set mode", 1, 1, modes),
+       CMDARG_END),
+     NULL), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__scale", scale, &scale__, NULL,
+     CMDARGV
+      (CMDARG_APPEND_FLOAT
+        (NULL, NULL, "<factor>", "scale factors", 1, 3, -INFINITY, INFINITY),
+       CMDARG_APPEND_LITERAL("v", "verbose", "print the scaled values", 0, 1),
+       CMDARG_END),
+     "Scale the values.\nEach value is scaled in place."), OK);
+  CHECK(cmdsys_add_command
+    (sys, "__io.load", nop, NULL, NULL,
+     CMDARGV
+      (CMDARG_APPEND_FILE(NULL, NULL, "<file>", "input file", 1, 1),
+       CMDARG_END),
+     NULL), OK);
+  CHECK(cmdsys_add_command(sys, "__nop", nop, NULL, NULL, NULL, NULL), OK);
+}
+
+static char*
+read_file(const char* filename, size_t* size)
+{
+  FILE* file = NULL;
+  char* buf = NULL;
+  long len = 0;
+
+  file = fopen(filename, "rb");
+  NCHECK(file, NULL);
+  CHECK(fseek(file, 0, SEEK_END), 0);
+  len = ftell(file);
+  CHECK(len > 0, true);
+  rewind(file);
+  buf = malloc((size_t)len);
+  NCHECK(buf, NULL);
+  CHECK(fread(buf, (size_t)len, 1, file), 1);
+  fclose(file);
+  *size = (size_t)len;
+  return buf;
+}
+
+/* `path' is the test_cmdsys_plugin module. */
+static void
+test_plugin(const char* path)
+{
+  struct cmdsys* sys = NULL;
+  struct cmdsys_prepared* prepared = NULL;
+  const char** list = NULL;
+  const char* output = NULL;
+  size_t list_len = 0;
+  size_t len = 0;
+  bool b = false;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_plugin(NULL, path, &test_schema, NULL), BAD_ARG);
+  CHECK(cmdsys_add_plugin(sys, NULL, &test_schema, NULL), BAD_ARG);
+  CHECK(cmdsys_add_plugin(sys, path, NULL, NULL), BAD_ARG);
+
+  /* The module is not loaded on registration. */
+  CHECK(cmdsys_add_plugin
+    (sys, "test_cmdsys_none.so", &test_schema, NULL), OK);
+  CHECK(cmdsys_add_plugin
+    (sys, "test_cmdsys_none.so", &test_schema, NULL), BAD_ARG);
+  CHECK(cmdsys_has_command(sys, "__nop", &b), OK);
+  CHECK(b, true);
+  /* The commands are parsed against the manifest descriptors. */
+  CHECK(cmdsys_validate_command(sys, "__set -n 42", NULL), OK);
+  CHECK(cmdsys_prepare(sys, "__set -n 42", &prepared), OK);
+  CHECK(cmdsys_execute_prepared(prepared), CMDSYS_IO_ERROR);
+  CHECK(cmdsys_prepared_ref_put(prepared), OK);
+  CHECK(cmdsys_execute_command(sys, "__nop", NULL), CMDSYS_IO_ERROR);
+  CHECK(cmdsys_man_command(sys, "__nop", NULL, 0, NULL), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_plugin(sys, path, &test_schema, NULL), OK);
+  CHECK(cmdsys_prepare(sys, "__set -n 7", &prepared), OK);
+  CHECK(cmdsys_execute_prepared(prepared), OK);
+  CHECK(cmdsys_prepared_ref_put(prepared), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "set 7"), 0);
+  CHECK(cmdsys_reset_output(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__set -n 42", NULL), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "set 42"), 0);
+  CHECK(cmdsys_reset_output(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__set --mode fast", NULL), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "mode fast"), 0);
+  CHECK(cmdsys_reset_output(sys), OK);
+  CHECK(cmdsys_execute_command(sys, "__nop", NULL), OK);
+  CHECK(cmdsys_get_output(sys, &output, &len, NULL), OK);
+  CHECK(strcmp(output, "nop"), 0);
+  CHECK(cmdsys_reset_output(sys), OK);
+
+  /* The completion function is bound with the command one. */
+  CHECK(cmdsys_command_arg_completion
+    (sys, "__io.load", "pl", 2, 0, NULL, &list_len, &list), OK);
+  CHECK(list_len, 1);
+  CHECK(strcmp(list[0], "plugin.txt"), 0);
+
+  /* The module does not resolve __scale. */
+  CHECK(cmdsys_execute_command(sys, "__scale 2", NULL), BAD_ARG);
+  CHECK(cmdsys_del_command(sys, "__scale"), OK);
+  CHECK(cmdsys_ref_put(sys), OK);
+}
+
+int
+main(int argc, char** argv)
+{
+  static const char* names[] = {
+    "__set", "__scale", "__io.load", "__nop"
+  };
+  struct cmdsys* sys = NULL;
+  struct cmdsys* ref = NULL;
+  struct cmdsys_memory_usage usage;
+  char man0[1024];
+  char man1[1024];
+  char* img0 = NULL;
+  char* img1 = NULL;
+  size_t size0 = 0;
+  size_t size1 = 0;
+  uint32_t id = 0;
+  bool b = false;
+  size_t i = 0;
+
+  if(argc != 2) {
+    fprintf(stderr, "Usage: %s PLUGIN\n", argv[0]);
+    return 1;
+  }
+
+  CHECK(test_schema.ncommands, 4);
+  CHECK(test_schema.nsyntaxes, 5);
+
+  /* Perfect hash. */
+  CHECK(cmdsys_schema_find(NULL, "__set", &id), BAD_ARG);
+  CHECK(cmdsys_schema_find(&test_schema, NULL, &id), BAD_ARG);
+  CHECK(cmdsys_schema_find(&test_schema, "__set", NULL), BAD_ARG);
+  for(i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+    CHECK(cmdsys_schema_find(&test_schema, names[i], &id), OK);
+    CHECK(id < test_schema.ncommands, true);
+    CHECK(strcmp(test_schema.commands[id].name, names[i]), 0);
+  }
+  CHECK(cmdsys_schema_find(&test_schema, "__foo", &id), OK);
+  CHECK(id, CMDSYS_SCHEMA_NIL);
+  CHECK(cmdsys_schema_find(&test_schema, "", &id), OK);
+  CHECK(id, CMDSYS_SCHEMA_NIL);
+  CHECK(cmdsys_schema_find(&test_schema, "__set", &id), OK);
+  CHECK(test_schema.commands[id].nsyntaxes, 2);
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_create(NULL, &ref), OK);
+  add_commands(ref);
+
+  CHECK(cmdsys_adopt_schema(NULL, &test_schema, resolve, NULL), BAD_ARG);
+  CHECK(cmdsys_adopt_schema(sys, NULL, resolve, NULL), BAD_ARG);
+  CHECK(cmdsys_adopt_schema(sys, &test_schema, NULL, NULL), BAD_ARG);
+
+  /* A failed adoption registers no command. */
+  CHECK(cmdsys_adopt_schema(sys, &test_schema, resolve_nop, NULL), BAD_ARG);
+  for(i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+    CHECK(cmdsys_has_command(sys, names[i], &b), OK);
+    CHECK(b, false);
+  }
+
+  CHECK(cmdsys_adopt_schema(sys, &test_schema, resolve, NULL), OK);
+  CHECK(cmdsys_adopt_schema(sys, &test_schema, resolve, NULL), BAD_ARG);
+  CHECK(cmdsys_has_command(sys, "__set", &b), OK);
+  CHECK(b, true);
+
+  /* The descriptions are not copied. */
+  CHECK(cmdsys_get_memory_usage(sys, &usage), OK);
+  CHECK(usage.category[CMDSYS_MEMORY_DESCRIPTIONS].size, 0);
+
+  /* Adopted and hand registered commands are indistinguishable. */
+  for(i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+    CHECK(cmdsys_man_command(sys, names[i], NULL, sizeof(man0), man0), OK);
+    CHECK(cmdsys_man_command(ref, names[i], NULL, sizeof(man1), man1), OK);
+    CHECK(strcmp(man0, man1), 0);
+  }
+  /* The manuals of the schema syntaxes do not build their arg tables. */
+  CHECK(cmdsys_get_memory_usage(sys, &usage), OK);
+  CHECK(usage.category[CMDSYS_MEMORY_ARGTABLE].count, 0);
+  CHECK(cmdsys_save_image(sys, "test_cmdsys_schema0.img"), OK);
+  CHECK(cmdsys_save_image(ref, "test_cmdsys_schema1.img"), OK);
+  img0 = read_file("test_cmdsys_schema0.img", &size0);
+  img1 = read_file("test_cmdsys_schema1.img", &size1);
+  CHECK(size0, size1);
+  CHECK(memcmp(img0, img1, size0), 0);
+  free(img0);
+  free(img1);
+  CHECK(remove("test_cmdsys_schema0.img"), 0);
+  CHECK(remove("test_cmdsys_schema1.img"), 0);
+
+  CHECK(cmdsys_execute_command(sys, "__set -n 42", NULL), OK);
+  CHECK(set__, 42);
+  CHECK(cmdsys_execute_command(sys, "__set --mode slow", NULL), OK);
+  CHECK(strcmp(mode__, "slow"), 0);
+  CHECK(cmdsys_execute_command(sys, "__set --mode foo", NULL),
+    CMDSYS_COMMAND_ERROR);
+  CHECK(cmdsys_execute_command(sys, "__scale 2 0.5 4 -v", NULL), OK);
+  CHECK(scale__, 4.f);
+  CHECK(verbose__, true);
+  CHECK(cmdsys_execute_command(sys, "__io.load foo.txt", NULL), OK);
+  CHECK(cmdsys_execute_command(sys, "__nop", NULL), OK);
+  CHECK(nop__, 2);
+  CHECK(cmdsys_flush_error(sys), OK);
+
+  CHECK(cmdsys_del_command(sys, "__scale"), OK);
+  CHECK(cmdsys_has_command(sys, "__scale", &b), OK);
+  CHECK(b, false);
+
+  CHECK(cmdsys_ref_put(sys), OK);
+  CHECK(cmdsys_ref_put(ref), OK);
+
+  test_plugin(argv[1]);
+  CHECK(MEM_ALLOCATED_SIZE(&mem_default_allocator), 0);
+  return 0;
+}
@@ -0,0 +1,17 @@
+# Commands of test_cmdsys_schema.
+command __set
+description "Set the \"number\"."
+int n num <n> "number to set" 1 1 0 100
+
+command __set
+string m mode - "set mode" 1 1 "fast" "slow"
+
+command __scale
+description "Scale the values.\nEach value is scaled in place."
+float - - <factor> "scale factors" 1 3 -inf inf
+literal v verbose "print the scaled values" 0 1
+
+command __io.load
+file - - <file> "input file" 1 1
+
+command __nop
@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L /* fcntl */
+
+#include "cmdsys_server.h"
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define OK CMDSYS_NO_ERROR
+#define BAD_ARG CMDSYS_INVALID_ARGUMENT
+#define SOCKET_PATH "test_cmdsys_server.sock"
+#define NCLIENTS 8
+#define NREQUESTS 200 /* Per client. */
+
+static int count__ = 0;
+
+static void
+count(struct cmdsys* sys, size_t argc, const struct cmdarg** argv, void* data)
+{
+  (void)argc, (void)argv, (void)data;
+  CMDSYS(printf(sys, "count %d", ++count__));
+}
+
+struct client {
+  int fd;
+  char input[65536];
+  size_t input_len;
+  int nresponses;
+};
+
+static size_t
+push_request(char* buf, const char* cmd)
+{
+  const size_t len = strlen(cmd);
+  buf[0] = (char)(len >> 24);
+  buf[1] = (char)(len >> 16);
+  buf[2] = (char)(len >> 8);
+  buf[3] = (char)len;
+  memcpy(buf + 4, cmd, len);
+  return len + 4;
+}
+
+static uint32_t
+read_be32(const char* buf)
+{
+  const unsigned char* b = (const unsigned char*)buf;
+  return ((uint32_t)b[0]<<24)|((uint32_t)b[1]<<16)|((uint32_t)b[2]<<8)|b[3];
+}
+
+static int
+connect_client(void)
+{
+  struct sockaddr_un addr;
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK(fd >= 0, true);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, SOCKET_PATH);
+  CHECK(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+  return fd;
+}
+
+/* Leave at SOCKET_PATH the socket file of a server that is not running. */
+static void
+create_stale_socket(void)
+{
+  struct sockaddr_un addr;
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK(fd >= 0, true);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, SOCKET_PATH);
+  CHECK(bind(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+  CHECK(close(fd), 0);
+}
+
+/* Read the available responses and check them against the requests. */
+static void
+read_responses(struct client* client)
+{
+  ssize_t n = 0;
+  size_t id = 0;
+
+  n = recv(client->fd, client->input + client->input_len,
+    sizeof(client->input) - client->input_len, 0);
+  if(n < 0) {
+    CHECK(errno == EAGAIN || errno == EWOULDBLOCK, true);
+    return;
+  }
+  client->input_len += (size_t)n;
+  while(client->input_len - id >= 4) {
+    const uint32_t len = read_be32(client->input + id);
+    const char* response = client->input + id + 4;
+    if(client->input_len - id < 4 + len)
+      break;
+    CHECK(len >= 8, true);
+    if(client->nresponses % 2) {
+      const char* err = "__unknown: command not found\n";
+      CHECK(read_be32(response), CMDSYS_COMMAND_ERROR);
+      CHECK(read_be32(response + 4), strlen(err));
+      CHECK(len - 8, strlen(err)); /* No output. */
+      CHECK(strncmp(response + 8, err, strlen(err)), 0);
+    } else {
+      CHECK(read_be32(response), CMDSYS_NO_ERROR);
+      CHECK(read_be32(response + 4), 0);
+      /* The output of the command only. */
+      CHECK(len - 8 > 6, true);
+      CHECK(strncmp(response + 8, "count ", 6), 0);
+      CHECK(memchr(response + 8 + 6, ' ', len - 8 - 6), NULL);
+    }
+    ++client->nresponses;
+    id += 4 + len;
+  }
+  memmove(client->input, client->input + id, client->input_len - id);
+  client->input_len -= id;
+}
+
+int
+main(int argc, char** argv)
+{
+  static struct client clients[NCLIENTS];
+  char buf[NREQUESTS * 32];
+  struct cmdsys* sys = NULL;
+  struct cmdsys_server* server = NULL;
+  struct cmdsys_server* server2 = NULL;
+  const char* error = NULL;
+  ssize_t n = 0;
+  size_t len = 0;
+  int fd = 0;
+  int i = 0;
+  int j = 0;
+  int ndone = 0;
+  (void)argc, (void)argv;
+
+  CHECK(cmdsys_create(NULL, &sys), OK);
+  CHECK(cmdsys_add_command(sys, "__count", count, NULL, NULL, NULL, NULL), OK);
+
+  CHECK(cmdsys_create_server(NULL, NULL, SOCKET_PATH, &server), BAD_ARG);
+  CHECK(cmdsys_create_server(NULL, sys, NULL, &server), BAD_ARG);
+  CHECK(cmdsys_create_server(NULL, sys, SOCKET_PATH, NULL), BAD_ARG);
+  CHECK(cmdsys_create_server(NULL, sys, SOCKET_PATH, &server), OK);
+  /* The path of a running server is not taken over. */
+  CHECK(cmdsys_create_server(NULL, sys, SOCKET_PATH, &server2), BAD_ARG);
+  CHECK(server2, NULL);
+  CHECK(access(SOCKET_PATH, F_OK), 0);
+  CHECK(cmdsys_server_get_fd(NULL, &fd), BAD_ARG);
+  CHECK(cmdsys_server_get_fd(server, NULL), BAD_ARG);
+  CHECK(cmdsys_server_get_fd(server, &fd), OK);
+  CHECK(fd >= 0, true);
+  CHECK(fcntl(fd, F_GETFD) & FD_CLOEXEC, FD_CLOEXEC);
+  CHECK(cmdsys_server_poll(NULL, 0), BAD_ARG);
+  CHECK(cmdsys_server_poll(server, 0), OK);
+
+  /* An error of the host that must survive the requests. */
+  CHECK(cmdsys_execute_command(sys, "__host", NULL), CMDSYS_COMMAND_ERROR);
+
+  /* Pipeline all the requests of each client. */
+  for(j = 0, len = 0; j < NREQUESTS; ++j)
+    len += push_request(buf + len, j % 2 ? "__unknown" : "__count");
+  for(i = 0; i < NCLIENTS; ++i) {
+    clients[i].fd = connect_client();
+    CHECK(send(clients[i].fd, buf, len, 0), (ssize_t)len);
+    CHECK(fcntl(clients[i].fd, F_SETFL, O_NONBLOCK), 0);
+  }
+  count__ = 0;
+  for(j = 0; ndone < NCLIENTS && j < 10000; ++j) {
+    CHECK(cmdsys_server_poll(server, 10), OK);
+    for(i = 0, ndone = 0; i < NCLIENTS; ++i) {
+      read_responses(clients + i);
+      ndone += clients[i].nresponses == NREQUESTS;
+    }
+  }
+  CHECK(ndone, NCLIENTS);
+  CHECK(count__, NCLIENTS * NREQUESTS / 2);
+  CHECK(cmdsys_get_error_count(sys, &len), OK);
+  CHECK(len, 1);
+  CHECK(cmdsys_get_error_string(sys, &error), OK);
+  CHECK(strcmp(error, "__host: command not found\n"), 0);
+
+  /* A request split in several packets. */
+  clients[0].nresponses = 0;
+  len = push_request(buf, "__count");
+  CHECK(send(clients[0].fd, buf, 3, 0), 3);
+  CHECK(cmdsys_server_poll(server, 10), OK);
+  CHECK(send(clients[0].fd, buf + 3, len - 3, 0), (ssize_t)(len - 3));
+  for(j = 0; clients[0].nresponses != 1 && j < 100; ++j) {
+    CHECK(cmdsys_server_poll(server, 10), OK);
+    read_responses(clients + 0);
+  }
+  CHECK(clients[0].nresponses, 1);
+
+  /* An oversized request is answered by an error and closes the
+   * connection. */
+  memset(buf, 0x7F, 4);
+  CHECK(send(clients[1].fd, buf, 4, 0), 4);
+  CHECK(cmdsys_server_poll(server, 10), OK);
+  CHECK(fcntl(clients[1].fd, F_SETFL, 0), 0);
+  n = recv(clients[1].fd, buf, sizeof(buf), 0);
+  CHECK(n >= 12, true);
+  CHECK(read_be32(buf), (uint32_t)n - 4);
+  CHECK(read_be32(buf + 4), CMDSYS_INVALID_ARGUMENT);
+  CHECK(read_be32(buf + 8), (uint32_t)n - 12);
+  CHECK(recv(clients[1].fd, buf, sizeof(buf), 0), 0);
+
+  for(i = 0; i < NCLIENTS; ++i)
+    CHECK(close(clients[i].fd), 0);
+  CHECK(cmdsys_server_poll(server, 10), OK);
+
+  CHECK(cmdsys_server_ref_get(NULL), BAD_ARG);
+  CHECK(cmdsys_server_ref_get(server), OK);
+  CHECK(cmdsys_server_ref_put(NULL), BAD_ARG);
+  CHECK(cmdsys_server_ref_put(server), OK);
+  CHECK(cmdsys_server_ref_put(server), OK);
+  CHECK(access(SOCKET_PATH, F_OK), -1);
+
+  /* The socket file of a stopped server is removed by the caller. */
+  create_stale_socket();
+  CHECK(cmdsys_create_server(NULL, sys, SOCKET_PATH, &server), CMDSYS_IO_ERROR);
+  CHECK(access(SOCKET_PATH, F_OK), 0);
+  CHECK(unlink(SOCKET_PATH), 0);
+  CHECK(cmdsys_create_server(NULL, sys, SOCKET_PATH, &server), OK);
+  CHECK(cmdsys_server_ref_put(server), OK);
+
+  CHECK(cmdsys_get_error_count(sys, &len), OK);
+  CHECK(len, 1);
+  CHECK(cmdsys_ref_put(sys), OK);
+
+  CHECK(MEM_ALLOCATED_SIZE(&mem_default_allocator), 0);
+  return 0;
+}